@@ -74,6 +74,8 @@ typedef struct
 #define AT_ENTRY  9
 #define AT_EXECFN 31
 
+#define AT_SYSINFO_EHDR 33
+
 static inline uint64_t
 __AlignUp__(uint64_t __Value__, uint64_t __Align__)
 {
@@ -324,6 +326,8 @@ Elf64BuildAux(File* __File__, void* __Image__, void* __AuxvBuf__, long __AuxvCap
     Aux[n++] = Img->Entry;
     Aux[n++] = AT_EXECFN;
     Aux[n++] = 0;
+    Aux[n++] = AT_SYSINFO_EHDR;
+    Aux[n++] = Img->Vdso;
     Aux[n++] = AT_NULL;
     Aux[n++] = 0;
 
@@ -9,10 +9,11 @@
 
 typedef struct TtyCtx
 {
-    char     Name[16];
-    uint32_t Fg;
-    uint32_t Bg;
-    SpinLock Lock;
+    char      Name[16];
+    uint32_t  Fg;
+    uint32_t  Bg;
+    SpinLock  Lock;
+    WaitQueue PollWait; /*Woken once there is input to wait for*/
 } TtyCtx;
 
 static long
@@ -40,6 +41,18 @@ TtyRead(void* __DevCtx__, void* __Buf__, long __Len__)
     return 0;
 }
 
+/*No input source yet, reads return at once so the tty is always ready*/
+static uint32_t
+TtyPoll(void* __DevCtx__, WaitQueue** __Queue__)
+{
+    TtyCtx* CCtx = (TtyCtx*)__DevCtx__;
+    if (__Queue__)
+    {
+        *__Queue__ = CCtx ? &CCtx->PollWait : NULL;
+    }
+    return VfsPollIn | VfsPollOut;
+}
+
 static int
 TtyOpen(void* __DevCtx__)
 {
@@ -138,6 +151,7 @@ TtyRegister(long __Index__)
     }
     memset(Ctx, 0, sizeof(TtyCtx));
     TtyMakeName(Ctx->Name, sizeof(Ctx->Name), __Index__);
+    InitializeWaitQueue(&Ctx->PollWait, "Tty");
 
     CharDevOps Ops = {
         .Open  = TtyOpen,
@@ -145,6 +159,7 @@ TtyRegister(long __Index__)
         .Read  = TtyRead,
         .Write = TtyWrite,
         .Ioctl = TtyIoctl,
+        .Poll  = TtyPoll,
     };
 
     if (TtyExists(Ctx->Name))
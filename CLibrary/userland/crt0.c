@@ -1,4 +1,5 @@
 #include <reent.h>
+#include "sysmac.h"
 extern void __libc_init_array(void);
 extern int  main(void);
 
@@ -14,6 +15,9 @@ _fini(void)
 void
 _start(void)
 {
+    /* The kernel enters as if called, so argc sits where the return address would */
+    __InitAuxv__((uint64_t*)__builtin_frame_address(0) + 1);
+
     _REENT_INIT_PTR(_impure_ptr);
     __sinit(_impure_ptr);
     __libc_init_array();
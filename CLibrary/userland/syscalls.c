@@ -12,6 +12,63 @@
 extern char  _end;
 static char* __heap_cursor__;
 
+typedef int (*__VdsoClockGettimeFn__)(clockid_t, struct timespec*);
+typedef int (*__VdsoGettimeofdayFn__)(struct timeval*, void*);
+
+/* newlib has no poll.h or sys/epoll.h, these are the layouts the kernel reads */
+struct pollfd
+{
+    int   fd;
+    short events;
+    short revents;
+};
+
+struct epoll_event
+{
+    uint32_t events;
+    uint64_t data;
+} __attribute__((packed));
+
+/* Filled in by the kernel, the layout is Linux's <linux/io_uring.h> */
+struct io_uring_params;
+
+static __VdsoClockGettimeFn__  __vdso_clock_gettime__;
+static __VdsoGettimeofdayFn__ __vdso_gettimeofday__;
+
+void
+__InitAuxv__(uint64_t* __sp__)
+{
+    /* argc, argv[], NULL, envp[], NULL, then the auxv pairs */
+    uint64_t* p = __sp__ + 1 + __sp__[0] + 1;
+    while (*p)
+    {
+        p++;
+    }
+    p++;
+
+    for (; p[0] != AtNull; p += 2)
+    {
+        if (p[0] != AtSysinfoEhdr || !p[1])
+        {
+            continue;
+        }
+
+        const VdsoHeader* h = (const VdsoHeader*)p[1];
+        if (h->Magic != VdsoMagic)
+        {
+            continue;
+        }
+        if (h->ClockGettime)
+        {
+            __vdso_clock_gettime__ = (__VdsoClockGettimeFn__)(p[1] + h->ClockGettime);
+        }
+        if (h->Gettimeofday)
+        {
+            __vdso_gettimeofday__ = (__VdsoGettimeofdayFn__)(p[1] + h->Gettimeofday);
+        }
+    }
+}
+
 void*
 sbrk(ptrdiff_t __incr__)
 {
@@ -154,6 +211,19 @@ fstat(int __fd__, struct stat* __st__)
     return 0;
 }
 
+long
+getdents64(int __fd__, void* __dirp__, size_t __count__)
+{
+    int64_t r =
+        Syscall(SysGetdents64, (uint64_t)__fd__, (uint64_t)__dirp__, (uint64_t)__count__, 0, 0, 0);
+    if (r < 0)
+    {
+        errno = (int)(-r);
+        return -1;
+    }
+    return (long)r;
+}
+
 int
 isatty(int __fd__)
 {
@@ -249,6 +319,11 @@ rmdir(const char* __path__)
 int
 gettimeofday(struct timeval* __tv__, void* __tz__)
 {
+    if (__vdso_gettimeofday__ && __vdso_gettimeofday__(__tv__, __tz__) == 0)
+    {
+        return 0;
+    }
+
     int64_t r = Syscall(SysGettimeofday, (uint64_t)__tv__, (uint64_t)__tz__, 0, 0, 0, 0);
     if (r < 0)
     {
@@ -270,6 +345,20 @@ nanosleep(const struct timespec* __req__, struct timespec* __rem__)
     return 0;
 }
 
+int
+clock_nanosleep(clockid_t              __clk__,
+                int                    __flags__,
+                const struct timespec* __req__,
+                struct timespec*       __rem__)
+{
+    /* newlib's TIMER_ABSTIME is 4, the kernel takes the Linux value */
+    uint64_t Flags = (__flags__ & TIMER_ABSTIME) ? 1 : 0;
+    int64_t  r     = Syscall(
+        SysClockNanosleep, (uint64_t)__clk__, Flags, (uint64_t)__req__, (uint64_t)__rem__, 0, 0);
+    /* POSIX hands the error back instead of setting errno */
+    return r < 0 ? (int)(-r) : 0;
+}
+
 int
 access(const char* __path__, int __mode__)
 {
@@ -325,6 +414,79 @@ select(
     return (int)r;
 }
 
+int
+poll(struct pollfd* __fds__, unsigned long __nfds__, int __timeout__)
+{
+    int64_t r =
+        Syscall(SysPoll, (uint64_t)__fds__, (uint64_t)__nfds__, (uint64_t)__timeout__, 0, 0, 0);
+    if (r < 0)
+    {
+        errno = (int)(-r);
+        return -1;
+    }
+    return (int)r;
+}
+
+int
+epoll_create(int __size__)
+{
+    int64_t r = Syscall(SysEpollCreate, (uint64_t)__size__, 0, 0, 0, 0, 0);
+    if (r < 0)
+    {
+        errno = (int)(-r);
+        return -1;
+    }
+    return (int)r;
+}
+
+int
+epoll_create1(int __flags__)
+{
+    int64_t r = Syscall(SysEpollCreate1, (uint64_t)__flags__, 0, 0, 0, 0, 0);
+    if (r < 0)
+    {
+        errno = (int)(-r);
+        return -1;
+    }
+    return (int)r;
+}
+
+int
+epoll_ctl(int __epfd__, int __op__, int __fd__, struct epoll_event* __event__)
+{
+    int64_t r = Syscall(SysEpollCtl,
+                        (uint64_t)__epfd__,
+                        (uint64_t)__op__,
+                        (uint64_t)__fd__,
+                        (uint64_t)__event__,
+                        0,
+                        0);
+    if (r < 0)
+    {
+        errno = (int)(-r);
+        return -1;
+    }
+    return (int)r;
+}
+
+int
+epoll_wait(int __epfd__, struct epoll_event* __events__, int __maxevents__, int __timeout__)
+{
+    int64_t r = Syscall(SysEpollWait,
+                        (uint64_t)__epfd__,
+                        (uint64_t)__events__,
+                        (uint64_t)__maxevents__,
+                        (uint64_t)__timeout__,
+                        0,
+                        0);
+    if (r < 0)
+    {
+        errno = (int)(-r);
+        return -1;
+    }
+    return (int)r;
+}
+
 int
 ioctl(int __fd__, unsigned long __cmd__, void* __arg__)
 {
@@ -361,6 +523,24 @@ dup2(int __oldfd__, int __newfd__)
     return (int)r;
 }
 
+int
+fcntl(int __fd__, int __cmd__, ...)
+{
+    /* Every command this kernel knows takes at most one integer argument */
+    __builtin_va_list ap;
+    __builtin_va_start(ap, __cmd__);
+    long arg = __builtin_va_arg(ap, long);
+    __builtin_va_end(ap);
+
+    int64_t r = Syscall(SysFcntl, (uint64_t)__fd__, (uint64_t)__cmd__, (uint64_t)arg, 0, 0, 0);
+    if (r < 0)
+    {
+        errno = (int)(-r);
+        return -1;
+    }
+    return (int)r;
+}
+
 pid_t
 getppid(void)
 {
@@ -547,6 +727,13 @@ clock_gettime(clockid_t __clk_id__, struct timespec* __tp__)
         errno = EINVAL;
         return -1;
     }
+
+    /* Clocks the vDSO does not serve fall through to the kernel */
+    if (__vdso_clock_gettime__ && __vdso_clock_gettime__(__clk_id__, __tp__) == 0)
+    {
+        return 0;
+    }
+
     int64_t r = Syscall(SysClockGettime, (uint64_t)__clk_id__, (uint64_t)__tp__, 0, 0, 0, 0);
     if (r < 0)
     {
@@ -569,3 +756,160 @@ waitpid(pid_t __pid__, int* __status__, int __opt__)
     }
     return (pid_t)r;
 }
+
+long
+futex(uint32_t*              __uaddr__,
+      int                    __op__,
+      uint32_t               __val__,
+      const struct timespec* __timeout__,
+      uint32_t*              __uaddr2__,
+      uint32_t               __val3__)
+{
+    int64_t r = Syscall(SysFutex,
+                        (uint64_t)__uaddr__,
+                        (uint64_t)__op__,
+                        (uint64_t)__val__,
+                        (uint64_t)__timeout__,
+                        (uint64_t)__uaddr2__,
+                        (uint64_t)__val3__);
+    if (r < 0)
+    {
+        errno = (int)(-r);
+        return -1;
+    }
+    return (long)r;
+}
+
+long
+splice(int      __fd_in__,
+       long*    __off_in__,
+       int      __fd_out__,
+       long*    __off_out__,
+       size_t   __len__,
+       unsigned __flags__)
+{
+    int64_t r = Syscall(SysSplice,
+                        (uint64_t)__fd_in__,
+                        (uint64_t)__off_in__,
+                        (uint64_t)__fd_out__,
+                        (uint64_t)__off_out__,
+                        (uint64_t)__len__,
+                        (uint64_t)__flags__);
+    if (r < 0)
+    {
+        errno = (int)(-r);
+        return -1;
+    }
+    return (long)r;
+}
+
+long
+tee(int __fd_in__, int __fd_out__, size_t __len__, unsigned __flags__)
+{
+    int64_t r = Syscall(SysTee,
+                        (uint64_t)__fd_in__,
+                        (uint64_t)__fd_out__,
+                        (uint64_t)__len__,
+                        (uint64_t)__flags__,
+                        0,
+                        0);
+    if (r < 0)
+    {
+        errno = (int)(-r);
+        return -1;
+    }
+    return (long)r;
+}
+
+long
+vmsplice(int __fd__, const struct iovec* __iov__, unsigned long __nr_segs__, unsigned __flags__)
+{
+    int64_t r = Syscall(SysVmsplice,
+                        (uint64_t)__fd__,
+                        (uint64_t)__iov__,
+                        (uint64_t)__nr_segs__,
+                        (uint64_t)__flags__,
+                        0,
+                        0);
+    if (r < 0)
+    {
+        errno = (int)(-r);
+        return -1;
+    }
+    return (long)r;
+}
+
+long
+sendfile(int __out_fd__, int __in_fd__, off_t* __offset__, size_t __count__)
+{
+    int64_t r = Syscall(SysSendfile,
+                        (uint64_t)__out_fd__,
+                        (uint64_t)__in_fd__,
+                        (uint64_t)__offset__,
+                        (uint64_t)__count__,
+                        0,
+                        0);
+    if (r < 0)
+    {
+        errno = (int)(-r);
+        return -1;
+    }
+    return (long)r;
+}
+
+long
+copy_file_range(int      __fd_in__,
+                off_t*   __off_in__,
+                int      __fd_out__,
+                off_t*   __off_out__,
+                size_t   __len__,
+                unsigned __flags__)
+{
+    int64_t r = Syscall(SysCopyFileRange,
+                        (uint64_t)__fd_in__,
+                        (uint64_t)__off_in__,
+                        (uint64_t)__fd_out__,
+                        (uint64_t)__off_out__,
+                        (uint64_t)__len__,
+                        (uint64_t)__flags__);
+    if (r < 0)
+    {
+        errno = (int)(-r);
+        return -1;
+    }
+    return (long)r;
+}
+
+int
+io_uring_setup(unsigned __entries__, struct io_uring_params* __params__)
+{
+    int64_t r = Syscall(SysIoUringSetup, (uint64_t)__entries__, (uint64_t)__params__, 0, 0, 0, 0);
+    if (r < 0)
+    {
+        errno = (int)(-r);
+        return -1;
+    }
+    return (int)r;
+}
+
+int
+io_uring_enter(int      __fd__,
+               unsigned __to_submit__,
+               unsigned __min_complete__,
+               unsigned __flags__,
+               void*    __sig__)
+{
+    int64_t r = Syscall(SysIoUringEnter,
+                        (uint64_t)__fd__,
+                        (uint64_t)__to_submit__,
+                        (uint64_t)__min_complete__,
+                        (uint64_t)__flags__,
+                        (uint64_t)__sig__,
+                        0);
+    if (r < 0)
+    {
+        errno = (int)(-r);
+        return -1;
+    }
+    return (int)r;
+}
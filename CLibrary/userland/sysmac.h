@@ -210,30 +210,59 @@ enum SysNo
     SysClockSettime        = 227,
     SysClockGettime        = 228,
     SysClockGetres         = 229,
-    SysClockNanosleep      = 230
+    SysClockNanosleep      = 230,
+
+    /* Sparse from here, only what is implemented */
+    SysEpollWait           = 232,
+    SysEpollCtl            = 233,
+    SysSplice              = 275,
+    SysTee                 = 276,
+    SysVmsplice            = 278,
+    SysEpollCreate1        = 291,
+    SysCopyFileRange       = 326,
+    SysIoUringSetup        = 425,
+    SysIoUringEnter        = 426
 };
 
-/*SysMac*/
+/*vDSO, mirrors the kernel's Vdso.h*/
+#define AtNull        0
+#define AtSysinfoEhdr 33
+#define VdsoMagic     0x53445641
+
+typedef struct
+{
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t ClockGettime; /* Offsets from the image, 0 when absent */
+    uint32_t Gettimeofday;
+    uint32_t DataOffset;
+    uint32_t Reserved[3];
+} VdsoHeader;
+
+void __InitAuxv__(uint64_t* __sp__);
+
+/*SysMac, SYSCALL fast path, RCX and R11 come back holding the return RIP and RFLAGS*/
 #define Syscall(__SysNum__, __Arg1__, __Arg2__, __Arg3__, __Arg4__, __Arg5__, __Arg6__)            \
     ({                                                                                             \
-        int64_t result;                                                                            \
-        __asm__ volatile("movq %1, %%rax\n\t" /* syscall __SysNum__ber */                          \
-                         "movq %2, %%rdi\n\t" /* __Arg1__ */                                       \
-                         "movq %3, %%rsi\n\t" /* __Arg2__ */                                       \
-                         "movq %4, %%rdx\n\t" /* __Arg3__ */                                       \
-                         "movq %5, %%r10\n\t" /* __Arg4__ */                                       \
-                         "movq %6, %%r8\n\t"  /* __Arg5__ */                                       \
-                         "movq %7, %%r9\n\t"  /* __Arg6__ */                                       \
-                         "int $0x80\n\t"      /* syscall interrupt */                              \
-                         "movq %%rax, %0"                                                          \
-                         : "=r"(result)                                                            \
-                         : "r"((uint64_t)(__SysNum__)),                                            \
-                           "r"((uint64_t)(__Arg1__)),                                              \
-                           "r"((uint64_t)(__Arg2__)),                                              \
-                           "r"((uint64_t)(__Arg3__)),                                              \
-                           "r"((uint64_t)(__Arg4__)),                                              \
-                           "r"((uint64_t)(__Arg5__)),                                              \
-                           "r"((uint64_t)(__Arg6__))                                               \
-                         : "rax", "rdi", "rsi", "rdx", "r10", "r8", "r9", "memory");               \
+        uint64_t          __Sa1__ = (uint64_t)(__Arg1__);                                          \
+        uint64_t          __Sa2__ = (uint64_t)(__Arg2__);                                          \
+        uint64_t          __Sa3__ = (uint64_t)(__Arg3__);                                          \
+        uint64_t          __Sa4__ = (uint64_t)(__Arg4__);                                          \
+        uint64_t          __Sa5__ = (uint64_t)(__Arg5__);                                          \
+        uint64_t          __Sa6__ = (uint64_t)(__Arg6__);                                          \
+        register uint64_t __R10__ __asm__("r10") = __Sa4__;                                        \
+        register uint64_t __R8__ __asm__("r8")   = __Sa5__;                                        \
+        register uint64_t __R9__ __asm__("r9")   = __Sa6__;                                        \
+        int64_t           result;                                                                  \
+        __asm__ volatile("syscall"                                                                 \
+                         : "=a"(result)                                                            \
+                         : "a"((uint64_t)(__SysNum__)),                                            \
+                           "D"(__Sa1__),                                                           \
+                           "S"(__Sa2__),                                                           \
+                           "d"(__Sa3__),                                                           \
+                           "r"(__R10__),                                                           \
+                           "r"(__R8__),                                                            \
+                           "r"(__R9__)                                                             \
+                         : "rcx", "r11", "memory");                                                \
         result;                                                                                    \
-    })
\ No newline at end of file
+    })
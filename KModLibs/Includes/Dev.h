@@ -1,6 +1,8 @@
 #pragma once
 
 #include <EveryType.h>
+#include <SyncSys.h>
+#include <Vfs.h>
 
 typedef enum DevType
 {
@@ -16,6 +18,11 @@ typedef struct CharDevOps
     long (*Read)(void* __DevCtx__, void* __Buf__, long __Len__);
     long (*Write)(void* __DevCtx__, const void* __Buf__, long __Len__);
     int (*Ioctl)(void* __DevCtx__, unsigned long __Cmd__, void* __Arg__);
+    /* Optional, VfsPoll* bits and the queue woken on change, always ready when NULL */
+    uint32_t (*Poll)(void* __DevCtx__, WaitQueue** __Queue__);
+    /* Optional, a whole iovec list in one call, per-segment Read/Write when NULL */
+    long (*ReadIter)(void* __DevCtx__, const VfsIovec* __Iov__, long __Cnt__);
+    long (*WriteIter)(void* __DevCtx__, const VfsIovec* __Iov__, long __Cnt__);
 
 } CharDevOps;
 
@@ -27,6 +34,15 @@ typedef struct BlockDevOps
     long (*WriteBlocks)(void* __DevCtx__, uint64_t __Lba__, const void* __Buf__, long __Count__);
     int (*Ioctl)(void* __DevCtx__, unsigned long __Cmd__, void* __Arg__);
     long BlockSize; /* bytes per block, e.g., 512 or 4096 */
+    /* Optional, one request from Lba over segments of whole blocks, returns blocks done */
+    long (*ReadBlocksIter)(void*           __DevCtx__,
+                           uint64_t        __Lba__,
+                           const VfsIovec* __Iov__,
+                           long            __Cnt__);
+    long (*WriteBlocksIter)(void*           __DevCtx__,
+                            uint64_t        __Lba__,
+                            const VfsIovec* __Iov__,
+                            long            __Cnt__);
 
 } BlockDevOps;
 
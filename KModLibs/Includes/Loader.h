@@ -44,6 +44,7 @@ typedef struct VirtImage
     uint32_t            Flags;
     void*               LoaderPriv;
     VirtAuxv            Auxv;
+    uint64_t            Vdso; /* Mapped vDSO image for AT_SYSINFO_EHDR, 0 when none */
 } VirtImage;
 
 typedef struct VirtRequest
@@ -5,33 +5,64 @@
 #include <ThrdSys.h>
 #include <Vfs.h>
 
+typedef struct PosixFile
+{
+    long                   Refcnt;
+    long                   Flags; /*Access mode and status flags*/
+    void*                  Obj;   /*File, PosixPipeT, PosixEpoll or PosixUring*/
+    int                    IsFile;
+    int                    IsChar;
+    int                    IsBlock;
+    int                    IsEpoll;
+    int                    IsUring;
+    Mutex                  PosLock; /*Serializes offset use on regular files*/
+    struct PosixEpollItem* EpItems; /*Epoll watches on this description*/
+} PosixFile;
+
 typedef struct PosixFd
 {
-    long  Fd;
-    long  Flags;
-    void* Obj;
-    long  Refcnt;
-    int   IsFile;
-    int   IsChar;
-    int   IsBlock;
+    long       Fd;
+    long       FdFlags; /*Per-descriptor, not shared by dups*/
+    PosixFile* Desc;
 } PosixFd;
 
+/*
+ * The fds themselves, an array and a bitmap of the slots in use, with a
+ * second level marking full bitmap words so the lowest free fd is a couple
+ * of bit scans. A forked child starts on its parent's set and whichever
+ * side changes it first takes a private copy, so fork costs a reference
+ * instead of a pass over every fd.
+ */
+typedef struct PosixFdSet
+{
+    long      Refs;    /*Tables on it, never written while above one*/
+    long      Cap;     /*Slots, a multiple of 64*/
+    long      Count;
+    long      NextFd;  /*No free slot below this*/
+    long      Rings;   /*io_uring fds, a set holding one is copied at fork*/
+    PosixFd*  Entries;
+    uint64_t* OpenMap; /*Bit per slot in use*/
+    uint64_t* FullMap; /*Bit per OpenMap word with every slot in use*/
+} PosixFdSet;
+
+/* One per process, every thread of it goes through the same table */
 typedef struct PosixFdTable
 {
-    PosixFd* Entries;
-    long     Count;
-    long     Cap;
-    long     StdinFd;
-    long     StdoutFd;
-    long     StderrFd;
-    SpinLock Lock;
+    PosixFdSet* Set;
+    long        StdinFd;
+    long        StdoutFd;
+    long        StderrFd;
+    SpinLock    Lock; /*Guards Set, and the set's contents while it is private*/
 } PosixFdTable;
 
 int  PosixFdInit(PosixFdTable* __Tab__, long __Cap__);
+long PosixFdCap(PosixFdTable* __Tab__);
 int  PosixOpen(PosixFdTable* __Tab__, const char* __Path__, long __Flags__, long __Mode__);
 int  PosixClose(PosixFdTable* __Tab__, int __Fd__);
 long PosixRead(PosixFdTable* __Tab__, int __Fd__, void* __Buf__, long __Len__);
 long PosixWrite(PosixFdTable* __Tab__, int __Fd__, const void* __Buf__, long __Len__);
+long PosixReadv(PosixFdTable* __Tab__, int __Fd__, const VfsIovec* __Iov__, long __Cnt__);
+long PosixWritev(PosixFdTable* __Tab__, int __Fd__, const VfsIovec* __Iov__, long __Cnt__);
 long PosixLseek(PosixFdTable* __Tab__, int __Fd__, long __Off__, int __Wh__);
 int  PosixDup(PosixFdTable* __Tab__, int __Fd__);
 int  PosixDup2(PosixFdTable* __Tab__, int __OldFd__, int __NewFd__);
@@ -41,11 +72,23 @@ int  PosixIoctl(PosixFdTable* __Tab__, int __Fd__, unsigned long __Cmd__, void*
 int  PosixAccess(PosixFdTable* __Tab__, const char* __Path__, long __Mode__);
 int  PosixStatPath(const char* __Path__, VfsStat* __Out__);
 int  PosixFstat(PosixFdTable* __Tab__, int __Fd__, VfsStat* __Out__);
+long PosixGetdents(PosixFdTable* __Tab__, int __Fd__, void* __Buf__, long __Len__);
 int  PosixMkdir(const char* __Path__, long __Mode__);
 int  PosixRmdir(const char* __Path__);
 int  PosixUnlink(const char* __Path__);
 int  PosixRename(const char* __Old__, const char* __New__);
 
+PosixFile* PosixFdGet(PosixFdTable* __Tab__, int __Fd__);
+void       PosixFilePut(PosixFile* __File__);
+long PosixFileRead(
+    PosixFile* __Desc__, void* __Buf__, long __Len__, long __Off__, int __Nonblock__);
+long PosixFileWrite(
+    PosixFile* __Desc__, const void* __Buf__, long __Len__, long __Off__, int __Nonblock__);
+long PosixFileReadv(
+    PosixFile* __Desc__, const VfsIovec* __Iov__, long __Cnt__, long __Off__, int __Nonblock__);
+long PosixFileWritev(
+    PosixFile* __Desc__, const VfsIovec* __Iov__, long __Cnt__, long __Off__, int __Nonblock__);
+
 typedef struct PosixTimes
 {
     uint64_t UserUsec;
@@ -101,7 +144,7 @@ typedef struct PosixProcTable
     PosixProc** Items;
     long        Count;
     long        Cap;
-    SpinLock    Lock;
+    RwSpinLock  Lock; /*enumeration shares, insert/remove and pid allocation exclusive*/
 } PosixProcTable;
 
 extern PosixProcTable PosixProcs;
@@ -129,6 +172,7 @@ int        PosixFchdir(PosixProc* __Proc__, int __Fd__);
 int        PosixSetUmask(PosixProc* __Proc__, long __Mask__);
 int        PosixGetTty(PosixProc* __Proc__, char* __Out__, long __Len__);
 PosixProc* PosixFind(long __Pid__);
+PosixProc* PosixCurrent(void);
 
 typedef void (*PosixSigHandler)(int);
 
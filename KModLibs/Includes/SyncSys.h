@@ -2,12 +2,24 @@
 
 #include <EveryType.h>
 
+/*
+ * Ticket lock, Lock overlays the two 16-bit tickets (Owner | Next << 16).
+ * Interrupts stay off while any spinlock is held on a CPU, the RFLAGS of the
+ * outermost acquire are kept per CPU and restored when the last one drops.
+ */
 typedef struct
 {
-    volatile uint32_t Lock;
-    uint32_t          CpuId;
-    const char*       Name;
-    uint64_t          Flags;
+    union
+    {
+        volatile uint32_t Lock;
+        struct
+        {
+            volatile uint16_t Owner; /* ticket being served */
+            volatile uint16_t Next;  /* next ticket handed out */
+        } Ticket;
+    };
+    uint32_t    CpuId;
+    const char* Name;
 
 } SpinLock;
 
@@ -16,12 +28,75 @@ void AcquireSpinLock(SpinLock* __Lock__);
 void ReleaseSpinLock(SpinLock* __Lock__);
 bool TryAcquireSpinLock(SpinLock* __Lock__);
 
+/*
+ * Reader-writer spinlock for read-mostly tables, writers are preferred.
+ * Held locks count in the same per-CPU depth as spinlocks, so any release
+ * order is fine. The acquire token is only kept for older callers.
+ */
+#define RwLockWriter        0x80000000U
+#define RwLockWriterWaiting 0x40000000U
+#define RwLockReaderMask    0x3FFFFFFFU
+
+typedef struct
+{
+    volatile uint32_t State;
+    const char*       Name;
+} RwSpinLock;
+
+void     InitializeRwSpinLock(RwSpinLock* __Lock__, const char* __Name__);
+uint64_t AcquireReadSpinLock(RwSpinLock* __Lock__);
+void     ReleaseReadSpinLock(RwSpinLock* __Lock__, uint64_t __Flags__);
+uint64_t AcquireWriteSpinLock(RwSpinLock* __Lock__);
+void     ReleaseWriteSpinLock(RwSpinLock* __Lock__, uint64_t __Flags__);
+
+struct Thread;
+
+struct WaitHook;
+typedef void (*WaitHookFn)(struct WaitHook* __Hook__);
+
+typedef struct WaitHook
+{
+    struct WaitHook* Next;
+    struct WaitHook* Prev;
+    WaitHookFn       Fn;
+    void*            Arg;
+    void*            Queue;
+} WaitHook;
+
 typedef struct
+{
+    SpinLock       Lock;
+    struct Thread* Head;
+    struct Thread* Tail;
+    const char*    Name;
+    WaitHook*      Hooks;
+} WaitQueue;
+
+void     InitializeWaitQueue(WaitQueue* __Queue__, const char* __Name__);
+void     WaitQueuePrepare(WaitQueue* __Queue__, uint32_t __Reason__, uint64_t __TimeoutMs__);
+int      WaitQueueCommit(WaitQueue* __Queue__);
+void     WaitQueueCancel(WaitQueue* __Queue__);
+int      WaitQueueSleep(WaitQueue* __Queue__, uint32_t __Reason__, uint64_t __TimeoutMs__);
+uint32_t WaitQueueWakeOne(WaitQueue* __Queue__);
+uint32_t WaitQueueWakeAll(WaitQueue* __Queue__);
+bool     WaitQueueEmpty(WaitQueue* __Queue__);
+void     WaitHookInit(WaitHook* __Hook__, WaitHookFn __Fn__, void* __Arg__);
+void     WaitQueueAddHook(WaitQueue* __Queue__, WaitHook* __Hook__);
+void     WaitQueueRemoveHook(WaitHook* __Hook__);
+
+/*
+ * Adaptive sleeping lock owned by a thread, contenders spin while the owner
+ * runs on another CPU and park on Waiters otherwise.
+ */
+typedef struct Mutex
 {
     volatile uint32_t Lock;
-    uint32_t          Owner;
+    struct Thread*    Owner; /* Cleared on release under Waiters.Lock */
     uint32_t          RecursionCount;
     const char*       Name;
+    WaitQueue         Waiters;
+    uint32_t          Boost;     /* Priority waiters lent the owner, 0 when none */
+    struct Mutex*     BoostNext; /* Links of the boosted mutexes, a global list */
 } Mutex;
 
 void InitializeMutex(Mutex* __Mutex__, const char* __Name__);
@@ -31,10 +106,9 @@ bool TryAcquireMutex(Mutex* __Mutex__);
 
 typedef struct
 {
-    volatile int32_t  Count;
-    volatile uint32_t WaitQueue;
-    SpinLock          QueueLock;
-    const char*       Name;
+    volatile int32_t Count;
+    WaitQueue        Waiters;
+    const char*      Name;
 } Semaphore;
 
 void InitializeSemaphore(Semaphore* __Semaphore__, int32_t __InitialCount__, const char* __Name__);
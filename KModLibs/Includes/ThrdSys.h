@@ -81,8 +81,8 @@ typedef struct Thread
     uint32_t CpuAffinity;
     uint32_t LastCpu;
     uint64_t TimeSlice;
-    uint64_t CpuTime;
-    uint64_t StartTime;
+    uint64_t CpuTime;   /*Nanoseconds run, closed slices*/
+    uint64_t StartTime; /*Monotonic ns of the last switch in*/
     uint64_t WakeupTime;
 
     /*Sync*/
@@ -97,10 +97,6 @@ typedef struct Thread
     struct Thread* Parent;
     struct Thread* Children;
 
-    /*File descr*/
-    void*    FileTable[64];
-    uint32_t FileCount;
-
     /*Signals*/
     uint64_t SignalMask;
     void*    SignalHandlers[32];
@@ -115,6 +111,34 @@ typedef struct Thread
     uint32_t Flags;
     void*    DebugInfo;
 
+    /*Wait queue links*/
+    struct Thread* WaitNext;
+    struct Thread* WaitPrev;
+
+    /*Owning PosixProc, NULL for kernel threads*/
+    void* Process;
+
+    /*Lazy FPU, XSAVE area (NULL until first use or with FXSAVE) and last CPU it was loaded on*/
+    void*    FpuArea;
+    void*    FpuAreaBase;
+    uint32_t FpuCpu;
+
+    /*Guarded kernel stack from the stack cache (StackSlot)*/
+    void* KernelStackSlot;
+
+    /*Chain in the thread id hash*/
+    struct Thread* HashNext;
+
+    /*Futex wait, physical address of the word and the wake bitset*/
+    uint64_t FutexKey;
+    uint32_t FutexBitset;
+
+    /*Sleeping queue deadline, monotonic ns*/
+    uint64_t SleepUntil;
+
+    /*One for the thread itself plus one per FindThreadById caller, freed at zero*/
+    uint32_t Refs;
+
 } Thread;
 
 #define ThreadFlagSystem    (1 << 0)
@@ -123,6 +147,9 @@ typedef struct Thread
 #define ThreadFlagTraced    (1 << 3)
 #define ThreadFlagSuspended (1 << 4)
 #define ThreadFlagCritical  (1 << 5)
+#define ThreadFlagParked    (1 << 6) /*Linked on its CPU's WaitingQueue*/
+#define ThreadFlagFpuUsed   (1 << 7) /*Has FPU/SIMD state worth saving*/
+#define ThreadFlagAsleep    (1 << 8) /*Linked on its CPU's SleepingQueue*/
 
 #define WaitReasonNone      0
 #define WaitReasonMutex     1
@@ -131,16 +158,23 @@ typedef struct Thread
 #define WaitReasonSleep     4
 #define WaitReasonSignal    5
 #define WaitReasonChild     6
+#define WaitReasonFutex     7
 
 #define UserVirtualBase 0x0000000000400000ULL
-#define KStackSize      8192
+#define KStackSize      16384 /*Default, CreateThreadEx takes up to KStackMaxSize*/
 
 void     InitializeThreadManager(void);
 Thread*  GetCurrentThread(uint32_t __CpuId__);
+Thread*  GetCurrentThreadLocal(void);
 Thread*  CreateThread(ThreadType     __Type__,
                       void*          __EntryPoint__,
                       void*          __Argument__,
                       ThreadPriority __Priority__);
+Thread*  CreateThreadEx(ThreadType     __Type__,
+                        void*          __EntryPoint__,
+                        void*          __Argument__,
+                        ThreadPriority __Priority__,
+                        uint32_t       __StackSize__);
 void     DestroyThread(Thread* __ThreadPtr__);
 void     SuspendThread(Thread* __ThreadPtr__);
 void     ResumeThread(Thread* __ThreadPtr__);
@@ -148,10 +182,23 @@ void     SetThreadPriority(Thread* __ThreadPtr__, ThreadPriority __Priority__);
 void     SetThreadAffinity(Thread* __ThreadPtr__, uint32_t __CpuMask__);
 void     ThreadYield(void);
 void     ThreadSleep(uint64_t __Milliseconds__);
+void     ThreadSleepPrepare(uint64_t __DeadlineNs__);
+int      ThreadSleepCommit(void);
+void     ThreadSleepCancel(void);
 void     ThreadExit(uint32_t __ExitCode__);
 Thread*  FindThreadById(uint32_t __ThreadId__);
+void     ThreadPut(Thread* __ThreadPtr__);
 uint32_t GetThreadCount(void);
 void     ThreadExecute(Thread* __ThreadPtr__);
 void     ThreadExecuteMultiple(Thread** __ThreadArray__, uint32_t __ThreadCount__);
+/*Clock*/
+uint64_t ClockMonotonicNs(void);
+uint64_t ClockRealtimeNs(void);
+int      ClockGetNs(long __ClockId__, uint64_t* __OutNs__);
+void     ClockBusyWaitNs(uint64_t __Ns__);
+uint64_t HpetReadCounter(void);
+int      HpetOneShotSetHandler(void (*__Handler__)(void));
+int      HpetArmOneShot(uint64_t __DeltaNs__);
+void     HpetCancelOneShot(void);
 /*SMP*/
 uint32_t GetCurrentCpuId(void);
\ No newline at end of file
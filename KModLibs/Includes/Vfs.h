@@ -1,6 +1,7 @@
 #pragma once
 
 #include <EveryType.h>
+#include <SyncSys.h>
 
 typedef struct Vnode         Vnode;
 typedef struct Dentry        Dentry;
@@ -16,6 +17,8 @@ typedef struct VfsPerm       VfsPerm;
 typedef struct VfsTimespec   VfsTimespec;
 typedef struct VfsMountFlags VfsMountFlags;
 typedef struct VfsNameBuf    VfsNameBuf;
+typedef struct VfsIovec      VfsIovec;
+typedef struct VfsDirCtx     VfsDirCtx;
 
 /*Node Type*/
 typedef enum VnodeType
@@ -55,6 +58,14 @@ typedef enum VfsSeekWhence
 
 } VfsSeekWhence;
 
+/*Readiness bits, poll(2) numbering*/
+#define VfsPollIn   0x001
+#define VfsPollPri  0x002
+#define VfsPollOut  0x004
+#define VfsPollErr  0x008
+#define VfsPollHup  0x010
+#define VfsPollNval 0x020
+
 /*Permissions*/
 typedef enum VfsPermMode
 {
@@ -171,6 +182,28 @@ typedef struct VfsDirEnt
 
 } VfsDirEnt; /*Dirent*/
 
+/*
+ * Readdir sink. The filesystem offers entries from Pos on, one Emit each, and
+ * bumps Pos past every entry taken; Emit returns 0 once the caller is full and
+ * that entry is offered again next time. Pos is File->Offset between calls.
+ */
+struct VfsDirCtx
+{
+    int (*Emit)(VfsDirCtx*, const char*, long, long, long); /*Name, length, ino, VnodeType*/
+    long Pos;
+};
+
+/*struct linux_dirent64, records padded to 8 bytes*/
+typedef struct VfsDirent64
+{
+    uint64_t Ino;
+    int64_t  Off; /*Pos after this entry*/
+    uint16_t Reclen;
+    uint8_t  Type; /*DT_* */
+    char     Name[];
+
+} VfsDirent64;
+
 typedef struct VfsNameBuf
 {
     char* Buf;
@@ -178,6 +211,14 @@ typedef struct VfsNameBuf
 
 } VfsNameBuf;
 
+/*One scatter-gather segment, laid out as struct iovec*/
+typedef struct VfsIovec
+{
+    void*  IovBase;
+    size_t IovLen;
+
+} VfsIovec;
+
 typedef struct FsType
 {
     const char* Name; /*Fat32*/
@@ -246,19 +287,23 @@ Vnode*  VfsLookup(Dentry*, const char*);
 int     VfsMkpath(const char*, long);
 int     VfsRealpath(const char*, char*, long);
 
-File* VfsOpen(const char*, long);
-File* VfsOpenAt(Dentry*, const char*, long);
-int   VfsClose(File*);
-long  VfsRead(File*, void*, long);
-long  VfsWrite(File*, const void*, long);
-long  VfsLseek(File*, long, int);
-int   VfsIoctl(File*, unsigned long, void*);
-int   VfsFsync(File*);
-int   VfsFstats(File*, VfsStat*);
-int   VfsStats(const char*, VfsStat*);
+File*    VfsOpen(const char*, long);
+File*    VfsOpenAt(Dentry*, const char*, long);
+int      VfsClose(File*);
+long     VfsRead(File*, void*, long);
+long     VfsWrite(File*, const void*, long);
+long     VfsReadv(File*, const VfsIovec*, long);
+long     VfsWritev(File*, const VfsIovec*, long);
+long     VfsLseek(File*, long, int);
+int      VfsIoctl(File*, unsigned long, void*);
+uint32_t VfsPoll(File*, WaitQueue**);
+int      VfsFsync(File*);
+int      VfsFstats(File*, VfsStat*);
+int      VfsStats(const char*, VfsStat*);
 
 long VfsReaddir(const char*, void*, long);
 long VfsReaddirF(File*, void*, long);
+long VfsGetdents(File*, void*, long);
 
 int VfsCreate(const char*, long, VfsPerm);
 int VfsUnlink(const char*);
@@ -300,8 +345,9 @@ int VfsIsDir(const char*);
 int VfsIsFile(const char*);
 int VfsIsSymlink(const char*);
 
-int VfsCopy(const char*, const char*, long);
-int VfsMove(const char*, const char*, long);
+int  VfsCopy(const char*, const char*, long);
+int  VfsMove(const char*, const char*, long);
+long VfsCopyRange(File*, long*, File*, long*, long, long);
 
 int VfsReadAll(const char*, void*, long, long*);
 int VfsWriteAll(const char*, const void*, long);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <EveryType.h>
+
+/*
+ * Deferred work. Items run later in the kernel worker pinned to the CPU they
+ * were queued on and may sleep, so an IRQ handler can hand its slow path off.
+ */
+typedef void (*WorkFunc)(void* __Arg__);
+
+typedef struct WorkItem
+{
+    struct WorkItem*  Next;
+    WorkFunc          Func;
+    void*             Arg;
+    volatile uint32_t Pending; /* Queued and not started yet, requeue is a no-op */
+
+} WorkItem;
+
+void InitWorkItem(WorkItem* __Item__, WorkFunc __Func__, void* __Arg__);
+bool QueueWorkOn(uint32_t __CpuId__, WorkItem* __Item__);
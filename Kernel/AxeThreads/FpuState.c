@@ -0,0 +1,353 @@
+#include <AxeSchd.h>    /* Current thread lookup */
+#include <FpuState.h>   /* Lazy FPU/XSAVE interfaces */
+#include <KHeap.h>      /* Save area allocation */
+#include <PerCPUData.h> /* Per-CPU FPU owner */
+#include <SMP.h>        /* Symmetric multiprocessing functions */
+#include <SymAP.h>      /* Per-CPU data lookup */
+
+FpuFeatures Fpu;
+
+static volatile uint32_t __FpuProbed__ = 0;
+
+/* Legacy region + XSAVE header, XSTATE_BV = 0 makes XRSTOR load the init state */
+static uint8_t __FpuInitImage__[FpuLegacySize + 64] __attribute__((aligned(FpuXsaveAlign)));
+
+static inline void
+__Cpuid__(uint32_t  __Leaf__,
+          uint32_t  __Sub__,
+          uint32_t* __A__,
+          uint32_t* __B__,
+          uint32_t* __C__,
+          uint32_t* __D__)
+{
+    __asm__ volatile("cpuid"
+                     : "=a"(*__A__), "=b"(*__B__), "=c"(*__C__), "=d"(*__D__)
+                     : "a"(__Leaf__), "c"(__Sub__));
+}
+
+static inline uint64_t
+__ReadCr0__(void)
+{
+    uint64_t Cr0;
+    __asm__ volatile("mov %%cr0, %0" : "=r"(Cr0));
+    return Cr0;
+}
+
+static inline void
+__SetTs__(void)
+{
+    uint64_t Cr0 = __ReadCr0__();
+    if (!(Cr0 & (1UL << 3)))
+    {
+        __asm__ volatile("mov %0, %%cr0" ::"r"(Cr0 | (1UL << 3)) : "memory");
+    }
+}
+
+static inline void
+__ClearTs__(void)
+{
+    __asm__ volatile("clts" ::: "memory");
+}
+
+static inline bool
+__TsSet__(void)
+{
+    return (__ReadCr0__() & (1UL << 3)) != 0;
+}
+
+static void
+__FpuLoadInit__(void)
+{
+    if (Fpu.UseXsave)
+    {
+        __asm__ volatile("xrstor64 (%0)" ::"r"(__FpuInitImage__),
+                         "a"((uint32_t)Fpu.Xcr0),
+                         "d"((uint32_t)(Fpu.Xcr0 >> 32))
+                         : "memory");
+    }
+    else
+    {
+        __asm__ volatile("fxrstor64 (%0)" ::"r"(__FpuInitImage__) : "memory");
+    }
+}
+
+static void
+__FpuSave__(Thread* __ThreadPtr__)
+{
+    if (__ThreadPtr__->FpuArea)
+    {
+        uint32_t Lo = (uint32_t)Fpu.Xcr0;
+        uint32_t Hi = (uint32_t)(Fpu.Xcr0 >> 32);
+        if (Fpu.UseXsaveOpt)
+        {
+            __asm__ volatile(
+                "xsaveopt64 (%0)" ::"r"(__ThreadPtr__->FpuArea), "a"(Lo), "d"(Hi) : "memory");
+        }
+        else
+        {
+            __asm__ volatile(
+                "xsave64 (%0)" ::"r"(__ThreadPtr__->FpuArea), "a"(Lo), "d"(Hi) : "memory");
+        }
+        return;
+    }
+
+    __asm__ volatile("fxsave64 (%0)" ::"r"(__ThreadPtr__->Context.FpuState) : "memory");
+}
+
+static void
+__FpuRestore__(Thread* __ThreadPtr__)
+{
+    if (__ThreadPtr__->FpuArea)
+    {
+        __asm__ volatile("xrstor64 (%0)" ::"r"(__ThreadPtr__->FpuArea),
+                         "a"((uint32_t)Fpu.Xcr0),
+                         "d"((uint32_t)(Fpu.Xcr0 >> 32))
+                         : "memory");
+        return;
+    }
+
+    /* Legacy buffer only covers x87/SSE, reset the wider components first */
+    if (Fpu.UseXsave)
+    {
+        __FpuLoadInit__();
+    }
+    __asm__ volatile("fxrstor64 (%0)" ::"r"(__ThreadPtr__->Context.FpuState) : "memory");
+}
+
+/* Falls back to the inline FXSAVE buffer (x87/SSE only) if the heap is exhausted */
+static void
+__FpuAllocArea__(Thread* __ThreadPtr__)
+{
+    if (!Fpu.UseXsave || __ThreadPtr__->FpuArea)
+    {
+        return;
+    }
+
+    uint8_t* Base = (uint8_t*)KMalloc(Fpu.AreaSize + FpuXsaveAlign);
+    if (!Base)
+    {
+        PWarn("FPU: No XSAVE area for thread %u, extended state disabled\n",
+              __ThreadPtr__->ThreadId);
+        return;
+    }
+
+    for (uint32_t Index = 0; Index < Fpu.AreaSize + FpuXsaveAlign; Index++)
+    {
+        Base[Index] = 0;
+    }
+
+    __ThreadPtr__->FpuAreaBase = Base;
+    __ThreadPtr__->FpuArea =
+        (void*)(((uint64_t)Base + FpuXsaveAlign - 1) & ~(uint64_t)(FpuXsaveAlign - 1));
+}
+
+void
+InitializeFpu(void)
+{
+    uint32_t Eax, Ebx, Ecx, Edx;
+    uint64_t Cr0, Cr4;
+
+    /* Read CR0 and CR4 */
+    __asm__ volatile("mov %%cr0, %0" : "=r"(Cr0));
+    __asm__ volatile("mov %%cr4, %0" : "=r"(Cr4));
+
+    /* CR0: clear EM (bit 2), set MP (bit 1), clear TS (bit 3) */
+    Cr0 &= ~(1UL << 2); /* EM = 0 */
+    Cr0 |= (1UL << 1);  /* MP = 1 */
+    Cr0 &= ~(1UL << 3); /* TS = 0 */
+    __asm__ volatile("mov %0, %%cr0" ::"r"(Cr0) : "memory");
+
+    /* CR4: set OSFXSR (bit 9) and OSXMMEXCPT (bit 10) for SSE */
+    Cr4 |= (1UL << 9) | (1UL << 10);
+
+    /* CR4: set OSXSAVE (bit 18) when the CPU has XSAVE */
+    __Cpuid__(1, 0, &Eax, &Ebx, &Ecx, &Edx);
+    bool HasXsave = (Ecx & (1U << 26)) != 0;
+    if (HasXsave)
+    {
+        Cr4 |= (1UL << 18);
+    }
+    __asm__ volatile("mov %0, %%cr4" ::"r"(Cr4) : "memory");
+
+    if (!__atomic_load_n(&__FpuProbed__, __ATOMIC_ACQUIRE))
+    {
+        /* Boot CPU decides the feature set, the others follow it */
+        Fpu.Xcr0        = XFeatureX87 | XFeatureSse;
+        Fpu.AreaSize    = FpuLegacySize;
+        Fpu.UseXsave    = HasXsave;
+        Fpu.UseXsaveOpt = false;
+
+        if (HasXsave)
+        {
+            __Cpuid__(0xD, 0, &Eax, &Ebx, &Ecx, &Edx);
+            uint64_t Supported = (uint64_t)Eax | ((uint64_t)Edx << 32);
+
+            if (Supported & XFeatureAvx)
+            {
+                Fpu.Xcr0 |= XFeatureAvx;
+                if ((Supported & XFeatureAvx512) == XFeatureAvx512)
+                {
+                    Fpu.Xcr0 |= XFeatureAvx512;
+                }
+            }
+        }
+
+        /* FCW masks all x87 exceptions, MXCSR masks all SIMD ones */
+        *(uint16_t*)&__FpuInitImage__[0]              = 0x037F;
+        *(uint32_t*)&__FpuInitImage__[FpuMxcsrOffset] = FpuDefaultMxcsr;
+    }
+
+    if (Fpu.UseXsave)
+    {
+        __asm__ volatile("xsetbv" ::"c"(0),
+                         "a"((uint32_t)Fpu.Xcr0),
+                         "d"((uint32_t)(Fpu.Xcr0 >> 32))
+                         : "memory");
+    }
+
+    if (!__atomic_load_n(&__FpuProbed__, __ATOMIC_ACQUIRE))
+    {
+        if (Fpu.UseXsave)
+        {
+            /* EBX reflects the size for the components now enabled in XCR0 */
+            __Cpuid__(0xD, 0, &Eax, &Ebx, &Ecx, &Edx);
+            Fpu.AreaSize = Ebx;
+
+            __Cpuid__(0xD, 1, &Eax, &Ebx, &Ecx, &Edx);
+            Fpu.UseXsaveOpt = (Eax & 1) != 0;
+        }
+
+        __atomic_store_n(&__FpuProbed__, 1, __ATOMIC_RELEASE);
+
+        PInfo("FPU: %s, XCR0=0x%llx, area %u bytes%s\n",
+              Fpu.UseXsave ? "XSAVE" : "FXSAVE",
+              Fpu.Xcr0,
+              Fpu.AreaSize,
+              Fpu.UseXsaveOpt ? ", XSAVEOPT" : "");
+    }
+
+    /* Initialize x87/SSE state */
+    __asm__ volatile("fninit");
+}
+
+void
+FpuHandleNm(void)
+{
+    __ClearTs__();
+
+    Thread* Self = GetCurrentThreadLocal();
+    if (!Self)
+    {
+        /* No thread context yet (early boot) */
+        __FpuLoadInit__();
+        return;
+    }
+
+    if (!(Self->Flags & ThreadFlagFpuUsed))
+    {
+        /* First touch, start from the architectural init state */
+        __FpuAllocArea__(Self);
+        __FpuLoadInit__();
+        __atomic_fetch_or(&Self->Flags, ThreadFlagFpuUsed, __ATOMIC_SEQ_CST);
+    }
+    else
+    {
+        __FpuRestore__(Self);
+    }
+
+    PerCpuSelf()->FpuOwner = Self;
+    Self->FpuCpu           = GetCurrentCpuId();
+}
+
+void
+FpuSwitchOut(Thread* __ThreadPtr__)
+{
+    if (!__ThreadPtr__ || !(__ThreadPtr__->Flags & ThreadFlagFpuUsed))
+    {
+        return;
+    }
+
+    /* TS still set means the thread never touched the FPU this slice, memory is current */
+    if (PerCpuSelf()->FpuOwner != __ThreadPtr__ || __TsSet__())
+    {
+        return;
+    }
+
+    /* Registers stay loaded, so a quick return to this CPU skips the restore */
+    __FpuSave__(__ThreadPtr__);
+}
+
+void
+FpuSwitchIn(Thread* __ThreadPtr__, uint32_t __CpuId__)
+{
+    if (__ThreadPtr__ && (__ThreadPtr__->Flags & ThreadFlagFpuUsed) &&
+        PerCpuSelf()->FpuOwner == __ThreadPtr__ && __ThreadPtr__->FpuCpu == __CpuId__)
+    {
+        __ClearTs__();
+        return;
+    }
+
+    __SetTs__();
+}
+
+void
+FpuCopyState(Thread* __Dst__, Thread* __Src__)
+{
+    if (!__Dst__ || !__Src__ || !(__Src__->Flags & ThreadFlagFpuUsed))
+    {
+        return;
+    }
+
+    /* Source may be the caller with newer state still in registers */
+    if (__Src__ == GetCurrentThreadLocal() && PerCpuSelf()->FpuOwner == __Src__ && !__TsSet__())
+    {
+        __FpuSave__(__Src__);
+    }
+
+    if (__Src__->FpuArea)
+    {
+        __FpuAllocArea__(__Dst__);
+    }
+
+    if (__Src__->FpuArea && __Dst__->FpuArea)
+    {
+        __builtin_memcpy(__Dst__->FpuArea, __Src__->FpuArea, Fpu.AreaSize);
+    }
+    else
+    {
+        __builtin_memcpy(__Dst__->Context.FpuState,
+                         __Src__->FpuArea ? __Src__->FpuArea : __Src__->Context.FpuState,
+                         FpuLegacySize);
+    }
+
+    __Dst__->FpuCpu = FpuNoCpu;
+    __atomic_fetch_or(&__Dst__->Flags, ThreadFlagFpuUsed, __ATOMIC_SEQ_CST);
+}
+
+void
+FpuReleaseThread(Thread* __ThreadPtr__)
+{
+    if (!__ThreadPtr__)
+    {
+        return;
+    }
+
+    /* Forget ownership so a thread reusing this address is not mistaken for it */
+    for (uint32_t CpuIndex = 0; CpuIndex < MaxCPUs; CpuIndex++)
+    {
+        Thread* Expected = __ThreadPtr__;
+        __atomic_compare_exchange_n(&GetPerCpuData(CpuIndex)->FpuOwner,
+                                    &Expected,
+                                    NULL,
+                                    false,
+                                    __ATOMIC_SEQ_CST,
+                                    __ATOMIC_RELAXED);
+    }
+
+    if (__ThreadPtr__->FpuAreaBase)
+    {
+        KFree(__ThreadPtr__->FpuAreaBase);
+        __ThreadPtr__->FpuAreaBase = NULL;
+        __ThreadPtr__->FpuArea     = NULL;
+    }
+}
@@ -1,22 +1,15 @@
 
 #include <AxeSchd.h>
+#include <ClockSource.h>
+#include <FpuState.h>
 #include <IDT.h>
+#include <String.h>
+#include <SymAP.h>
 #include <Timer.h>
+#include <VMM.h>
 
 CpuScheduler CpuSchedulers[MaxCPUs];
 
-static inline void
-ThreadFxSave(void* __State__)
-{
-    __asm__ volatile("fxsave %0" : "=m"(*(char (*)[512])__State__));
-}
-
-static inline void
-ThreadFxRestore(const void* __State__)
-{
-    __asm__ volatile("fxrstor %0" ::"m"(*(const char (*)[512])__State__));
-}
-
 void
 AddThreadToReadyQueue(uint32_t __CpuId__, Thread* __ThreadPtr__)
 {
@@ -103,20 +96,111 @@ AddThreadToWaitingQueue(uint32_t __CpuId__, Thread* __ThreadPtr__)
 
     CpuScheduler* Scheduler = &CpuSchedulers[__CpuId__];
 
-    /* Set thread state to blocked atomically */
-    __atomic_store_n(&__ThreadPtr__->State, ThreadStateBlocked, __ATOMIC_SEQ_CST);
-
     /* Acquire spinlock before modifying the waiting queue */
     AcquireSpinLock(&Scheduler->SchedulerLock);
 
+    /*
+     * The thread marked itself blocked before yielding, a WakeThread that raced
+     * in since then already flipped it back to ready, so do not park it.
+     */
+    if (__atomic_load_n(&__ThreadPtr__->State, __ATOMIC_SEQ_CST) != ThreadStateBlocked)
+    {
+        ReleaseSpinLock(&Scheduler->SchedulerLock);
+        AddThreadToReadyQueue(__CpuId__, __ThreadPtr__);
+        return;
+    }
+
     /* Add thread at head of waiting queue */
-    __ThreadPtr__->Next     = Scheduler->WaitingQueue;
+    __ThreadPtr__->Prev = NULL;
+    __ThreadPtr__->Next = Scheduler->WaitingQueue;
+    if (Scheduler->WaitingQueue)
+    {
+        Scheduler->WaitingQueue->Prev = __ThreadPtr__;
+    }
     Scheduler->WaitingQueue = __ThreadPtr__;
+    __ThreadPtr__->Flags |= ThreadFlagParked;
 
     /* Release spinlock after modification */
     ReleaseSpinLock(&Scheduler->SchedulerLock);
 }
 
+/* Caller holds the scheduler lock */
+static void
+__UnparkThread__(CpuScheduler* __Scheduler__, Thread* __ThreadPtr__)
+{
+    if (__ThreadPtr__->Prev)
+    {
+        __ThreadPtr__->Prev->Next = __ThreadPtr__->Next;
+    }
+    else
+    {
+        __Scheduler__->WaitingQueue = __ThreadPtr__->Next;
+    }
+    if (__ThreadPtr__->Next)
+    {
+        __ThreadPtr__->Next->Prev = __ThreadPtr__->Prev;
+    }
+    __ThreadPtr__->Flags &= ~ThreadFlagParked;
+
+    __atomic_store_n(&__ThreadPtr__->WakeupTime, 0, __ATOMIC_SEQ_CST);
+    __ThreadPtr__->State = ThreadStateReady;
+    __ThreadPtr__->Prev  = NULL;
+    __ThreadPtr__->Next  = NULL;
+
+    /* splice into ready tail */
+    if (!__Scheduler__->ReadyQueue)
+    {
+        __Scheduler__->ReadyQueue = __ThreadPtr__;
+    }
+    else
+    {
+        Thread* Tail = __Scheduler__->ReadyQueue;
+        while (Tail->Next)
+        {
+            Tail = Tail->Next;
+        }
+        Tail->Next          = __ThreadPtr__;
+        __ThreadPtr__->Prev = Tail;
+    }
+
+    __Scheduler__->ReadyCount++;
+}
+
+void
+WakeThread(Thread* __ThreadPtr__)
+{
+    if (!__ThreadPtr__)
+    {
+        return;
+    }
+
+    /* A blocked thread stays bound to the CPU it blocked on until it is woken */
+    uint32_t CpuId = __atomic_load_n(&__ThreadPtr__->LastCpu, __ATOMIC_SEQ_CST);
+    if (CpuId >= MaxCPUs)
+    {
+        return;
+    }
+
+    CpuScheduler* Scheduler = &CpuSchedulers[CpuId];
+
+    AcquireSpinLock(&Scheduler->SchedulerLock);
+
+    if (__atomic_load_n(&__ThreadPtr__->State, __ATOMIC_SEQ_CST) == ThreadStateBlocked)
+    {
+        if (__ThreadPtr__->Flags & ThreadFlagParked)
+        {
+            __UnparkThread__(Scheduler, __ThreadPtr__);
+        }
+        else
+        {
+            /* Not switched out yet, Schedule will requeue it as ready */
+            __atomic_store_n(&__ThreadPtr__->State, ThreadStateReady, __ATOMIC_SEQ_CST);
+        }
+    }
+
+    ReleaseSpinLock(&Scheduler->SchedulerLock);
+}
+
 void
 AddThreadToZombieQueue(uint32_t __CpuId__, Thread* __ThreadPtr__)
 {
@@ -154,20 +238,145 @@ AddThreadToSleepingQueue(uint32_t __CpuId__, Thread* __ThreadPtr__)
 
     CpuScheduler* Scheduler = &CpuSchedulers[__CpuId__];
 
-    /* Atomically set thread state to sleeping */
-    __atomic_store_n(&__ThreadPtr__->State, ThreadStateSleeping, __ATOMIC_SEQ_CST);
-
     /* Lock scheduler queue for safe insertion */
     AcquireSpinLock(&Scheduler->SchedulerLock);
 
-    /* Insert at head of sleeping queue */
-    __ThreadPtr__->Next      = Scheduler->SleepingQueue;
-    Scheduler->SleepingQueue = __ThreadPtr__;
+    /* Woken between ThreadSleepPrepare and the switch, it runs on instead */
+    if (__atomic_load_n(&__ThreadPtr__->State, __ATOMIC_SEQ_CST) != ThreadStateSleeping)
+    {
+        ReleaseSpinLock(&Scheduler->SchedulerLock);
+        AddThreadToReadyQueue(__CpuId__, __ThreadPtr__);
+        return;
+    }
+
+    /* Kept in deadline order, the head is the next one due and arms the one-shot */
+    uint64_t Deadline = __atomic_load_n(&__ThreadPtr__->SleepUntil, __ATOMIC_SEQ_CST);
+    Thread*  Prev     = NULL;
+    Thread*  Cursor   = Scheduler->SleepingQueue;
+    while (Cursor && __atomic_load_n(&Cursor->SleepUntil, __ATOMIC_SEQ_CST) <= Deadline)
+    {
+        Prev   = Cursor;
+        Cursor = Cursor->Next;
+    }
+
+    __ThreadPtr__->Prev = Prev;
+    __ThreadPtr__->Next = Cursor;
+    if (Prev)
+    {
+        Prev->Next = __ThreadPtr__;
+    }
+    else
+    {
+        Scheduler->SleepingQueue = __ThreadPtr__;
+    }
+    if (Cursor)
+    {
+        Cursor->Prev = __ThreadPtr__;
+    }
+    __ThreadPtr__->Flags |= ThreadFlagAsleep;
 
     /* Unlock after modification */
     ReleaseSpinLock(&Scheduler->SchedulerLock);
 }
 
+/* Caller holds the scheduler lock */
+static void
+__WakeSleeper__(CpuScheduler* __Scheduler__, Thread* __ThreadPtr__)
+{
+    if (__ThreadPtr__->Prev)
+    {
+        __ThreadPtr__->Prev->Next = __ThreadPtr__->Next;
+    }
+    else
+    {
+        __Scheduler__->SleepingQueue = __ThreadPtr__->Next;
+    }
+    if (__ThreadPtr__->Next)
+    {
+        __ThreadPtr__->Next->Prev = __ThreadPtr__->Prev;
+    }
+    __ThreadPtr__->Flags &= ~ThreadFlagAsleep;
+
+    __atomic_store_n(&__ThreadPtr__->WaitReason, WaitReasonNone, __ATOMIC_SEQ_CST);
+    __ThreadPtr__->State = ThreadStateReady;
+    __ThreadPtr__->Prev  = NULL;
+    __ThreadPtr__->Next  = NULL;
+
+    /* splice into ready tail */
+    if (!__Scheduler__->ReadyQueue)
+    {
+        __Scheduler__->ReadyQueue = __ThreadPtr__;
+    }
+    else
+    {
+        Thread* Tail = __Scheduler__->ReadyQueue;
+        while (Tail->Next)
+        {
+            Tail = Tail->Next;
+        }
+        Tail->Next          = __ThreadPtr__;
+        __ThreadPtr__->Prev = Tail;
+    }
+
+    __Scheduler__->ReadyCount++;
+}
+
+void
+WakeSleepingThread(Thread* __ThreadPtr__)
+{
+    if (!__ThreadPtr__)
+    {
+        return;
+    }
+
+    /* A sleeper stays on the queue of the CPU it went to sleep on */
+    uint32_t CpuId = __atomic_load_n(&__ThreadPtr__->LastCpu, __ATOMIC_SEQ_CST);
+    if (CpuId >= MaxCPUs)
+    {
+        return;
+    }
+
+    CpuScheduler* Scheduler = &CpuSchedulers[CpuId];
+
+    AcquireSpinLock(&Scheduler->SchedulerLock);
+
+    if (__atomic_load_n(&__ThreadPtr__->State, __ATOMIC_SEQ_CST) == ThreadStateSleeping)
+    {
+        if (__ThreadPtr__->Flags & ThreadFlagAsleep)
+        {
+            __WakeSleeper__(Scheduler, __ThreadPtr__);
+        }
+        else
+        {
+            /* Not switched out yet, AddThreadToSleepingQueue will requeue it as ready */
+            __atomic_store_n(&__ThreadPtr__->State, ThreadStateReady, __ATOMIC_SEQ_CST);
+        }
+    }
+
+    ReleaseSpinLock(&Scheduler->SchedulerLock);
+}
+
+uint64_t
+NextSleeperDeadline(uint32_t __CpuId__)
+{
+    if (__CpuId__ >= MaxCPUs)
+    {
+        return 0;
+    }
+
+    CpuScheduler* Scheduler = &CpuSchedulers[__CpuId__];
+    uint64_t      Deadline  = 0;
+
+    AcquireSpinLock(&Scheduler->SchedulerLock);
+    if (Scheduler->SleepingQueue)
+    {
+        Deadline = __atomic_load_n(&Scheduler->SleepingQueue->SleepUntil, __ATOMIC_SEQ_CST);
+    }
+    ReleaseSpinLock(&Scheduler->SchedulerLock);
+
+    return Deadline;
+}
+
 void
 MigrateThreadToCpu(Thread* __ThreadPtr__, uint32_t __TargetCpuId__)
 {
@@ -234,55 +443,29 @@ WakeupSleepingThreads(uint32_t __CpuId__)
 
     CpuScheduler* Scheduler    = &CpuSchedulers[__CpuId__];
     uint64_t      CurrentTicks = GetSystemTicks();
+    uint64_t      NowNs        = ClockMonotonicNs();
 
     AcquireSpinLock(&Scheduler->SchedulerLock);
 
+    /* Sorted by deadline, stop at the first one still in the future */
     Thread* Current = Scheduler->SleepingQueue;
-    Thread* Prev    = NULL;
+    while (Current && __atomic_load_n(&Current->SleepUntil, __ATOMIC_SEQ_CST) <= NowNs)
+    {
+        Thread* Next = Current->Next;
+        __WakeSleeper__(Scheduler, Current);
+        Current = Next;
+    }
 
+    /* Blocked waiters with an expired timeout, the waiter unlinks itself from its queue */
+    Current = Scheduler->WaitingQueue;
     while (Current)
     {
-        Thread* Next = Current->Next;
+        Thread*  Next     = Current->Next;
+        uint64_t Deadline = __atomic_load_n(&Current->WakeupTime, __ATOMIC_SEQ_CST);
 
-        if (__atomic_load_n(&Current->WakeupTime, __ATOMIC_SEQ_CST) <= CurrentTicks)
+        if (Deadline && Deadline <= CurrentTicks)
         {
-            /* unlink from sleeping */
-            if (Prev)
-            {
-                Prev->Next = Next;
-            }
-            else
-            {
-                Scheduler->SleepingQueue = Next;
-            }
-
-            __atomic_store_n(&Current->WaitReason, WaitReasonNone, __ATOMIC_SEQ_CST);
-            __atomic_store_n(&Current->WakeupTime, 0, __ATOMIC_SEQ_CST);
-            Current->State = ThreadStateReady;
-            Current->Prev  = NULL;
-            Current->Next  = NULL;
-
-            /* splice into ready tail under lock */
-            if (!Scheduler->ReadyQueue)
-            {
-                Scheduler->ReadyQueue = Current;
-            }
-            else
-            {
-                Thread* Tail = Scheduler->ReadyQueue;
-                while (Tail->Next)
-                {
-                    Tail = Tail->Next;
-                }
-                Tail->Next    = Current;
-                Current->Prev = Tail;
-            }
-
-            Scheduler->ReadyCount++;
-        }
-        else
-        {
-            Prev = Current;
+            __UnparkThread__(Scheduler, Current);
         }
 
         Current = Next;
@@ -319,6 +502,42 @@ CleanupZombieThreads(uint32_t __CpuId__)
     }
 }
 
+/* What a CPU runs when nothing is ready, it never sits on a queue */
+static void
+__IdleLoop__(void* __Argument__)
+{
+    (void)__Argument__;
+
+    for (;;)
+    {
+        __asm__ volatile("sti; hlt");
+    }
+}
+
+static Thread*
+__CreateIdleThread__(uint32_t __CpuId__)
+{
+    Thread* Idle = CreateThread(ThreadTypeKernel, __IdleLoop__, NULL, ThreadPriorityIdle);
+    if (!Idle)
+    {
+        PError("CPU %u: Failed to create idle thread\n", __CpuId__);
+        return NULL;
+    }
+
+    /* Kernel page tables, a switch to idle must not keep a dying address space loaded */
+    Idle->ProcessId     = 0;
+    Idle->PageDirectory = Vmm.KernelPml4Physical;
+    Idle->CpuAffinity   = __CpuId__ < 32 ? (1U << __CpuId__) : 0xFFFFFFFF;
+    Idle->LastCpu       = __CpuId__;
+
+    char Num[16];
+    UnsignedToStringEx(__CpuId__, Num, 10, 0);
+    StringCopy(Idle->Name, "idle/", sizeof(Idle->Name));
+    StringCopy(Idle->Name + sizeof("idle/") - 1, Num, sizeof(Idle->Name) - (sizeof("idle/") - 1));
+
+    return Idle;
+}
+
 void
 InitializeCpuScheduler(uint32_t __CpuId__)
 {
@@ -334,15 +553,15 @@ InitializeCpuScheduler(uint32_t __CpuId__)
     Scheduler->WaitingQueue  = NULL;
     Scheduler->ZombieQueue   = NULL;
     Scheduler->SleepingQueue = NULL;
-    Scheduler->CurrentThread = NULL;
     Scheduler->NextThread    = NULL;
-    Scheduler->IdleThread    = NULL;
 
     /* Reset all counters atomically */
     __atomic_store_n(&Scheduler->ThreadCount, 0, __ATOMIC_SEQ_CST);
     __atomic_store_n(&Scheduler->ReadyCount, 0, __ATOMIC_SEQ_CST);
     __atomic_store_n(&Scheduler->ContextSwitches, 0, __ATOMIC_SEQ_CST);
     __atomic_store_n(&Scheduler->IdleTicks, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&Scheduler->IdleNs, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&Scheduler->IdleSince, 0, __ATOMIC_SEQ_CST);
     __atomic_store_n(&Scheduler->LoadAverage, 0, __ATOMIC_SEQ_CST);
     __atomic_store_n(&Scheduler->ScheduleTicks, 0, __ATOMIC_SEQ_CST);
     __atomic_store_n(&Scheduler->LastSchedule, 0, __ATOMIC_SEQ_CST);
@@ -350,6 +569,16 @@ InitializeCpuScheduler(uint32_t __CpuId__)
     /* Initialize spinlock with identifier for debug */
     InitializeSpinLock(&Scheduler->SchedulerLock, "CpuScheduler");
 
+    /* Both the boot CPU and the AP itself initialize an AP's scheduler, create idle once */
+    if (!Scheduler->IdleThread)
+    {
+        Scheduler->IdleThread = __CreateIdleThread__(__CpuId__);
+    }
+
+    /* Let this CPU reach its queues straight through GS */
+    GetPerCpuData(__CpuId__)->Scheduler = Scheduler;
+    SetCurrentThread(__CpuId__, NULL);
+
     PDebug("CPU %u scheduler initialized\n", __CpuId__);
 }
 
@@ -402,9 +631,6 @@ LoadThreadContextToInterruptFrame(Thread* __ThreadPtr__, InterruptFrame* __Frame
         __asm__ volatile("mov %0, %%cr3" ::"r"(__Pd__) : "memory");
     }
 
-    /*FPU*/
-    ThreadFxRestore(__ThreadPtr__->Context.FpuState);
-
     ThreadContext* Context = &__ThreadPtr__->Context;
 
     /* Load general-purpose registers into interrupt frame */
@@ -441,22 +667,39 @@ Schedule(uint32_t __CpuId__, InterruptFrame* __Frame__)
     }
 
     CpuScheduler* Scheduler  = &CpuSchedulers[__CpuId__];
-    Thread*       Current    = Scheduler->CurrentThread;
+    Thread*       Current    = GetCurrentThread(__CpuId__);
     Thread*       NextThread = NULL;
+    uint64_t      NowNs      = ClockMonotonicNs();
 
     /* Update scheduler tick counters */
     __atomic_fetch_add(&Scheduler->ScheduleTicks, 1, __ATOMIC_SEQ_CST);
     __atomic_store_n(&Scheduler->LastSchedule, GetSystemTicks(), __ATOMIC_SEQ_CST);
 
-    /* If there is a currently running thread */
-    if (Current)
+    /*
+     * Reap zombies parked by an earlier switch. One parked below may still be
+     * executing this very call on its kernel stack, so it waits for the next.
+     */
+    CleanupZombieThreads(__CpuId__);
+
+    /* If there is a currently running thread, idle is saved but never queued */
+    if (Current && Current == Scheduler->IdleThread)
     {
-        /*FPU*/
-        ThreadFxSave(Current->Context.FpuState);
+        SaveInterruptFrameToThread(Current, __Frame__);
+    }
+    else if (Current)
+    {
+        /*FPU, only written back if the thread touched it this slice*/
+        FpuSwitchOut(Current);
 
         /* Save current thread's CPU context */
         SaveInterruptFrameToThread(Current, __Frame__);
-        __atomic_fetch_add(&Current->CpuTime, 1, __ATOMIC_SEQ_CST);
+
+        /* Charge the slice just ended, StartTime is when it was switched in */
+        uint64_t Since = __atomic_load_n(&Current->StartTime, __ATOMIC_SEQ_CST);
+        if (NowNs > Since)
+        {
+            __atomic_fetch_add(&Current->CpuTime, NowNs - Since, __ATOMIC_SEQ_CST);
+        }
 
         /* Handle current thread's state transitions */
         switch (Current->State)
@@ -498,20 +741,52 @@ SelectAgain:
     /* Attempt to wake up any sleeping threads whose timeout expired */
     WakeupSleepingThreads(__CpuId__);
 
-    /* Cleanup any zombie threads */
-    CleanupZombieThreads(__CpuId__);
-
     /* Select next thread from ready queue */
     NextThread = RemoveThreadFromReadyQueue(__CpuId__);
 
     /* If no ready thread exists, CPU is idle */
     if (!NextThread)
     {
-        Scheduler->CurrentThread = NULL;
         __atomic_fetch_add(&Scheduler->IdleTicks, 1, __ATOMIC_SEQ_CST);
+        if (!Scheduler->IdleSince)
+        {
+            __atomic_store_n(&Scheduler->IdleSince, NowNs, __ATOMIC_SEQ_CST);
+        }
+
+        /*
+         * Halt in the idle thread, the frame we came in on may belong to a thread
+         * that just blocked or exited and must not run on. Without one (boot
+         * context, before the first switch) the interrupted frame is resumed.
+         */
+        Thread* Idle = Scheduler->IdleThread;
+        if (!Idle)
+        {
+            SetCurrentThread(__CpuId__, NULL);
+            return;
+        }
+
+        Idle->State   = ThreadStateRunning;
+        Idle->LastCpu = __CpuId__;
+        __atomic_store_n(&Idle->StartTime, NowNs, __ATOMIC_SEQ_CST);
+
+        if (Current != Idle)
+        {
+            __atomic_fetch_add(&Scheduler->ContextSwitches, 1, __ATOMIC_SEQ_CST);
+            LoadThreadContextToInterruptFrame(Idle, __Frame__);
+            FpuSwitchIn(Idle, __CpuId__);
+        }
+
+        SetCurrentThread(__CpuId__, Idle);
         return;
     }
 
+    /* Leaving idle, close the idle period */
+    uint64_t IdleSince = __atomic_exchange_n(&Scheduler->IdleSince, 0, __ATOMIC_SEQ_CST);
+    if (IdleSince && NowNs > IdleSince)
+    {
+        __atomic_fetch_add(&Scheduler->IdleNs, NowNs - IdleSince, __ATOMIC_SEQ_CST);
+    }
+
     /* Override code segment and stack segment selectors based on thread type */
     if (NextThread->Type == ThreadTypeUser)
     {
@@ -573,11 +848,10 @@ SelectAgain:
         __atomic_store_n(&NextThread->Cooldown, Stride - 1, __ATOMIC_SEQ_CST);
     }
 
-    /* Set the selected thread as current running and update state */
-    Scheduler->CurrentThread = NextThread;
-    NextThread->State        = ThreadStateRunning;
-    NextThread->LastCpu      = __CpuId__;
-    __atomic_store_n(&NextThread->StartTime, GetSystemTicks(), __ATOMIC_SEQ_CST);
+    /* Update state, the thread becomes current once its context is loaded */
+    NextThread->State   = ThreadStateRunning;
+    NextThread->LastCpu = __CpuId__;
+    __atomic_store_n(&NextThread->StartTime, NowNs, __ATOMIC_SEQ_CST);
 
     /* Update context switch statistics */
     __atomic_fetch_add(&Scheduler->ContextSwitches, 1, __ATOMIC_SEQ_CST);
@@ -586,7 +860,19 @@ SelectAgain:
     /* Load the next thread's saved context into the interrupt frame */
     LoadThreadContextToInterruptFrame(NextThread, __Frame__);
 
-    /* Update current thread reference for the CPU */
+    /* Ring 3 entries land on the thread's own kernel stack, a blocked syscall keeps its frame */
+    PerCpuData*       CpuData   = GetPerCpuData(__CpuId__);
+    TaskStateSegment* ActiveTss = CpuData->ActiveTss;
+    if (ActiveTss && NextThread->Type == ThreadTypeUser && NextThread->KernelStack)
+    {
+        ActiveTss->Rsp0    = NextThread->KernelStack;
+        CpuData->KernelRsp = NextThread->KernelStack; /* SYSCALL does not consult the TSS */
+    }
+
+    /* Arm the #NM trap unless this CPU still holds the thread's FPU state */
+    FpuSwitchIn(NextThread, __CpuId__);
+
+    /* Publish it in this CPU's single current thread slot */
     SetCurrentThread(__CpuId__, NextThread);
 }
 
@@ -606,8 +892,8 @@ DumpCpuSchedulerInfo(uint32_t __CpuId__)
           __atomic_load_n(&Scheduler->ReadyCount, __ATOMIC_SEQ_CST));
     PInfo("  Context Switches: %llu\n",
           __atomic_load_n(&Scheduler->ContextSwitches, __ATOMIC_SEQ_CST));
-    PInfo("  Current Thread: %u\n",
-          Scheduler->CurrentThread ? Scheduler->CurrentThread->ThreadId : 0);
+    Thread* Current = GetCurrentThread(__CpuId__);
+    PInfo("  Current Thread: %u\n", Current ? Current->ThreadId : 0);
 }
 
 void
@@ -0,0 +1,238 @@
+#include <AxeThreads.h> /* Default stack size */
+#include <GDT.h>        /* BSP TSS for the double fault stack */
+#include <IDT.h>        /* Double fault IDT entry */
+#include <KHeap.h>      /* Slot descriptors */
+#include <PMM.h>        /* Backing pages */
+#include <StackCache.h> /* Stack cache interfaces */
+
+static StackCpuCache __Caches__[MaxCPUs];
+
+/* Slots whose mapping failed half way, never seen by another CPU so safe to reuse */
+static SpinLock   __ArenaLock__;
+static StackSlot* __FreeSlots__;
+static uint32_t   __NextSlot__;
+static uint32_t   __SlotLimit__;
+
+static void
+__UnmapRange__(uint64_t __Start__, uint64_t __End__)
+{
+    for (uint64_t Va = __Start__; Va < __End__; Va += PageSize)
+    {
+        uint64_t Phys = GetPhysicalAddress(Vmm.KernelSpace, Va);
+        if (!Phys)
+        {
+            continue;
+        }
+
+        UnmapPage(Vmm.KernelSpace, Va);
+        FreePage(Phys & ~0xFFFULL);
+    }
+}
+
+static int
+__MapRange__(uint64_t __Start__, uint64_t __End__)
+{
+    for (uint64_t Va = __Start__; Va < __End__; Va += PageSize)
+    {
+        uint64_t Phys = AllocPage();
+        if (!Phys)
+        {
+            __UnmapRange__(__Start__, Va);
+            return -1;
+        }
+
+        if (MapPage(Vmm.KernelSpace, Va, Phys, PTEPRESENT | PTEWRITABLE | PTENOEXECUTE) != 1)
+        {
+            FreePage(Phys);
+            __UnmapRange__(__Start__, Va);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static StackSlot*
+__SlotGet__(void)
+{
+    AcquireSpinLock(&__ArenaLock__);
+    StackSlot* Slot = __FreeSlots__;
+    if (Slot)
+    {
+        __FreeSlots__ = Slot->Next;
+        ReleaseSpinLock(&__ArenaLock__);
+        return Slot;
+    }
+    ReleaseSpinLock(&__ArenaLock__);
+
+    Slot = (StackSlot*)KMalloc(sizeof(StackSlot));
+    if (!Slot)
+    {
+        return NULL;
+    }
+
+    AcquireSpinLock(&__ArenaLock__);
+    if (__NextSlot__ >= __SlotLimit__)
+    {
+        ReleaseSpinLock(&__ArenaLock__);
+        KFree(Slot);
+        PError("StackAlloc: Kernel stack arena exhausted\n");
+        return NULL;
+    }
+    Slot->Index = __NextSlot__++;
+    ReleaseSpinLock(&__ArenaLock__);
+
+    Slot->Next = NULL;
+    Slot->Top  = KStackArenaBase + ((uint64_t)Slot->Index + 1) * KStackSlotSize;
+    return Slot;
+}
+
+static void
+__SlotPut__(StackSlot* __Slot__)
+{
+    AcquireSpinLock(&__ArenaLock__);
+    __Slot__->Next = __FreeSlots__;
+    __FreeSlots__  = __Slot__;
+    ReleaseSpinLock(&__ArenaLock__);
+}
+
+void
+InitializeStackCache(void)
+{
+    InitializeSpinLock(&__ArenaLock__, "StackArena");
+    __FreeSlots__ = NULL;
+    __NextSlot__  = 0;
+    __SlotLimit__ = (uint32_t)(KStackArenaSize / KStackSlotSize);
+
+    for (uint32_t CpuIndex = 0; CpuIndex < MaxCPUs; CpuIndex++)
+    {
+        InitializeSpinLock(&__Caches__[CpuIndex].Lock, "StackCache");
+        __Caches__[CpuIndex].Head   = NULL;
+        __Caches__[CpuIndex].Count  = 0;
+        __Caches__[CpuIndex].Hits   = 0;
+        __Caches__[CpuIndex].Misses = 0;
+    }
+
+    /*
+     * Populate the arena's PML4 entry now, CreateVirtualSpace copies the upper
+     * half by value so every space created later sees the same stacks.
+     */
+    if (!GetPageTable(Vmm.KernelSpace->Pml4, KStackArenaBase, 3, 1))
+    {
+        PError("StackCache: Failed to create arena tables\n");
+        return;
+    }
+
+    /* The boot CPU's double fault stack, APs get theirs in PerCpuInterruptInit */
+    StackSlot* IstStack = StackAlloc(KStackIstSize);
+    if (IstStack)
+    {
+        Tss.Ist1          = IstStack->Top;
+        IdtEntries[8].Ist = KStackIstDoubleFault; /* #DF */
+    }
+    else
+    {
+        PWarn("StackCache: No double fault stack\n");
+    }
+
+    PSuccess("Stack cache initialized: %u slots of %u KiB at 0x%016llx\n",
+             __SlotLimit__,
+             KStackSlotSize / 1024,
+             KStackArenaBase);
+}
+
+StackSlot*
+StackAlloc(uint32_t __Size__)
+{
+    uint32_t Size = __Size__ ? __Size__ : KStackSize;
+    Size          = (Size + PageSize - 1) & ~(uint32_t)(PageSize - 1);
+    if (Size > KStackMaxSize)
+    {
+        PError("StackAlloc: %u bytes exceeds the %u byte limit\n", Size, KStackMaxSize);
+        return NULL;
+    }
+
+    if (Size == KStackSize)
+    {
+        StackCpuCache* Cache = &__Caches__[GetCurrentCpuId()];
+
+        AcquireSpinLock(&Cache->Lock);
+        StackSlot* Slot = Cache->Head;
+        if (Slot)
+        {
+            Cache->Head = Slot->Next;
+            Cache->Count--;
+            Cache->Hits++;
+            ReleaseSpinLock(&Cache->Lock);
+
+            Slot->Next = NULL;
+            return Slot;
+        }
+        Cache->Misses++;
+        ReleaseSpinLock(&Cache->Lock);
+    }
+
+    StackSlot* Slot = __SlotGet__();
+    if (!Slot)
+    {
+        return NULL;
+    }
+
+    Slot->Size = Size;
+    Slot->Base = Slot->Top - Size;
+
+    if (__MapRange__(Slot->Base, Slot->Top) != 0)
+    {
+        PError("StackAlloc: Out of memory for a %u byte stack\n", Size);
+        __SlotPut__(Slot);
+        return NULL;
+    }
+
+    return Slot;
+}
+
+void
+StackFree(StackSlot* __Slot__)
+{
+    if (!__Slot__)
+    {
+        return;
+    }
+
+    /* Default-size stacks go back mapped so the next CreateThread is a list pop */
+    if (__Slot__->Size == KStackSize)
+    {
+        StackCpuCache* Cache = &__Caches__[GetCurrentCpuId()];
+
+        AcquireSpinLock(&Cache->Lock);
+        if (Cache->Count < KStackCacheDepth)
+        {
+            __Slot__->Next = Cache->Head;
+            Cache->Head    = __Slot__;
+            Cache->Count++;
+            ReleaseSpinLock(&Cache->Lock);
+            return;
+        }
+        ReleaseSpinLock(&Cache->Lock);
+    }
+
+    /*
+     * The range is retired rather than recycled, there is no TLB shootdown
+     * and another CPU may still cache the old translation. The arena holds
+     * about two million slots and only odd sizes and cache overflow get here.
+     */
+    __UnmapRange__(__Slot__->Base, __Slot__->Top);
+    KFree(__Slot__);
+}
+
+bool
+StackIsGuardAddress(uint64_t __Addr__)
+{
+    if (__Addr__ < KStackArenaBase || __Addr__ >= KStackArenaBase + KStackArenaSize)
+    {
+        return false;
+    }
+
+    /* Anything unmapped inside the arena is below some stack */
+    return GetPhysicalAddress(Vmm.KernelSpace, __Addr__) == 0;
+}
@@ -1,34 +1,73 @@
 
 #include <AxeSchd.h>
 #include <AxeThreads.h>
+#include <ClockSource.h>
+#include <FpuState.h>
 #include <KHeap.h>
 #include <PerCPUData.h>
 #include <SMP.h>
+#include <StackCache.h>
+#include <SymAP.h>
 #include <Sync.h>
 #include <Timer.h>
 #include <VMM.h>
 
-uint32_t        NextThreadId = 1;
-Thread*         ThreadList   = NULL;
-SpinLock        ThreadListLock;
-Thread*         CurrentThreads[MaxCPUs];
-static SpinLock CurrentThreadLock; /*Mutexes would have been fine ig*/
+uint32_t NextThreadId = 1;
+Thread*  ThreadList   = NULL;
+SpinLock ThreadListLock;
+
+/* Id lookup, a hit is referenced under the lock so DestroyThread cannot free it under the caller */
+static Thread*  __ThreadHash__[ThreadHashBuckets];
+static SpinLock __ThreadHashLock__;
+
+static void
+__ThreadHashInsert__(Thread* __ThreadPtr__)
+{
+    Thread** Bucket = &__ThreadHash__[__ThreadPtr__->ThreadId & (ThreadHashBuckets - 1)];
+
+    AcquireSpinLock(&__ThreadHashLock__);
+    __ThreadPtr__->HashNext = *Bucket;
+    *Bucket                 = __ThreadPtr__;
+    ReleaseSpinLock(&__ThreadHashLock__);
+}
+
+static void
+__ThreadHashRemove__(Thread* __ThreadPtr__)
+{
+    Thread** Link = &__ThreadHash__[__ThreadPtr__->ThreadId & (ThreadHashBuckets - 1)];
+
+    AcquireSpinLock(&__ThreadHashLock__);
+    while (*Link && *Link != __ThreadPtr__)
+    {
+        Link = &(*Link)->HashNext;
+    }
+    if (*Link)
+    {
+        *Link = __ThreadPtr__->HashNext;
+    }
+    ReleaseSpinLock(&__ThreadHashLock__);
+}
 
 void
 InitializeThreadManager(void)
 {
     InitializeSpinLock(&ThreadListLock, "ThreadList");
-    InitializeSpinLock(&CurrentThreadLock, "CurrentThread");
+    InitializeSpinLock(&__ThreadHashLock__, "ThreadHash");
     NextThreadId = 1;
     ThreadList   = NULL;
 
+    for (uint32_t Bucket = 0; Bucket < ThreadHashBuckets; Bucket++)
+    {
+        __ThreadHash__[Bucket] = NULL;
+    }
+
     /*
-     * Initialize current threads array to NULL for all CPUs.
+     * Clear every CPU's current thread slot.
      * This prevents accessing invalid thread pointers on startup.
      */
     for (uint32_t CpuIndex = 0; CpuIndex < MaxCPUs; CpuIndex++)
     {
-        CurrentThreads[CpuIndex] = NULL;
+        GetPerCpuData(CpuIndex)->CurrentThread = NULL;
     }
 
     PSuccess("Thread Manager initialized\n");
@@ -48,11 +87,20 @@ GetCurrentThread(uint32_t __CpuId__)
         return NULL;
     }
 
-    AcquireSpinLock(&CurrentThreadLock);
-    Thread* Result = CurrentThreads[__CpuId__];
-    ReleaseSpinLock(&CurrentThreadLock);
+    /* Single per-CPU slot, only its own CPU writes it so a plain load is enough */
+    return __atomic_load_n(&GetPerCpuData(__CpuId__)->CurrentThread, __ATOMIC_ACQUIRE);
+}
+
+Thread*
+GetCurrentThreadLocal(void)
+{
+    /* One gs load, cannot be torn by a migration between reading the CPU and the slot */
+    if (__atomic_load_n(&PerCpuReady, __ATOMIC_ACQUIRE))
+    {
+        return PerCpuCurrentThread();
+    }
 
-    return Result;
+    return GetCurrentThread(GetCurrentCpuId());
 }
 
 void
@@ -63,9 +111,7 @@ SetCurrentThread(uint32_t __CpuId__, Thread* __ThreadPtr__)
         return;
     }
 
-    AcquireSpinLock(&CurrentThreadLock);
-    CurrentThreads[__CpuId__] = __ThreadPtr__;
-    ReleaseSpinLock(&CurrentThreadLock);
+    __atomic_store_n(&GetPerCpuData(__CpuId__)->CurrentThread, __ThreadPtr__, __ATOMIC_RELEASE);
 }
 
 Thread*
@@ -73,6 +119,16 @@ CreateThread(ThreadType     __Type__,
              void*          __EntryPoint__,
              void*          __Argument__,
              ThreadPriority __Priority__)
+{
+    return CreateThreadEx(__Type__, __EntryPoint__, __Argument__, __Priority__, KStackSize);
+}
+
+Thread*
+CreateThreadEx(ThreadType     __Type__,
+               void*          __EntryPoint__,
+               void*          __Argument__,
+               ThreadPriority __Priority__,
+               uint32_t       __StackSize__)
 {
     PDebug("CreateThread: Entry - Type=%u, EntryPoint=%p, Arg=%p\n",
            __Type__,
@@ -84,7 +140,6 @@ CreateThread(ThreadType     __Type__,
     if (!NewThread)
     {
         PError("CreateThread: Failed to allocate thread\n");
-        ReleaseSpinLock(&ThreadListLock);
         return NULL;
     }
     PDebug("CreateThread: TCB allocated at %p\n", NewThread);
@@ -105,59 +160,34 @@ CreateThread(ThreadType     __Type__,
     NewThread->Type         = __Type__;
     NewThread->Priority     = __Priority__;
     NewThread->BasePriority = __Priority__;
+    NewThread->FpuCpu       = FpuNoCpu;
+    NewThread->Refs         = 1;
     PDebug("CreateThread: Core fields initialized\n");
 
     PDebug("CreateThread: Setting thread name\n");
     KrnPrintf(NewThread->Name, "Thread-%u", NewThread->ThreadId);
     PDebug("CreateThread: Thread name set to: %s\n", NewThread->Name);
 
-    PDebug("CreateThread: About to allocate stacks\n");
-    if (__Type__ == ThreadTypeKernel)
-    {
-        PDebug("CreateThread: Allocating kernel stack (8192 bytes)\n");
-        void* KernelStackBase = KMalloc(8192);
-        if (!KernelStackBase)
-        {
-            PError("CreateThread: Failed to allocate kernel stack\n");
-            KFree(NewThread);
-            ReleaseSpinLock(&ThreadListLock);
-            return NULL;
-        }
-        NewThread->KernelStack =
-            (uint64_t)KernelStackBase + 8192; /** Stack grows downwards; store top */
-        NewThread->UserStack = 0;             /** Kernel thread has no user stack */
-        NewThread->StackSize = 8192;
-        PDebug("CreateThread: Kernel stack allocated at %p (top: %p)\n",
-               KernelStackBase,
-               (void*)NewThread->KernelStack);
-    }
-    else
+    /*
+     * Kernel stack from the guarded stack cache, a default-size stack is a
+     * per-CPU list pop. User stacks live in the process address space and are
+     * installed by the loader (VirtSetupStack) or copied by fork.
+     */
+    PDebug("CreateThread: Allocating kernel stack (%u bytes)\n", __StackSize__);
+    StackSlot* KernelStackSlot = StackAlloc(__StackSize__);
+    if (!KernelStackSlot)
     {
-        PDebug("CreateThread: Allocating kernel and user stacks\n");
-        void* KernelStackBase = KMalloc(8192);
-        void* UserStackBase   = KMalloc(8192);
-        if (!KernelStackBase || !UserStackBase)
-        {
-            PError("CreateThread: Failed to allocate stacks\n");
-            if (KernelStackBase)
-            {
-                KFree(KernelStackBase);
-            }
-            if (UserStackBase)
-            {
-                KFree(UserStackBase);
-            }
-            KFree(NewThread);
-            ReleaseSpinLock(&ThreadListLock);
-            return NULL;
-        }
-        NewThread->KernelStack = (uint64_t)KernelStackBase + 8192;
-        NewThread->UserStack   = (uint64_t)UserStackBase + 8192;
-        NewThread->StackSize   = 8192;
-        PDebug("CreateThread: Stacks allocated - Kernel: %p, User: %p\n",
-               (void*)NewThread->KernelStack,
-               (void*)NewThread->UserStack);
+        PError("CreateThread: Failed to allocate kernel stack\n");
+        KFree(NewThread);
+        return NULL;
     }
+    NewThread->KernelStackSlot = KernelStackSlot;
+    NewThread->KernelStack     = KernelStackSlot->Top; /** Stack grows downwards; store top */
+    NewThread->UserStack       = 0;
+    NewThread->StackSize       = KernelStackSlot->Size;
+    PDebug("CreateThread: Kernel stack at %p (top: %p)\n",
+           (void*)KernelStackSlot->Base,
+           (void*)NewThread->KernelStack);
 
     PDebug("CreateThread: Initializing thread context\n");
     NewThread->Context.Rip    = (uint64_t)__EntryPoint__;
@@ -172,7 +202,7 @@ CreateThread(ThreadType     __Type__,
     {
         NewThread->Context.Cs  = UserCodeSelector;
         NewThread->Context.Ss  = UserDataSelector;
-        NewThread->Context.Rsp = (NewThread->UserStack & ~0xFULL) - 16;
+        NewThread->Context.Rsp = 0; /** Set by the caller once the user stack exists */
     }
 
     NewThread->Context.Ds  = NewThread->Context.Ss;
@@ -190,14 +220,14 @@ CreateThread(ThreadType     __Type__,
     NewThread->TimeSlice   = 10;
     NewThread->Cooldown    = 0;
     PDebug("CreateThread: About to call GetSystemTicks\n");
-    NewThread->StartTime    = GetSystemTicks();
+    NewThread->StartTime    = ClockMonotonicNs();
     NewThread->CreationTick = GetSystemTicks();
     PDebug("CreateThread: System ticks retrieved\n");
     NewThread->WaitReason = WaitReasonNone;
 
     NewThread->PageDirectory = 0;
     NewThread->VirtualBase   = UserVirtualBase;
-    NewThread->MemoryUsage   = (NewThread->StackSize * 2) / 1024;
+    NewThread->MemoryUsage   = NewThread->StackSize / 1024;
     PDebug("CreateThread: Scheduling and memory fields initialized\n");
 
     PDebug("CreateThread: Adding to thread list (current head: %p)\n", ThreadList);
@@ -209,6 +239,8 @@ CreateThread(ThreadType     __Type__,
     ThreadList = NewThread;
     PDebug("CreateThread: Added to thread list (new head: %p)\n", ThreadList);
 
+    __ThreadHashInsert__(NewThread);
+
     PDebug("Created thread %u (%s)\n",
            NewThread->ThreadId,
            __Type__ == ThreadTypeKernel ? "Kernel" : "User");
@@ -245,19 +277,29 @@ DestroyThread(Thread* __ThreadPtr__)
 
     ReleaseSpinLock(&ThreadListLock);
 
-    if (__ThreadPtr__->KernelStack)
-    {
-        KFree((void*)(__ThreadPtr__->KernelStack - __ThreadPtr__->StackSize));
-    }
+    __ThreadHashRemove__(__ThreadPtr__);
 
-    if (__ThreadPtr__->UserStack)
+    FpuReleaseThread(__ThreadPtr__);
+
+    if (__ThreadPtr__->KernelStackSlot)
     {
-        KFree((void*)(__ThreadPtr__->UserStack - __ThreadPtr__->StackSize));
+        StackFree((StackSlot*)__ThreadPtr__->KernelStackSlot);
+        __ThreadPtr__->KernelStackSlot = NULL;
     }
 
-    KFree(__ThreadPtr__);
-
     PDebug("Destroyed thread %u\n", __ThreadPtr__->ThreadId);
+
+    /* Unhashed above, only lookups already holding a reference can still reach it */
+    ThreadPut(__ThreadPtr__);
+}
+
+void
+ThreadPut(Thread* __ThreadPtr__)
+{
+    if (__ThreadPtr__ && __atomic_sub_fetch(&__ThreadPtr__->Refs, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        KFree(__ThreadPtr__);
+    }
 }
 
 void
@@ -295,7 +337,8 @@ ResumeThread(Thread* __ThreadPtr__)
 
     if (__ThreadPtr__->State == ThreadStateBlocked && __ThreadPtr__->WaitReason == WaitReasonNone)
     {
-        __ThreadPtr__->State = ThreadStateReady;
+        /* Suspended threads get parked on the waiting queue, move it back to ready */
+        WakeThread(__ThreadPtr__);
     }
 
     PDebug("Resumed thread %u\n", __ThreadPtr__->ThreadId);
@@ -309,7 +352,9 @@ SetThreadPriority(Thread* __ThreadPtr__, ThreadPriority __Priority__)
         return;
     }
 
-    __ThreadPtr__->Priority = __Priority__;
+    /* Base priority is what a mutex owner falls back to once inheritance ends */
+    __ThreadPtr__->BasePriority = __Priority__;
+    __ThreadPtr__->Priority     = __Priority__;
 
     PDebug("Set thread %u priority to %u\n", __ThreadPtr__->ThreadId, __Priority__);
 }
@@ -559,31 +604,77 @@ ThreadYield(void)
 }
 
 void
-ThreadSleep(uint64_t __Milliseconds__)
+ThreadSleepPrepare(uint64_t __DeadlineNs__)
 {
-    uint32_t CpuId   = GetCurrentCpuId();
-    Thread*  Current = GetCurrentThread(CpuId);
+    Thread* Current = GetCurrentThreadLocal();
+    if (!Current)
+    {
+        return;
+    }
 
-    if (Current)
+    __atomic_store_n(&Current->SleepUntil, __DeadlineNs__, __ATOMIC_SEQ_CST);
+    Current->WaitReason = WaitReasonSleep;
+
+    /* From here a preemption parks us just as Commit would, WakeSleepingThread undoes it */
+    __atomic_store_n(&Current->State, ThreadStateSleeping, __ATOMIC_SEQ_CST);
+}
+
+int
+ThreadSleepCommit(void)
+{
+    Thread* Current = GetCurrentThreadLocal();
+    if (!Current)
     {
-        Current->State      = ThreadStateSleeping;
-        Current->WaitReason = WaitReasonSleep;
-        Current->WakeupTime = GetSystemTicks() + __Milliseconds__;
+        return 0;
+    }
 
-        /* Trigger scheduler by invoking timer interrupt */
+    uint64_t Deadline = __atomic_load_n(&Current->SleepUntil, __ATOMIC_SEQ_CST);
+
+    /* Still marked sleeping unless a wake or a preemption already went through */
+    if (__atomic_load_n(&Current->State, __ATOMIC_SEQ_CST) == ThreadStateSleeping)
+    {
         __asm__ volatile("int $0x20");
     }
-    else
+
+    Current->WaitReason = WaitReasonNone;
+    return (ClockMonotonicNs() >= Deadline) ? 0 : -1;
+}
+
+void
+ThreadSleepCancel(void)
+{
+    Thread* Current = GetCurrentThreadLocal();
+    if (!Current)
+    {
+        return;
+    }
+
+    __atomic_store_n(&Current->State, ThreadStateRunning, __ATOMIC_SEQ_CST);
+    Current->WaitReason = WaitReasonNone;
+}
+
+void
+ThreadSleep(uint64_t __Milliseconds__)
+{
+    uint64_t Deadline = ClockMonotonicNs() + __Milliseconds__ * NsPerMsec;
+
+    if (!GetCurrentThreadLocal())
     {
         PWarn("Sleep Halt loop Has been jumped!\n");
 
         /* Busy wait fallback using halt instruction */
-        uint64_t WakeupTime = GetSystemTicks() + __Milliseconds__;
-        while (GetSystemTicks() < WakeupTime)
+        while (ClockMonotonicNs() < Deadline)
         {
             __asm__ volatile("hlt");
         }
+        return;
     }
+
+    /* Only an early wake returns short, sleep out the rest */
+    do
+    {
+        ThreadSleepPrepare(Deadline);
+    } while (ThreadSleepCommit() != 0);
 }
 
 void
@@ -609,21 +700,20 @@ ThreadExit(uint32_t __ExitCode__)
 Thread*
 FindThreadById(uint32_t __ThreadId__)
 {
-    AcquireSpinLock(&ThreadListLock);
+    AcquireSpinLock(&__ThreadHashLock__);
 
-    Thread* Current = ThreadList;
-    while (Current)
+    Thread* Current = __ThreadHash__[__ThreadId__ & (ThreadHashBuckets - 1)];
+    while (Current && Current->ThreadId != __ThreadId__)
     {
-        if (Current->ThreadId == __ThreadId__)
-        {
-            ReleaseSpinLock(&ThreadListLock);
-            return Current;
-        }
-        Current = Current->Next;
+        Current = Current->HashNext;
+    }
+    if (Current)
+    {
+        __atomic_fetch_add(&Current->Refs, 1, __ATOMIC_ACQ_REL);
     }
 
-    ReleaseSpinLock(&ThreadListLock);
-    return NULL;
+    ReleaseSpinLock(&__ThreadHashLock__);
+    return Current;
 }
 
 uint32_t
@@ -643,28 +733,6 @@ GetThreadCount(void)
     return Count;
 }
 
-void
-WakeSleepingThreads(void)
-{
-    uint64_t CurrentTicks = GetSystemTicks();
-
-    AcquireSpinLock(&ThreadListLock);
-    Thread* Current = ThreadList;
-
-    while (Current)
-    {
-        if (Current->State == ThreadStateSleeping && Current->WakeupTime <= CurrentTicks)
-        {
-            Current->State      = ThreadStateReady;
-            Current->WaitReason = WaitReasonNone;
-            Current->WakeupTime = 0;
-        }
-        Current = Current->Next;
-    }
-
-    ReleaseSpinLock(&ThreadListLock);
-}
-
 void
 DumpThreadInfo(Thread* __ThreadPtr__)
 {
@@ -678,7 +746,7 @@ DumpThreadInfo(Thread* __ThreadPtr__)
           __ThreadPtr__->State,
           __ThreadPtr__->Type,
           __ThreadPtr__->Priority);
-    PInfo("  CPU Time: %llu, Context Switches: %llu\n",
+    PInfo("  CPU Time: %llu ns, Context Switches: %llu\n",
           __ThreadPtr__->CpuTime,
           __ThreadPtr__->ContextSwitches);
     PInfo("  Stack: K=0x%llx U=0x%llx Size=%u\n",
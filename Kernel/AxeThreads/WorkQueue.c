@@ -0,0 +1,171 @@
+#include <AxeSchd.h>    /* Ready queue placement of the workers */
+#include <AxeThreads.h> /* Worker threads */
+#include <SMP.h>        /* Online CPU count */
+#include <String.h>     /* Worker names */
+#include <WorkQueue.h>  /* Work queue interfaces */
+
+static WorkQueueCpu      __WorkQueues__[MaxCPUs];
+static volatile uint32_t __WorkQueuesReady__ = 0;
+
+static void
+__WorkerMain__(void* __Argument__)
+{
+    WorkQueueCpu* Queue = (WorkQueueCpu*)__Argument__;
+
+    PDebug("WorkQueue: worker for CPU %u started\n", Queue->CpuId);
+
+    for (;;)
+    {
+        WaitQueuePrepare(&Queue->Wait, WaitReasonIo, 0);
+
+        /* Take the whole list at once, items queued meanwhile form the next batch */
+        AcquireSpinLock(&Queue->Lock);
+        WorkItem* Batch = Queue->Head;
+        Queue->Head     = NULL;
+        Queue->Tail     = NULL;
+        ReleaseSpinLock(&Queue->Lock);
+
+        if (!Batch)
+        {
+            WaitQueueCommit(&Queue->Wait);
+            continue;
+        }
+        WaitQueueCancel(&Queue->Wait);
+
+        uint64_t Count = 0;
+        while (Batch)
+        {
+            WorkItem* Next = Batch->Next;
+
+            /* Cleared before the call so the function may requeue its own item */
+            Batch->Next = NULL;
+            __atomic_store_n(&Batch->Pending, 0, __ATOMIC_RELEASE);
+            Batch->Func(Batch->Arg);
+
+            Count++;
+            Batch = Next;
+        }
+
+        /* Only this worker writes MaxBatch, the store just has to be whole for readers */
+        __atomic_fetch_add(&Queue->Executed, Count, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&Queue->Batches, 1, __ATOMIC_RELAXED);
+        if (Count > __atomic_load_n(&Queue->MaxBatch, __ATOMIC_RELAXED))
+        {
+            __atomic_store_n(&Queue->MaxBatch, Count, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+void
+InitializeWorkQueues(void)
+{
+    for (uint32_t CpuIndex = 0; CpuIndex < MaxCPUs; CpuIndex++)
+    {
+        WorkQueueCpu* Queue = &__WorkQueues__[CpuIndex];
+
+        InitializeSpinLock(&Queue->Lock, "WorkQueue");
+        InitializeWaitQueue(&Queue->Wait, "WorkQueue");
+        Queue->Head     = NULL;
+        Queue->Tail     = NULL;
+        Queue->Worker   = NULL;
+        Queue->CpuId    = CpuIndex;
+        Queue->Queued   = 0;
+        Queue->Executed = 0;
+        Queue->Batches  = 0;
+        Queue->MaxBatch = 0;
+    }
+
+    /* One pinned worker per CPU, items run where they were queued */
+    for (uint32_t CpuIndex = 0; CpuIndex < Smp.CpuCount; CpuIndex++)
+    {
+        WorkQueueCpu* Queue = &__WorkQueues__[CpuIndex];
+
+        Thread* Worker =
+            CreateThread(ThreadTypeKernel, __WorkerMain__, Queue, ThreadPrioritykernel);
+        if (!Worker)
+        {
+            PError("WorkQueue: Failed to create worker for CPU %u\n", CpuIndex);
+            continue;
+        }
+
+        char Num[16];
+        UnsignedToStringEx(CpuIndex, Num, 10, 0);
+        StringCopy(Worker->Name, "kworker/", sizeof(Worker->Name));
+        StringCopy(Worker->Name + sizeof("kworker/") - 1,
+                   Num,
+                   sizeof(Worker->Name) - (sizeof("kworker/") - 1));
+        Worker->Flags |= ThreadFlagSystem | ThreadFlagPinned;
+        SetThreadAffinity(Worker, CpuIndex < 32 ? (1U << CpuIndex) : 0xFFFFFFFF);
+        Worker->LastCpu = CpuIndex;
+        Worker->State   = ThreadStateReady;
+        Queue->Worker   = Worker;
+
+        AddThreadToReadyQueue(CpuIndex, Worker);
+    }
+
+    __atomic_store_n(&__WorkQueuesReady__, 1, __ATOMIC_RELEASE);
+
+    PSuccess("Work queues initialized for %u CPUs\n", Smp.CpuCount);
+}
+
+void
+InitWorkItem(WorkItem* __Item__, WorkFunc __Func__, void* __Arg__)
+{
+    __Item__->Next    = NULL;
+    __Item__->Func    = __Func__;
+    __Item__->Arg     = __Arg__;
+    __Item__->Pending = 0;
+}
+
+bool
+QueueWorkOn(uint32_t __CpuId__, WorkItem* __Item__)
+{
+    if (!__Item__ || !__Item__->Func || __CpuId__ >= MaxCPUs ||
+        !__atomic_load_n(&__WorkQueuesReady__, __ATOMIC_ACQUIRE))
+    {
+        return false;
+    }
+
+    /* Already waiting to run, it will see whatever state the caller just set */
+    if (__atomic_exchange_n(&__Item__->Pending, 1, __ATOMIC_ACQ_REL))
+    {
+        return false;
+    }
+
+    WorkQueueCpu* Queue = &__WorkQueues__[__CpuId__];
+
+    AcquireSpinLock(&Queue->Lock);
+    __Item__->Next = NULL;
+    if (Queue->Tail)
+    {
+        Queue->Tail->Next = __Item__;
+    }
+    else
+    {
+        Queue->Head = __Item__;
+    }
+    Queue->Tail = __Item__;
+    __atomic_fetch_add(&Queue->Queued, 1, __ATOMIC_RELAXED);
+    ReleaseSpinLock(&Queue->Lock);
+
+    /* Safe from IRQ context, WakeThread only takes spinlocks */
+    WaitQueueWakeOne(&Queue->Wait);
+    return true;
+}
+
+int
+WorkQueueStatsRead(uint32_t __CpuId__, WorkQueueTotals* __Out__)
+{
+    if (__CpuId__ >= MaxCPUs || !__Out__)
+    {
+        return -1;
+    }
+
+    /* Unlocked, a reader may see an item queued but not yet counted as run */
+    WorkQueueCpu* Queue = &__WorkQueues__[__CpuId__];
+    __Out__->Queued     = __atomic_load_n(&Queue->Queued, __ATOMIC_RELAXED);
+    __Out__->Executed   = __atomic_load_n(&Queue->Executed, __ATOMIC_RELAXED);
+    __Out__->Batches    = __atomic_load_n(&Queue->Batches, __ATOMIC_RELAXED);
+    __Out__->MaxBatch   = __atomic_load_n(&Queue->MaxBatch, __ATOMIC_RELAXED);
+    return 0;
+}
@@ -111,6 +111,108 @@ BlkDiskWriteBlocks(void* __Ctx__, uint64_t __Lba__, const void* __Buf__, long __
     return (put < 0) ? 0 : put;
 }
 
+/*
+ * Scatter-gather over whole blocks of the disk, clamped to Max blocks. One
+ * driver request when the controller takes iovecs and the list fits,
+ * otherwise one ReadBlocks/WriteBlocks per segment.
+ */
+static long
+__BlkIter__(BlockDisk*      __D__,
+            uint64_t        __DiskLba__,
+            uint64_t        __Max__,
+            const VfsIovec* __Iov__,
+            long            __Cnt__,
+            int             __Write__)
+{
+    long     Blk   = __D__->BlockSize;
+    uint64_t Total = 0;
+
+    for (long I = 0; I < __Cnt__; I++)
+    {
+        Total += (uint64_t)(__Iov__[I].IovLen / (size_t)Blk);
+    }
+
+    if (Total <= __Max__ && (__Write__ ? __D__->Ops.WriteBlocksIter : __D__->Ops.ReadBlocksIter))
+    {
+        long Done =
+            __Write__ ? __D__->Ops.WriteBlocksIter(__D__->CtrlCtx, __DiskLba__, __Iov__, __Cnt__)
+                      : __D__->Ops.ReadBlocksIter(__D__->CtrlCtx, __DiskLba__, __Iov__, __Cnt__);
+        return (Done < 0) ? 0 : Done;
+    }
+
+    long Done = 0;
+    for (long I = 0; I < __Cnt__ && (uint64_t)Done < __Max__; I++)
+    {
+        long Count = (long)(__Iov__[I].IovLen / (size_t)Blk);
+        if (!Count)
+        {
+            continue;
+        }
+        if ((uint64_t)Count > __Max__ - (uint64_t)Done)
+        {
+            Count = (long)(__Max__ - (uint64_t)Done);
+        }
+
+        uint64_t Lba = __DiskLba__ + (uint64_t)Done;
+        long     R   = __Write__
+                           ? __D__->Ops.WriteBlocks(__D__->CtrlCtx, Lba, __Iov__[I].IovBase, Count)
+                           : __D__->Ops.ReadBlocks(__D__->CtrlCtx, Lba, __Iov__[I].IovBase, Count);
+        if (R > 0)
+        {
+            Done += R;
+        }
+        if (R != Count)
+        {
+            break;
+        }
+    }
+    return Done;
+}
+
+static long
+BlkDiskReadBlocksIter(void* __Ctx__, uint64_t __Lba__, const VfsIovec* __Iov__, long __Cnt__)
+{
+    BlockDisk* D = (BlockDisk*)__Ctx__;
+    PDebug("BLK: DiskReadIter ctx=%p lba=%llu segs=%ld\n",
+           __Ctx__,
+           (unsigned long long)__Lba__,
+           __Cnt__);
+
+    if (!D || !__Iov__ || __Cnt__ <= 0 || __Lba__ >= D->TotalBlocks)
+    {
+        return 0;
+    }
+    if (!D->Ops.ReadBlocks || !D->CtrlCtx)
+    {
+        PError("BLK: DiskReadIter missing ops/cctx\n");
+        return 0;
+    }
+
+    return __BlkIter__(D, __Lba__, D->TotalBlocks - __Lba__, __Iov__, __Cnt__, 0);
+}
+
+static long
+BlkDiskWriteBlocksIter(void* __Ctx__, uint64_t __Lba__, const VfsIovec* __Iov__, long __Cnt__)
+{
+    BlockDisk* D = (BlockDisk*)__Ctx__;
+    PDebug("BLK: DiskWriteIter ctx=%p lba=%llu segs=%ld\n",
+           __Ctx__,
+           (unsigned long long)__Lba__,
+           __Cnt__);
+
+    if (!D || !__Iov__ || __Cnt__ <= 0 || __Lba__ >= D->TotalBlocks)
+    {
+        return 0;
+    }
+    if (!D->Ops.WriteBlocks || !D->CtrlCtx)
+    {
+        PError("BLK: DiskWriteIter missing ops/cctx\n");
+        return 0;
+    }
+
+    return __BlkIter__(D, __Lba__, D->TotalBlocks - __Lba__, __Iov__, __Cnt__, 1);
+}
+
 static int
 BlkDiskIoctl(void* __Ctx__, unsigned long __Cmd__, void* __Arg__)
 {
@@ -239,6 +341,52 @@ BlkPartWriteBlocks(void* __Ctx__, uint64_t __Lba__, const void* __Buf__, long __
     return (put < 0) ? 0 : put;
 }
 
+static long
+BlkPartReadBlocksIter(void* __Ctx__, uint64_t __Lba__, const VfsIovec* __Iov__, long __Cnt__)
+{
+    BlockPart* P = (BlockPart*)__Ctx__;
+    BlockDisk* D = P ? P->Parent : 0;
+    PDebug("BLK: PartReadIter ctx=%p lba=%llu segs=%ld\n",
+           __Ctx__,
+           (unsigned long long)__Lba__,
+           __Cnt__);
+
+    if (!P || !D || !__Iov__ || __Cnt__ <= 0 || __Lba__ >= P->NumBlocks)
+    {
+        return 0;
+    }
+    if (!D->Ops.ReadBlocks || !D->CtrlCtx)
+    {
+        PError("BLK: PartReadIter missing parent ops/cctx\n");
+        return 0;
+    }
+
+    return __BlkIter__(D, P->StartLba + __Lba__, P->NumBlocks - __Lba__, __Iov__, __Cnt__, 0);
+}
+
+static long
+BlkPartWriteBlocksIter(void* __Ctx__, uint64_t __Lba__, const VfsIovec* __Iov__, long __Cnt__)
+{
+    BlockPart* P = (BlockPart*)__Ctx__;
+    BlockDisk* D = P ? P->Parent : 0;
+    PDebug("BLK: PartWriteIter ctx=%p lba=%llu segs=%ld\n",
+           __Ctx__,
+           (unsigned long long)__Lba__,
+           __Cnt__);
+
+    if (!P || !D || !__Iov__ || __Cnt__ <= 0 || __Lba__ >= P->NumBlocks)
+    {
+        return 0;
+    }
+    if (!D->Ops.WriteBlocks || !D->CtrlCtx)
+    {
+        PError("BLK: PartWriteIter missing parent ops/cctx\n");
+        return 0;
+    }
+
+    return __BlkIter__(D, P->StartLba + __Lba__, P->NumBlocks - __Lba__, __Iov__, __Cnt__, 1);
+}
+
 static int
 BlkPartIoctl(void* __Ctx__, unsigned long __Cmd__, void* __Arg__)
 {
@@ -273,12 +421,14 @@ BlockRegisterDisk(BlockDisk* __Disk__)
            (void*)__Disk__->Ops.Ioctl,
            __Disk__->BlockSize);
 
-    BlockDevOps Ops = {.Open        = BlkDiskOpen,
-                       .Close       = BlkDiskClose,
-                       .ReadBlocks  = BlkDiskReadBlocks,
-                       .WriteBlocks = BlkDiskWriteBlocks,
-                       .Ioctl       = BlkDiskIoctl,
-                       .BlockSize   = __Disk__->BlockSize};
+    BlockDevOps Ops = {.Open            = BlkDiskOpen,
+                       .Close           = BlkDiskClose,
+                       .ReadBlocks      = BlkDiskReadBlocks,
+                       .WriteBlocks     = BlkDiskWriteBlocks,
+                       .Ioctl           = BlkDiskIoctl,
+                       .ReadBlocksIter  = BlkDiskReadBlocksIter,
+                       .WriteBlocksIter = BlkDiskWriteBlocksIter,
+                       .BlockSize       = __Disk__->BlockSize};
 
     int DiskRC = DevFsRegisterBlockDevice(__Disk__->Name, 8, 0, Ops, (void*)__Disk__);
     if (DiskRC != 0)
@@ -310,12 +460,14 @@ BlockRegisterPartition(BlockPart* __Part__)
            __Part__->Parent ? __Part__->Parent->CtrlCtx : 0,
            __Part__->BlockSize);
 
-    BlockDevOps Ops = {.Open        = BlkPartOpen,
-                       .Close       = BlkPartClose,
-                       .ReadBlocks  = BlkPartReadBlocks,
-                       .WriteBlocks = BlkPartWriteBlocks,
-                       .Ioctl       = BlkPartIoctl,
-                       .BlockSize   = __Part__->BlockSize};
+    BlockDevOps Ops = {.Open            = BlkPartOpen,
+                       .Close           = BlkPartClose,
+                       .ReadBlocks      = BlkPartReadBlocks,
+                       .WriteBlocks     = BlkPartWriteBlocks,
+                       .Ioctl           = BlkPartIoctl,
+                       .ReadBlocksIter  = BlkPartReadBlocksIter,
+                       .WriteBlocksIter = BlkPartWriteBlocksIter,
+                       .BlockSize       = __Part__->BlockSize};
 
     int DiskRC = DevFsRegisterBlockDevice(__Part__->Name, 8, 0, Ops, (void*)__Part__);
     if (DiskRC != 0)
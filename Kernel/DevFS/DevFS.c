@@ -12,47 +12,58 @@ static long         __DevCount__ = 0;
 static Superblock* __DevSuper__ = 0;
 
 /* Forward declarations of VnodeOps and SuperOps */
-static int    DevVfsOpen(Vnode* __Node__, File* __File__);
-static int    DevVfsClose(File* __File__);
-static long   DevVfsRead(File* __File__, void* __Buf__, long __Len__);
-static long   DevVfsWrite(File* __File__, const void* __Buf__, long __Len__);
-static long   DevVfsLseek(File* __File__, long __Off__, int __Whence__);
-static int    DevVfsIoctl(File* __File__, unsigned long __Cmd__, void* __Arg__);
-static int    DevVfsStat(Vnode* __Node__, VfsStat* __Out__);
-static long   DevVfsReaddir(Vnode* __Dir__, void* __Buf__, long __BufLen__);
-static Vnode* DevVfsLookup(Vnode* __Dir__, const char* __Name__);
-static int    DevVfsCreate(Vnode* __Dir__, const char* __Name__, long __Flags__, VfsPerm __Perm__);
-static int    DevVfsMkdir(Vnode* __Dir__, const char* __Name__, VfsPerm __Perm__);
-static int    DevVfsSync(Vnode* __Node__);
-static int    DevVfsSuperSync(Superblock* __Sb__);
-static int    DevVfsSuperStatFs(Superblock* __Sb__, VfsStatFs* __Out__);
-static void   DevVfsSuperRelease(Superblock* __Sb__);
-static int    DevVfsSuperUmount(Superblock* __Sb__);
+static int      DevVfsOpen(Vnode* __Node__, File* __File__);
+static int      DevVfsClose(File* __File__);
+static long     DevVfsRead(File* __File__, void* __Buf__, long __Len__);
+static long     DevVfsWrite(File* __File__, const void* __Buf__, long __Len__);
+static long     DevVfsReadIter(File* __File__, const VfsIovec* __Iov__, long __Cnt__);
+static long     DevVfsWriteIter(File* __File__, const VfsIovec* __Iov__, long __Cnt__);
+static long     DevVfsLseek(File* __File__, long __Off__, int __Whence__);
+static int      DevVfsIoctl(File* __File__, unsigned long __Cmd__, void* __Arg__);
+static uint32_t DevVfsPoll(File* __File__, WaitQueue** __Queue__);
+static int      DevVfsStat(Vnode* __Node__, VfsStat* __Out__);
+static long     DevVfsReaddir(Vnode* __Dir__, void* __Buf__, long __BufLen__);
+static long     DevVfsIterate(File* __Dir__, VfsDirCtx* __Ctx__);
+static Vnode*   DevVfsLookup(Vnode* __Dir__, const char* __Name__);
+static int      DevVfsCreate(Vnode*      __Dir__,
+                             const char* __Name__,
+                             long        __Flags__,
+                             VfsPerm     __Perm__);
+static int      DevVfsMkdir(Vnode* __Dir__, const char* __Name__, VfsPerm __Perm__);
+static int      DevVfsSync(Vnode* __Node__);
+static int      DevVfsSuperSync(Superblock* __Sb__);
+static int      DevVfsSuperStatFs(Superblock* __Sb__, VfsStatFs* __Out__);
+static void     DevVfsSuperRelease(Superblock* __Sb__);
+static int      DevVfsSuperUmount(Superblock* __Sb__);
 
 /* Ops tables */
-static const VnodeOps __DevVfsOps__ = {.Open     = DevVfsOpen,
-                                       .Close    = DevVfsClose,
-                                       .Read     = DevVfsRead,
-                                       .Write    = DevVfsWrite,
-                                       .Lseek    = DevVfsLseek,
-                                       .Ioctl    = DevVfsIoctl,
-                                       .Stat     = DevVfsStat,
-                                       .Readdir  = DevVfsReaddir,
-                                       .Lookup   = DevVfsLookup,
-                                       .Create   = DevVfsCreate,
-                                       .Unlink   = 0,
-                                       .Mkdir    = DevVfsMkdir,
-                                       .Rmdir    = 0,
-                                       .Symlink  = 0,
-                                       .Readlink = 0,
-                                       .Link     = 0,
-                                       .Rename   = 0,
-                                       .Chmod    = 0,
-                                       .Chown    = 0,
-                                       .Truncate = 0,
-                                       .Sync     = DevVfsSync,
-                                       .Map      = 0,
-                                       .Unmap    = 0};
+static const VnodeOps __DevVfsOps__ = {.Open      = DevVfsOpen,
+                                       .Close     = DevVfsClose,
+                                       .Read      = DevVfsRead,
+                                       .Write     = DevVfsWrite,
+                                       .Lseek     = DevVfsLseek,
+                                       .Ioctl     = DevVfsIoctl,
+                                       .Stat      = DevVfsStat,
+                                       .Readdir   = DevVfsReaddir,
+                                       .Lookup    = DevVfsLookup,
+                                       .Create    = DevVfsCreate,
+                                       .Unlink    = 0,
+                                       .Mkdir     = DevVfsMkdir,
+                                       .Rmdir     = 0,
+                                       .Symlink   = 0,
+                                       .Readlink  = 0,
+                                       .Link      = 0,
+                                       .Rename    = 0,
+                                       .Chmod     = 0,
+                                       .Chown     = 0,
+                                       .Truncate  = 0,
+                                       .Sync      = DevVfsSync,
+                                       .Map       = 0,
+                                       .Unmap     = 0,
+                                       .Poll      = DevVfsPoll,
+                                       .ReadIter  = DevVfsReadIter,
+                                       .WriteIter = DevVfsWriteIter,
+                                       .Iterate   = DevVfsIterate};
 
 static const SuperOps __DevVfsSuperOps__ = {.Sync    = DevVfsSuperSync,
                                             .StatFs  = DevVfsSuperStatFs,
@@ -368,89 +379,258 @@ DevVfsClose(File* __File__)
     return 0;
 }
 
+/* Byte stream over a block device through a one-block bounce, for unaligned spans */
 static long
-DevVfsRead(File* __File__, void* __Buf__, long __Len__)
+__DevBlockRead__(DevFsFileCtx* __FC__, void* __Buf__, long __Len__)
 {
-    if (!__File__ || !__Buf__ || __Len__ <= 0)
+    const DeviceEntry* Dev = __FC__->Dev;
+    long               Blk = Dev->Ops.B.BlockSize;
+
+    uint8_t* Dst       = (uint8_t*)__Buf__;
+    long     Remaining = __Len__;
+    long     Total     = 0;
+
+    void* Tmp = KMalloc((size_t)Blk);
+    if (!Tmp)
     {
         return -1;
     }
 
-    DevFsFileCtx* FC = (DevFsFileCtx*)__File__->Priv;
-    if (!FC || !FC->Dev)
+    while (Remaining > 0)
+    {
+        long ToRead = Remaining;
+        if (ToRead > Blk - __FC__->Offset)
+        {
+            ToRead = Blk - __FC__->Offset;
+        }
+
+        long rb = Dev->Ops.B.ReadBlocks(Dev->Context, __FC__->Lba, Tmp, 1);
+        if (rb != 1)
+        {
+            break;
+        }
+
+        __builtin_memcpy(Dst + Total, (uint8_t*)Tmp + __FC__->Offset, (size_t)ToRead);
+
+        Total += ToRead;
+        Remaining -= ToRead;
+        __FC__->Offset += ToRead;
+
+        if (__FC__->Offset >= Blk)
+        {
+            __FC__->Offset = 0;
+            __FC__->Lba++;
+        }
+    }
+
+    KFree(Tmp);
+    return Total;
+}
+
+static long
+__DevBlockWrite__(DevFsFileCtx* __FC__, const void* __Buf__, long __Len__)
+{
+    const DeviceEntry* Dev = __FC__->Dev;
+    long               Blk = Dev->Ops.B.BlockSize;
+
+    const uint8_t* Src       = (const uint8_t*)__Buf__;
+    long           Remaining = __Len__;
+    long           Total     = 0;
+
+    void* Tmp = KMalloc((size_t)Blk);
+    if (!Tmp)
     {
         return -1;
     }
 
-    if (FC->Dev->Type == DevChar)
+    while (Remaining > 0)
     {
-        if (!FC->Dev->Ops.C.Read)
+        long ToWrite = Remaining;
+        if (ToWrite > Blk - __FC__->Offset)
         {
-            return -1;
+            ToWrite = Blk - __FC__->Offset;
         }
-        long r = FC->Dev->Ops.C.Read(FC->Dev->Context, __Buf__, __Len__);
-        if (r > 0)
+
+        /* Read-modify-write a partial block to preserve untouched bytes */
+        if (ToWrite < Blk)
         {
-            __File__->Offset += r;
+            long rb = Dev->Ops.B.ReadBlocks(Dev->Context, __FC__->Lba, Tmp, 1);
+            if (rb != 1)
+            {
+                __builtin_memset(Tmp, 0, (size_t)Blk);
+            }
+        }
+
+        __builtin_memcpy((uint8_t*)Tmp + __FC__->Offset, Src + Total, (size_t)ToWrite);
+
+        long wb = Dev->Ops.B.WriteBlocks(Dev->Context, __FC__->Lba, Tmp, 1);
+        if (wb != 1)
+        {
+            break;
+        }
+
+        Total += ToWrite;
+        Remaining -= ToWrite;
+        __FC__->Offset += ToWrite;
+
+        if (__FC__->Offset >= Blk)
+        {
+            __FC__->Offset = 0;
+            __FC__->Lba++;
         }
-        return r;
     }
 
-    if (FC->Dev->Type == DevBlock)
+    KFree(Tmp);
+    return Total;
+}
+
+/* Cursor on a block boundary and every segment whole blocks, the driver can take it directly */
+static int
+__DevBlockAligned__(DevFsFileCtx* __FC__, const VfsIovec* __Iov__, long __Cnt__)
+{
+    long Blk = __FC__->Dev->Ops.B.BlockSize;
+    if (__FC__->Offset)
+    {
+        return 0;
+    }
+
+    for (long I = 0; I < __Cnt__; I++)
     {
-        if (!FC->Dev->Ops.B.ReadBlocks)
+        if (__Iov__[I].IovLen % (size_t)Blk)
         {
-            return -1;
+            return 0;
         }
+    }
+    return 1;
+}
 
-        /* Raw streaming over blocks: compute block span */
-        long Blk = FC->Dev->Ops.B.BlockSize;
-        if (Blk <= 0)
+/* Whole-block list straight to the driver, one request when it takes iovecs */
+static long
+__DevBlockIter__(DevFsFileCtx* __FC__, const VfsIovec* __Iov__, long __Cnt__, int __Write__)
+{
+    const DeviceEntry* Dev  = __FC__->Dev;
+    long               Blk  = Dev->Ops.B.BlockSize;
+    long               Done = 0;
+
+    if (__Write__ ? Dev->Ops.B.WriteBlocksIter : Dev->Ops.B.ReadBlocksIter)
+    {
+        Done = __Write__ ? Dev->Ops.B.WriteBlocksIter(Dev->Context, __FC__->Lba, __Iov__, __Cnt__)
+                         : Dev->Ops.B.ReadBlocksIter(Dev->Context, __FC__->Lba, __Iov__, __Cnt__);
+        if (Done < 0)
         {
             return -1;
         }
+    }
+    else
+    {
+        for (long I = 0; I < __Cnt__; I++)
+        {
+            long Count = (long)(__Iov__[I].IovLen / (size_t)Blk);
+            if (!Count)
+            {
+                continue;
+            }
+
+            uint64_t Lba = __FC__->Lba + (uint64_t)Done;
+            void*    Buf = __Iov__[I].IovBase;
+            long     R   = __Write__ ? Dev->Ops.B.WriteBlocks(Dev->Context, Lba, Buf, Count)
+                                     : Dev->Ops.B.ReadBlocks(Dev->Context, Lba, Buf, Count);
+            if (R > 0)
+            {
+                Done += R;
+            }
+            if (R != Count)
+            {
+                break;
+            }
+        }
+    }
+
+    __FC__->Lba += (uint64_t)Done;
+    return Done * Blk;
+}
+
+static long
+DevVfsReadIter(File* __File__, const VfsIovec* __Iov__, long __Cnt__)
+{
+    if (!__File__ || !__Iov__ || __Cnt__ <= 0)
+    {
+        return -1;
+    }
 
-        uint8_t* Dst       = (uint8_t*)__Buf__;
-        long     Remaining = __Len__;
-        long     Total     = 0;
+    DevFsFileCtx* FC = (DevFsFileCtx*)__File__->Priv;
+    if (!FC || !FC->Dev)
+    {
+        return -1;
+    }
 
-        while (Remaining > 0)
+    if (FC->Dev->Type == DevChar)
+    {
+        if (FC->Dev->Ops.C.ReadIter)
+        {
+            return FC->Dev->Ops.C.ReadIter(FC->Dev->Context, __Iov__, __Cnt__);
+        }
+        if (!FC->Dev->Ops.C.Read)
         {
-            long ToRead = Remaining;
-            if (ToRead > Blk - FC->Offset)
+            return -1;
+        }
+
+        long Total = 0;
+        for (long I = 0; I < __Cnt__; I++)
+        {
+            if (!__Iov__[I].IovLen)
             {
-                ToRead = Blk - FC->Offset;
+                continue;
             }
 
-            /* Read one block into a temporary buffer then copy slice */
-            void* Tmp = KMalloc((size_t)Blk);
-            if (!Tmp)
+            long r = FC->Dev->Ops.C.Read(
+                FC->Dev->Context, __Iov__[I].IovBase, (long)__Iov__[I].IovLen);
+            if (r < 0)
             {
-                return (Total > 0) ? Total : -1;
+                return Total ? Total : r;
             }
 
-            long rb = FC->Dev->Ops.B.ReadBlocks(FC->Dev->Context, FC->Lba, Tmp, 1);
-            if (rb != 1)
+            Total += r;
+            if (r < (long)__Iov__[I].IovLen)
             {
-                KFree(Tmp);
                 break;
             }
+        }
+        return Total;
+    }
+
+    if (FC->Dev->Type == DevBlock)
+    {
+        if (!FC->Dev->Ops.B.ReadBlocks || FC->Dev->Ops.B.BlockSize <= 0)
+        {
+            return -1;
+        }
 
-            __builtin_memcpy(Dst + Total, (uint8_t*)Tmp + FC->Offset, (size_t)ToRead);
-            KFree(Tmp);
+        if (__DevBlockAligned__(FC, __Iov__, __Cnt__))
+        {
+            return __DevBlockIter__(FC, __Iov__, __Cnt__, 0);
+        }
 
-            Total += ToRead;
-            Remaining -= ToRead;
-            FC->Offset += ToRead;
+        long Total = 0;
+        for (long I = 0; I < __Cnt__; I++)
+        {
+            if (!__Iov__[I].IovLen)
+            {
+                continue;
+            }
 
-            if (FC->Offset >= Blk)
+            long r = __DevBlockRead__(FC, __Iov__[I].IovBase, (long)__Iov__[I].IovLen);
+            if (r < 0)
             {
-                FC->Offset = 0;
-                FC->Lba++;
+                return Total ? Total : r;
             }
-        }
 
-        __File__->Offset += Total;
+            Total += r;
+            if (r < (long)__Iov__[I].IovLen)
+            {
+                break;
+            }
+        }
         return Total;
     }
 
@@ -458,9 +638,9 @@ DevVfsRead(File* __File__, void* __Buf__, long __Len__)
 }
 
 static long
-DevVfsWrite(File* __File__, const void* __Buf__, long __Len__)
+DevVfsWriteIter(File* __File__, const VfsIovec* __Iov__, long __Cnt__)
 {
-    if (!__File__ || !__Buf__ || __Len__ <= 0)
+    if (!__File__ || !__Iov__ || __Cnt__ <= 0)
     {
         return -1;
     }
@@ -473,83 +653,103 @@ DevVfsWrite(File* __File__, const void* __Buf__, long __Len__)
 
     if (FC->Dev->Type == DevChar)
     {
+        if (FC->Dev->Ops.C.WriteIter)
+        {
+            return FC->Dev->Ops.C.WriteIter(FC->Dev->Context, __Iov__, __Cnt__);
+        }
         if (!FC->Dev->Ops.C.Write)
         {
             return -1;
         }
-        long w = FC->Dev->Ops.C.Write(FC->Dev->Context, __Buf__, __Len__);
-        if (w > 0)
+
+        long Total = 0;
+        for (long I = 0; I < __Cnt__; I++)
         {
-            __File__->Offset += w;
+            if (!__Iov__[I].IovLen)
+            {
+                continue;
+            }
+
+            long w = FC->Dev->Ops.C.Write(
+                FC->Dev->Context, __Iov__[I].IovBase, (long)__Iov__[I].IovLen);
+            if (w < 0)
+            {
+                return Total ? Total : w;
+            }
+
+            Total += w;
+            if (w < (long)__Iov__[I].IovLen)
+            {
+                break;
+            }
         }
-        return w;
+        return Total;
     }
 
     if (FC->Dev->Type == DevBlock)
     {
-        if (!FC->Dev->Ops.B.WriteBlocks)
+        if (!FC->Dev->Ops.B.WriteBlocks || !FC->Dev->Ops.B.ReadBlocks ||
+            FC->Dev->Ops.B.BlockSize <= 0)
         {
             return -1;
         }
 
-        long Blk = FC->Dev->Ops.B.BlockSize;
-        if (Blk <= 0)
+        if (__DevBlockAligned__(FC, __Iov__, __Cnt__))
         {
-            return -1;
+            return __DevBlockIter__(FC, __Iov__, __Cnt__, 1);
         }
 
-        const uint8_t* Src       = (const uint8_t*)__Buf__;
-        long           Remaining = __Len__;
-        long           Total     = 0;
-
-        while (Remaining > 0)
+        long Total = 0;
+        for (long I = 0; I < __Cnt__; I++)
         {
-            long ToWrite = Remaining;
-            if (ToWrite > Blk - FC->Offset)
+            if (!__Iov__[I].IovLen)
             {
-                ToWrite = Blk - FC->Offset;
+                continue;
             }
 
-            void* Tmp = KMalloc((size_t)Blk);
-            if (!Tmp)
+            long w = __DevBlockWrite__(FC, __Iov__[I].IovBase, (long)__Iov__[I].IovLen);
+            if (w < 0)
             {
-                return (Total > 0) ? Total : -1;
+                return Total ? Total : w;
             }
 
-            /* Read-modify-write current block to preserve untouched bytes */
-            long rb = FC->Dev->Ops.B.ReadBlocks(FC->Dev->Context, FC->Lba, Tmp, 1);
-            if (rb != 1)
-            {
-                __builtin_memset(Tmp, 0, (size_t)Blk);
-            }
-
-            __builtin_memcpy((uint8_t*)Tmp + FC->Offset, Src + Total, (size_t)ToWrite);
-
-            long wb = FC->Dev->Ops.B.WriteBlocks(FC->Dev->Context, FC->Lba, Tmp, 1);
-            KFree(Tmp);
-            if (wb != 1)
+            Total += w;
+            if (w < (long)__Iov__[I].IovLen)
             {
                 break;
             }
-
-            Total += ToWrite;
-            Remaining -= ToWrite;
-            FC->Offset += ToWrite;
-
-            if (FC->Offset >= Blk)
-            {
-                FC->Offset = 0;
-                FC->Lba++;
-            }
         }
-
-        __File__->Offset += Total;
         return Total;
     }
 
     return -1;
 }
 
+/* Plain read and write are the one-segment case, File->Offset is advanced by the VFS */
+static long
+DevVfsRead(File* __File__, void* __Buf__, long __Len__)
+{
+    if (!__Buf__ || __Len__ <= 0)
+    {
+        return -1;
+    }
+
+    VfsIovec Seg = {.IovBase = __Buf__, .IovLen = (size_t)__Len__};
+    return DevVfsReadIter(__File__, &Seg, 1);
+}
+
+static long
+DevVfsWrite(File* __File__, const void* __Buf__, long __Len__)
+{
+    if (!__Buf__ || __Len__ <= 0)
+    {
+        return -1;
+    }
+
+    VfsIovec Seg = {.IovBase = (void*)__Buf__, .IovLen = (size_t)__Len__};
+    return DevVfsWriteIter(__File__, &Seg, 1);
+}
+
 static long
 DevVfsLseek(File* __File__, long __Off__, int __Whence__)
 {
@@ -558,6 +758,13 @@ DevVfsLseek(File* __File__, long __Off__, int __Whence__)
         return -1;
     }
 
+    /* A directory seeks its readdir cursor, an entry index with no end to seek from */
+    if (__File__->Node && __File__->Node->Type == VNodeDIR)
+    {
+        long Pos = (__Whence__ == VSeekCUR) ? __File__->Offset + __Off__ : __Off__;
+        return (__Whence__ == VSeekEND || Pos < 0) ? -1 : Pos;
+    }
+
     DevFsFileCtx* FC = (DevFsFileCtx*)__File__->Priv;
     if (!FC || !FC->Dev)
     {
@@ -649,6 +856,24 @@ DevVfsIoctl(File* __File__, unsigned long __Cmd__, void* __Arg__ /*Could have us
     return -1;
 }
 
+static uint32_t
+DevVfsPoll(File* __File__, WaitQueue** __Queue__)
+{
+    DevFsFileCtx* FC = (DevFsFileCtx*)__File__->Priv;
+    if (!FC || !FC->Dev)
+    {
+        return VfsPollNval;
+    }
+
+    if (FC->Dev->Type == DevChar && FC->Dev->Ops.C.Poll)
+    {
+        return FC->Dev->Ops.C.Poll(FC->Dev->Context, __Queue__);
+    }
+
+    /* Block devices and char drivers without a Poll op never block */
+    return VfsPollIn | VfsPollOut;
+}
+
 static int
 DevVfsStat(Vnode* __Node__, VfsStat* __Out__)
 {
@@ -762,6 +987,49 @@ DevVfsReaddir(Vnode* __Dir__, void* __Buf__, long __BufLen__)
     return Wrote * (long)sizeof(VfsDirEnt);
 }
 
+/* "." and ".." first, then device slot I at position I + 2 */
+static long
+DevVfsIterate(File* __Dir__, VfsDirCtx* __Ctx__)
+{
+    if (!__Dir__ || !__Dir__->Node || __Dir__->Node->Type != VNodeDIR || !__Ctx__)
+    {
+        return -1;
+    }
+
+    long Ino = (long)(uintptr_t)__Dir__->Node;
+    if (__Ctx__->Pos == 0)
+    {
+        if (!__Ctx__->Emit(__Ctx__, ".", 1, Ino, VNodeDIR))
+        {
+            return 0;
+        }
+        __Ctx__->Pos++;
+    }
+    if (__Ctx__->Pos == 1)
+    {
+        if (!__Ctx__->Emit(__Ctx__, "..", 2, Ino, VNodeDIR))
+        {
+            return 0;
+        }
+        __Ctx__->Pos++;
+    }
+
+    for (; __Ctx__->Pos >= 2 && __Ctx__->Pos - 2 < __DevCount__; __Ctx__->Pos++)
+    {
+        long         I = __Ctx__->Pos - 2;
+        DeviceEntry* E = __DevTable__[I];
+        if (!E)
+        {
+            continue;
+        }
+        if (!__Ctx__->Emit(__Ctx__, E->Name, (long)strlen(E->Name), I, VNodeDEV))
+        {
+            break;
+        }
+    }
+    return 0;
+}
+
 static Vnode*
 DevVfsLookup(Vnode* __Dir__, const char* __Name__)
 {
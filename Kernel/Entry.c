@@ -10,6 +10,9 @@ KernelWorkerThread(void* __Argument__)
 {
     PInfo("Kernel Worker: Started on CPU %u\n", GetCurrentCpuId());
 
+    /* Every CPU's scheduler is up by now, the per-CPU workers can be queued */
+    InitializeWorkQueues();
+
     ModMemInit();
     InitializeBootImage();
 
@@ -35,6 +38,7 @@ KernelWorkerThread(void* __Argument__)
     InitRamDiskDevDrvs();
 
     __TEST__Proc();
+    __TEST__PipeSplice();
 
     /*done*/
     ThreadExit(0);
@@ -64,31 +68,20 @@ _start(void)
         InitializeGdt();
         InitializeIdt();
 
-        unsigned long Cr0, Cr4;
-
-        /* Read CR0 and CR4 */
-        __asm__ volatile("mov %%cr0, %0" : "=r"(Cr0));
-        __asm__ volatile("mov %%cr4, %0" : "=r"(Cr4));
-
-        /* CR0: clear EM (bit 2), set MP (bit 1), clear TS (bit 3) */
-        Cr0 &= ~(1UL << 2); /* EM = 0 */
-        Cr0 |= (1UL << 1);  /* MP = 1 */
-        Cr0 &= ~(1UL << 3); /* TS = 0 */
-        __asm__ volatile("mov %0, %%cr0" ::"r"(Cr0) : "memory");
-
-        /* CR4: set OSFXSR (bit 9) and OSXMMEXCPT (bit 10) for SSE */
-        Cr4 |= (1UL << 9) | (1UL << 10);
-        __asm__ volatile("mov %0, %%cr4" ::"r"(Cr4) : "memory");
-
-        /* Initialize x87/SSE state */
-        __asm__ volatile("fninit");
+        /* x87/SSE and, when present, XSAVE with AVX/AVX-512 */
+        InitializeFpu();
 
         InitializePmm();
         InitializeVmm();
         InitializeKHeap();
 
+        /* Guarded kernel stacks, before any address space copies the upper half */
+        InitializeStackCache();
+
         InitializeTimer();
+        InitializeVdso();
         InitSyscall();
+        InitializeFutex();
         SetIdtEntry(0x80, (uint64_t)SysEntASM, KernelCodeSelector, 0xEE);
         InitializeThreadManager();
         InitializeSpinLock(&SMPLock, "SMP");
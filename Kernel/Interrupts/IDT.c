@@ -304,6 +304,10 @@ IRQ_STUB(14, 46)
 IRQ_STUB(15, 47)
 
 __asm__("IsrCommonStub:\n\t"
+        "testb $3, 24(%rsp)\n\t" /*From user mode? CS sits above vector, error and RIP*/
+        "jz 1f\n\t"
+        "swapgs\n\t" /*Bring in the kernel per-CPU GS base*/
+        "1:\n\t"
         "pushq %rax\n\t" /*Save general-purpose registers*/
         "pushq %rbx\n\t"
         "pushq %rcx\n\t"
@@ -337,10 +341,18 @@ __asm__("IsrCommonStub:\n\t"
         "popq %rbx\n\t"
         "popq %rax\n\t"
         "addq $16, %rsp\n\t" /*Remove error code and vector number from stack*/
-        "iretq\n\t"          /*Return from interrupt*/
+        "testb $3, 8(%rsp)\n\t" /*Returning to user mode, the frame may belong to another thread*/
+        "jz 2f\n\t"
+        "swapgs\n\t"
+        "2:\n\t"
+        "iretq\n\t" /*Return from interrupt*/
 );
 
 __asm__("IrqCommonStub:\n\t"
+        "testb $3, 24(%rsp)\n\t" /*From user mode? CS sits above vector, error and RIP*/
+        "jz 1f\n\t"
+        "swapgs\n\t" /*Bring in the kernel per-CPU GS base*/
+        "1:\n\t"
         "pushq %rax\n\t" /*Save general-purpose registers*/
         "pushq %rbx\n\t"
         "pushq %rcx\n\t"
@@ -374,5 +386,9 @@ __asm__("IrqCommonStub:\n\t"
         "popq %rbx\n\t"
         "popq %rax\n\t"
         "addq $16, %rsp\n\t" /*Remove dummy error code and vector number*/
-        "iretq\n\t"          /*Return from interrupt*/
+        "testb $3, 8(%rsp)\n\t" /*Returning to user mode, the frame may belong to another thread*/
+        "jz 2f\n\t"
+        "swapgs\n\t"
+        "2:\n\t"
+        "iretq\n\t" /*Return from interrupt*/
 );
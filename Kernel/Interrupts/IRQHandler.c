@@ -1,5 +1,8 @@
+#include <HPETTimer.h>
 #include <IDT.h>
+#include <SMP.h>
 #include <Timer.h>
+#include <WorkQueue.h>
 
 void
 IrqHandler(InterruptFrame* __Frame__)
@@ -11,6 +14,14 @@ IrqHandler(InterruptFrame* __Frame__)
         return;                  /*APIC handles its own EOI, no need for PIC EOI*/
     }
 
+    /*HPET one-shot, delivered as a message straight to the local APIC*/
+    if (__Frame__->IntNo == HpetOneShotVector)
+    {
+        HpetInterrupt();
+        SoftIrqRun(GetCurrentCpuId());
+        return;
+    }
+
     /*Legacy PIC interrupts - Handle EOI (End of Interrupt) signaling*/
     /*If interrupt came from slave PIC (vectors 40-47), send EOI to slave first*/
     if (__Frame__->IntNo >= 40)
@@ -19,4 +30,7 @@ IrqHandler(InterruptFrame* __Frame__)
     }
     /*Always send EOI to master PIC to acknowledge the interrupt*/
     __asm__ volatile("outb %0, %1" : : "a"((uint8_t)0x20), "Nd"((uint16_t)0x20));
+
+    /*Bottom halves raised by the handler, after EOI so the line can fire again*/
+    SoftIrqRun(GetCurrentCpuId());
 }
@@ -1,12 +1,41 @@
+#include <FpuState.h>
 #include <GDT.h>
 #include <IDT.h>
+#include <POSIXProc.h>
 #include <PerCPUData.h>
 #include <SMP.h>
+#include <StackCache.h>
 #include <SymAP.h>
+#include <VirtBin.h>
 
 void
 IsrHandler(InterruptFrame* __Frame__)
 {
+    /*Lazy FPU switch, not an error*/
+    if (__Frame__->IntNo == FpuVectorNm)
+    {
+        FpuHandleNm();
+        return;
+    }
+
+    /*Demand growth of the user stack, not an error either*/
+    if (__Frame__->IntNo == 14)
+    {
+        uint64_t FaultAddr;
+        __asm__ volatile("movq %%cr2, %0" : "=r"(FaultAddr));
+
+        PosixProc* Proc = PosixCurrent();
+        if (Proc && VirtStackFault(Proc->Space, FaultAddr, __Frame__->ErrCode) == 0)
+        {
+            Thread* Current = GetCurrentThreadLocal();
+            if (Current)
+            {
+                Current->PageFaults++;
+            }
+            return;
+        }
+    }
+
     /*Disable interrupts to prevent re-entrant exceptions during diagnostics*/
     __asm__ volatile("cli");
 
@@ -110,6 +139,18 @@ IsrHandler(InterruptFrame* __Frame__)
     /*Provide detailed analysis for specific exception types*/
     switch (__Frame__->IntNo)
     {
+        case 8: /*Double Fault - Usually a fault while pushing the frame of another*/
+            {
+                uint64_t cr2;
+                __asm__ volatile("movq %%cr2, %0" : "=r"(cr2));
+                if (StackIsGuardAddress(cr2))
+                {
+                    KrnPrintf("\nDOUBLE FAULT DETAILS:\n");
+                    KrnPrintf("  Kernel stack overflow into a guard page at 0x%016lx\n", cr2);
+                }
+            }
+            break;
+
         case 13: /*General Protection Fault - Most common protection violation*/
             KrnPrintf("\nGENERAL PROTECTION FAULT DETAILS:\n");
             if (__Frame__->ErrCode & 1)
@@ -183,6 +224,11 @@ IsrHandler(InterruptFrame* __Frame__)
                 }
 
                 KrnPrintf("\n");
+
+                if (StackIsGuardAddress(cr2))
+                {
+                    KrnPrintf("  Kernel stack overflow into a guard page\n");
+                }
             }
             break;
     }
@@ -0,0 +1,122 @@
+#include <SMP.h>       /* Symmetric multiprocessing functions */
+#include <WorkQueue.h> /* SoftIrq and work queue interfaces */
+
+static SoftIrqHandler    __SoftIrqHandlers__[SoftIrqCount];
+static volatile uint32_t __SoftIrqPending__[MaxCPUs];
+static volatile uint32_t __SoftIrqActive__[MaxCPUs];
+static volatile uint64_t __SoftIrqRuns__[SoftIrqCount];
+
+static const char* __SoftIrqNames__[SoftIrqCount] = {"timer"};
+
+/* Per-CPU item that lets the worker finish what an IRQ exit left behind */
+static WorkItem __SoftIrqDrain__[MaxCPUs];
+
+static void
+__SoftIrqDrainWork__(void* __Argument__)
+{
+    uint32_t CpuId = (uint32_t)(uint64_t)__Argument__;
+
+    /* Handlers expect interrupt context, keep this CPU's IRQs off while they run */
+    uint64_t Flags;
+    __asm__ volatile("pushfq; popq %0; cli" : "=r"(Flags)::"memory");
+    SoftIrqRun(CpuId);
+    __asm__ volatile("pushq %0; popfq" ::"r"(Flags) : "memory");
+}
+
+int
+SoftIrqRegister(SoftIrqVector __Vector__, SoftIrqHandler __Handler__)
+{
+    if ((uint32_t)__Vector__ >= SoftIrqCount || !__Handler__)
+    {
+        return -1;
+    }
+
+    if (__SoftIrqHandlers__[__Vector__])
+    {
+        PWarn("SoftIrq: vector %u already registered\n", (uint32_t)__Vector__);
+        return -1;
+    }
+
+    __atomic_store_n(&__SoftIrqHandlers__[__Vector__], __Handler__, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void
+SoftIrqRaiseOn(uint32_t __CpuId__, SoftIrqVector __Vector__)
+{
+    if (__CpuId__ >= MaxCPUs || (uint32_t)__Vector__ >= SoftIrqCount)
+    {
+        return;
+    }
+
+    /* No IPI, a remote CPU picks it up on its next interrupt exit */
+    __atomic_fetch_or(&__SoftIrqPending__[__CpuId__], 1U << __Vector__, __ATOMIC_RELEASE);
+}
+
+void
+SoftIrqRun(uint32_t __CpuId__)
+{
+    if (__CpuId__ >= MaxCPUs ||
+        !__atomic_load_n(&__SoftIrqPending__[__CpuId__], __ATOMIC_ACQUIRE))
+    {
+        return;
+    }
+
+    /* Not reentrant, a nested run leaves its bits for the outer loop */
+    if (__SoftIrqActive__[__CpuId__])
+    {
+        return;
+    }
+    __SoftIrqActive__[__CpuId__] = 1;
+
+    for (uint32_t Pass = 0; Pass < SoftIrqMaxRestart; Pass++)
+    {
+        uint32_t Pending =
+            __atomic_exchange_n(&__SoftIrqPending__[__CpuId__], 0, __ATOMIC_ACQ_REL);
+        if (!Pending)
+        {
+            break;
+        }
+
+        /* Everything raised so far runs in one batch, lowest vector first */
+        while (Pending)
+        {
+            uint32_t Vector = (uint32_t)__builtin_ctz(Pending);
+            Pending &= Pending - 1;
+
+            SoftIrqHandler Handler =
+                __atomic_load_n(&__SoftIrqHandlers__[Vector], __ATOMIC_ACQUIRE);
+            if (Handler)
+            {
+                Handler(__CpuId__);
+                __atomic_fetch_add(&__SoftIrqRuns__[Vector], 1, __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    __SoftIrqActive__[__CpuId__] = 0;
+
+    /* Handlers kept re-raising, bound the IRQ exit and let the worker continue */
+    if (__atomic_load_n(&__SoftIrqPending__[__CpuId__], __ATOMIC_ACQUIRE))
+    {
+        if (!__SoftIrqDrain__[__CpuId__].Func)
+        {
+            InitWorkItem(
+                &__SoftIrqDrain__[__CpuId__], __SoftIrqDrainWork__, (void*)(uint64_t)__CpuId__);
+        }
+        QueueWorkOn(__CpuId__, &__SoftIrqDrain__[__CpuId__]);
+    }
+}
+
+int
+SoftIrqStatsRead(uint32_t __Vector__, SoftIrqTotals* __Out__)
+{
+    if (__Vector__ >= SoftIrqCount || !__Out__)
+    {
+        return -1;
+    }
+
+    __Out__->Name = __SoftIrqNames__[__Vector__];
+    __Out__->Runs = __atomic_load_n(&__SoftIrqRuns__[__Vector__], __ATOMIC_RELAXED);
+    return 0;
+}
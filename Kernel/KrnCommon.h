@@ -7,8 +7,11 @@
 #include <BootConsole.h>
 #include <BootImg.h>
 #include <CharBus.h>
+#include <ClockSource.h>
 #include <DevFS.h>
 #include <EarlyBootFB.h>
+#include <FpuState.h>
+#include <Futex.h>
 #include <GDT.h>
 #include <IDT.h>
 #include <KExports.h>
@@ -24,15 +27,19 @@
 #include <POSIXSignals.h>
 #include <SMP.h>
 #include <Serial.h>
+#include <StackCache.h>
 #include <SymAP.h>
 #include <Sync.h>
 #include <Syscall.h>
 #include <Timer.h>
 #include <VFS.h>
 #include <VMM.h>
+#include <Vdso.h>
+#include <WorkQueue.h>
 
 /*for sensitive testing*/
 extern SpinLock TestLock;
 
 /*TEST handles*/
-void __TEST__Proc(void);
\ No newline at end of file
+void __TEST__Proc(void);
+void __TEST__PipeSplice(void);
\ No newline at end of file
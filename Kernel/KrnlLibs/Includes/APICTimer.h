@@ -9,6 +9,7 @@
 #define TimerApicRegTimerCurrCount 0x390
 #define TimerApicRegTimerDivide    0x3E0
 #define TimerApicRegEoi            0x0B0
+#define TimerApicTimerOneShot      (0 << 17)
 #define TimerApicTimerPeriodic     (1 << 17)
 #define TimerApicTimerMasked       (1 << 16)
 #define TimerApicTimerDivideBy16   0x03
\ No newline at end of file
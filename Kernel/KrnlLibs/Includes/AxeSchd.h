@@ -3,13 +3,12 @@
 #include <AxeThreads.h>
 #include <IDT.h>
 
-typedef struct
+typedef struct CpuScheduler
 {
     Thread*  ReadyQueue;      /*Ready queue*/
     Thread*  WaitingQueue;    /*Blocked threads*/
     Thread*  ZombieQueue;     /*Terminated threads*/
     Thread*  SleepingQueue;   /*Sleeping threads*/
-    Thread*  CurrentThread;   /*Currently running thread*/
     Thread*  NextThread;      /*Next thread to run*/
     Thread*  IdleThread;      /*Idle thread for this CPU*/
     uint32_t ThreadCount;     /*Total threads on this CPU*/
@@ -19,7 +18,9 @@ typedef struct
     uint64_t ScheduleTicks;   /*Schedule counter*/
     SpinLock SchedulerLock;   /*Protect scheduler state*/
     uint64_t ContextSwitches; /*Context switch count*/
-    uint64_t IdleTicks;       /*Time spent idle*/
+    uint64_t IdleTicks;       /*Schedules that found nothing to run*/
+    uint64_t IdleNs;          /*Time spent idle, closed periods*/
+    uint64_t IdleSince;       /*Start of the current idle period, 0 when busy*/
     uint32_t LoadAverage;     /*Load average*/
 
 } CpuScheduler;
@@ -33,8 +34,11 @@ Thread*  GetNextThread(uint32_t __CpuId__);
 void     AddThreadToReadyQueue(uint32_t __CpuId__, Thread* __ThreadPtr__);
 Thread*  RemoveThreadFromReadyQueue(uint32_t __CpuId__);
 void     AddThreadToWaitingQueue(uint32_t __CpuId__, Thread* __ThreadPtr__);
+void     WakeThread(Thread* __ThreadPtr__);
 void     AddThreadToZombieQueue(uint32_t __CpuId__, Thread* __ThreadPtr__);
 void     AddThreadToSleepingQueue(uint32_t __CpuId__, Thread* __ThreadPtr__);
+void     WakeSleepingThread(Thread* __ThreadPtr__);
+uint64_t NextSleeperDeadline(uint32_t __CpuId__);
 void     SaveInterruptFrameToThread(Thread* __ThreadPtr__, InterruptFrame* __Frame__);
 void     LoadThreadContextToInterruptFrame(Thread* __ThreadPtr__, InterruptFrame* __Frame__);
 uint32_t GetCpuThreadCount(uint32_t __CpuId__);
@@ -84,8 +84,8 @@ typedef struct Thread
     uint32_t CpuAffinity;
     uint32_t LastCpu;
     uint64_t TimeSlice;
-    uint64_t CpuTime;
-    uint64_t StartTime;
+    uint64_t CpuTime;   /*Nanoseconds run, closed slices*/
+    uint64_t StartTime; /*Monotonic ns of the last switch in*/
     uint64_t WakeupTime;
 
     /*Sync*/
@@ -100,10 +100,6 @@ typedef struct Thread
     struct Thread* Parent;
     struct Thread* Children;
 
-    /*File descr*/
-    void*    FileTable[64];
-    uint32_t FileCount;
-
     /*Signals*/
     uint64_t SignalMask;
     void*    SignalHandlers[32];
@@ -118,6 +114,34 @@ typedef struct Thread
     uint32_t Flags;
     void*    DebugInfo;
 
+    /*Wait queue links*/
+    struct Thread* WaitNext;
+    struct Thread* WaitPrev;
+
+    /*Owning PosixProc, NULL for kernel threads*/
+    void* Process;
+
+    /*Lazy FPU, XSAVE area (NULL until first use or with FXSAVE) and last CPU it was loaded on*/
+    void*    FpuArea;
+    void*    FpuAreaBase;
+    uint32_t FpuCpu;
+
+    /*Guarded kernel stack from the stack cache (StackSlot)*/
+    void* KernelStackSlot;
+
+    /*Chain in the thread id hash*/
+    struct Thread* HashNext;
+
+    /*Futex wait, physical address of the word and the wake bitset*/
+    uint64_t FutexKey;
+    uint32_t FutexBitset;
+
+    /*Sleeping queue deadline, monotonic ns*/
+    uint64_t SleepUntil;
+
+    /*One for the thread itself plus one per FindThreadById caller, freed at zero*/
+    uint32_t Refs;
+
 } Thread;
 
 #define ThreadFlagSystem    (1 << 0)
@@ -126,6 +150,9 @@ typedef struct Thread
 #define ThreadFlagTraced    (1 << 3)
 #define ThreadFlagSuspended (1 << 4)
 #define ThreadFlagCritical  (1 << 5)
+#define ThreadFlagParked    (1 << 6) /*Linked on its CPU's WaitingQueue*/
+#define ThreadFlagFpuUsed   (1 << 7) /*Has FPU/SIMD state worth saving*/
+#define ThreadFlagAsleep    (1 << 8) /*Linked on its CPU's SleepingQueue*/
 
 #define WaitReasonNone      0
 #define WaitReasonMutex     1
@@ -134,18 +161,20 @@ typedef struct Thread
 #define WaitReasonSleep     4
 #define WaitReasonSignal    5
 #define WaitReasonChild     6
+#define WaitReasonFutex     7
 
-#define UserVirtualBase 0x0000000000400000ULL
-#define KStackSize      8192
+#define UserVirtualBase   0x0000000000400000ULL
+#define ThreadHashBuckets 256 /*Power of two, indexed by the low id bits*/
+#define KStackSize        16384 /*Default, CreateThreadEx takes up to KStackMaxSize*/
 
 extern uint32_t NextThreadId;
 extern Thread*  ThreadList;
 extern SpinLock ThreadListLock;
-extern Thread*  CurrentThreads[MaxCPUs];
 
 /*Thread Manager Core*/
 void    InitializeThreadManager(void);
 Thread* GetCurrentThread(uint32_t __CpuId__);
+Thread* GetCurrentThreadLocal(void);
 void    SetCurrentThread(uint32_t __CpuId__, Thread* __ThreadPtr__); //
 
 /*Thread Lifecycle*/
@@ -153,6 +182,11 @@ Thread* CreateThread(ThreadType     __Type__,
                      void*          __EntryPoint__,
                      void*          __Argument__,
                      ThreadPriority __Priority__);
+Thread* CreateThreadEx(ThreadType     __Type__,
+                       void*          __EntryPoint__,
+                       void*          __Argument__,
+                       ThreadPriority __Priority__,
+                       uint32_t       __StackSize__);
 void    DestroyThread(Thread* __ThreadPtr__);
 void    SuspendThread(Thread* __ThreadPtr__);
 void    ResumeThread(Thread* __ThreadPtr__);
@@ -166,8 +200,18 @@ void ThreadYield(void);
 void ThreadSleep(uint64_t __Milliseconds__);
 void ThreadExit(uint32_t __ExitCode__);
 
-/*Thread Queries*/
+/*
+ * Sleep on this CPU's sleeping queue until a monotonic deadline. Prepare,
+ * recheck whatever may end the sleep early, then Commit or Cancel, as with
+ * wait queues. Commit returns 0 once the deadline passed, -1 if woken early.
+ */
+void ThreadSleepPrepare(uint64_t __DeadlineNs__);
+int  ThreadSleepCommit(void);
+void ThreadSleepCancel(void);
+
+/*Thread Queries, a found thread is referenced and released with ThreadPut*/
 Thread*  FindThreadById(uint32_t __ThreadId__);
+void     ThreadPut(Thread* __ThreadPtr__);
 uint32_t GetThreadCount(void);
 
 /*Load Balancing*/
@@ -183,12 +227,13 @@ void     GetSystemLoadStats(uint32_t* __TotalThreads__,
                             uint32_t* __MinLoad__); //
 
 /*Utilities*/
-void WakeSleepingThreads(void);             //
 void DumpThreadInfo(Thread* __ThreadPtr__); //
 void DumpAllThreads(void);                  //
 
 KEXPORT(GetCurrentThread);
+KEXPORT(GetCurrentThreadLocal);
 KEXPORT(CreateThread);
+KEXPORT(CreateThreadEx);
 KEXPORT(DestroyThread);
 KEXPORT(SuspendThread);
 KEXPORT(ResumeThread);
@@ -196,8 +241,12 @@ KEXPORT(SetThreadPriority);
 KEXPORT(SetThreadAffinity);
 KEXPORT(ThreadYield);
 KEXPORT(ThreadSleep);
+KEXPORT(ThreadSleepPrepare);
+KEXPORT(ThreadSleepCommit);
+KEXPORT(ThreadSleepCancel);
 KEXPORT(ThreadExit);
 KEXPORT(FindThreadById);
+KEXPORT(ThreadPut);
 KEXPORT(GetThreadCount);
 KEXPORT(ThreadExecute);
 KEXPORT(ThreadExecuteMultiple);
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <AllTypes.h>
+#include <KExports.h>
+#include <Vdso.h>
+
+/*
+ * Timekeeping. With an invariant TSC the monotonic clock is the TSC scaled
+ * to nanoseconds since boot and the tick plays no part in it. Without one
+ * the HPET main counter is used, and without that the boot CPU's tick
+ * count interpolated with the TSC for at most one tick. The wall clock is
+ * the monotonic clock plus an offset taken from the CMOS RTC at boot.
+ */
+
+typedef enum
+{
+    ClockSourceTick, /* 1 ms tick, TSC only interpolates */
+    ClockSourceHpet, /* HPET main counter, kernel only */
+    ClockSourceTsc   /* Invariant TSC */
+
+} ClockSourceKind;
+
+#define NsPerSec  1000000000ULL
+#define NsPerMsec 1000000ULL
+#define NsPerUsec 1000ULL
+
+#define ClockPitHz          1193182 /* PIT input clock */
+#define ClockCalibrateUs    10000   /* Length of one calibration window */
+#define ClockCalibrateRuns  3       /* Windows measured, the shortest wins */
+#define ClockPitPollLimit   1000000 /* Polls before the PIT is assumed absent */
+
+#define ClockIdRealtime        0
+#define ClockIdMonotonic       1
+#define ClockIdProcessCputime  2
+#define ClockIdThreadCputime   3
+#define ClockIdMonotonicRaw    4
+#define ClockIdRealtimeCoarse  5
+#define ClockIdMonotonicCoarse 6
+#define ClockIdBoottime        7
+
+typedef struct
+{
+    ClockSourceKind Kind;
+    uint32_t        InvariantTsc;
+    uint64_t        TscHz;        /* 0 when calibration failed */
+    const char*     CalibratedBy; /* "cpuid", "hpet", "pit" or "none" */
+    uint64_t        TscBoot;
+    uint64_t        HpetBoot;     /* Counter at boot, widened to 64 bits */
+    uint64_t        HpetLast;     /* Widened counter at the last tick, under Data.Seq */
+
+    /* Seqlocked, same layout and reader as the user-visible vDSO page */
+    VdsoData Data;
+
+} ClockSourceState;
+
+extern ClockSourceState ClockSource;
+
+void     InitializeClockSource(void);
+void     ClockTick(void);
+uint64_t ClockMonotonicNs(void);
+uint64_t ClockRealtimeNs(void);
+void     ClockSetRealtimeNs(uint64_t __Ns__);
+int      ClockGetNs(long __ClockId__, uint64_t* __OutNs__);
+void     ClockBusyWaitNs(uint64_t __Ns__);
+
+KEXPORT(ClockMonotonicNs);
+KEXPORT(ClockRealtimeNs);
+KEXPORT(ClockGetNs);
+KEXPORT(ClockBusyWaitNs);
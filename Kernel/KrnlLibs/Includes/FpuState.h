@@ -0,0 +1,41 @@
+#pragma once
+
+#include <AllTypes.h>
+#include <AxeThreads.h>
+
+/* XCR0 state components */
+#define XFeatureX87    (1ULL << 0)
+#define XFeatureSse    (1ULL << 1)
+#define XFeatureAvx    (1ULL << 2)
+#define XFeatureAvx512 (7ULL << 5) /* Opmask, ZMM_Hi256, Hi16_ZMM, enabled all or none */
+
+#define FpuLegacySize    512
+#define FpuXsaveAlign    64
+#define FpuMxcsrOffset   24     /* MXCSR inside the legacy region */
+#define FpuDefaultMxcsr  0x1F80 /* All SIMD exceptions masked */
+#define FpuNoCpu         0xFFFFFFFF
+#define FpuVectorNm      7 /* Device Not Available (#NM) */
+
+typedef struct
+{
+    uint64_t Xcr0;        /* Components enabled on every CPU */
+    uint32_t AreaSize;    /* Bytes needed by XSAVE for Xcr0, 512 with FXSAVE */
+    bool     UseXsave;    /* CR4.OSXSAVE set */
+    bool     UseXsaveOpt; /* Skip components unmodified since the last XRSTOR */
+
+} FpuFeatures;
+
+extern FpuFeatures Fpu;
+
+/*
+ * Lazy switching, CR0.TS stays set for threads whose state is not loaded and
+ * the first FPU/SIMD instruction traps (#NM) to load it. Threads that never
+ * touch the FPU (all kernel threads, the kernel is built without SSE/x87)
+ * never allocate a save area nor pay for a save/restore.
+ */
+void InitializeFpu(void);
+void FpuHandleNm(void);
+void FpuSwitchOut(Thread* __ThreadPtr__);
+void FpuSwitchIn(Thread* __ThreadPtr__, uint32_t __CpuId__);
+void FpuCopyState(Thread* __Dst__, Thread* __Src__);
+void FpuReleaseThread(Thread* __ThreadPtr__);
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <AllTypes.h>
+#include <KExports.h>
+#include <Sync.h>
+
+/*
+ * Fast user-space mutexes. Waiters are keyed by the physical address of the
+ * 32-bit word, so threads sharing the page through different mappings meet
+ * on the same key, and parked on one of FutexBuckets hashed wait queues.
+ */
+
+#define FutexBuckets   256 /* Power of two */
+#define FutexBitsetAll 0xFFFFFFFFU
+#define FutexNoTimeout (~0ULL)
+#define FutexUserLimit 0x0000800000000000ULL
+
+/* Operation word, low bits select the command */
+#define FutexOpWait        0
+#define FutexOpWake        1
+#define FutexOpRequeue     3
+#define FutexOpCmpRequeue  4
+#define FutexOpWaitBitset  9
+#define FutexOpWakeBitset  10
+#define FutexOpPrivate     128 /* Accepted, keys are physical either way */
+#define FutexOpRealtime    256 /* WaitBitset deadline is CLOCK_REALTIME */
+#define FutexOpCommandMask 0x7F
+
+void InitializeFutex(void);
+
+/* Return 0 or a count on success and -SysErr* on failure, timeouts are relative */
+long FutexWait(uint32_t* __Uaddr__, uint32_t __Val__, uint64_t __TimeoutNs__, uint32_t __Bitset__);
+long FutexWake(uint32_t* __Uaddr__, uint32_t __Count__, uint32_t __Bitset__);
+long FutexRequeue(uint32_t* __Uaddr__,
+                  uint32_t  __WakeCount__,
+                  uint32_t  __RequeueCount__,
+                  uint32_t* __Uaddr2__,
+                  bool      __Compare__,
+                  uint32_t  __Val3__);
+
+KEXPORT(FutexWait);
+KEXPORT(FutexWake);
+KEXPORT(FutexRequeue);
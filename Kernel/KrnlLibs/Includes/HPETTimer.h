@@ -1,8 +1,78 @@
 #pragma once
 
+#include <AllTypes.h>
+#include <KExports.h>
+
 #define TimerHpetBaseAddress         0xFED00000
 #define TimerHpetCapabilitiesReg     0x000
 #define TimerHpetConfigReg           0x010
+#define TimerHpetIntStatusReg        0x020
 #define TimerHpetCounterReg          0x0F0
 #define TimerHpetTimer0ConfigReg     0x100
-#define TimerHpetTimer0ComparatorReg 0x108
\ No newline at end of file
+#define TimerHpetTimer0ComparatorReg 0x108
+#define TimerHpetTimer0FsbRouteReg   0x110
+#define TimerHpetTimerStride         0x20
+
+/*General capabilities*/
+#define TimerHpetCapCounter64   (1ULL << 13)
+#define TimerHpetCapLegacyRoute (1ULL << 15)
+#define TimerHpetCapTimersShift 8
+#define TimerHpetCapTimersMask  0x1F
+#define TimerHpetCapPeriodShift 32
+#define TimerHpetMaxPeriodFs    100000000ULL /* 100 ns, the slowest clock the spec allows */
+
+/*General configuration*/
+#define TimerHpetCfgEnable      (1ULL << 0)
+#define TimerHpetCfgLegacyRoute (1ULL << 1)
+
+/*Per-timer configuration*/
+#define TimerHpetTnLevel      (1ULL << 1)
+#define TimerHpetTnIntEnable  (1ULL << 2)
+#define TimerHpetTnPeriodic   (1ULL << 3)
+#define TimerHpetTnPeriodicOk (1ULL << 4)
+#define TimerHpetTn64Ok       (1ULL << 5)
+#define TimerHpetTnValSet     (1ULL << 6)
+#define TimerHpetTn32Mode     (1ULL << 8)
+#define TimerHpetTnFsbEnable  (1ULL << 14)
+#define TimerHpetTnFsbOk      (1ULL << 15)
+
+/* Message address of a fixed, physical-destination interrupt to one local APIC */
+#define TimerHpetMsiAddress(ApicId) (0xFEE00000ULL | ((uint64_t)(ApicId) << 12))
+
+/* IRQ2 is the PIC cascade and never raised, its vector carries the one-shot */
+#define HpetOneShotVector 34
+
+typedef void (*HpetHandler)(void);
+
+typedef struct
+{
+    volatile uint8_t* Regs;
+    uint64_t          PhysBase;
+    uint32_t          PeriodFs;  /* Femtoseconds per counter tick */
+    uint64_t          Hz;        /* Counter rate */
+    uint64_t          NsMult;    /* ns per tick << 32 */
+    uint64_t          TickMult;  /* ticks per ns << 32 */
+    uint32_t          Counter64; /* Main counter is 64 bits wide */
+    uint32_t          Timers;    /* Comparators implemented */
+    int32_t           TickTimer; /* Comparator driving the system tick, -1 if none */
+    int32_t           OneShot;   /* Comparator for one-shot events, -1 if none */
+    HpetHandler       OneShotHandler;
+    uint32_t          Ready;
+
+} HpetState;
+
+extern HpetState Hpet;
+
+uint64_t HpetReadCounter(void);
+uint64_t HpetCounterToNs(uint64_t __Ticks__);
+void     HpetBusyWaitNs(uint64_t __Ns__);
+
+int  HpetOneShotSetHandler(HpetHandler __Handler__);
+int  HpetArmOneShot(uint64_t __DeltaNs__);
+void HpetCancelOneShot(void);
+void HpetInterrupt(void);
+
+KEXPORT(HpetReadCounter);
+KEXPORT(HpetArmOneShot);
+KEXPORT(HpetCancelOneShot);
+KEXPORT(HpetOneShotSetHandler);
@@ -4,39 +4,138 @@
 #include <Sync.h>
 #include <VFS.h>
 
+/*
+ * Open file description, one per open() or pipe end. Every fd made from it
+ * by dup, dup2, fcntl or fork points at the same one and shares its offset
+ * and status flags. Refcnt counts those fds plus any I/O in flight, so a
+ * read or write holds the description alive without the table lock.
+ */
+typedef struct PosixFile
+{
+    long                   Refcnt;
+    long                   Flags; /*Access mode and status flags*/
+    void*                  Obj;   /*File, PosixPipeT, PosixEpoll or PosixUring*/
+    int                    IsFile;
+    int                    IsChar;
+    int                    IsBlock;
+    int                    IsEpoll;
+    int                    IsUring;
+    Mutex                  PosLock; /*Serializes offset use on regular files*/
+    struct PosixEpollItem* EpItems; /*Epoll watches on this description*/
+} PosixFile;
+
 typedef struct PosixFd
 {
-    long  Fd;
-    long  Flags;
-    void* Obj;
-    long  Refcnt;
-    int   IsFile;
-    int   IsChar;
-    int   IsBlock;
+    long       Fd;
+    long       FdFlags; /*Per-descriptor, not shared by dups*/
+    PosixFile* Desc;
 } PosixFd;
 
+/*
+ * The fds themselves, an array and a bitmap of the slots in use, with a
+ * second level marking full bitmap words so the lowest free fd is a couple
+ * of bit scans. A forked child starts on its parent's set and whichever
+ * side changes it first takes a private copy, so fork costs a reference
+ * instead of a pass over every fd.
+ */
+typedef struct PosixFdSet
+{
+    long      Refs;    /*Tables on it, never written while above one*/
+    long      Cap;     /*Slots, a multiple of 64*/
+    long      Count;
+    long      NextFd;  /*No free slot below this*/
+    long      Rings;   /*io_uring fds, a set holding one is copied at fork*/
+    PosixFd*  Entries;
+    uint64_t* OpenMap; /*Bit per slot in use*/
+    uint64_t* FullMap; /*Bit per OpenMap word with every slot in use*/
+} PosixFdSet;
+
+/* One per process, every thread of it goes through the same table */
 typedef struct PosixFdTable
 {
-    PosixFd* Entries;
-    long     Count;
-    long     Cap;
-    long     StdinFd;
-    long     StdoutFd;
-    long     StderrFd;
-    SpinLock Lock;
+    PosixFdSet* Set;
+    long        StdinFd;
+    long        StdoutFd;
+    long        StderrFd;
+    SpinLock    Lock; /*Guards Set, and the set's contents while it is private*/
 } PosixFdTable;
 
-typedef struct Iovec
+/*Table sizes, grown by doubling*/
+#define PosixFdMin 64    /*One bitmap word*/
+#define PosixFdMax 65536 /*RLIMIT_NOFILE*/
+
+/*Status and fcntl values, newlib numbering*/
+#define PosixAccMode   3      /*Access mode bits of PosixFile.Flags*/
+#define PosixONonblock 0x4000 /*O_NONBLOCK*/
+#define PosixFdCloexec 1      /*FD_CLOEXEC*/
+
+#define PosixFDupFd     0
+#define PosixFGetFd     1
+#define PosixFSetFd     2
+#define PosixFGetFl     3
+#define PosixFSetFl     4
+#define PosixFSetPipeSz 1031
+#define PosixFGetPipeSz 1032
+
+/*Pipe ring sizes, whole pages*/
+#define PosixPipeBuf     4096    /*PIPE_BUF, writes up to this size never interleave*/
+#define PosixPipeDefSize 65536
+#define PosixPipeMaxSize 1048576
+
+/*splice, tee and vmsplice flags*/
+#define PosixSpliceMove     1
+#define PosixSpliceNonblock 2
+#define PosixSpliceMore     4
+#define PosixSpliceGift     8
+
+/*A page of pipe data, referenced by every pipe slot that holds a span of it*/
+typedef struct PosixPipePage
 {
-    void*  IovBase;
-    size_t IovLen;
-} Iovec;
+    long  Refs;
+    char* Data; /*One page*/
+} PosixPipePage;
+
+/*One ring slot, Len queued bytes at Off in Page*/
+typedef struct PosixPipeSlot
+{
+    PosixPipePage* Page;
+    long           Off;
+    long           Len;
+} PosixPipeSlot;
+
+typedef struct PosixPipeT
+{
+    PosixPipeSlot* Ring;       /*Slots entries*/
+    long           Slots;
+    long           Cap;        /*Slots pages, in bytes*/
+    long           Head;       /*Ring index of the oldest slot*/
+    long           Count;      /*Slots in use*/
+    long           Len;        /*Bytes queued*/
+    SpinLock       Lock;       /*Slot bookkeeping and the end counts*/
+    Mutex          ReadMutex;  /*Held by the consumer, retires slots at the head*/
+    Mutex          WriteMutex; /*Held by the producer, adds slots at the tail*/
+    long           Readers;    /*open read ends*/
+    long           Writers;    /*open write ends*/
+    long           Refs;       /*Ends whose release has not finished waking sleepers*/
+    WaitQueue      ReadWait;   /*readers sleeping on an empty pipe*/
+    WaitQueue      WriteWait;  /*writers sleeping on a full pipe*/
+} PosixPipeT;
+
+/*struct iovec, the VFS segment type so user arrays go down the stack unconverted*/
+typedef VfsIovec Iovec;
+
+#define PosixIovMax 1024 /*IOV_MAX*/
 
 int  PosixFdInit(PosixFdTable* __Tab__, long __Cap__);
+int  PosixFdFork(PosixFdTable* __Parent__, PosixFdTable* __Child__);
+void PosixFdDestroy(PosixFdTable* __Tab__);
+long PosixFdCap(PosixFdTable* __Tab__);
 int  PosixOpen(PosixFdTable* __Tab__, const char* __Path__, long __Flags__, long __Mode__);
 int  PosixClose(PosixFdTable* __Tab__, int __Fd__);
 long PosixRead(PosixFdTable* __Tab__, int __Fd__, void* __Buf__, long __Len__);
 long PosixWrite(PosixFdTable* __Tab__, int __Fd__, const void* __Buf__, long __Len__);
+long PosixReadv(PosixFdTable* __Tab__, int __Fd__, const Iovec* __Iov__, long __Cnt__);
+long PosixWritev(PosixFdTable* __Tab__, int __Fd__, const Iovec* __Iov__, long __Cnt__);
 long PosixLseek(PosixFdTable* __Tab__, int __Fd__, long __Off__, int __Wh__);
 int  PosixDup(PosixFdTable* __Tab__, int __Fd__);
 int  PosixDup2(PosixFdTable* __Tab__, int __OldFd__, int __NewFd__);
@@ -46,18 +145,74 @@ int  PosixIoctl(PosixFdTable* __Tab__, int __Fd__, unsigned long __Cmd__, void*
 int  PosixAccess(PosixFdTable* __Tab__, const char* __Path__, long __Mode__);
 int  PosixStatPath(const char* __Path__, VfsStat* __Out__);
 int  PosixFstat(PosixFdTable* __Tab__, int __Fd__, VfsStat* __Out__);
+long PosixGetdents(PosixFdTable* __Tab__, int __Fd__, void* __Buf__, long __Len__);
 int  PosixMkdir(const char* __Path__, long __Mode__);
 int  PosixRmdir(const char* __Path__);
 int  PosixUnlink(const char* __Path__);
 int  PosixRename(const char* __Old__, const char* __New__);
+long PosixSplice(PosixFdTable* __Tab__,
+                 int           __FdIn__,
+                 long*         __OffIn__,
+                 int           __FdOut__,
+                 long*         __OffOut__,
+                 long          __Len__,
+                 unsigned int  __Flags__);
+long PosixTee(PosixFdTable* __Tab__,
+              int           __FdIn__,
+              int           __FdOut__,
+              long          __Len__,
+              unsigned int  __Flags__);
+long PosixVmsplice(PosixFdTable* __Tab__,
+                   int           __Fd__,
+                   const Iovec*  __Iov__,
+                   long          __IovCnt__,
+                   unsigned int  __Flags__);
+long PosixSendfile(PosixFdTable* __Tab__,
+                   int           __OutFd__,
+                   int           __InFd__,
+                   long*         __Off__,
+                   long          __Count__);
+long PosixCopyFileRange(PosixFdTable* __Tab__,
+                        int           __FdIn__,
+                        long*         __OffIn__,
+                        int           __FdOut__,
+                        long*         __OffOut__,
+                        long          __Len__,
+                        unsigned int  __Flags__);
+/*Pipes*/
+PosixPipeT* PosixPipeAlloc(void);
+long        PosixPipeRead(PosixPipeT* __P__, void* __Buf__, long __Len__, int __Nonblock__);
+long        PosixPipeWrite(PosixPipeT* __P__, const void* __Buf__, long __Len__, int __Nonblock__);
+long        PosixPipeResize(PosixPipeT* __P__, long __Size__);
+void        PosixPipeRelease(PosixPipeT* __P__, long __Flags__);
+uint32_t    PosixPipePoll(PosixPipeT* __P__, long __Flags__, WaitQueue** __Queue__);
 /*Helpers*/
-int __FindFreeFd__(PosixFdTable* __Tab__, int __Start__);
+int  __FindFreeFd__(PosixFdTable* __Tab__, int __Start__);
+void PosixFdRetain(PosixFd* __E__);
+
+/* Lookup under the table lock, the reference is dropped with PosixFilePut after the I/O */
+PosixFile* PosixFdGet(PosixFdTable* __Tab__, int __Fd__);
+void       PosixFileRetain(PosixFile* __File__);
+void       PosixFilePut(PosixFile* __File__);
+
+/* I/O on a description already held, negative offset for the file position, -SysErr* */
+long PosixFileRead(
+    PosixFile* __Desc__, void* __Buf__, long __Len__, long __Off__, int __Nonblock__);
+long PosixFileWrite(
+    PosixFile* __Desc__, const void* __Buf__, long __Len__, long __Off__, int __Nonblock__);
+long PosixFileReadv(
+    PosixFile* __Desc__, const Iovec* __Iov__, long __Cnt__, long __Off__, int __Nonblock__);
+long PosixFileWritev(
+    PosixFile* __Desc__, const Iovec* __Iov__, long __Cnt__, long __Off__, int __Nonblock__);
 
 KEXPORT(PosixFdInit)
+KEXPORT(PosixFdCap)
 KEXPORT(PosixOpen)
 KEXPORT(PosixClose)
 KEXPORT(PosixRead)
 KEXPORT(PosixWrite)
+KEXPORT(PosixReadv)
+KEXPORT(PosixWritev)
 KEXPORT(PosixLseek)
 KEXPORT(PosixDup)
 KEXPORT(PosixDup2)
@@ -67,7 +222,19 @@ KEXPORT(PosixIoctl)
 KEXPORT(PosixAccess)
 KEXPORT(PosixStatPath)
 KEXPORT(PosixFstat)
+KEXPORT(PosixGetdents)
 KEXPORT(PosixMkdir)
 KEXPORT(PosixRmdir)
 KEXPORT(PosixUnlink)
-KEXPORT(PosixRename)
\ No newline at end of file
+KEXPORT(PosixRename)
+KEXPORT(PosixFdGet)
+KEXPORT(PosixFilePut)
+KEXPORT(PosixFileRead)
+KEXPORT(PosixFileWrite)
+KEXPORT(PosixFileReadv)
+KEXPORT(PosixFileWritev)
+KEXPORT(PosixSplice)
+KEXPORT(PosixTee)
+KEXPORT(PosixVmsplice)
+KEXPORT(PosixSendfile)
+KEXPORT(PosixCopyFileRange)
\ No newline at end of file
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <AllTypes.h>
+#include <KExports.h>
+#include <POSIXFd.h>
+#include <Sync.h>
+#include <VFS.h>
+
+/*
+ * Readiness waits. Every pollable description reports its VfsPoll* bits and
+ * the WaitQueue woken when they change, poll, select and epoll hang a
+ * WaitHook there instead of sleeping blind and rescanning.
+ */
+
+/*epoll_ctl operations and event flags, Linux numbering*/
+#define PosixEpollCtlAdd  1
+#define PosixEpollCtlDel  2
+#define PosixEpollCtlMod  3
+#define PosixEpollOneshot (1U << 30)
+#define PosixEpollEt      (1U << 31)
+#define PosixEpollCloexec 0x40000 /*O_CLOEXEC, newlib numbering*/
+
+/*struct pollfd*/
+typedef struct PosixPollFd
+{
+    int   Fd;
+    short Events;
+    short Revents;
+} PosixPollFd;
+
+/*struct epoll_event, packed on x86_64*/
+typedef struct __attribute__((packed)) PosixEpollEvent
+{
+    uint32_t Events;
+    uint64_t Data;
+} PosixEpollEvent;
+
+/* One watched (fd, description) pair of an epoll instance */
+typedef struct PosixEpollItem
+{
+    struct PosixEpollItem* Next; /*Interest list*/
+    struct PosixEpollItem* Prev;
+    struct PosixEpollItem* ReadyNext;
+    struct PosixEpollItem* ReadyPrev;
+    struct PosixEpollItem* FileNext; /*Other watches on the same description*/
+    struct PosixEpoll*     Ep;
+    PosixFile*             Desc; /*Not a reference, a dying description drops its watches*/
+    int                    Fd;
+    uint32_t               Events;
+    uint64_t               Data;
+    bool                   Ready;  /*On the ready list*/
+    bool                   Linked; /*On the interest list*/
+    WaitHook               Hook;
+} PosixEpollItem;
+
+typedef struct PosixEpoll
+{
+    SpinLock        Lock;    /*Ready list*/
+    Mutex           CtlLock; /*Keeps ctl from freeing items a wait is reporting*/
+    PosixEpollItem* Items;
+    PosixEpollItem* ReadyHead;
+    PosixEpollItem* ReadyTail;
+    long            ReadyCount;
+    WaitQueue       Wait;
+} PosixEpoll;
+
+uint32_t PosixFilePoll(PosixFile* __Desc__, WaitQueue** __Queue__);
+uint32_t PosixFilePollWait(PosixFile* __Desc__, uint32_t __Events__, long __TimeoutMs__);
+
+/* Timeouts in milliseconds, negative waits forever, counts or -SysErr* */
+long PosixPoll(PosixFdTable* __Tab__, PosixPollFd* __Fds__, long __Nfds__, long __TimeoutMs__);
+long PosixSelect(PosixFdTable* __Tab__,
+                 int           __Nfds__,
+                 uint8_t*      __Rfds__,
+                 uint8_t*      __Wfds__,
+                 uint8_t*      __Efds__,
+                 long          __TimeoutMs__);
+
+PosixEpoll* PosixEpollAlloc(void);
+void        PosixEpollRelease(PosixEpoll* __Ep__);
+void        PosixEpollForget(PosixFile* __Desc__);
+int         PosixEpollCreate(PosixFdTable* __Tab__, long __Flags__);
+int         PosixEpollCtl(PosixFdTable*          __Tab__,
+                          int                    __EpFd__,
+                          int                    __Op__,
+                          int                    __Fd__,
+                          const PosixEpollEvent* __Event__);
+long        PosixEpollWait(PosixFdTable*    __Tab__,
+                           int              __EpFd__,
+                           PosixEpollEvent* __Out__,
+                           int              __Max__,
+                           long             __TimeoutMs__);
+
+KEXPORT(PosixFilePoll)
+KEXPORT(PosixFilePollWait)
+KEXPORT(PosixPoll)
+KEXPORT(PosixSelect)
+KEXPORT(PosixEpollCreate)
+KEXPORT(PosixEpollCtl)
+KEXPORT(PosixEpollWait)
@@ -59,6 +59,11 @@ typedef struct PosixProc
     char*                EnvironBuf;
     long                 EnvironLen;
     struct PosixFdTable* Fds;
+    WaitQueue            ChildWait;   /*wait4 sleepers, woken on child exit*/
+    long                 TableIndex;  /*Slot in PosixProcs.Items, for O(1) removal*/
+    struct PosixProc*    Children;    /*Live and zombie children, guarded by Lock*/
+    struct PosixProc*    SiblingNext; /*Links in the parent's Children*/
+    struct PosixProc*    SiblingPrev;
 
 } PosixProc;
 
@@ -67,13 +72,15 @@ typedef struct PosixProcTable
     PosixProc** Items;
     long        Count;
     long        Cap;
-    SpinLock    Lock;
+    RwSpinLock  Lock; /*enumeration shares, insert/remove and pid allocation exclusive*/
 } PosixProcTable;
 
 #ifndef WNOHANG
 #    define WNOHANG 1
 #endif
 
+#define PosixTimerAbstime 1 /*TIMER_ABSTIME, Linux numbering*/
+
 extern PosixProcTable PosixProcs;
 
 PosixProc* PosixProcCreate(void);
@@ -99,6 +106,14 @@ int        PosixFchdir(PosixProc* __Proc__, int __Fd__);
 int        PosixSetUmask(PosixProc* __Proc__, long __Mask__);
 int        PosixGetTty(PosixProc* __Proc__, char* __Out__, long __Len__);
 PosixProc* PosixFind(long __Pid__);
+PosixProc* PosixCurrent(void);
+bool       PosixSignalPending(PosixProc* __Proc__);
+/* Sleeps on the CPU's sleeping queue until the deadline or a signal, -SysErr* */
+long       PosixClockNanosleep(PosixProc* __Proc__,
+                               long       __ClockId__,
+                               int        __Flags__,
+                               uint64_t   __Ns__,
+                               uint64_t*  __LeftNs__);
 /*Global Helpers*/
 char __ProcStateCode__(PosixProc* __Proc__);
 
@@ -117,4 +132,6 @@ KEXPORT(PosixChdir)
 KEXPORT(PosixFchdir)
 KEXPORT(PosixSetUmask)
 KEXPORT(PosixGetTty)
-KEXPORT(PosixFind)
\ No newline at end of file
+KEXPORT(PosixFind)
+KEXPORT(PosixCurrent)
+KEXPORT(PosixClockNanosleep)
\ No newline at end of file
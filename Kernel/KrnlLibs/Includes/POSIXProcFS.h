@@ -41,6 +41,10 @@ long ProcFsListFds(PosixProc* __Proc__, char* __Buf__, long __Cap__);
 long ProcFsWriteState(PosixProc* __Proc__, const char* __Buf__, long __Len__);
 long ProcFsWriteExec(PosixProc* __Proc__, const char* __Buf__, long __Len__);
 long ProcFsWriteSignal(PosixProc* __Proc__, const char* __Buf__, long __Len__);
+long ProcFsMakeSyscalls(char* __Buf__, long __Cap__);
+long ProcFsWriteSyscalls(const char* __Buf__, long __Len__);
+long ProcFsMakeUptime(char* __Buf__, long __Cap__);
+long ProcFsMakeSoftirqs(char* __Buf__, long __Cap__);
 
 int         ProcFsInit(void);
 Superblock* ProcFsMountImpl(const char* __Dev__, const char* __Opts__);
@@ -54,6 +58,7 @@ long   ProcLseek(File* __File__, long __Off__, int __Wh__);
 int    ProcIoctl(File* __File__, unsigned long __Cmd__, void* __Arg__);
 int    ProcStat(Vnode* __Node__, VfsStat* __Out__);
 long   ProcReaddir(Vnode* __Node__, void* __Buf__, long __Len__);
+long   ProcIterate(File* __Dir__, VfsDirCtx* __Ctx__);
 Vnode* ProcLookup(Vnode* __Dir__, const char* __Name__);
 int    ProcCreate(Vnode* __Dir__, const char* __Name__, long __Flags__, VfsPerm __Perm__);
 int    ProcUnlink(Vnode* __Dir__, const char* __Name__);
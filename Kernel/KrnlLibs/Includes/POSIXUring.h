@@ -0,0 +1,210 @@
+#pragma once
+
+#include <AllTypes.h>
+#include <AxeThreads.h>
+#include <KExports.h>
+#include <POSIXFd.h>
+#include <POSIXProc.h>
+#include <Sync.h>
+#include <VFS.h>
+#include <VMM.h>
+
+/*
+ * Submission and completion rings shared with userland, io_uring layout.
+ * The process fills SQEs and bumps SqTail, one io_uring_enter (or the
+ * optional polling thread) consumes a whole batch. Requests run inline when
+ * they cannot block, the rest go to a few kernel workers bound to the
+ * ring's address space, and every result lands as a CQE the process reaps
+ * without a trap.
+ */
+
+/*Rings live in this window of every address space, one slot per ring*/
+#define PosixUringBase     0x00007FFFE0000000ULL
+#define PosixUringSlotSize 0x0000000000100000ULL
+#define PosixUringSlots    256
+
+#define PosixUringMaxEntries 4096
+#define PosixUringMaxWorkers 4
+#define PosixUringIdleMs     1000 /*SQPOLL idle before it sleeps, when none was asked*/
+
+/*io_uring_setup flags and features*/
+#define PosixUringSetupSqPoll (1U << 1)
+#define PosixUringSetupCqSize (1U << 3)
+#define PosixUringFeatSingle  (1U << 0) /*SQ and CQ rings share one mapping*/
+#define PosixUringFeatStable  (1U << 2) /*SQEs are copied at submit*/
+
+/*io_uring_enter flags*/
+#define PosixUringEnterGetEvents (1U << 0)
+#define PosixUringEnterSqWakeup  (1U << 1)
+
+/*SqFlags*/
+#define PosixUringSqNeedWakeup (1U << 0)
+
+/*Per-SQE flags*/
+#define PosixUringSqeAsync (1U << 4)
+
+/*mmap offsets, all three land in the one mapping*/
+#define PosixUringOffSqRing 0ULL
+#define PosixUringOffCqRing 0x8000000ULL
+#define PosixUringOffSqes   0x10000000ULL
+
+#define PosixUringAtFdCwd (-100)
+
+/*Opcodes, Linux numbering*/
+enum PosixUringOp
+{
+    PosixUringOpNop     = 0,
+    PosixUringOpReadv   = 1,
+    PosixUringOpWritev  = 2,
+    PosixUringOpFsync   = 3,
+    PosixUringOpPollAdd = 6,
+    PosixUringOpOpenat  = 18,
+    PosixUringOpClose   = 19,
+    PosixUringOpRead    = 22,
+    PosixUringOpWrite   = 23,
+    PosixUringOpLast
+};
+
+/*struct io_uring_sqe*/
+typedef struct PosixUringSqe
+{
+    uint8_t  Opcode;
+    uint8_t  Flags;
+    uint16_t Ioprio;
+    int32_t  Fd;
+    uint64_t Off; /*(uint64_t)-1 for the file position*/
+    uint64_t Addr;
+    uint32_t Len;
+    uint32_t OpFlags; /*rw_flags, fsync_flags, poll32_events or open_flags*/
+    uint64_t UserData;
+    uint16_t BufIndex;
+    uint16_t Personality;
+    int32_t  SpliceFdIn;
+    uint64_t Addr3;
+    uint64_t Pad;
+} PosixUringSqe;
+
+/*struct io_uring_cqe*/
+typedef struct PosixUringCqe
+{
+    uint64_t UserData;
+    int32_t  Res;
+    uint32_t Flags;
+} PosixUringCqe;
+
+/* Indices at the head of the shared pages, the two sides on their own lines */
+typedef struct PosixUringRings
+{
+    uint32_t SqHead; /*Kernel owned*/
+    uint32_t SqTail; /*User owned*/
+    uint32_t SqMask;
+    uint32_t SqEntries;
+    uint32_t SqFlags;
+    uint32_t SqDropped;
+    uint32_t CqHead __attribute__((aligned(64))); /*User owned*/
+    uint32_t CqTail;                              /*Kernel owned*/
+    uint32_t CqMask;
+    uint32_t CqEntries;
+    uint32_t CqOverflow;
+    uint32_t CqFlags;
+} __attribute__((aligned(64))) PosixUringRings;
+
+/*struct io_sqring_offsets and io_cqring_offsets*/
+typedef struct PosixUringSqOffsets
+{
+    uint32_t Head;
+    uint32_t Tail;
+    uint32_t RingMask;
+    uint32_t RingEntries;
+    uint32_t Flags;
+    uint32_t Dropped;
+    uint32_t Array;
+    uint32_t Resv1;
+    uint64_t UserAddr; /*Where the ring is already mapped*/
+} PosixUringSqOffsets;
+
+typedef struct PosixUringCqOffsets
+{
+    uint32_t Head;
+    uint32_t Tail;
+    uint32_t RingMask;
+    uint32_t RingEntries;
+    uint32_t Overflow;
+    uint32_t Cqes;
+    uint32_t Flags;
+    uint32_t Resv1;
+    uint64_t UserAddr; /*Where the SQE array is already mapped*/
+} PosixUringCqOffsets;
+
+/*struct io_uring_params*/
+typedef struct PosixUringParams
+{
+    uint32_t            SqEntries;
+    uint32_t            CqEntries;
+    uint32_t            Flags;
+    uint32_t            SqThreadCpu;
+    uint32_t            SqThreadIdle;
+    uint32_t            Features;
+    uint32_t            WqFd;
+    uint32_t            Resv[3];
+    PosixUringSqOffsets SqOff;
+    PosixUringCqOffsets CqOff;
+} PosixUringParams;
+
+/* A request punted to the workers, owns its reference on Desc */
+typedef struct PosixUringReq
+{
+    struct PosixUringReq* Next;
+    PosixFile*            Desc;
+    PosixUringSqe         Sqe;
+} PosixUringReq;
+
+typedef struct PosixUring
+{
+    long                Refs; /*The description, each worker and the SQPOLL thread*/
+    volatile int        Dying;
+    PosixUringRings*    Rings;
+    uint32_t*           SqArray;
+    PosixUringCqe*      Cqes;
+    PosixUringSqe*      Sqes;
+    uint64_t            Phys;
+    long                Pages;
+    uint64_t            UserBase;
+    long                SqeOff;
+    VirtualMemorySpace* Space; /*Referenced, the workers run in it*/
+    PosixFdTable*       Tab;   /*Owner's table, for the SQPOLL thread*/
+    uint32_t            SetupFlags;
+    uint32_t            IdleMs;
+    Mutex               SubmitLock; /*One consumer of the SQ at a time*/
+    SpinLock            CqLock;     /*Producers of the CQ*/
+    WaitQueue           CqWait;     /*Reapers, and poll on the ring fd*/
+    WaitQueue           SqWait;     /*The SQPOLL thread once idle*/
+    SpinLock            WorkLock;
+    PosixUringReq*      WorkHead;
+    PosixUringReq*      WorkTail;
+    WaitQueue           WorkWait;
+    long                Workers;
+    long                IdleWorkers;
+} PosixUring;
+
+/* Rings and the fd that owns them, -SysErr* */
+long     PosixUringAlloc(PosixProc*        __Proc__,
+                         uint32_t          __Entries__,
+                         PosixUringParams* __Params__,
+                         PosixUring**      __Out__);
+int      PosixUringCreate(PosixProc* __Proc__, uint32_t __Entries__, PosixUringParams* __Params__);
+long     PosixUringEnter(PosixProc* __Proc__,
+                         int        __Fd__,
+                         uint32_t   __ToSubmit__,
+                         uint32_t   __MinComplete__,
+                         uint32_t   __Flags__);
+void     PosixUringRelease(PosixUring* __Ring__);
+uint32_t PosixUringPoll(PosixUring* __Ring__, WaitQueue** __Queue__);
+uint64_t PosixUringMmapAddr(PosixFile*          __Desc__,
+                            VirtualMemorySpace* __Space__,
+                            uint64_t            __Off__,
+                            uint64_t            __Len__);
+bool     PosixUringIsRingAddress(uint64_t __Va__);
+
+KEXPORT(PosixUringCreate)
+KEXPORT(PosixUringEnter)
@@ -2,8 +2,27 @@
 
 #include <IDT.h>
 
-typedef struct
+struct Thread;
+struct CpuScheduler;
+
+#define MsrGsBase       0xC0000101 /* IA32_GS_BASE */
+#define MsrKernelGsBase 0xC0000102 /* IA32_KERNEL_GS_BASE, swapped in by swapgs */
+
+/*
+ * Anchored at GS_BASE while in kernel mode, the hot fields come first so
+ * they are reachable with a single gs-relative load.
+ */
+typedef struct PerCpuData
 {
+    struct PerCpuData*   Self;          /* gs:0, linear address of this block */
+    uint32_t             CpuNumber;     /* Logical index into Smp.Cpus */
+    uint32_t             Reserved;
+    struct Thread*       CurrentThread; /* Thread running on this CPU */
+    struct CpuScheduler* Scheduler;     /* This CPU's run queues */
+    struct Thread*       FpuOwner;      /* Thread whose FPU state is in the registers */
+    TaskStateSegment*    ActiveTss;     /* TSS loaded in TR, Rsp0 follows the running thread */
+    uint64_t             KernelRsp;     /* gs:48, SYSCALL entry stack, tracks Rsp0 */
+    uint64_t             UserRsp;       /* gs:56, user RSP parked by the SYSCALL entry */
 
     GdtEntry         Gdt[MaxGdt]; /* GDT*/
     GdtPointer       GdtPtr;
@@ -14,5 +33,58 @@ typedef struct
     uint64_t         ApicBase;   /* APIC Base*/
     uint64_t         LocalTicks; /* Timer Data*/
     uint32_t         LocalInterrupts;
+    uint64_t         NextTickNs; /* One-shot LAPIC, when the next tick is due*/
+
+} PerCpuData;
+
+/* Used from the SYSCALL entry stub, which cannot take offsetof operands */
+#define PerCpuKernelRspOffset 48
+#define PerCpuUserRspOffset   56
+
+_Static_assert(__builtin_offsetof(PerCpuData, KernelRsp) == PerCpuKernelRspOffset,
+               "SYSCALL entry expects KernelRsp at gs:48");
+_Static_assert(__builtin_offsetof(PerCpuData, UserRsp) == PerCpuUserRspOffset,
+               "SYSCALL entry expects UserRsp at gs:56");
+
+/* Set once the boot CPU has GS_BASE installed, until then fall back to the LAPIC */
+extern volatile uint32_t PerCpuReady;
+
+void PerCpuInstall(uint32_t __CpuNumber__);
 
-} PerCpuData;
\ No newline at end of file
+static inline PerCpuData*
+PerCpuSelf(void)
+{
+    PerCpuData* Self;
+    __asm__ volatile("movq %%gs:%c1, %0" : "=r"(Self) : "i"(__builtin_offsetof(PerCpuData, Self)));
+    return Self;
+}
+
+static inline uint32_t
+PerCpuCpuNumber(void)
+{
+    uint32_t CpuNumber;
+    __asm__ volatile("movl %%gs:%c1, %0"
+                     : "=r"(CpuNumber)
+                     : "i"(__builtin_offsetof(PerCpuData, CpuNumber)));
+    return CpuNumber;
+}
+
+static inline struct Thread*
+PerCpuCurrentThread(void)
+{
+    struct Thread* Current;
+    __asm__ volatile("movq %%gs:%c1, %0"
+                     : "=r"(Current)
+                     : "i"(__builtin_offsetof(PerCpuData, CurrentThread)));
+    return Current;
+}
+
+static inline struct CpuScheduler*
+PerCpuScheduler(void)
+{
+    struct CpuScheduler* Scheduler;
+    __asm__ volatile("movq %%gs:%c1, %0"
+                     : "=r"(Scheduler)
+                     : "i"(__builtin_offsetof(PerCpuData, Scheduler)));
+    return Scheduler;
+}
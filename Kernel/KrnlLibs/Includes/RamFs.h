@@ -81,11 +81,13 @@ typedef struct RamVfsPrivFile
 int    RamVfsOpen(Vnode*, File*);
 int    RamVfsClose(File*);
 long   RamVfsRead(File*, void*, long);
+long   RamVfsReadIter(File*, const VfsIovec*, long);
 long   RamVfsWrite(File*, const void*, long);
 long   RamVfsLseek(File*, long, int);
 int    RamVfsIoctl(File*, unsigned long, void*);
 int    RamVfsStat(Vnode*, VfsStat*);
 long   RamVfsReaddir(Vnode*, void*, long);
+long   RamVfsIterate(File*, VfsDirCtx*);
 Vnode* RamVfsLookup(Vnode*, const char*);
 int    RamVfsCreate(Vnode*, const char*, long, VfsPerm);
 int    RamVfsUnlink(Vnode*, const char*);
@@ -101,6 +103,7 @@ int    RamVfsTruncate(Vnode*, long);
 int    RamVfsSync(Vnode*);
 int    RamVfsMap(Vnode*, void**, long, long);
 int    RamVfsUnmap(Vnode*, void*, long);
+long   RamVfsCopyRange(File*, long, File*, long, long);
 
 int  RamVfsSuperSync(Superblock*);
 int  RamVfsSuperStatFs(Superblock*, VfsStatFs*);
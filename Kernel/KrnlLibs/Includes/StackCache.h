@@ -0,0 +1,57 @@
+#pragma once
+
+#include <AllTypes.h>
+#include <KExports.h>
+#include <SMP.h>
+#include <Sync.h>
+#include <VMM.h>
+
+/*
+ * Kernel stacks live in their own PML4 slot so every address space shares
+ * them. Each slot is KStackSlotSize bytes, the stack is mapped at its top and
+ * everything below (at least one page) stays unmapped, so an overflow faults
+ * instead of running into the neighbouring stack.
+ */
+#define KStackArenaBase  0xFFFFFE0000000000ULL /* PML4 entry 508 */
+#define KStackArenaSize  0x0000008000000000ULL /* One PML4 entry, 512 GiB */
+#define KStackMaxSize    0x40000               /* Largest stack a thread may ask for */
+#define KStackGuardSize  PageSize
+#define KStackSlotSize   (KStackMaxSize + KStackGuardSize)
+#define KStackCacheDepth 8 /* Default-size stacks kept per CPU */
+
+/* Double fault runs on its own stack (IST1) so a blown kernel stack still reports */
+#define KStackIstDoubleFault 1
+#define KStackIstSize        0x2000
+
+/* Main thread user stack, reserved up front and grown on demand below UserStackTop */
+#define UserStackTop     0x00007FFFFFFFF000ULL
+#define UserStackReserve 0x0000000000800000ULL /* Growth limit, 8 MiB */
+#define UserStackCommit  0x0000000000010000ULL /* Mapped at exec time */
+
+typedef struct StackSlot
+{
+    struct StackSlot* Next;
+    uint64_t          Base; /* Lowest mapped byte */
+    uint64_t          Top;  /* One past the highest byte */
+    uint32_t          Size;
+    uint32_t          Index; /* Slot number within the arena */
+
+} StackSlot;
+
+typedef struct
+{
+    SpinLock   Lock;
+    StackSlot* Head;
+    uint32_t   Count;
+    uint64_t   Hits;
+    uint64_t   Misses;
+
+} StackCpuCache;
+
+void       InitializeStackCache(void);
+StackSlot* StackAlloc(uint32_t __Size__);
+void       StackFree(StackSlot* __Slot__);
+bool       StackIsGuardAddress(uint64_t __Addr__);
+
+KEXPORT(StackAlloc);
+KEXPORT(StackFree);
@@ -208,5 +208,41 @@ enum SysNo
     SysClockSettime        = 227,
     SysClockGettime        = 228,
     SysClockGetres         = 229,
-    SysClockNanosleep      = 230
+    SysClockNanosleep      = 230,
+
+    /* Sparse from here, only what is implemented */
+    SysEpollWait           = 232,
+    SysEpollCtl            = 233,
+    SysSplice              = 275,
+    SysTee                 = 276,
+    SysVmsplice            = 278,
+    SysEpollCreate1        = 291,
+    SysCopyFileRange       = 326,
+    SysIoUringSetup        = 425,
+    SysIoUringEnter        = 426
+};
+
+/*
+ * Error numbers for handlers that report a cause, returned negated. The values
+ * are the userland C library's, it stores -result in errno as is.
+ */
+enum SysErr
+{
+    SysErrPerm     = 1,
+    SysErrNoEnt    = 2,
+    SysErrIntr     = 4,
+    SysErrIo       = 5,
+    SysErrBadf     = 9,
+    SysErrAgain    = 11,
+    SysErrNoMem    = 12,
+    SysErrFault    = 14,
+    SysErrBusy     = 16,
+    SysErrExist    = 17,
+    SysErrNotDir   = 20,
+    SysErrInval    = 22,
+    SysErrMfile    = 24,
+    SysErrSpipe    = 29,
+    SysErrPipe     = 32,
+    SysErrNoSys    = 88,
+    SysErrTimedOut = 116
 };
@@ -50,6 +50,12 @@ int64_t __Handle__Fstat(uint64_t __Fd__,
                         uint64_t __U4__,
                         uint64_t __U5__,
                         uint64_t __U6__);
+int64_t __Handle__Getdents64(uint64_t __Fd__,
+                             uint64_t __Dirp__,
+                             uint64_t __Count__,
+                             uint64_t __U4__,
+                             uint64_t __U5__,
+                             uint64_t __U6__);
 int64_t __Handle__Lseek(uint64_t __Fd__,
                         uint64_t __Off__,
                         uint64_t __Whence__,
@@ -86,6 +92,42 @@ int64_t __Handle__Dup2(uint64_t __OldFd__,
                        uint64_t __U4__,
                        uint64_t __U5__,
                        uint64_t __U6__);
+int64_t __Handle__Fcntl(uint64_t __Fd__,
+                        uint64_t __Cmd__,
+                        uint64_t __Arg__,
+                        uint64_t __U4__,
+                        uint64_t __U5__,
+                        uint64_t __U6__);
+int64_t __Handle__Splice(uint64_t __FdIn__,
+                         uint64_t __OffIn__,
+                         uint64_t __FdOut__,
+                         uint64_t __OffOut__,
+                         uint64_t __Len__,
+                         uint64_t __Flags__);
+int64_t __Handle__Tee(uint64_t __FdIn__,
+                      uint64_t __FdOut__,
+                      uint64_t __Len__,
+                      uint64_t __Flags__,
+                      uint64_t __U5__,
+                      uint64_t __U6__);
+int64_t __Handle__Sendfile(uint64_t __OutFd__,
+                           uint64_t __InFd__,
+                           uint64_t __OffPtr__,
+                           uint64_t __Count__,
+                           uint64_t __U5__,
+                           uint64_t __U6__);
+int64_t __Handle__CopyFileRange(uint64_t __FdIn__,
+                                uint64_t __OffIn__,
+                                uint64_t __FdOut__,
+                                uint64_t __OffOut__,
+                                uint64_t __Len__,
+                                uint64_t __Flags__);
+int64_t __Handle__Vmsplice(uint64_t __Fd__,
+                           uint64_t __IovPtr__,
+                           uint64_t __IovCnt__,
+                           uint64_t __Flags__,
+                           uint64_t __U5__,
+                           uint64_t __U6__);
 int64_t __Handle__Mkdir(uint64_t __Path__,
                         uint64_t __Mode__,
                         uint64_t __U3__,
@@ -206,6 +248,18 @@ int64_t __Handle__ClockGettime(uint64_t __ClkId__,
                                uint64_t __U4__,
                                uint64_t __U5__,
                                uint64_t __U6__);
+int64_t __Handle__ClockNanosleep(uint64_t __ClkId__,
+                                 uint64_t __Flags__,
+                                 uint64_t __ReqPtr__,
+                                 uint64_t __RemPtr__,
+                                 uint64_t __U5__,
+                                 uint64_t __U6__);
+int64_t __Handle__Futex(uint64_t __Uaddr__,
+                        uint64_t __Op__,
+                        uint64_t __Val__,
+                        uint64_t __Timeout__,
+                        uint64_t __Uaddr2__,
+                        uint64_t __Val3__);
 int64_t __Handle__Mmap(uint64_t __Addr__,
                        uint64_t __Len__,
                        uint64_t __Prot__,
@@ -230,3 +284,45 @@ int64_t __Handle__Select(uint64_t __Nfds__,
                          uint64_t __Exceptfds__,
                          uint64_t __Timeout__,
                          uint64_t __U6__);
+int64_t __Handle__Poll(uint64_t __Fds__,
+                       uint64_t __Nfds__,
+                       uint64_t __Timeout__,
+                       uint64_t __U4__,
+                       uint64_t __U5__,
+                       uint64_t __U6__);
+int64_t __Handle__EpollCreate(uint64_t __Size__,
+                              uint64_t __U2__,
+                              uint64_t __U3__,
+                              uint64_t __U4__,
+                              uint64_t __U5__,
+                              uint64_t __U6__);
+int64_t __Handle__EpollCreate1(uint64_t __Flags__,
+                               uint64_t __U2__,
+                               uint64_t __U3__,
+                               uint64_t __U4__,
+                               uint64_t __U5__,
+                               uint64_t __U6__);
+int64_t __Handle__EpollCtl(uint64_t __EpFd__,
+                           uint64_t __Op__,
+                           uint64_t __Fd__,
+                           uint64_t __Event__,
+                           uint64_t __U5__,
+                           uint64_t __U6__);
+int64_t __Handle__EpollWait(uint64_t __EpFd__,
+                            uint64_t __Events__,
+                            uint64_t __Max__,
+                            uint64_t __Timeout__,
+                            uint64_t __U5__,
+                            uint64_t __U6__);
+int64_t __Handle__IoUringSetup(uint64_t __Entries__,
+                               uint64_t __Params__,
+                               uint64_t __U3__,
+                               uint64_t __U4__,
+                               uint64_t __U5__,
+                               uint64_t __U6__);
+int64_t __Handle__IoUringEnter(uint64_t __Fd__,
+                               uint64_t __ToSubmit__,
+                               uint64_t __MinComplete__,
+                               uint64_t __Flags__,
+                               uint64_t __Sig__,
+                               uint64_t __SigSz__);
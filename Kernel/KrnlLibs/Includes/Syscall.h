@@ -3,7 +3,15 @@
 #include <AllTypes.h>
 #include <IDT.h>
 
-#define MaxSysNo 99999
+#define MaxSysNo 427 /* One past the highest number in SysABI.h */
+
+/* SYSCALL/SYSRET setup */
+#define MsrEfer           0xC0000080
+#define MsrStar           0xC0000081
+#define MsrLstar          0xC0000082
+#define MsrSfmask         0xC0000084
+#define EferSyscallEnable (1ULL << 0)
+#define SyscallFlagMask   0x47700ULL /* TF, IF, DF, IOPL, NT and AC cleared on entry */
 
 typedef int64_t (*SysHandle)(uint64_t __Arg1__,
                              uint64_t __Arg2__,
@@ -14,41 +22,69 @@ typedef int64_t (*SysHandle)(uint64_t __Arg1__,
 typedef struct
 {
     SysHandle   Handler;
+    uint32_t    Number; /* ABI number from SysABI.h */
     const char* SysName;
-    int         ArgIdx;
 } SysEnt;
 
-static SysEnt SysTbl[MaxSysNo];
+extern const SysEnt   SysTbl[];
+extern const uint32_t SysCount;
+
+/*
+ * Per-syscall accounting, one block per CPU summed on read. Latency is in
+ * TSC cycles, bucket 0 is below 1 << SysHistShift and each following bucket
+ * doubles, the last one takes everything above.
+ */
+#define SysHistShift   8
+#define SysHistBuckets 12
+
+typedef struct
+{
+    uint64_t Calls;
+    uint64_t Cycles;
+    uint32_t Hist[SysHistBuckets];
+} SysCallStat;
+
+typedef struct
+{
+    uint32_t    Number;
+    const char* Name;
+    uint64_t    Calls;
+    uint64_t    Cycles;
+    uint64_t    Hist[SysHistBuckets];
+} SysCallTotals;
 
+/*
+ * Kernel side goes through the int $0x80 gate, SYSRET would drop the caller
+ * into ring 3. Userland's copy in sysmac.h takes the SYSCALL fast path.
+ */
 #define Syscall(__SysNum__, __Arg1__, __Arg2__, __Arg3__, __Arg4__, __Arg5__, __Arg6__)            \
     ({                                                                                             \
-        int64_t result;                                                                            \
-        __asm__ volatile("movq %1, %%rax\n\t" /* syscall __SysNum__ber */                          \
-                         "movq %2, %%rdi\n\t" /* __Arg1__ */                                       \
-                         "movq %3, %%rsi\n\t" /* __Arg2__ */                                       \
-                         "movq %4, %%rdx\n\t" /* __Arg3__ */                                       \
-                         "movq %5, %%r10\n\t" /* __Arg4__ */                                       \
-                         "movq %6, %%r8\n\t"  /* __Arg5__ */                                       \
-                         "movq %7, %%r9\n\t"  /* __Arg6__ */                                       \
-                         "int $0x80\n\t"      /* syscall interrupt */                              \
-                         "movq %%rax, %0"                                                          \
-                         : "=r"(result)                                                            \
-                         : "r"((uint64_t)(__SysNum__)),                                            \
-                           "r"((uint64_t)(__Arg1__)),                                              \
-                           "r"((uint64_t)(__Arg2__)),                                              \
-                           "r"((uint64_t)(__Arg3__)),                                              \
-                           "r"((uint64_t)(__Arg4__)),                                              \
-                           "r"((uint64_t)(__Arg5__)),                                              \
-                           "r"((uint64_t)(__Arg6__))                                               \
-                         : "rax", "rdi", "rsi", "rdx", "r10", "r8", "r9", "memory");               \
+        uint64_t          __Sa1__ = (uint64_t)(__Arg1__);                                          \
+        uint64_t          __Sa2__ = (uint64_t)(__Arg2__);                                          \
+        uint64_t          __Sa3__ = (uint64_t)(__Arg3__);                                          \
+        uint64_t          __Sa4__ = (uint64_t)(__Arg4__);                                          \
+        uint64_t          __Sa5__ = (uint64_t)(__Arg5__);                                          \
+        uint64_t          __Sa6__ = (uint64_t)(__Arg6__);                                          \
+        register uint64_t __R10__ __asm__("r10") = __Sa4__;                                        \
+        register uint64_t __R8__ __asm__("r8")   = __Sa5__;                                        \
+        register uint64_t __R9__ __asm__("r9")   = __Sa6__;                                        \
+        int64_t           result;                                                                  \
+        __asm__ volatile("int $0x80"                                                               \
+                         : "=a"(result)                                                            \
+                         : "a"((uint64_t)(__SysNum__)),                                            \
+                           "D"(__Sa1__),                                                           \
+                           "S"(__Sa2__),                                                           \
+                           "d"(__Sa3__),                                                           \
+                           "r"(__R10__),                                                           \
+                           "r"(__R8__),                                                            \
+                           "r"(__R9__)                                                             \
+                         : "memory");                                                              \
         result;                                                                                    \
     })
 extern void SysEntASM(void);
+extern void SysCallEntry(void);
 void        InitSyscall(void);
-void        SyscallHandler(uint64_t __SyscallNo__,
-                           uint64_t __A1__,
-                           uint64_t __A2__,
-                           uint64_t __A3__,
-                           uint64_t __A4__,
-                           uint64_t __A5__,
-                           uint64_t __A6__);
\ No newline at end of file
+void        InitSyscallCpu(void);
+void        SyscallDispatch(InterruptFrame* __Frame__);
+void        SyscallStatsEnable(bool __Enable__);
+int         SyscallStatsRead(uint32_t __Index__, SysCallTotals* __Out__);
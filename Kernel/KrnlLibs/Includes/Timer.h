@@ -16,6 +16,7 @@ typedef enum
 
 #define TimerTargetFrequency 1000
 #define TimerVector          32
+#define TimerTickNs          (1000000000ULL / TimerTargetFrequency)
 
 typedef struct
 {
@@ -23,8 +24,9 @@ typedef struct
     uint64_t  ApicBase;
     uint64_t  HpetBase;
     uint32_t  TimerFrequency;
-    uint64_t  SystemTicks;
+    uint64_t  SystemTicks; /* Boot CPU ticks only, see ClockSource.h for time */
     uint32_t  TimerInitialized;
+    uint32_t  OneShot; /* LAPIC re-armed per interrupt for the tick or the next sleeper */
 
 } TimerManager;
 
@@ -47,4 +49,12 @@ int InitializePitTimer(void);
 uint64_t ReadMsr(uint32_t __Msr__);
 void     WriteMsr(uint32_t __Msr__, uint64_t __Value__);
 
+static inline uint64_t
+ReadTsc(void)
+{
+    uint32_t Low, High;
+    __asm__ volatile("rdtsc" : "=a"(Low), "=d"(High));
+    return ((uint64_t)High << 32) | Low;
+}
+
 void SetupApicTimerForThisCpu(void);
@@ -2,6 +2,7 @@
 
 #include <AllTypes.h>
 #include <KExports.h>
+#include <Sync.h>
 
 typedef struct Vnode         Vnode;
 typedef struct Dentry        Dentry;
@@ -17,6 +18,8 @@ typedef struct VfsPerm       VfsPerm;
 typedef struct VfsTimespec   VfsTimespec;
 typedef struct VfsMountFlags VfsMountFlags;
 typedef struct VfsNameBuf    VfsNameBuf;
+typedef struct VfsIovec      VfsIovec;
+typedef struct VfsDirCtx     VfsDirCtx;
 
 /*Node Type*/
 typedef enum VnodeType
@@ -56,6 +59,14 @@ typedef enum VfsSeekWhence
 
 } VfsSeekWhence;
 
+/*Readiness bits, poll(2) numbering*/
+#define VfsPollIn   0x001
+#define VfsPollPri  0x002
+#define VfsPollOut  0x004
+#define VfsPollErr  0x008
+#define VfsPollHup  0x010
+#define VfsPollNval 0x020
+
 /*Permissions*/
 typedef enum VfsPermMode
 {
@@ -172,6 +183,28 @@ typedef struct VfsDirEnt
 
 } VfsDirEnt; /*Dirent*/
 
+/*
+ * Readdir sink. The filesystem offers entries from Pos on, one Emit each, and
+ * bumps Pos past every entry taken; Emit returns 0 once the caller is full and
+ * that entry is offered again next time. Pos is File->Offset between calls.
+ */
+struct VfsDirCtx
+{
+    int (*Emit)(VfsDirCtx*, const char*, long, long, long); /*Name, length, ino, VnodeType*/
+    long Pos;
+};
+
+/*struct linux_dirent64, records padded to 8 bytes*/
+typedef struct VfsDirent64
+{
+    uint64_t Ino;
+    int64_t  Off; /*Pos after this entry*/
+    uint16_t Reclen;
+    uint8_t  Type; /*DT_* */
+    char     Name[];
+
+} VfsDirent64;
+
 typedef struct VfsNameBuf
 {
     char* Buf;
@@ -179,6 +212,14 @@ typedef struct VfsNameBuf
 
 } VfsNameBuf;
 
+/*One scatter-gather segment, laid out as struct iovec so user arrays pass straight through*/
+typedef struct VfsIovec
+{
+    void*  IovBase;
+    size_t IovLen;
+
+} VfsIovec;
+
 typedef struct VnodeOps
 {
     int (*Open)(Vnode*, File*);
@@ -204,6 +245,15 @@ typedef struct VnodeOps
     int (*Sync)(Vnode*);
     int (*Map)(Vnode*, void**, long, long);
     int (*Unmap)(Vnode*, void*, long);
+    /*In-filesystem copy at explicit offsets, bytes copied or -1 to use the generic loop*/
+    long (*CopyRange)(File*, long, File*, long, long);
+    /*Readiness bits now, and the queue woken when they change or NULL if they never do*/
+    uint32_t (*Poll)(File*, WaitQueue**);
+    /*Whole scatter-gather list in one call at the file position, File->Offset is left to the VFS*/
+    long (*ReadIter)(File*, const VfsIovec*, long);
+    long (*WriteIter)(File*, const VfsIovec*, long);
+    /*Batched readdir on an open directory, 0 or -1, entries go through the context*/
+    long (*Iterate)(File*, VfsDirCtx*);
 
 } VnodeOps;
 
@@ -284,19 +334,23 @@ Vnode*  VfsLookup(Dentry*, const char*);
 int     VfsMkpath(const char*, long);
 int     VfsRealpath(const char*, char*, long);
 
-File* VfsOpen(const char*, long);
-File* VfsOpenAt(Dentry*, const char*, long);
-int   VfsClose(File*);
-long  VfsRead(File*, void*, long);
-long  VfsWrite(File*, const void*, long);
-long  VfsLseek(File*, long, int);
-int   VfsIoctl(File*, unsigned long, void*);
-int   VfsFsync(File*);
-int   VfsFstats(File*, VfsStat*);
-int   VfsStats(const char*, VfsStat*);
+File*    VfsOpen(const char*, long);
+File*    VfsOpenAt(Dentry*, const char*, long);
+int      VfsClose(File*);
+long     VfsRead(File*, void*, long);
+long     VfsWrite(File*, const void*, long);
+long     VfsReadv(File*, const VfsIovec*, long);
+long     VfsWritev(File*, const VfsIovec*, long);
+long     VfsLseek(File*, long, int);
+int      VfsIoctl(File*, unsigned long, void*);
+uint32_t VfsPoll(File*, WaitQueue**);
+int      VfsFsync(File*);
+int      VfsFstats(File*, VfsStat*);
+int      VfsStats(const char*, VfsStat*);
 
 long VfsReaddir(const char*, void*, long);
 long VfsReaddirF(File*, void*, long);
+long VfsGetdents(File*, void*, long);
 
 int VfsCreate(const char*, long, VfsPerm);
 int VfsUnlink(const char*);
@@ -338,8 +392,11 @@ int VfsIsDir(const char*);
 int VfsIsFile(const char*);
 int VfsIsSymlink(const char*);
 
-int VfsCopy(const char*, const char*, long);
-int VfsMove(const char*, const char*, long);
+int  VfsCopy(const char*, const char*, long);
+int  VfsMove(const char*, const char*, long);
+long VfsCopyRange(File*, long*, File*, long*, long, long);
+
+#define VfsCopyChunk 65536 /*Bounce buffer of the generic VfsCopyRange loop, whole pages*/
 
 int VfsReadAll(const char*, void*, long, long*);
 int VfsWriteAll(const char*, const void*, long);
@@ -406,13 +463,17 @@ KEXPORT(VfsOpenAt);
 KEXPORT(VfsClose);
 KEXPORT(VfsRead);
 KEXPORT(VfsWrite);
+KEXPORT(VfsReadv);
+KEXPORT(VfsWritev);
 KEXPORT(VfsLseek);
 KEXPORT(VfsIoctl);
+KEXPORT(VfsPoll);
 KEXPORT(VfsFsync);
 KEXPORT(VfsFstats);
 KEXPORT(VfsStats);
 KEXPORT(VfsReaddir);
 KEXPORT(VfsReaddirF);
+KEXPORT(VfsGetdents);
 KEXPORT(VfsCreate);
 KEXPORT(VfsUnlink);
 KEXPORT(VfsMkdir);
@@ -449,6 +510,7 @@ KEXPORT(VfsIsFile);
 KEXPORT(VfsIsSymlink);
 KEXPORT(VfsCopy);
 KEXPORT(VfsMove);
+KEXPORT(VfsCopyRange);
 KEXPORT(VfsReadAll);
 KEXPORT(VfsWriteAll);
 KEXPORT(VfsJoinPath);
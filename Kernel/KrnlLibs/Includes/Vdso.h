@@ -0,0 +1,92 @@
+#pragma once
+
+#include <AllTypes.h>
+#include <KExports.h>
+#include <VMM.h>
+
+/*
+ * Virtual DSO, two pages mapped at the same address in every process. The
+ * image page starts with a VdsoHeader followed by the code from the VdsoText
+ * section, the data page after it is written by the kernel on every tick and
+ * only read from user mode. AT_SYSINFO_EHDR carries the image address.
+ */
+#define VdsoBase     0x00007FFFF0000000ULL
+#define VdsoDataBase (VdsoBase + PageSize)
+#define VdsoSize     (2 * PageSize)
+
+#define VdsoMagic   0x53445641 /* "AVDS" */
+#define VdsoVersion 1
+
+#define AtSysinfoEhdr 33 /* AT_SYSINFO_EHDR */
+
+#define VdsoMultShift 32 /* Fixed point of VdsoData.Mult */
+
+#define VdsoFlagSyscall 0x1 /* Clock not readable from user mode, callers take the syscall */
+
+/* Image header, mirrored in CLibrary/userland/sysmac.h */
+typedef struct
+{
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t ClockGettime; /* Offsets from VdsoBase, 0 when absent */
+    uint32_t Gettimeofday;
+    uint32_t DataOffset;
+    uint32_t Reserved[3];
+
+} VdsoHeader;
+
+typedef struct
+{
+    volatile uint32_t Seq;   /* Odd while the kernel is writing */
+    uint32_t          Flags; /* VdsoFlag* */
+    uint64_t          BaseNs;      /* Nanoseconds since boot at the last tick */
+    uint64_t          TscBase;     /* TSC read at that tick */
+    uint64_t          Mult;        /* ns per cycle << VdsoMultShift, 0 without a TSC */
+    uint64_t          MaxInterpNs; /* Cap on TscBase to now, keeps tick readings in order */
+    uint64_t          RealtimeOffsetNs; /* Added for CLOCK_REALTIME */
+
+} VdsoData;
+
+/*
+ * Nanoseconds since boot from a seqlocked VdsoData. Always inlined, it is
+ * compiled into the user-mode vDSO text as well as the kernel clock.
+ */
+static inline __attribute__((always_inline)) uint64_t
+VdsoReadNs(const volatile VdsoData* __Data__)
+{
+    uint32_t Seq;
+    uint64_t Ns;
+
+    do
+    {
+        Seq = __Data__->Seq;
+        while (Seq & 1)
+        {
+            __asm__ volatile("pause");
+            Seq = __Data__->Seq;
+        }
+        __asm__ volatile("" ::: "memory");
+
+        uint32_t Low, High;
+        __asm__ volatile("lfence; rdtsc" : "=a"(Low), "=d"(High));
+        uint64_t Tsc = ((uint64_t)High << 32) | Low;
+
+        uint64_t Delta = Tsc > __Data__->TscBase ? Tsc - __Data__->TscBase : 0;
+        uint64_t Extra =
+            (uint64_t)(((unsigned __int128)Delta * __Data__->Mult) >> VdsoMultShift);
+        if (Extra > __Data__->MaxInterpNs)
+        {
+            Extra = __Data__->MaxInterpNs;
+        }
+        Ns = __Data__->BaseNs + Extra;
+
+        __asm__ volatile("" ::: "memory");
+    } while (__Data__->Seq != Seq);
+
+    return Ns;
+}
+
+void     InitializeVdso(void);
+void     VdsoUpdate(void);
+uint64_t VdsoMap(VirtualMemorySpace* __Space__); /* Image address, 0 when not mapped */
+bool     VdsoIsVdsoAddress(uint64_t __Addr__);
@@ -48,6 +48,7 @@ typedef struct VirtImage
     uint32_t            Flags;
     void*               LoaderPriv;
     VirtAuxv            Auxv;
+    uint64_t            Vdso; /* Mapped vDSO image for AT_SYSINFO_EHDR, 0 when none */
 } VirtImage;
 
 typedef struct VirtRequest
@@ -71,6 +72,7 @@ uint64_t VirtSetupStack(VirtualMemorySpace* __Space__,
                         const char* const*  __Envp__,
                         int                 __Nx__,
                         uint64_t*           __OutRsp__);
+int      VirtStackFault(VirtualMemorySpace* __Space__, uint64_t __Addr__, uint64_t __ErrCode__);
 int      VirtLoad(const VirtRequest* __Req__, VirtImage* __OutImg__);
 int      VirtCommit(VirtImage* __Img__);
 
@@ -78,5 +80,6 @@ KEXPORT(VirtCreateSpace)
 KEXPORT(VirtMapPage)
 KEXPORT(VirtMapRangeZeroed)
 KEXPORT(VirtSetupStack)
+KEXPORT(VirtStackFault)
 KEXPORT(VirtLoad)
 KEXPORT(VirtCommit)
\ No newline at end of file
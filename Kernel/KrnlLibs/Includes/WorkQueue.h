@@ -0,0 +1,80 @@
+#pragma once
+
+#include <AllTypes.h>
+#include <AxeThreads.h>
+#include <KExports.h>
+#include <SMP.h>
+#include <Sync.h>
+
+/*
+ * Deferred work. SoftIrqs are a fixed set of per-CPU handlers raised from IRQ
+ * handlers and run on the way out of the interrupt, still with interrupts
+ * off. Work items run later in a per-CPU kernel worker thread and may sleep.
+ */
+
+typedef void (*WorkFunc)(void* __Arg__);
+typedef void (*SoftIrqHandler)(uint32_t __CpuId__);
+
+typedef struct WorkItem
+{
+    struct WorkItem*  Next;
+    WorkFunc          Func;
+    void*             Arg;
+    volatile uint32_t Pending; /* Queued and not started yet, requeue is a no-op */
+
+} WorkItem;
+
+typedef struct
+{
+    SpinLock       Lock;
+    WorkItem*      Head;
+    WorkItem*      Tail;
+    WaitQueue      Wait; /* The worker parks here while the list is empty */
+    struct Thread* Worker;
+    uint32_t       CpuId;
+
+    /*Statistics, bumped atomically and read without the lock*/
+    uint64_t Queued;
+    uint64_t Executed;
+    uint64_t Batches;
+    uint64_t MaxBatch; /* Most items one wakeup of the worker ran */
+
+} WorkQueueCpu;
+
+typedef struct
+{
+    uint64_t Queued;
+    uint64_t Executed;
+    uint64_t Batches;
+    uint64_t MaxBatch;
+
+} WorkQueueTotals;
+
+typedef struct
+{
+    const char* Name;
+    uint64_t    Runs; /* Handler calls, all CPUs */
+
+} SoftIrqTotals;
+
+typedef enum
+{
+    SoftIrqTimer, /* Tick bookkeeping and sleeper wakeups */
+    SoftIrqCount
+
+} SoftIrqVector;
+
+#define SoftIrqMaxRestart 4 /* Passes per IRQ exit before the rest goes to the worker */
+
+void InitializeWorkQueues(void);
+void InitWorkItem(WorkItem* __Item__, WorkFunc __Func__, void* __Arg__);
+bool QueueWorkOn(uint32_t __CpuId__, WorkItem* __Item__);
+int  WorkQueueStatsRead(uint32_t __CpuId__, WorkQueueTotals* __Out__);
+
+int  SoftIrqRegister(SoftIrqVector __Vector__, SoftIrqHandler __Handler__);
+void SoftIrqRaiseOn(uint32_t __CpuId__, SoftIrqVector __Vector__);
+void SoftIrqRun(uint32_t __CpuId__);
+int  SoftIrqStatsRead(uint32_t __Vector__, SoftIrqTotals* __Out__);
+
+KEXPORT(InitWorkItem);
+KEXPORT(QueueWorkOn);
@@ -17,13 +17,10 @@ StringCopy(char* __Dest__, const char* __Src__, uint32_t __MaxLen__)
 void*
 __builtin_memcpy(void* __Dest__, const void* __Src__, size_t __Size__)
 {
-    char*       Dest = __Dest__;
-    const char* Src  = __Src__;
-
-    while (__Size__--)
-    {
-        *Dest++ = *Src++;
-    }
+    /* rep movsb, fast strings make it the quickest bulk copy without SSE */
+    void*       Dest = __Dest__;
+    const void* Src  = __Src__;
+    __asm__ volatile("rep movsb" : "+D"(Dest), "+S"(Src), "+c"(__Size__) : : "memory");
 
     return __Dest__;
 }
@@ -1,38 +1,58 @@
 #include <AllTypes.h>
 #include <AxeSchd.h>
 #include <AxeThreads.h>
+#include <ClockSource.h>
+#include <FpuState.h>
 #include <KHeap.h>
 #include <KrnPrintf.h>
 #include <POSIXFd.h>
 #include <POSIXProc.h>
 #include <POSIXProcFS.h>
 #include <POSIXSignals.h>
+#include <POSIXUring.h>
+#include <StackCache.h>
 #include <String.h>
 #include <Sync.h>
+#include <SysABI.h>
 #include <Timer.h>
 #include <VFS.h>
 #include <VMM.h>
+#include <Vdso.h>
 #include <VirtBin.h>
 
 #define __attribute_unused__ __attribute__((unused))
 
-#define MaxProcs      32768
-#define MaxFdsDefault 256
-#define MaxPathLen    256
-#define DefaultUmask  022
+#define MaxProcs     32768
+#define MaxPathLen   256
+#define DefaultUmask 022
 
 #define TZombie 1
 #define TAlive  0
 
 #define RlimitMaxRss (64ULL * 1024ULL * 1024ULL)
 
-static long    __NextPid__ = 1;
-PosixProcTable PosixProcs  = {0};
+#define PidLeafShift 9
+#define PidLeafSize  (1L << PidLeafShift)
+#define PidLeafCount (MaxProcs / PidLeafSize)
+
+PosixProcTable PosixProcs = {0};
+
+/*
+ * Pid -> proc as a two level radix table, leaves are allocated on first use
+ * and never freed, so PosixFind is two acquire loads and takes no lock.
+ * Slots are cleared before a proc is freed. The bitmap and the cursor are
+ * guarded by the table's write lock, the cursor makes ids recycle only after
+ * the allocator wraps around.
+ */
+static PosixProc** __PidMap__[PidLeafCount];
+static uint64_t    __PidBitmap__[MaxProcs / 64];
+static long        __PidCursor__ = 1;
 
 static PosixProc* __AllocProc__(void);
 static void       __FreeProc__(PosixProc* __Proc__);
 static int        __AttachThread__(PosixProc* __Proc__, Thread* __Th__);
 static int        __DetachThread__(PosixProc* __Proc__);
+static int        __ThreadIsRunning__(Thread* __Th__);
 /*static int __CloneSpace__(VirtualMemorySpace*  __Src__,
                                                VirtualMemorySpace** __Out__);*/
 static int  __ForkCopyFds__(PosixProc* __Parent__, PosixProc* __Child__);
@@ -47,6 +67,10 @@ static int  __CreateTableIfNeeded__(void);
 static int  __TableInsert__(PosixProc* __Proc__);
 static int  __TableRemove__(PosixProc* __Proc__);
 static long __FindFreePid__(void);
+static void __ReleasePid__(long __Pid__);
+static void __LinkChild__(PosixProc* __Parent__, PosixProc* __Child__);
+static void __UnlinkChild__(PosixProc* __Parent__, PosixProc* __Child__);
+static void __ReparentChildren__(PosixProc* __Proc__);
 static int  __ResolveExecFile__(const char* __Path__, File** __OutFile__);
 static int  __EnsureCwdRoot__(PosixProc* __Proc__);
 
@@ -99,12 +123,22 @@ __ProcStateCode__(PosixProc* __Proc__)
 static PosixProc*
 __CurrentProc__(void)
 {
-    uint32_t CPU  = GetCurrentCpuId();
-    Thread*  Thrd = GetCurrentThread(CPU);
+    return PosixCurrent();
+}
+
+PosixProc*
+PosixCurrent(void)
+{
+    Thread* Thrd = GetCurrentThreadLocal();
     if (!Thrd)
     {
         return NULL;
     }
+    /* Attached threads carry their process, others resolve by pid as before */
+    if (Thrd->Process)
+    {
+        return (PosixProc*)Thrd->Process;
+    }
     return PosixFind((long)Thrd->ProcessId);
 }
 
@@ -262,10 +296,12 @@ PosixProcExecve(PosixProc*         __Proc__,
 
         Th->Context.Rip   = Img.Entry;
         Th->Context.Rsp   = UserSp;
+        Th->UserStack     = UserStackTop;
         Th->Type          = ThreadTypeUser;
         Th->State         = ThreadStateReady;
         Th->PageDirectory = (uint64_t)__Proc__->Space->PhysicalBase;
         Th->ProcessId     = __Proc__->Pid;
+        Th->Process       = __Proc__;
 
         if (__AttachThread__(__Proc__, Th) != 0)
         {
@@ -291,10 +327,12 @@ PosixProcExecve(PosixProc*         __Proc__,
 
         Th->Context.Rip   = Img.Entry;
         Th->Context.Rsp   = UserSp;
+        Th->UserStack     = UserStackTop;
         Th->Type          = ThreadTypeUser;
         Th->State         = ThreadStateReady;
         Th->PageDirectory = (uint64_t)__Proc__->Space->PhysicalBase;
         Th->ProcessId     = __Proc__->Pid;
+        Th->Process       = __Proc__;
 
         PDebug("Execve: Thread RIP=0x%llx RSP=0x%llx PD=0x%llx\n",
                (unsigned long long)Th->Context.Rip,
@@ -344,7 +382,7 @@ PosixFork(PosixProc* __Parent__, PosixProc** __OutChild__)
         return -1;
     }
 
-    Child->Ppid = __Parent__->Pid;
+    __LinkChild__(__Parent__, Child);
     Child->Pgrp = __Parent__->Pgrp;
     Child->Sid  = __Parent__->Sid;
     Child->Cred = __Parent__->Cred;
@@ -372,6 +410,7 @@ PosixFork(PosixProc* __Parent__, PosixProc** __OutChild__)
     Cth->Context.Rax    = 0; /* fork return value in child */
     Cth->Context.Rip    = __ParentRip__;
     Cth->Context.Rsp    = __ParentRsp__;
+    Cth->UserStack      = Pth->UserStack;
     Cth->Context.Cs     = 0x23;
     Cth->Context.Ss     = 0x1b;
     Cth->Context.Rflags = 0x202;
@@ -379,6 +418,8 @@ PosixFork(PosixProc* __Parent__, PosixProc** __OutChild__)
     Cth->State          = ThreadStateReady;
     Cth->PageDirectory  = (uint64_t)Child->Space->PhysicalBase;
     Cth->ProcessId      = (uint32_t)Child->Pid;
+    Cth->Process        = Child;
+    FpuCopyState(Cth, Pth);
 
     /* More direct copy
         TODO: Probably add COW(Copy On Write)
@@ -433,6 +474,18 @@ PosixFork(PosixProc* __Parent__, PosixProc** __OutChild__)
                         continue;
                     }
 
+                    /* Shared with every process, a private copy would stop ticking */
+                    if (VdsoIsVdsoAddress(__Va__))
+                    {
+                        continue;
+                    }
+
+                    /* Rings stay with the parent, their fds are not inherited */
+                    if (PosixUringIsRingAddress(__Va__))
+                    {
+                        continue;
+                    }
+
                     uint64_t __SrcPhys__ = __Leaf__ & 0x000FFFFFFFFFF000ULL;
                     uint64_t __NewPhys__ = AllocPage();
                     if (__NewPhys__ == 0)
@@ -456,6 +509,8 @@ PosixFork(PosixProc* __Parent__, PosixProc** __OutChild__)
         }
     }
 
+    VdsoMap(Child->Space);
+
     if (__AttachThread__(Child, Cth) != 0)
     {
         DestroyThread(Cth);
@@ -484,22 +539,11 @@ PosixExit(PosixProc* __Proc__, int __Status__)
     }
 
     __Proc__->ExitCode = __Status__;
-    __Proc__->Zombie   = 1;
 
     __UpdateTimesOnExit__(__Proc__);
 
     AcquireSpinLock(&ThreadListLock);
 
-    /* clear per-CPU current thread references */
-    for (uint32_t CpuIndex = 0; CpuIndex < MaxCPUs; CpuIndex++)
-    {
-        Thread* Ct = CurrentThreads[CpuIndex];
-        if (Ct && (long)Ct->ProcessId == __Proc__->Pid)
-        {
-            CurrentThreads[CpuIndex] = NULL;
-        }
-    }
-
     __DetachThread__(__Proc__);
 
     Thread* ThreadPtr = ThreadList;
@@ -509,21 +553,49 @@ PosixExit(PosixProc* __Proc__, int __Status__)
         if ((long)ThreadPtr->ProcessId == __Proc__->Pid)
         {
             ThreadPtr->State = ThreadStateTerminated;
-            DestroyThread(ThreadPtr);
-            PInfo("Exit: Destroyed ThreadId=%u of Pid=%u\n", ThreadPtr->ThreadId, __Proc__->Pid);
+            if (!__ThreadIsRunning__(ThreadPtr))
+            {
+                DestroyThread(ThreadPtr);
+                PInfo("Exit: Destroyed ThreadId=%u of Pid=%u\n",
+                      ThreadPtr->ThreadId,
+                      __Proc__->Pid);
+            }
         }
         ThreadPtr = NextThread;
     }
 
     ReleaseSpinLock(&ThreadListLock);
 
-    PosixProc* ParentProc = PosixFind(__Proc__->Ppid);
-    if (ParentProc)
+    __ReparentChildren__(__Proc__);
+
+    /*
+     * Zombie goes up last, the parent's wait4 may reap and free us the moment
+     * it sees it. Set and announced under the parent's lock with Ppid checked
+     * again, so a parent reparenting us meanwhile is retried with the new one.
+     */
+    long Pid = __Proc__->Pid;
+    for (;;)
     {
-        __WakeParent__(ParentProc, __Proc__);
+        long       Ppid       = __Proc__->Ppid;
+        PosixProc* ParentProc = PosixFind(Ppid);
+        if (!ParentProc)
+        {
+            __atomic_store_n(&__Proc__->Zombie, 1, __ATOMIC_RELEASE);
+            break;
+        }
+
+        AcquireSpinLock(&ParentProc->Lock);
+        if (__Proc__->Ppid == Ppid)
+        {
+            __atomic_store_n(&__Proc__->Zombie, 1, __ATOMIC_RELEASE);
+            __WakeParent__(ParentProc, __Proc__);
+            ReleaseSpinLock(&ParentProc->Lock);
+            break;
+        }
+        ReleaseSpinLock(&ParentProc->Lock);
     }
 
-    PSuccess("Exit (zombie): Pid=%ld Status=%d\n", __Proc__->Pid, __Status__);
+    PSuccess("Exit (zombie): Pid=%ld Status=%d\n", Pid, __Status__);
     return 0;
 }
 
@@ -544,55 +616,73 @@ PosixWait4(PosixProc*   __Parent__,
 
     for (;;)
     {
-        for (long I = 1; I <= MaxProcs; I++)
+        /* Queue before scanning so an exit racing with the scan still wakes us */
+        WaitQueuePrepare(&__Parent__->ChildWait, WaitReasonChild, 0);
+
+        long       HaveChild = 0;
+        PosixProc* P         = NULL;
+
+        /* Only this parent's children, unlinked under its lock so one waiter reaps */
+        AcquireSpinLock(&__Parent__->Lock);
+        for (PosixProc* C = __Parent__->Children; C; C = C->SiblingNext)
         {
-            PosixProc* P = PosixFind(I);
-            if (!P || P->Ppid != __Parent__->Pid)
+            if (TargetPid > 0 && C->Pid != TargetPid)
             {
                 continue;
             }
-            if (TargetPid > 0 && P->Pid != TargetPid)
+            HaveChild = 1;
+
+            if (__atomic_load_n(&C->Zombie, __ATOMIC_ACQUIRE))
             {
-                continue;
+                __UnlinkChild__(__Parent__, C);
+                P = C;
+                break;
             }
+        }
+        ReleaseSpinLock(&__Parent__->Lock);
 
-            if (P->Zombie)
-            {
-                if (__OutStatus__)
-                {
-                    *__OutStatus__ = P->ExitCode;
-                }
-                if (__OutUsage__)
-                {
-                    __OutUsage__->UtimeUsec       = P->Times.UserUsec;
-                    __OutUsage__->StimeUsec       = P->Times.SysUsec;
-                    __OutUsage__->MaxRss          = RlimitMaxRss;
-                    __OutUsage__->MinorFaults     = 0;
-                    __OutUsage__->MajorFaults     = 0;
-                    __OutUsage__->VoluntaryCtxt   = 0;
-                    __OutUsage__->InvoluntaryCtxt = 0;
-                }
+        if (P)
+        {
+            WaitQueueCancel(&__Parent__->ChildWait);
 
-                long ReapedId = P->Pid;
-                ProcFsNotifyProcRemoved(P);
-                __TableRemove__(P);
-                __FreeProc__(P);
-                PSuccess("Wait4: reaped=%ld\n", ReapedId);
-                return ReapedId;
+            if (__OutStatus__)
+            {
+                *__OutStatus__ = P->ExitCode;
+            }
+            if (__OutUsage__)
+            {
+                __OutUsage__->UtimeUsec       = P->Times.UserUsec;
+                __OutUsage__->StimeUsec       = P->Times.SysUsec;
+                __OutUsage__->MaxRss          = RlimitMaxRss;
+                __OutUsage__->MinorFaults     = 0;
+                __OutUsage__->MajorFaults     = 0;
+                __OutUsage__->VoluntaryCtxt   = 0;
+                __OutUsage__->InvoluntaryCtxt = 0;
             }
+
+            long ReapedId = P->Pid;
+            ProcFsNotifyProcRemoved(P);
+            __TableRemove__(P);
+            __FreeProc__(P);
+            PSuccess("Wait4: reaped=%ld\n", ReapedId);
+            return ReapedId;
         }
 
-        if (__Options__ & WNOHANG)
+        if (!HaveChild)
         {
-            return 0;
+            /* Nothing could ever wake us (ECHILD) */
+            WaitQueueCancel(&__Parent__->ChildWait);
+            return -1;
         }
 
-        if (__Parent__->MainThread)
+        if (__Options__ & WNOHANG)
         {
-            __Parent__->MainThread->State      = ThreadStateBlocked;
-            __Parent__->MainThread->WaitReason = WaitReasonChild;
+            WaitQueueCancel(&__Parent__->ChildWait);
+            return 0;
         }
-        ThreadYield();
+
+        /* Parked until __WakeParent__ */
+        WaitQueueCommit(&__Parent__->ChildWait);
     }
 }
 
@@ -715,6 +805,115 @@ PosixKill(long __Pid__, int __Sig__)
     }
     /* Enqueue signal bit */
     P->SigPending |= (1ULL << (__Sig__ & 63));
+    /* Cut an interruptible sleep short, it returns EINTR and delivery runs on the way out */
+    if (P->MainThread)
+    {
+        WakeSleepingThread(P->MainThread);
+    }
+    return 0;
+}
+
+/*
+ * Whether a pending signal would do something on delivery: unmasked, and
+ * either caught or one of the signals that terminate by default. Anything
+ * else is discarded by delivery and must not interrupt a sleep.
+ */
+bool
+PosixSignalPending(PosixProc* __Proc__)
+{
+    if (!__Proc__)
+    {
+        return false;
+    }
+
+    uint64_t Pend = __atomic_load_n(&__Proc__->SigPending, __ATOMIC_ACQUIRE) & ~__Proc__->SigMask;
+    if (Pend == 0)
+    {
+        return false;
+    }
+
+    uint64_t Fatal = (1ULL << SigTerm) | (1ULL << SigKill) | (1ULL << SigInt);
+    if (Pend & Fatal)
+    {
+        return true;
+    }
+
+    Thread* Main = __Proc__->MainThread;
+    if (!Main)
+    {
+        return false;
+    }
+    for (int S = 1; S <= 31; S++)
+    {
+        if ((Pend & (1ULL << S)) && Main->SignalHandlers[S])
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+long
+PosixClockNanosleep(PosixProc* __Proc__,
+                    long       __ClockId__,
+                    int        __Flags__,
+                    uint64_t   __Ns__,
+                    uint64_t*  __LeftNs__)
+{
+    if (__ClockId__ != ClockIdRealtime && __ClockId__ != ClockIdMonotonic &&
+        __ClockId__ != ClockIdBoottime)
+    {
+        return -SysErrInval;
+    }
+
+    /* Every deadline is kept on the monotonic clock the sleeping queue sorts by */
+    uint64_t Mono = ClockMonotonicNs();
+    uint64_t Deadline;
+    if (__Flags__ & PosixTimerAbstime)
+    {
+        uint64_t Now = 0;
+        if (ClockGetNs(__ClockId__, &Now) != 0)
+        {
+            return -SysErrInval;
+        }
+        if (__Ns__ <= Now)
+        {
+            return 0;
+        }
+        uint64_t Rel = __Ns__ - Now;
+        Deadline     = Rel > ~0ULL - Mono ? ~0ULL : Mono + Rel;
+    }
+    else
+    {
+        Deadline = __Ns__ > ~0ULL - Mono ? ~0ULL : Mono + __Ns__;
+    }
+
+    /* Kernel threads outside a process have no signals to wait out */
+    if (!GetCurrentThreadLocal())
+    {
+        while (ClockMonotonicNs() < Deadline)
+        {
+            __asm__ volatile("hlt");
+        }
+        return 0;
+    }
+
+    while (ClockMonotonicNs() < Deadline)
+    {
+        /* Published as sleeping before the check, so a kill in between still wakes us */
+        ThreadSleepPrepare(Deadline);
+        if (PosixSignalPending(__Proc__))
+        {
+            ThreadSleepCancel();
+            if (__LeftNs__)
+            {
+                uint64_t Now = ClockMonotonicNs();
+                *__LeftNs__  = Deadline > Now ? Deadline - Now : 0;
+            }
+            return -SysErrIntr;
+        }
+        ThreadSleepCommit();
+    }
     return 0;
 }
 
@@ -727,7 +926,9 @@ PosixTkill(long __Tid__, int __Sig__)
     {
         return -1;
     }
-    return PosixKill((long)Th->ProcessId, __Sig__);
+    long Pid = (long)Th->ProcessId;
+    ThreadPut(Th);
+    return PosixKill(Pid, __Sig__);
 }
 
 int
@@ -833,14 +1034,21 @@ PosixSigqueue(long __Pid__, int __Sig__, int __Value__)
 int
 PosixDeliverSignals(void)
 {
-    for (long I = 1; I <= MaxProcs; I++)
+    /* Walk allocated pids only, a whole free word is skipped at once */
+    for (long Word = 0; Word < MaxProcs / 64; Word++)
     {
-        PosixProc* P = PosixFind(I);
-        if (!P)
+        uint64_t Bits = __atomic_load_n(&__PidBitmap__[Word], __ATOMIC_RELAXED);
+        while (Bits)
         {
-            continue;
+            long Bit = __builtin_ctzll(Bits);
+            Bits &= Bits - 1;
+
+            PosixProc* P = PosixFind(Word * 64 + Bit);
+            if (P)
+            {
+                __DeliverPendingSignals__(P);
+            }
         }
-        __DeliverPendingSignals__(P);
     }
     return 0;
 }
@@ -848,19 +1056,17 @@ PosixDeliverSignals(void)
 PosixProc*
 PosixFind(long __Pid__)
 {
-    if (__Pid__ <= 0 || !PosixProcs.Items)
+    if (__Pid__ <= 0 || __Pid__ >= MaxProcs)
     {
         return NULL;
     }
-    for (long I = 0; I < PosixProcs.Count; I++)
+
+    PosixProc** Leaf = __atomic_load_n(&__PidMap__[__Pid__ >> PidLeafShift], __ATOMIC_ACQUIRE);
+    if (!Leaf)
     {
-        PosixProc* P = PosixProcs.Items[I];
-        if (P && P->Pid == __Pid__)
-        {
-            return P;
-        }
+        return NULL;
     }
-    return NULL;
+    return __atomic_load_n(&Leaf[__Pid__ & (PidLeafSize - 1)], __ATOMIC_ACQUIRE);
 }
 
 static int
@@ -877,57 +1083,210 @@ __CreateTableIfNeeded__(void)
     {
         return -1;
     }
-    InitializeSpinLock(&PosixProcs.Lock, "PosixProcs");
+    InitializeRwSpinLock(&PosixProcs.Lock, "PosixProcs");
+    __PidBitmap__[0] = 1; /* Pid 0 is never handed out */
     return 0;
 }
 
 static long
 __FindFreePid__(void)
 {
-    /* Naive monotonic PID allocation */
-    long pid = __NextPid__++;
-    if (pid <= 0)
+    uint64_t Flags = AcquireWriteSpinLock(&PosixProcs.Lock);
+
+    long Pid = __PidCursor__;
+    for (long Scanned = 0; Scanned < MaxProcs;)
     {
-        pid = (__NextPid__ = 1);
+        if (Pid >= MaxProcs)
+        {
+            Pid = 1;
+        }
+
+        uint64_t Word = __PidBitmap__[Pid / 64];
+        if (Word == ~0ULL)
+        {
+            /* Full word, jump to the next one */
+            Scanned += 64 - (Pid % 64);
+            Pid = (Pid | 63) + 1;
+            continue;
+        }
+
+        if (!(Word & (1ULL << (Pid % 64))))
+        {
+            __PidBitmap__[Pid / 64] = Word | (1ULL << (Pid % 64));
+            __PidCursor__           = Pid + 1;
+            ReleaseWriteSpinLock(&PosixProcs.Lock, Flags);
+            return Pid;
+        }
+
+        Pid++;
+        Scanned++;
     }
-    return pid;
+
+    ReleaseWriteSpinLock(&PosixProcs.Lock, Flags);
+    return -1;
+}
+
+static void
+__ReleasePid__(long __Pid__)
+{
+    if (__Pid__ <= 0 || __Pid__ >= MaxProcs)
+    {
+        return;
+    }
+
+    uint64_t Flags = AcquireWriteSpinLock(&PosixProcs.Lock);
+    __PidBitmap__[__Pid__ / 64] &= ~(1ULL << (__Pid__ % 64));
+    ReleaseWriteSpinLock(&PosixProcs.Lock, Flags);
 }
 
 static int
 __TableInsert__(PosixProc* __Proc__)
 {
-    AcquireSpinLock(&PosixProcs.Lock);
+    long Pid = __Proc__->Pid;
+    if (Pid <= 0 || Pid >= MaxProcs)
+    {
+        return -1;
+    }
+
+    /* Leaf allocated outside the lock, a racing insert may win and this one is dropped */
+    PosixProc** NewLeaf = NULL;
+    if (!__atomic_load_n(&__PidMap__[Pid >> PidLeafShift], __ATOMIC_ACQUIRE))
+    {
+        NewLeaf = (PosixProc**)KMalloc(sizeof(PosixProc*) * PidLeafSize);
+        if (!NewLeaf)
+        {
+            return -1;
+        }
+        memset(NewLeaf, 0, sizeof(PosixProc*) * PidLeafSize);
+    }
+
+    uint64_t Flags = AcquireWriteSpinLock(&PosixProcs.Lock);
     if (PosixProcs.Count >= PosixProcs.Cap)
     {
-        ReleaseSpinLock(&PosixProcs.Lock);
+        ReleaseWriteSpinLock(&PosixProcs.Lock, Flags);
+        if (NewLeaf)
+        {
+            KFree(NewLeaf);
+        }
         return -1;
     }
+
+    PosixProc** Leaf = __PidMap__[Pid >> PidLeafShift];
+    if (!Leaf)
+    {
+        Leaf    = NewLeaf;
+        NewLeaf = NULL;
+        __atomic_store_n(&__PidMap__[Pid >> PidLeafShift], Leaf, __ATOMIC_RELEASE);
+    }
+
+    __Proc__->TableIndex                 = PosixProcs.Count;
     PosixProcs.Items[PosixProcs.Count++] = __Proc__;
-    ReleaseSpinLock(&PosixProcs.Lock);
+    __atomic_store_n(&Leaf[Pid & (PidLeafSize - 1)], __Proc__, __ATOMIC_RELEASE);
+    ReleaseWriteSpinLock(&PosixProcs.Lock, Flags);
+
+    if (NewLeaf)
+    {
+        KFree(NewLeaf);
+    }
     return 0;
 }
 
 static int
 __TableRemove__(PosixProc* __Proc__)
 {
-    AcquireSpinLock(&PosixProcs.Lock);
-    long idx = -1;
-    for (long I = 0; I < PosixProcs.Count; I++)
+    uint64_t Flags = AcquireWriteSpinLock(&PosixProcs.Lock);
+
+    long Idx = __Proc__->TableIndex;
+    if (Idx >= 0 && Idx < PosixProcs.Count && PosixProcs.Items[Idx] == __Proc__)
+    {
+        PosixProc* Last                        = PosixProcs.Items[PosixProcs.Count - 1];
+        PosixProcs.Items[Idx]                  = Last;
+        Last->TableIndex                       = Idx;
+        PosixProcs.Items[PosixProcs.Count - 1] = NULL;
+        PosixProcs.Count--;
+        __Proc__->TableIndex = -1;
+
+        PosixProc** Leaf = __PidMap__[__Proc__->Pid >> PidLeafShift];
+        __atomic_store_n(&Leaf[__Proc__->Pid & (PidLeafSize - 1)], NULL, __ATOMIC_RELEASE);
+    }
+
+    ReleaseWriteSpinLock(&PosixProcs.Lock, Flags);
+    return 0;
+}
+
+static void
+__LinkChild__(PosixProc* __Parent__, PosixProc* __Child__)
+{
+    AcquireSpinLock(&__Parent__->Lock);
+    __Child__->Ppid        = __Parent__->Pid;
+    __Child__->SiblingPrev = NULL;
+    __Child__->SiblingNext = __Parent__->Children;
+    if (__Parent__->Children)
+    {
+        __Parent__->Children->SiblingPrev = __Child__;
+    }
+    __Parent__->Children = __Child__;
+    ReleaseSpinLock(&__Parent__->Lock);
+}
+
+/* Caller holds __Parent__->Lock */
+static void
+__UnlinkChild__(PosixProc* __Parent__, PosixProc* __Child__)
+{
+    if (__Child__->SiblingPrev)
+    {
+        __Child__->SiblingPrev->SiblingNext = __Child__->SiblingNext;
+    }
+    else
+    {
+        __Parent__->Children = __Child__->SiblingNext;
+    }
+    if (__Child__->SiblingNext)
+    {
+        __Child__->SiblingNext->SiblingPrev = __Child__->SiblingPrev;
+    }
+    __Child__->SiblingNext = NULL;
+    __Child__->SiblingPrev = NULL;
+}
+
+static void
+__ReparentChildren__(PosixProc* __Proc__)
+{
+    /* Detach the whole list first, init's lock is never taken inside ours */
+    AcquireSpinLock(&__Proc__->Lock);
+    PosixProc* C       = __Proc__->Children;
+    __Proc__->Children = NULL;
+    ReleaseSpinLock(&__Proc__->Lock);
+
+    PosixProc* Init = PosixFind(1);
+    if (Init == __Proc__)
     {
-        if (PosixProcs.Items[I] == __Proc__)
+        Init = NULL;
+    }
+
+    int HaveZombie = 0;
+    while (C)
+    {
+        PosixProc* Next = C->SiblingNext;
+        if (Init)
         {
-            idx = I;
-            break;
+            __LinkChild__(Init, C);
+            HaveZombie |= C->Zombie;
         }
+        else
+        {
+            C->Ppid        = 0;
+            C->SiblingNext = NULL;
+            C->SiblingPrev = NULL;
+        }
+        C = Next;
     }
-    if (idx >= 0)
+
+    /* Init has to learn about orphans that already exited */
+    if (Init && HaveZombie)
     {
-        PosixProcs.Items[idx]                  = PosixProcs.Items[PosixProcs.Count - 1];
-        PosixProcs.Items[PosixProcs.Count - 1] = NULL;
-        PosixProcs.Count--;
+        __WakeParent__(Init, __Proc__);
     }
-    ReleaseSpinLock(&PosixProcs.Lock);
-    return 0;
 }
 
 static PosixProc*
@@ -940,6 +1299,8 @@ __AllocProc__(void)
     }
     memset(P, 0, sizeof(*P));
     InitializeSpinLock(&P->Lock, "proc");
+    InitializeWaitQueue(&P->ChildWait, "proc-child");
+    P->TableIndex = -1;
 
     /* allocate cmdline/environ buffers */
     P->CmdlineBuf = (char*)KMalloc(4096);
@@ -973,15 +1334,7 @@ __FreeProc__(PosixProc* __Proc__)
 
     if (__Proc__->Fds)
     {
-        for (long I = 0; I < __Proc__->Fds->Cap; I++)
-        {
-            PosixFd* E = &__Proc__->Fds->Entries[I];
-            if (E->Fd >= 0)
-            {
-                PosixClose(__Proc__->Fds, (int)E->Fd);
-            }
-        }
-        KFree(__Proc__->Fds->Entries);
+        PosixFdDestroy(__Proc__->Fds);
         KFree(__Proc__->Fds);
         __Proc__->Fds = NULL;
     }
@@ -1002,6 +1355,9 @@ __FreeProc__(PosixProc* __Proc__)
         DestroyVirtualSpace(__Proc__->Space);
         __Proc__->Space = NULL;
     }
+
+    /* Unpublished by __TableRemove__ already (or never inserted), the id may go */
+    __ReleasePid__(__Proc__->Pid);
     KFree(__Proc__);
 }
 
@@ -1014,9 +1370,28 @@ __AttachThread__(PosixProc* __Proc__, Thread* __Th__)
     }
     __Proc__->MainThread = __Th__;
     __Th__->ProcessId    = (uint32_t)__Proc__->Pid;
+    __Th__->Process      = __Proc__;
     __Th__->State        = ThreadStateReady;
     return 0;
 }
+/*
+ * A thread current on some CPU is still executing on its kernel stack (an exit
+ * syscall runs on it), so it is only marked terminated. Its CPU parks it on the
+ * zombie queue at the next switch and destroys it from a later Schedule.
+ */
+static int
+__ThreadIsRunning__(Thread* __Th__)
+{
+    for (uint32_t CpuIndex = 0; CpuIndex < MaxCPUs; CpuIndex++)
+    {
+        if (GetCurrentThread(CpuIndex) == __Th__)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 static int
 __DetachThread__(PosixProc* __Proc__)
 {
@@ -1028,7 +1403,10 @@ __DetachThread__(PosixProc* __Proc__)
     if (Th)
     {
         Th->State = ThreadStateTerminated; /*Sceduler will automatically remove from ready*/
-        DestroyThread(Th);
+        if (!__ThreadIsRunning__(Th))
+        {
+            DestroyThread(Th);
+        }
         __Proc__->MainThread = NULL;
     }
     return 0;
@@ -1056,46 +1434,15 @@ __ForkCopyFds__(PosixProc* __Parent__, PosixProc* __Child__)
         PError("ForkFds: table alloc failed\n");
         return -1;
     }
-    if (PosixFdInit(__Child__->Fds, __Parent__->Fds->Cap) != 0)
+    /* Copy on write, the entries are only duplicated once either side changes them */
+    if (PosixFdFork(__Parent__->Fds, __Child__->Fds) != 0)
     {
         KFree(__Child__->Fds);
         __Child__->Fds = NULL;
-        PError("ForkFds: init failed\n");
+        PError("ForkFds: table share failed\n");
         return -1;
     }
 
-    /* Duplicate entries with refcounts */
-    for (long I = 0; I < __Parent__->Fds->Cap; I++)
-    {
-        PosixFd* E = &__Parent__->Fds->Entries[I];
-        if (E->Fd < 0)
-        {
-            continue;
-        }
-
-        int NewFd = __FindFreeFd__(__Child__->Fds, 0);
-        if (NewFd < 0)
-        {
-            PError("ForkFds: no free fd\n");
-            return -1;
-        }
-
-        __Child__->Fds->Entries[NewFd]    = *E;
-        __Child__->Fds->Entries[NewFd].Fd = NewFd;
-        __Child__->Fds->Entries[NewFd].Refcnt++;
-
-        if (__Child__->Fds->Entries[NewFd].IsFile && __Child__->Fds->Entries[NewFd].Obj)
-        {
-            ((File*)__Child__->Fds->Entries[NewFd].Obj)->Refcnt++;
-        }
-
-        __Child__->Fds->Count++;
-    }
-
-    __Child__->Fds->StdinFd  = __Parent__->Fds->StdinFd;
-    __Child__->Fds->StdoutFd = __Parent__->Fds->StdoutFd;
-    __Child__->Fds->StderrFd = __Parent__->Fds->StderrFd;
-
     /* Comm, cmdline, environ (bounded copy) */
     StringCopy(__Child__->Comm, __Parent__->Comm, (uint32_t)sizeof(__Child__->Comm));
 
@@ -1132,7 +1479,7 @@ __SetDefaultFds__(PosixProc* __Proc__)
         return -1;
     }
 
-    if (PosixFdInit(__Proc__->Fds, MaxFdsDefault) != 0)
+    if (PosixFdInit(__Proc__->Fds, PosixFdMin) != 0)
     {
         KFree(__Proc__->Fds);
         __Proc__->Fds = NULL;
@@ -1284,9 +1631,12 @@ __PopulateTimesStart__(PosixProc* __Proc__)
 static int
 __UpdateTimesOnExit__(PosixProc* __Proc__)
 {
-    uint64_t now = GetSystemTicks();
-    uint64_t dur = (now > __Proc__->Times.StartTick) ? (now - __Proc__->Times.StartTick) : 0;
-    __Proc__->Times.SysUsec += dur * 1000; /* pretend 1 tick = 1ms */
+    /* User and kernel time are not split yet, all of it is reported as system time */
+    Thread* Main = __Proc__->MainThread;
+    if (Main)
+    {
+        __Proc__->Times.SysUsec += __atomic_load_n(&Main->CpuTime, __ATOMIC_SEQ_CST) / NsPerUsec;
+    }
     return 0;
 }
 
@@ -1333,6 +1683,9 @@ __WakeParent__(PosixProc* __Parent__, PosixProc* __Child__)
     }
     /* Set SIGCHLD pending on parent */
     __Parent__->SigPending |= (1ULL << (SigChld & 63));
+
+    /* Release any wait4 sleeping on this parent */
+    WaitQueueWakeAll(&__Parent__->ChildWait);
 }
 
 static int
@@ -1,29 +1,23 @@
 #include <AllTypes.h>
+#include <AxeThreads.h>
 #include <DevFS.h>
 #include <KHeap.h>
 #include <KrnPrintf.h>
 #include <POSIXFd.h>
+#include <POSIXPoll.h>
+#include <POSIXUring.h>
 #include <String.h>
 #include <Sync.h>
+#include <SysABI.h>
 #include <VFS.h>
 
 /*Most of all POSIX Shimming live here,
     as well as on the Proc.c*/
 
-typedef struct PosixPipeT
-{
-    char*    Buf;
-    long     Cap;
-    long     Head;
-    long     Tail;
-    long     Len;
-    SpinLock Lock;
-} PosixPipeT;
-
 static int
 __IsValidFd__(PosixFdTable* __Tab__, int __Fd__)
 {
-    return (__Fd__ >= 0 && (long)__Fd__ < __Tab__->Cap);
+    return (__Fd__ >= 0 && (long)__Fd__ < __Tab__->Set->Cap);
 }
 
 static PosixFd*
@@ -33,118 +27,481 @@ __GetEntry__(PosixFdTable* __Tab__, int __Fd__)
     {
         return NULL;
     }
-    return &__Tab__->Entries[__Fd__];
+    return &__Tab__->Set->Entries[__Fd__];
 }
 
-int
-__FindFreeFd__(PosixFdTable* __Tab__, int __Start__)
+static void
+__InitEntry__(PosixFd* __E__)
+{
+    __E__->Fd      = -1;
+    __E__->FdFlags = 0;
+    __E__->Desc    = NULL;
+}
+
+/* Entries, OpenMap and FullMap share the one allocation, everything starts free */
+static PosixFdSet*
+__SetAlloc__(long __Cap__)
 {
-    long I = (__Start__ < 0) ? 0 : (long)__Start__;
-    for (; I < __Tab__->Cap; I++)
+    long   Words = __Cap__ >> 6;
+    long   Fulls = (Words + 63) >> 6;
+    size_t Size  = sizeof(PosixFdSet) + (size_t)__Cap__ * sizeof(PosixFd) +
+                  (size_t)(Words + Fulls) * sizeof(uint64_t);
+    PosixFdSet* S = (PosixFdSet*)KMalloc(Size);
+    if (!S)
+    {
+        return NULL;
+    }
+    S->Refs    = 1;
+    S->Cap     = __Cap__;
+    S->Count   = 0;
+    S->NextFd  = 0;
+    S->Rings   = 0;
+    S->Entries = (PosixFd*)(S + 1);
+    S->OpenMap = (uint64_t*)(S->Entries + __Cap__);
+    S->FullMap = S->OpenMap + Words;
+    memset(S->OpenMap, 0, (size_t)(Words + Fulls) * sizeof(uint64_t));
+    for (long I = 0; I < __Cap__; I++)
     {
-        if (__Tab__->Entries[I].Fd < 0)
+        __InitEntry__(&S->Entries[I]);
+    }
+    return S;
+}
+
+static void
+__SetMark__(PosixFdSet* __S__, long __Fd__)
+{
+    uint64_t* Word = &__S__->OpenMap[__Fd__ >> 6];
+    *Word |= 1ULL << (__Fd__ & 63);
+    if (*Word == ~0ULL)
+    {
+        __S__->FullMap[__Fd__ >> 12] |= 1ULL << ((__Fd__ >> 6) & 63);
+    }
+}
+
+static void
+__SetUnmark__(PosixFdSet* __S__, long __Fd__)
+{
+    __S__->OpenMap[__Fd__ >> 6] &= ~(1ULL << (__Fd__ & 63));
+    __S__->FullMap[__Fd__ >> 12] &= ~(1ULL << ((__Fd__ >> 6) & 63));
+}
+
+/* Lowest clear bit at or above __Start__, whole words skipped through FullMap, -1 when full */
+static long
+__SetFirstFree__(PosixFdSet* __S__, long __Start__)
+{
+    long Words = __S__->Cap >> 6;
+    long W     = __Start__ >> 6;
+    if (W >= Words)
+    {
+        return -1;
+    }
+
+    uint64_t Free = ~__S__->OpenMap[W] & (~0ULL << (__Start__ & 63));
+    if (Free)
+    {
+        return (W << 6) + __builtin_ctzll(Free);
+    }
+
+    for (W++; W < Words;)
+    {
+        uint64_t Open = ~__S__->FullMap[W >> 6] & (~0ULL << (W & 63));
+        if (!Open)
+        {
+            W = (W | 63) + 1;
+            continue;
+        }
+        W = (W & ~63L) + __builtin_ctzll(Open);
+        if (W >= Words)
         {
-            return (int)I;
+            break;
         }
+        return (W << 6) + __builtin_ctzll(~__S__->OpenMap[W]);
     }
     return -1;
 }
 
+/* A private set of __Cap__ slots holding __Src__'s fds, each one a new reference */
+static PosixFdSet*
+__SetClone__(PosixFdSet* __Src__, long __Cap__, int __SkipRings__)
+{
+    PosixFdSet* S = __SetAlloc__(__Cap__);
+    if (!S)
+    {
+        return NULL;
+    }
+    for (long W = 0; W < (__Src__->Cap >> 6); W++)
+    {
+        for (uint64_t Bits = __Src__->OpenMap[W]; Bits; Bits &= Bits - 1)
+        {
+            long     Fd = (W << 6) + __builtin_ctzll(Bits);
+            PosixFd* E  = &__Src__->Entries[Fd];
+            if (__SkipRings__ && E->Desc->IsUring)
+            {
+                continue;
+            }
+            S->Entries[Fd] = *E;
+            PosixFileRetain(E->Desc);
+            __SetMark__(S, Fd);
+            S->Count++;
+            S->Rings += E->Desc->IsUring;
+        }
+    }
+    S->NextFd = __SetFirstFree__(S, 0);
+    if (S->NextFd < 0)
+    {
+        S->NextFd = S->Cap;
+    }
+    return S;
+}
+
+/* Last table off the set, its references go with it */
 static void
-__InitEntry__(PosixFd* __E__)
+__SetPut__(PosixFdSet* __S__)
 {
-    __E__->Fd      = -1;
-    __E__->Flags   = 0;
-    __E__->Obj     = NULL;
-    __E__->Refcnt  = 0;
-    __E__->IsFile  = 0;
-    __E__->IsChar  = 0;
-    __E__->IsBlock = 0;
+    if (!__S__ || __atomic_sub_fetch(&__S__->Refs, 1, __ATOMIC_ACQ_REL) > 0)
+    {
+        return;
+    }
+    for (long W = 0; W < (__S__->Cap >> 6); W++)
+    {
+        for (uint64_t Bits = __S__->OpenMap[W]; Bits; Bits &= Bits - 1)
+        {
+            PosixFilePut(__S__->Entries[(W << 6) + __builtin_ctzll(Bits)].Desc);
+        }
+    }
+    KFree(__S__);
 }
 
-static long
-__PipeWrite__(PosixPipeT* __P__, const void* __Buf__, long __Len__)
+/*
+ * Caller holds the table lock and is about to write the set: it is made
+ * private, copied off a set still shared since fork, and at least __Cap__
+ * slots long. The heap never sleeps, so this runs under the lock.
+ */
+static int
+__SetPrivate__(PosixFdTable* __Tab__, long __Cap__)
 {
-    long W = 0;
-    AcquireSpinLock(&__P__->Lock);
-    while (W < __Len__ && __P__->Len < __P__->Cap)
+    PosixFdSet* Old  = __Tab__->Set;
+    long        Refs = __atomic_load_n(&Old->Refs, __ATOMIC_ACQUIRE);
+    long        Cap  = __Cap__ > Old->Cap ? __Cap__ : Old->Cap;
+    if (Refs == 1 && Cap == Old->Cap)
     {
-        __P__->Buf[__P__->Tail] = ((const char*)__Buf__)[W];
-        __P__->Tail             = (__P__->Tail + 1) % __P__->Cap;
-        __P__->Len++;
-        W++;
+        return 0;
     }
-    ReleaseSpinLock(&__P__->Lock);
-    return W;
+
+    if (Refs > 1)
+    {
+        PosixFdSet* New = __SetClone__(Old, Cap, 0);
+        if (!New)
+        {
+            return -1;
+        }
+        __Tab__->Set = New;
+        /* New holds every description too, so a last drop here never closes one under the lock */
+        __SetPut__(Old);
+        return 0;
+    }
+
+    /* Ours alone, the entries move and no reference changes hands */
+    PosixFdSet* New = __SetAlloc__(Cap);
+    if (!New)
+    {
+        return -1;
+    }
+    long Words = Old->Cap >> 6;
+    __builtin_memcpy(New->Entries, Old->Entries, (size_t)Old->Cap * sizeof(PosixFd));
+    __builtin_memcpy(New->OpenMap, Old->OpenMap, (size_t)Words * sizeof(uint64_t));
+    __builtin_memcpy(New->FullMap, Old->FullMap, (size_t)((Words + 63) >> 6) * sizeof(uint64_t));
+    New->Count   = Old->Count;
+    New->NextFd  = Old->NextFd;
+    New->Rings   = Old->Rings;
+    __Tab__->Set = New;
+    KFree(Old);
+    return 0;
 }
 
+/* Doubled until __Need__ slots fit, 0 past the limit */
 static long
-__PipeRead__(PosixPipeT* __P__, void* __Buf__, long __Len__)
+__GrowCap__(long __Cap__, long __Need__)
 {
-    long R = 0;
-    AcquireSpinLock(&__P__->Lock);
-    while (R < __Len__ && __P__->Len > 0)
+    if (__Need__ > PosixFdMax)
     {
-        ((char*)__Buf__)[R] = __P__->Buf[__P__->Head];
-        __P__->Head         = (__P__->Head + 1) % __P__->Cap;
-        __P__->Len--;
-        R++;
+        return 0;
     }
-    ReleaseSpinLock(&__P__->Lock);
-    return R;
+    long Cap = __Cap__ < PosixFdMin ? PosixFdMin : __Cap__;
+    while (Cap < __Need__)
+    {
+        Cap <<= 1;
+    }
+    return Cap > PosixFdMax ? PosixFdMax : Cap;
+}
+
+/* Caller holds the table lock, the set comes back private with the slot in range */
+int
+__FindFreeFd__(PosixFdTable* __Tab__, int __Start__)
+{
+    long Start = (__Start__ < 0) ? 0 : (long)__Start__;
+    if (__SetPrivate__(__Tab__, 0) != 0)
+    {
+        return -1;
+    }
+
+    PosixFdSet* S  = __Tab__->Set;
+    long        Fd = __SetFirstFree__(S, Start > S->NextFd ? Start : S->NextFd);
+    if (Fd < 0)
+    {
+        /* Everything from Start to the end is taken, the first slot past both is free */
+        Fd       = Start > S->Cap ? Start : S->Cap;
+        long Cap = __GrowCap__(S->Cap, Fd + 1);
+        if (!Cap || __SetPrivate__(__Tab__, Cap) != 0)
+        {
+            return -1;
+        }
+    }
+    return (int)Fd;
+}
+
+/* Caller holds the table lock and found __Fd__ free, takes over the caller's reference */
+static void
+__InstallFd__(PosixFdTable* __Tab__, int __Fd__, PosixFile* __Desc__)
+{
+    PosixFdSet* S = __Tab__->Set;
+    PosixFd*    E = &S->Entries[__Fd__];
+    E->Fd         = __Fd__;
+    E->FdFlags    = 0;
+    E->Desc       = __Desc__;
+    __SetMark__(S, __Fd__);
+    S->Count++;
+    S->Rings += __Desc__->IsUring;
+    if (S->NextFd == __Fd__)
+    {
+        S->NextFd = __Fd__ + 1;
+    }
+}
+
+static PosixFile*
+__FileAlloc__(void* __Obj__, long __Flags__, int __IsFile__, int __IsChar__)
+{
+    PosixFile* F = (PosixFile*)KMalloc(sizeof(PosixFile));
+    if (!F)
+    {
+        return NULL;
+    }
+    F->Refcnt  = 1;
+    F->Flags   = __Flags__;
+    F->Obj     = __Obj__;
+    F->IsFile  = __IsFile__;
+    F->IsChar  = __IsChar__;
+    F->IsBlock = 0;
+    F->IsEpoll = 0;
+    F->IsUring = 0;
+    F->EpItems = NULL;
+    InitializeMutex(&F->PosLock, "PosixFile");
+    return F;
+}
+
+void
+PosixFileRetain(PosixFile* __File__)
+{
+    if (__File__)
+    {
+        __atomic_add_fetch(&__File__->Refcnt, 1, __ATOMIC_ACQ_REL);
+    }
+}
+
+void
+PosixFilePut(PosixFile* __File__)
+{
+    if (!__File__ || __atomic_sub_fetch(&__File__->Refcnt, 1, __ATOMIC_ACQ_REL) > 0)
+    {
+        return;
+    }
+
+    /* Last fd closed and no I/O left in flight, epoll watches go first */
+    if (__atomic_load_n(&__File__->EpItems, __ATOMIC_ACQUIRE))
+    {
+        PosixEpollForget(__File__);
+    }
+    if (__File__->IsEpoll && __File__->Obj)
+    {
+        PosixEpollRelease((PosixEpoll*)__File__->Obj);
+    }
+    if (__File__->IsUring && __File__->Obj)
+    {
+        PosixUringRelease((PosixUring*)__File__->Obj);
+    }
+    if (__File__->IsFile && __File__->Obj)
+    {
+        VfsClose((File*)__File__->Obj);
+    }
+    if (__File__->IsChar && __File__->Obj)
+    {
+        PosixPipeRelease((PosixPipeT*)__File__->Obj, __File__->Flags);
+    }
+    KFree(__File__);
+}
+
+void
+PosixFdRetain(PosixFd* __E__)
+{
+    if (__E__)
+    {
+        PosixFileRetain(__E__->Desc);
+    }
+}
+
+PosixFile*
+PosixFdGet(PosixFdTable* __Tab__, int __Fd__)
+{
+    if (!__Tab__)
+    {
+        return NULL;
+    }
+
+    AcquireSpinLock(&__Tab__->Lock);
+    PosixFd*   E    = __GetEntry__(__Tab__, __Fd__);
+    PosixFile* Desc = (E && E->Fd >= 0) ? E->Desc : NULL;
+    PosixFileRetain(Desc);
+    ReleaseSpinLock(&__Tab__->Lock);
+    return Desc;
 }
 
 int
 PosixFdInit(PosixFdTable* __Tab__, long __Cap__)
 {
-    __Tab__->Entries  = (PosixFd*)KMalloc(sizeof(PosixFd) * (size_t)__Cap__);
-    __Tab__->Count    = 0;
-    __Tab__->Cap      = __Cap__;
+    __Tab__->Set = __SetAlloc__(__GrowCap__(0, __Cap__));
+    if (!__Tab__->Set)
+    {
+        return -1;
+    }
     __Tab__->StdinFd  = -1;
     __Tab__->StdoutFd = -1;
     __Tab__->StderrFd = -1;
     InitializeSpinLock(&__Tab__->Lock, "PosixFdTable");
-    long I = 0;
-    for (I = 0; I < __Cap__; I++)
-    {
-        __InitEntry__(&__Tab__->Entries[I]);
-    }
     return 0;
 }
 
+/* The child shares the parent's set until either writes it, ring fds stay with the parent */
 int
-PosixOpen(PosixFdTable* __Tab__, const char* __Path__, long __Flags__, long __Mode__)
+PosixFdFork(PosixFdTable* __Parent__, PosixFdTable* __Child__)
 {
-    if (!__Tab__ || !__Path__)
+    InitializeSpinLock(&__Child__->Lock, "PosixFdTable");
+
+    AcquireSpinLock(&__Parent__->Lock);
+    PosixFdSet* S = __Parent__->Set;
+    if (S->Rings == 0)
     {
-        return -1;
+        __atomic_add_fetch(&S->Refs, 1, __ATOMIC_ACQ_REL);
+        __Child__->Set = S;
     }
+    else
+    {
+        __Child__->Set = __SetClone__(S, S->Cap, 1);
+    }
+    __Child__->StdinFd  = __Parent__->StdinFd;
+    __Child__->StdoutFd = __Parent__->StdoutFd;
+    __Child__->StderrFd = __Parent__->StderrFd;
+    ReleaseSpinLock(&__Parent__->Lock);
 
-    AcquireSpinLock(&__Tab__->Lock);
-    int NewFd = __FindFreeFd__(__Tab__, 0);
-    if (NewFd < 0)
+    return __Child__->Set ? 0 : -1;
+}
+
+/* Clears a slot under the table lock, the description is handed back to put after unlock */
+static PosixFile*
+__CloseEntry__(PosixFdTable* __Tab__, PosixFd* __E__)
+{
+    PosixFdSet* S    = __Tab__->Set;
+    PosixFile*  Desc = __E__->Desc;
+    long        Fd   = __E__->Fd;
+    __InitEntry__(__E__);
+    __SetUnmark__(S, Fd);
+    S->Count--;
+    S->Rings -= Desc->IsUring;
+    if (Fd < S->NextFd)
+    {
+        S->NextFd = Fd;
+    }
+    return Desc;
+}
+
+void
+PosixFdDestroy(PosixFdTable* __Tab__)
+{
+    /*
+     * Ring fds close first, one at a time with the set still attached. Their
+     * release waits out an SQPOLL submit that may be looking fds up in this
+     * table, so it must not find the set already gone.
+     */
+    for (long Fd = 0;; Fd++)
     {
+        AcquireSpinLock(&__Tab__->Lock);
+        PosixFdSet* S = __Tab__->Set;
+        if (!S->Rings || Fd >= S->Cap)
+        {
+            ReleaseSpinLock(&__Tab__->Lock);
+            break;
+        }
+        PosixFd*   E    = &S->Entries[Fd];
+        PosixFile* Desc = (E->Fd >= 0 && E->Desc->IsUring) ? __CloseEntry__(__Tab__, E) : NULL;
         ReleaseSpinLock(&__Tab__->Lock);
+
+        if (Desc)
+        {
+            PosixFilePut(Desc);
+        }
+    }
+
+    AcquireSpinLock(&__Tab__->Lock);
+    PosixFdSet* S = __Tab__->Set;
+    __Tab__->Set  = NULL;
+    ReleaseSpinLock(&__Tab__->Lock);
+
+    /* Outside the lock, the last reference closes what was still open */
+    __SetPut__(S);
+}
+
+/* Slots right now, anything at or past it is closed */
+long
+PosixFdCap(PosixFdTable* __Tab__)
+{
+    AcquireSpinLock(&__Tab__->Lock);
+    long Cap = __Tab__->Set->Cap;
+    ReleaseSpinLock(&__Tab__->Lock);
+    return Cap;
+}
+
+int
+PosixOpen(PosixFdTable* __Tab__, const char* __Path__, long __Flags__, long __Mode__)
+{
+    if (!__Tab__ || !__Path__)
+    {
         return -1;
     }
 
+    /* Path walk and the filesystem open run before the table is locked */
     File* F = VfsOpen(__Path__, __Flags__);
     if (!F)
     {
-        ReleaseSpinLock(&__Tab__->Lock);
+        return -1;
+    }
+    PosixFile* Desc = __FileAlloc__(F, __Flags__, 1, 0);
+    if (!Desc)
+    {
+        VfsClose(F);
         return -1;
     }
 
-    PosixFd* E = &__Tab__->Entries[NewFd];
-    E->Fd      = NewFd;
-    E->Flags   = __Flags__;
-    E->Obj     = (void*)F;
-    E->Refcnt  = 1;
-    E->IsFile  = 1;
-    E->IsChar  = 0;
-    E->IsBlock = 0;
-    __Tab__->Count++;
+    AcquireSpinLock(&__Tab__->Lock);
+    int NewFd = __FindFreeFd__(__Tab__, 0);
+    if (NewFd >= 0)
+    {
+        __InstallFd__(__Tab__, NewFd, Desc);
+    }
     ReleaseSpinLock(&__Tab__->Lock);
+
+    if (NewFd < 0)
+    {
+        PosixFilePut(Desc);
+    }
     return NewFd;
 }
 
@@ -153,137 +510,310 @@ PosixClose(PosixFdTable* __Tab__, int __Fd__)
 {
     AcquireSpinLock(&__Tab__->Lock);
     PosixFd* E = __GetEntry__(__Tab__, __Fd__);
-    if (!E || E->Fd < 0)
+    if (!E || E->Fd < 0 || __SetPrivate__(__Tab__, 0) != 0)
     {
         ReleaseSpinLock(&__Tab__->Lock);
         return -1;
     }
-    if (--E->Refcnt <= 0)
+    /* The set may have been copied, look again in the private one */
+    E = __GetEntry__(__Tab__, __Fd__);
+    PosixFile* Desc = __CloseEntry__(__Tab__, E);
+    ReleaseSpinLock(&__Tab__->Lock);
+
+    /* Outside the table lock, the last put closes the file or drops a pipe end */
+    PosixFilePut(Desc);
+    return 0;
+}
+
+/* Nothing to wait for, a nonblocking caller gets EAGAIN instead of sleeping in the driver */
+static int
+__WouldBlock__(PosixFile* __Desc__, uint32_t __Want__)
+{
+    WaitQueue* Queue = NULL;
+    uint32_t   Mask  = VfsPoll((File*)__Desc__->Obj, &Queue);
+    return Queue && !(Mask & (__Want__ | VfsPollErr | VfsPollHup));
+}
+
+/* Offset negative for the shared file position, otherwise pread and pwrite semantics */
+static long
+__FileIo__(PosixFile* __Desc__, const VfsIovec* __Iov__, long __Cnt__, long __Off__, int __Write__)
+{
+    File* F     = (File*)__Desc__->Obj;
+    long  Saved = 0;
+    long  R     = -1;
+
+    AcquireMutex(&__Desc__->PosLock);
+    if (__Off__ >= 0)
+    {
+        Saved = VfsLseek(F, 0, VSeekCUR);
+        if (Saved < 0 || VfsLseek(F, __Off__, VSeekSET) != __Off__)
+        {
+            ReleaseMutex(&__Desc__->PosLock);
+            return -SysErrSpipe;
+        }
+    }
+    /* The whole list goes down as one VFS call, the filesystem or driver sees every segment */
+    R = __Write__ ? VfsWritev(F, __Iov__, __Cnt__) : VfsReadv(F, __Iov__, __Cnt__);
+    if (__Off__ >= 0)
+    {
+        VfsLseek(F, Saved, VSeekSET);
+    }
+    ReleaseMutex(&__Desc__->PosLock);
+    return R;
+}
+
+/* Pipes have no list op, segments go in turn and only the first may block on a read */
+static long
+__PipeIo__(
+    PosixPipeT* __P__, const VfsIovec* __Iov__, long __Cnt__, int __Nonblock__, int __Write__)
+{
+    long Total = 0;
+    for (long I = 0; I < __Cnt__; I++)
     {
-        if (E->IsFile && E->Obj)
+        long Len = (long)__Iov__[I].IovLen;
+        if (Len <= 0)
         {
-            VfsClose((File*)E->Obj);
+            continue;
         }
-        if (E->IsChar && E->Obj)
+
+        int  Nb = __Nonblock__ || (!__Write__ && Total > 0);
+        long R  = __Write__ ? PosixPipeWrite(__P__, __Iov__[I].IovBase, Len, Nb)
+                            : PosixPipeRead(__P__, __Iov__[I].IovBase, Len, Nb);
+        if (R < 0)
         {
-            PosixPipeT* P = (PosixPipeT*)E->Obj;
-            KFree(P->Buf);
-            KFree(P);
+            return Total ? Total : R;
+        }
+        Total += R;
+        if (R < Len)
+        {
+            break;
+        }
+    }
+    return Total;
+}
+
+static long
+__CheckIov__(const VfsIovec* __Iov__, long __Cnt__)
+{
+    if (__Cnt__ < 0 || __Cnt__ > PosixIovMax)
+    {
+        return -SysErrInval;
+    }
+    if (!__Iov__ && __Cnt__)
+    {
+        return -SysErrFault;
+    }
+    for (long I = 0; I < __Cnt__; I++)
+    {
+        if ((long)__Iov__[I].IovLen < 0)
+        {
+            return -SysErrInval;
         }
-        __InitEntry__(E);
-        __Tab__->Count--;
     }
-    ReleaseSpinLock(&__Tab__->Lock);
     return 0;
 }
 
 long
-PosixRead(PosixFdTable* __Tab__, int __Fd__, void* __Buf__, long __Len__)
+PosixFileReadv(
+    PosixFile* __Desc__, const VfsIovec* __Iov__, long __Cnt__, long __Off__, int __Nonblock__)
 {
-    AcquireSpinLock(&__Tab__->Lock);
-    PosixFd* E = __GetEntry__(__Tab__, __Fd__);
-    if (!E || E->Fd < 0)
+    long Bad = __CheckIov__(__Iov__, __Cnt__);
+    if (Bad < 0)
     {
-        ReleaseSpinLock(&__Tab__->Lock);
-        return -1;
+        return Bad;
     }
-    if (E->IsFile)
+    if (__Desc__->IsFile)
     {
-        long R = VfsRead((File*)E->Obj, __Buf__, __Len__);
-        ReleaseSpinLock(&__Tab__->Lock);
-        return R;
+        if (__Nonblock__ && __WouldBlock__(__Desc__, VfsPollIn))
+        {
+            return -SysErrAgain;
+        }
+        return __FileIo__(__Desc__, __Iov__, __Cnt__, __Off__, 0);
     }
-    if (E->IsChar)
+    if (__Desc__->IsChar)
     {
-        long R = __PipeRead__((PosixPipeT*)E->Obj, __Buf__, __Len__);
-        ReleaseSpinLock(&__Tab__->Lock);
-        return R;
+        if (__Off__ >= 0)
+        {
+            return -SysErrSpipe;
+        }
+        return __PipeIo__((PosixPipeT*)__Desc__->Obj, __Iov__, __Cnt__, __Nonblock__, 0);
     }
-    ReleaseSpinLock(&__Tab__->Lock);
-    return -1;
+    return -SysErrInval;
+}
+
+long
+PosixFileWritev(
+    PosixFile* __Desc__, const VfsIovec* __Iov__, long __Cnt__, long __Off__, int __Nonblock__)
+{
+    long Bad = __CheckIov__(__Iov__, __Cnt__);
+    if (Bad < 0)
+    {
+        return Bad;
+    }
+    if (__Desc__->IsFile)
+    {
+        if (__Nonblock__ && __WouldBlock__(__Desc__, VfsPollOut))
+        {
+            return -SysErrAgain;
+        }
+        return __FileIo__(__Desc__, __Iov__, __Cnt__, __Off__, 1);
+    }
+    if (__Desc__->IsChar)
+    {
+        if (__Off__ >= 0)
+        {
+            return -SysErrSpipe;
+        }
+        return __PipeIo__((PosixPipeT*)__Desc__->Obj, __Iov__, __Cnt__, __Nonblock__, 1);
+    }
+    return -SysErrInval;
+}
+
+long
+PosixFileRead(PosixFile* __Desc__, void* __Buf__, long __Len__, long __Off__, int __Nonblock__)
+{
+    VfsIovec Seg = {.IovBase = __Buf__, .IovLen = (size_t)__Len__};
+    return PosixFileReadv(__Desc__, &Seg, 1, __Off__, __Nonblock__);
+}
+
+long
+PosixFileWrite(
+    PosixFile* __Desc__, const void* __Buf__, long __Len__, long __Off__, int __Nonblock__)
+{
+    VfsIovec Seg = {.IovBase = (void*)__Buf__, .IovLen = (size_t)__Len__};
+    return PosixFileWritev(__Desc__, &Seg, 1, __Off__, __Nonblock__);
+}
+
+long
+PosixRead(PosixFdTable* __Tab__, int __Fd__, void* __Buf__, long __Len__)
+{
+    PosixFile* Desc = PosixFdGet(__Tab__, __Fd__);
+    if (!Desc)
+    {
+        return -1;
+    }
+
+    long R = -1;
+    if (Desc->IsFile || Desc->IsChar)
+    {
+        R = PosixFileRead(Desc, __Buf__, __Len__, -1, (Desc->Flags & PosixONonblock) != 0);
+    }
+
+    PosixFilePut(Desc);
+    return R;
 }
 
 long
 PosixWrite(PosixFdTable* __Tab__, int __Fd__, const void* __Buf__, long __Len__)
 {
-    AcquireSpinLock(&__Tab__->Lock);
-    PosixFd* E = __GetEntry__(__Tab__, __Fd__);
-    if (!E || E->Fd < 0)
+    PosixFile* Desc = PosixFdGet(__Tab__, __Fd__);
+    if (!Desc)
     {
-        ReleaseSpinLock(&__Tab__->Lock);
         PError("PosixWrite: bad fd=%d\n", __Fd__);
         return -1;
     }
 
     PDebug("PosixWrite: fd=%d IsFile=%d IsChar=%d IsBlock=%d\n",
            __Fd__,
-           E->IsFile,
-           E->IsChar,
-           E->IsBlock);
+           Desc->IsFile,
+           Desc->IsChar,
+           Desc->IsBlock);
 
-    if (E->IsFile)
+    long W = -1;
+    if (Desc->IsFile || Desc->IsChar)
     {
-        PDebug("PosixWrite: dispatching to VfsWrite, len=%ld\n", __Len__);
-        long W = VfsWrite((File*)E->Obj, __Buf__, __Len__);
-        PDebug("PosixWrite: VfsWrite returned %ld\n", W);
-        ReleaseSpinLock(&__Tab__->Lock);
-        return W;
+        W = PosixFileWrite(Desc, __Buf__, __Len__, -1, (Desc->Flags & PosixONonblock) != 0);
+        PDebug("PosixWrite: returned %ld, len=%ld\n", W, __Len__);
     }
-
-    if (E->IsChar)
+    else
     {
-        PDebug("PosixWrite: dispatching to __PipeWrite__, len=%ld\n", __Len__);
-        long W = __PipeWrite__((PosixPipeT*)E->Obj, __Buf__, __Len__);
-        PDebug("PosixWrite: __PipeWrite__ returned %ld\n", W);
-        ReleaseSpinLock(&__Tab__->Lock);
-        return W;
+        PError("PosixWrite: fd=%d not file/char, returning -1\n", __Fd__);
     }
 
-    ReleaseSpinLock(&__Tab__->Lock);
-    PError("PosixWrite: fd=%d not file/char, returning -1\n", __Fd__);
-    return -1;
+    PosixFilePut(Desc);
+    return W;
 }
 
 long
-PosixLseek(PosixFdTable* __Tab__, int __Fd__, long __Off__, int __Wh__)
+PosixReadv(PosixFdTable* __Tab__, int __Fd__, const VfsIovec* __Iov__, long __Cnt__)
 {
-    AcquireSpinLock(&__Tab__->Lock);
-    PosixFd* E = __GetEntry__(__Tab__, __Fd__);
-    if (!E || E->Fd < 0 || !E->IsFile)
+    PosixFile* Desc = PosixFdGet(__Tab__, __Fd__);
+    if (!Desc)
     {
-        ReleaseSpinLock(&__Tab__->Lock);
         return -1;
     }
-    long R = VfsLseek((File*)E->Obj, __Off__, __Wh__);
-    ReleaseSpinLock(&__Tab__->Lock);
+
+    long R = -1;
+    if (Desc->IsFile || Desc->IsChar)
+    {
+        R = PosixFileReadv(Desc, __Iov__, __Cnt__, -1, (Desc->Flags & PosixONonblock) != 0);
+    }
+
+    PosixFilePut(Desc);
     return R;
 }
 
-int
-PosixDup(PosixFdTable* __Tab__, int __Fd__)
+long
+PosixWritev(PosixFdTable* __Tab__, int __Fd__, const VfsIovec* __Iov__, long __Cnt__)
 {
-    AcquireSpinLock(&__Tab__->Lock);
-    PosixFd* E = __GetEntry__(__Tab__, __Fd__);
-    if (!E || E->Fd < 0)
+    PosixFile* Desc = PosixFdGet(__Tab__, __Fd__);
+    if (!Desc)
     {
-        ReleaseSpinLock(&__Tab__->Lock);
         return -1;
     }
-    int NewFd = __FindFreeFd__(__Tab__, 0);
-    if (NewFd < 0)
+
+    long W = -1;
+    if (Desc->IsFile || Desc->IsChar)
+    {
+        W = PosixFileWritev(Desc, __Iov__, __Cnt__, -1, (Desc->Flags & PosixONonblock) != 0);
+    }
+
+    PosixFilePut(Desc);
+    return W;
+}
+
+long
+PosixLseek(PosixFdTable* __Tab__, int __Fd__, long __Off__, int __Wh__)
+{
+    PosixFile* Desc = PosixFdGet(__Tab__, __Fd__);
+    if (!Desc)
     {
-        ReleaseSpinLock(&__Tab__->Lock);
         return -1;
     }
-    PosixFd* N = &__Tab__->Entries[NewFd];
-    *N         = *E;
-    N->Fd      = NewFd;
-    N->Refcnt++;
-    if (N->IsFile && N->Obj)
+
+    long R = -1;
+    if (Desc->IsFile)
     {
-        ((File*)N->Obj)->Refcnt++;
+        AcquireMutex(&Desc->PosLock);
+        R = VfsLseek((File*)Desc->Obj, __Off__, __Wh__);
+        ReleaseMutex(&Desc->PosLock);
     }
-    __Tab__->Count++;
+    PosixFilePut(Desc);
+    return R;
+}
+
+/* Caller holds the table lock, a new fd at or above __Start__ sharing __E__'s description */
+static int
+__DupEntry__(PosixFdTable* __Tab__, PosixFd* __E__, int __Start__)
+{
+    /* Finding a slot may copy or grow the set under __E__ */
+    PosixFile* Desc  = __E__->Desc;
+    int        NewFd = __FindFreeFd__(__Tab__, __Start__);
+    if (NewFd < 0)
+    {
+        return -1;
+    }
+    PosixFileRetain(Desc);
+    __InstallFd__(__Tab__, NewFd, Desc);
+    return NewFd;
+}
+
+int
+PosixDup(PosixFdTable* __Tab__, int __Fd__)
+{
+    AcquireSpinLock(&__Tab__->Lock);
+    PosixFd* E     = __GetEntry__(__Tab__, __Fd__);
+    int      NewFd = (E && E->Fd >= 0) ? __DupEntry__(__Tab__, E, 0) : -1;
     ReleaseSpinLock(&__Tab__->Lock);
     return NewFd;
 }
@@ -293,7 +823,7 @@ PosixDup2(PosixFdTable* __Tab__, int __OldFd__, int __NewFd__)
 {
     AcquireSpinLock(&__Tab__->Lock);
     PosixFd* E = __GetEntry__(__Tab__, __OldFd__);
-    if (!E || E->Fd < 0 || !__IsValidFd__(__Tab__, __NewFd__))
+    if (!E || E->Fd < 0 || __NewFd__ < 0 || __NewFd__ >= PosixFdMax)
     {
         ReleaseSpinLock(&__Tab__->Lock);
         return -1;
@@ -303,126 +833,323 @@ PosixDup2(PosixFdTable* __Tab__, int __OldFd__, int __NewFd__)
         ReleaseSpinLock(&__Tab__->Lock);
         return __NewFd__;
     }
-    PosixFd* D = &__Tab__->Entries[__NewFd__];
-    if (D->Fd >= 0)
+    PosixFile* Desc = E->Desc;
+    if (__SetPrivate__(__Tab__, __GrowCap__(__Tab__->Set->Cap, (long)__NewFd__ + 1)) != 0)
     {
-        int rc = PosixClose(__Tab__, __NewFd__);
-        if (rc != 0)
-        {
-            ReleaseSpinLock(&__Tab__->Lock);
-            return -1;
-        }
+        ReleaseSpinLock(&__Tab__->Lock);
+        return -1;
     }
-    *D    = *E;
-    D->Fd = __NewFd__;
-    D->Refcnt++;
-    if (D->IsFile && D->Obj)
+    PosixFd*   D   = &__Tab__->Set->Entries[__NewFd__];
+    PosixFile* Old = NULL;
+    if (D->Fd >= 0)
     {
-        ((File*)D->Obj)->Refcnt++;
+        /* PosixClose would retake the table lock */
+        Old = __CloseEntry__(__Tab__, D);
     }
-    __Tab__->Count++;
+    PosixFileRetain(Desc);
+    __InstallFd__(__Tab__, __NewFd__, Desc);
     ReleaseSpinLock(&__Tab__->Lock);
+
+    PosixFilePut(Old);
     return __NewFd__;
 }
 
 int
 PosixPipe(PosixFdTable* __Tab__, int __Pipefd__[2])
 {
-    AcquireSpinLock(&__Tab__->Lock);
-    int Rd = __FindFreeFd__(__Tab__, 0);
-    int Wr = __FindFreeFd__(__Tab__, Rd + 1);
-    if (Rd < 0 || Wr < 0)
+    PosixPipeT* P = PosixPipeAlloc();
+    if (!P)
     {
-        ReleaseSpinLock(&__Tab__->Lock);
         return -1;
     }
-    PosixPipeT* P = (PosixPipeT*)KMalloc(sizeof(PosixPipeT));
-    P->Cap        = 4096;
-    P->Buf        = (char*)KMalloc((size_t)P->Cap);
-    P->Head       = 0;
-    P->Tail       = 0;
-    P->Len        = 0;
-    InitializeSpinLock(&P->Lock, "PosixPipeT");
-
-    PosixFd* ER = &__Tab__->Entries[Rd];
-    PosixFd* EW = &__Tab__->Entries[Wr];
-    __InitEntry__(ER);
-    __InitEntry__(EW);
-
-    ER->Fd      = Rd;
-    ER->Flags   = VFlgRDONLY;
-    ER->Obj     = (void*)P;
-    ER->Refcnt  = 1;
-    ER->IsFile  = 0;
-    ER->IsChar  = 1;
-    ER->IsBlock = 0;
-
-    EW->Fd      = Wr;
-    EW->Flags   = VFlgWRONLY;
-    EW->Obj     = (void*)P;
-    EW->Refcnt  = 1;
-    EW->IsFile  = 0;
-    EW->IsChar  = 1;
-    EW->IsBlock = 0;
-
-    __Tab__->Count += 2;
-    __Pipefd__[0] = Rd;
-    __Pipefd__[1] = Wr;
+
+    /* One description per end, putting one drops that end of the pipe */
+    PosixFile* Rd = __FileAlloc__(P, VFlgRDONLY, 0, 1);
+    PosixFile* Wr = __FileAlloc__(P, VFlgWRONLY, 0, 1);
+    if (!Rd || !Wr)
+    {
+        if (Rd)
+        {
+            KFree(Rd);
+        }
+        if (Wr)
+        {
+            KFree(Wr);
+        }
+        PosixPipeRelease(P, VFlgRDONLY);
+        PosixPipeRelease(P, VFlgWRONLY);
+        return -1;
+    }
+
+    AcquireSpinLock(&__Tab__->Lock);
+    int RdFd = __FindFreeFd__(__Tab__, 0);
+    int WrFd = RdFd < 0 ? -1 : __FindFreeFd__(__Tab__, RdFd + 1);
+    if (WrFd >= 0)
+    {
+        __InstallFd__(__Tab__, RdFd, Rd);
+        __InstallFd__(__Tab__, WrFd, Wr);
+    }
     ReleaseSpinLock(&__Tab__->Lock);
+
+    if (WrFd < 0)
+    {
+        PosixFilePut(Rd);
+        PosixFilePut(Wr);
+        return -1;
+    }
+    __Pipefd__[0] = RdFd;
+    __Pipefd__[1] = WrFd;
     return 0;
 }
 
 int
-PosixFcntl(PosixFdTable* __Tab__, int __Fd__, int __Cmd__, long __Arg__ __attribute__((unused)))
+PosixFcntl(PosixFdTable* __Tab__, int __Fd__, int __Cmd__, long __Arg__)
 {
+    /* Pipe sizing works on the description alone, the ring is resized outside the table lock */
+    if (__Cmd__ == PosixFSetPipeSz || __Cmd__ == PosixFGetPipeSz)
+    {
+        PosixFile* Desc = PosixFdGet(__Tab__, __Fd__);
+        if (!Desc)
+        {
+            return -SysErrBadf;
+        }
+        long R = -SysErrInval;
+        if (Desc->IsChar && Desc->Obj)
+        {
+            PosixPipeT* P = (PosixPipeT*)Desc->Obj;
+            R = (__Cmd__ == PosixFSetPipeSz) ? PosixPipeResize(P, __Arg__) : P->Cap;
+        }
+        PosixFilePut(Desc);
+        return (int)R;
+    }
+
     AcquireSpinLock(&__Tab__->Lock);
     PosixFd* E = __GetEntry__(__Tab__, __Fd__);
     if (!E || E->Fd < 0)
     {
         ReleaseSpinLock(&__Tab__->Lock);
-        return -1;
-    }
-    if (__Cmd__ == 0)
-    {
-        ReleaseSpinLock(&__Tab__->Lock);
-        return E->Flags;
+        return -SysErrBadf;
     }
-    if (__Cmd__ == 1)
+    int R = -SysErrInval;
+    switch (__Cmd__)
     {
-        int NewFd = __FindFreeFd__(__Tab__, 0);
-        if (NewFd < 0)
-        {
-            ReleaseSpinLock(&__Tab__->Lock);
-            return -1;
-        }
-        PosixFd* N = &__Tab__->Entries[NewFd];
-        *N         = *E;
-        N->Fd      = NewFd;
-        N->Refcnt++;
-        if (N->IsFile && N->Obj)
+        case PosixFDupFd:
+            R = (__Arg__ < 0) ? -SysErrInval : __DupEntry__(__Tab__, E, (int)__Arg__);
+            if (R == -1)
+            {
+                R = -SysErrMfile;
+            }
+            break;
+
+        case PosixFGetFd:
+            R = (int)E->FdFlags;
+            break;
+
+        case PosixFSetFd:
+            if (__SetPrivate__(__Tab__, 0) != 0)
+            {
+                R = -SysErrNoMem;
+                break;
+            }
+            __Tab__->Set->Entries[__Fd__].FdFlags = __Arg__ & PosixFdCloexec;
+            R                                     = 0;
+            break;
+
+        case PosixFGetFl:
+            R = (int)E->Desc->Flags;
+            break;
+
+        /* Only O_NONBLOCK may change, the access mode is fixed at open */
+        case PosixFSetFl:
         {
-            ((File*)N->Obj)->Refcnt++;
+            long Old = __atomic_load_n(&E->Desc->Flags, __ATOMIC_RELAXED);
+            long New = (Old & ~(long)PosixONonblock) | (__Arg__ & PosixONonblock);
+            __atomic_store_n(&E->Desc->Flags, New, __ATOMIC_RELAXED);
+            R = 0;
+            break;
         }
-        __Tab__->Count++;
-        ReleaseSpinLock(&__Tab__->Lock);
-        return NewFd;
+
+        default:
+            break;
     }
     ReleaseSpinLock(&__Tab__->Lock);
-    return -1;
+    return R;
 }
 
 int
 PosixIoctl(PosixFdTable* __Tab__, int __Fd__, unsigned long __Cmd__, void* __Arg__)
 {
-    AcquireSpinLock(&__Tab__->Lock);
-    PosixFd* E = __GetEntry__(__Tab__, __Fd__);
-    if (!E || E->Fd < 0 || !E->IsFile)
+    PosixFile* Desc = PosixFdGet(__Tab__, __Fd__);
+    if (!Desc)
     {
-        ReleaseSpinLock(&__Tab__->Lock);
         return -1;
     }
-    int R = VfsIoctl((File*)E->Obj, __Cmd__, __Arg__);
+    int R = Desc->IsFile ? VfsIoctl((File*)Desc->Obj, __Cmd__, __Arg__) : -1;
+    PosixFilePut(Desc);
+    return R;
+}
+
+int
+PosixEpollCreate(PosixFdTable* __Tab__, long __Flags__)
+{
+    if (__Flags__ & ~(long)PosixEpollCloexec)
+    {
+        return -SysErrInval;
+    }
+    PosixEpoll* Ep = PosixEpollAlloc();
+    if (!Ep)
+    {
+        return -SysErrNoMem;
+    }
+    PosixFile* Desc = __FileAlloc__(Ep, VFlgRDWR, 0, 0);
+    if (!Desc)
+    {
+        PosixEpollRelease(Ep);
+        return -SysErrNoMem;
+    }
+    Desc->IsEpoll = 1;
+
+    AcquireSpinLock(&__Tab__->Lock);
+    int NewFd = __FindFreeFd__(__Tab__, 0);
+    if (NewFd >= 0)
+    {
+        __InstallFd__(__Tab__, NewFd, Desc);
+        __Tab__->Set->Entries[NewFd].FdFlags =
+            (__Flags__ & PosixEpollCloexec) ? PosixFdCloexec : 0;
+    }
     ReleaseSpinLock(&__Tab__->Lock);
+
+    if (NewFd < 0)
+    {
+        PosixFilePut(Desc);
+        return -SysErrMfile;
+    }
+    return NewFd;
+}
+
+/* Ring fds are close-on-exec, the mapping they describe does not survive it */
+int
+PosixUringCreate(PosixProc* __Proc__, uint32_t __Entries__, PosixUringParams* __Params__)
+{
+    PosixUring* Ring = NULL;
+    long        Err  = PosixUringAlloc(__Proc__, __Entries__, __Params__, &Ring);
+    if (Err < 0)
+    {
+        return (int)Err;
+    }
+    PosixFile* Desc = __FileAlloc__(Ring, VFlgRDWR, 0, 0);
+    if (!Desc)
+    {
+        PosixUringRelease(Ring);
+        return -SysErrNoMem;
+    }
+    Desc->IsUring = 1;
+
+    PosixFdTable* Tab = __Proc__->Fds;
+    AcquireSpinLock(&Tab->Lock);
+    int NewFd = __FindFreeFd__(Tab, 0);
+    if (NewFd >= 0)
+    {
+        __InstallFd__(Tab, NewFd, Desc);
+        Tab->Set->Entries[NewFd].FdFlags = PosixFdCloexec;
+    }
+    ReleaseSpinLock(&Tab->Lock);
+
+    if (NewFd < 0)
+    {
+        PosixFilePut(Desc);
+        return -SysErrMfile;
+    }
+    return NewFd;
+}
+
+/* Both offsets serialized, in address order so two opposite copies cannot deadlock */
+static void
+__LockPair__(PosixFile* __A__, PosixFile* __B__)
+{
+    PosixFile* First  = (__A__ < __B__) ? __A__ : __B__;
+    PosixFile* Second = (__A__ < __B__) ? __B__ : __A__;
+    AcquireMutex(&First->PosLock);
+    if (Second != First)
+    {
+        AcquireMutex(&Second->PosLock);
+    }
+}
+
+static void
+__UnlockPair__(PosixFile* __A__, PosixFile* __B__)
+{
+    if (__A__ != __B__)
+    {
+        ReleaseMutex(&__B__->PosLock);
+    }
+    ReleaseMutex(&__A__->PosLock);
+}
+
+static long
+__CopyFiles__(
+    PosixFile* __In__, long* __OffIn__, PosixFile* __Out__, long* __OffOut__, long __Len__)
+{
+    __LockPair__(__In__, __Out__);
+    long R = VfsCopyRange(
+        (File*)__In__->Obj, __OffIn__, (File*)__Out__->Obj, __OffOut__, __Len__, 0);
+    __UnlockPair__(__In__, __Out__);
+    return (R < 0) ? -SysErrIo : R;
+}
+
+/* Input must be a file, output a file, a device or a pipe */
+long
+PosixSendfile(PosixFdTable* __Tab__, int __OutFd__, int __InFd__, long* __Off__, long __Count__)
+{
+    PosixFile* In  = PosixFdGet(__Tab__, __InFd__);
+    PosixFile* Out = PosixFdGet(__Tab__, __OutFd__);
+    long       R   = -SysErrBadf;
+    if (In && Out)
+    {
+        if (!In->IsFile || (In->Flags & PosixAccMode) == VFlgWRONLY)
+        {
+            R = -SysErrInval;
+        }
+        else if (__Count__ <= 0)
+        {
+            R = 0;
+        }
+        else if (Out->IsChar)
+        {
+            R = PosixSplice(__Tab__, __InFd__, __Off__, __OutFd__, NULL, __Count__, 0);
+        }
+        else if (Out->IsFile)
+        {
+            R = __CopyFiles__(In, __Off__, Out, NULL, __Count__);
+        }
+    }
+    PosixFilePut(In);
+    PosixFilePut(Out);
+    return R;
+}
+
+long
+PosixCopyFileRange(PosixFdTable* __Tab__,
+                   int           __FdIn__,
+                   long*         __OffIn__,
+                   int           __FdOut__,
+                   long*         __OffOut__,
+                   long          __Len__,
+                   unsigned int  __Flags__)
+{
+    PosixFile* In  = PosixFdGet(__Tab__, __FdIn__);
+    PosixFile* Out = PosixFdGet(__Tab__, __FdOut__);
+    long       R   = -SysErrBadf;
+    if (In && Out)
+    {
+        R = -SysErrInval;
+        if (In->IsFile && Out->IsFile && !__Flags__ && __Len__ >= 0)
+        {
+            R = __Len__ ? __CopyFiles__(In, __OffIn__, Out, __OffOut__, __Len__) : 0;
+        }
+    }
+    PosixFilePut(In);
+    PosixFilePut(Out);
     return R;
 }
 
@@ -441,15 +1168,40 @@ PosixStatPath(const char* __Path__, VfsStat* __Out__)
 int
 PosixFstat(PosixFdTable* __Tab__, int __Fd__, VfsStat* __Out__)
 {
-    AcquireSpinLock(&__Tab__->Lock);
-    PosixFd* E = __GetEntry__(__Tab__, __Fd__);
-    if (!E || E->Fd < 0 || !E->IsFile)
+    PosixFile* Desc = PosixFdGet(__Tab__, __Fd__);
+    if (!Desc)
     {
-        ReleaseSpinLock(&__Tab__->Lock);
         return -1;
     }
-    int R = VfsFstats((File*)E->Obj, __Out__);
-    ReleaseSpinLock(&__Tab__->Lock);
+    int R = Desc->IsFile ? VfsFstats((File*)Desc->Obj, __Out__) : -1;
+    PosixFilePut(Desc);
+    return R;
+}
+
+/* Packed linux_dirent64 records from the description's cursor, bytes filled or -SysErr* */
+long
+PosixGetdents(PosixFdTable* __Tab__, int __Fd__, void* __Buf__, long __Len__)
+{
+    PosixFile* Desc = PosixFdGet(__Tab__, __Fd__);
+    if (!Desc)
+    {
+        return -SysErrBadf;
+    }
+
+    File* F = (File*)Desc->Obj;
+    long  R = -SysErrNotDir;
+    if (Desc->IsFile && F->Node && F->Node->Type == VNodeDIR)
+    {
+        /* The cursor is the description's offset, shared by dups like any other */
+        AcquireMutex(&Desc->PosLock);
+        R = VfsGetdents(F, __Buf__, __Len__);
+        ReleaseMutex(&Desc->PosLock);
+        if (R < 0)
+        {
+            R = -SysErrInval;
+        }
+    }
+    PosixFilePut(Desc);
     return R;
 }
 
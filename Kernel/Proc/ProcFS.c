@@ -5,8 +5,10 @@
 #include <POSIXProcFS.h>
 #include <POSIXSignals.h>
 #include <String.h>
+#include <Syscall.h>
 #include <Timer.h>
 #include <VFS.h>
+#include <WorkQueue.h>
 
 typedef struct ProcFsInode
 {
@@ -51,9 +53,7 @@ __Min__(long a, long IdxUal)
 static inline PosixProc*
 __CurrentProc__(void)
 {
-    uint32_t CPU = GetCurrentCpuId();
-    Thread*  Th  = GetCurrentThread(CPU);
-    return Th ? PosixFind((long)Th->ProcessId) : NULL;
+    return PosixCurrent();
 }
 
 int
@@ -146,6 +146,32 @@ ProcClose(File* __File__)
     return 0;
 }
 
+/* Rendered whole into a scratch buffer of __Size__ on each read, the file offset picks the slice */
+static long
+__ProcReadWhole__(File* __File__,
+                  void* __Buf__,
+                  long  __Len__,
+                  long  __Size__,
+                  long (*__Make__)(char*, long))
+{
+    char* Text = (char*)KMalloc((size_t)__Size__);
+    if (!Text)
+    {
+        return -1;
+    }
+
+    long Total = __Make__(Text, __Size__);
+    long Off   = __File__->Offset;
+    long C     = 0;
+    if (Total > Off)
+    {
+        C = __Min__(Total - Off, __Len__);
+        __builtin_memcpy(__Buf__, Text + Off, (size_t)C);
+    }
+    KFree(Text);
+    return C;
+}
+
 long
 ProcRead(File* __File__, void* __Buf__, long __Len__)
 {
@@ -175,32 +201,22 @@ ProcRead(File* __File__, void* __Buf__, long __Len__)
 
         if (strcmp(Nm, "uptime") == 0)
         {
-            uint64_t ticks = GetSystemTicks();
-            uint64_t secs  = ticks / 1000; /* 1 tick = 1ms */
-            char     Num[32];
-            long     N = 0;
-
-            UnsignedToStringEx(secs, Num, 10, 0);
-            StringCopy(Buf + N, Num, (uint32_t)(Cap - N));
-            N += (long)StringLength(Num);
-
-            /* space separator */
-            if (N < Cap)
-            {
-                Buf[N++] = ' ';
-            }
-
-            UnsignedToStringEx(0ULL, Num, 10, 0);
-            StringCopy(Buf + N, Num, (uint32_t)(Cap - N));
-            N += (long)StringLength(Num);
+            return ProcFsMakeUptime(Buf, Cap);
+        }
 
-            /* newline terminator */
-            if (N < Cap)
-            {
-                Buf[N++] = '\n';
-            }
+        if (strcmp(Nm, "syscalls") == 0)
+        {
+            return __ProcReadWhole__(
+                __File__, __Buf__, __Len__, (long)SysCount * 384 + 256, ProcFsMakeSyscalls);
+        }
 
-            return N;
+        if (strcmp(Nm, "softirqs") == 0)
+        {
+            return __ProcReadWhole__(__File__,
+                                     __Buf__,
+                                     __Len__,
+                                     (long)(SoftIrqCount + Smp.CpuCount) * 128 + 256,
+                                     ProcFsMakeSoftirqs);
         }
 
         if (strcmp(Nm, "self") == 0)
@@ -318,6 +334,10 @@ ProcWrite(File* __File__, const void* __Buf__, long __Len__)
     const char* Nm  = Pn->Name;
     const char* Src = (const char*)__Buf__;
 
+    if (strcmp(Nm, "syscalls") == 0)
+    {
+        return ProcFsWriteSyscalls(Src, __Len__);
+    }
     if (strcmp(Nm, "state") == 0)
     {
         PosixProc* Pr = (PosixProc*)Pn->Priv;
@@ -436,68 +456,59 @@ __ResetCursor__(ProcDirCursorEntry* __C__)
     }
 }
 
-long
-ProcReaddir(Vnode* __Node__, void* __Buf__, long __Len__)
+/* Entry at __Idx__ of a directory, 0 past the last one */
+static int
+__ProcDirEntry__(ProcFsNode* __Pn__, long __Idx__, VfsDirEnt* __Ent__)
 {
-    if (!__Node__ || !__Buf__)
+    if (__Idx__ == 0)
     {
-        return -1;
+        StringCopy(__Ent__->Name, ".", 256);
+        __Ent__->Type = VNodeDIR;
+        __Ent__->Ino  = __Pn__->Ino;
+        return 1;
     }
-
-    ProcFsNode* Pn = (ProcFsNode*)__Node__->Priv;
-    if (!Pn || Pn->Kind != ProcFsNodeDir)
+    if (__Idx__ == 1)
     {
-        return -1;
+        StringCopy(__Ent__->Name, "..", 256);
+        __Ent__->Type = VNodeDIR;
+        __Ent__->Ino  = __Pn__->Ino;
+        return 1;
     }
 
-    ProcDirCursorEntry* Cur = __GetCursor__(__Node__);
-    if (!Cur)
+    if (strcmp(__Pn__->Name, "") == 0)
     {
-        return -1;
-    }
-
-    VfsDirEnt* Ent = (VfsDirEnt*)__Buf__;
-    long       Idx = Cur->Index;
-
-    if (Idx == 0)
-    {
-        StringCopy(Ent->Name, ".", 256);
-        Ent->Type = VNodeDIR;
-        Ent->Ino  = Pn->Ino;
-        __AdvanceCursor__(Cur);
-        return sizeof(VfsDirEnt);
-    }
-    if (Idx == 1)
-    {
-        StringCopy(Ent->Name, "..", 256);
-        Ent->Type = VNodeDIR;
-        Ent->Ino  = Pn->Ino;
-        __AdvanceCursor__(Cur);
-        return sizeof(VfsDirEnt);
-    }
-
-    if (strcmp(Pn->Name, "") == 0)
-    {
-        long Base = Idx - 2;
+        long Base = __Idx__ - 2;
 
         if (Base == 0)
         {
-            StringCopy(Ent->Name, "uptime", 256);
-            Ent->Type = VNodeFILE;
-            Ent->Ino  = Pn->Ino + 1;
-            __AdvanceCursor__(Cur);
-            return sizeof(VfsDirEnt);
+            StringCopy(__Ent__->Name, "uptime", 256);
+            __Ent__->Type = VNodeFILE;
+            __Ent__->Ino  = __Pn__->Ino + 1;
+            return 1;
         }
         if (Base == 1)
         {
-            StringCopy(Ent->Name, "self", 256);
-            Ent->Type = VNodeFILE;
-            Ent->Ino  = Pn->Ino + 2;
-            __AdvanceCursor__(Cur);
-            return sizeof(VfsDirEnt);
+            StringCopy(__Ent__->Name, "self", 256);
+            __Ent__->Type = VNodeFILE;
+            __Ent__->Ino  = __Pn__->Ino + 2;
+            return 1;
+        }
+        if (Base == 2)
+        {
+            StringCopy(__Ent__->Name, "syscalls", 256);
+            __Ent__->Type = VNodeFILE;
+            __Ent__->Ino  = __Pn__->Ino + 3;
+            return 1;
+        }
+        if (Base == 3)
+        {
+            StringCopy(__Ent__->Name, "softirqs", 256);
+            __Ent__->Type = VNodeFILE;
+            __Ent__->Ino  = __Pn__->Ino + 4;
+            return 1;
         }
 
-        long ListIdx = Base - 2;
+        long ListIdx = Base - 4;
         long Seen    = 0;
 
         for (long pid = 1; pid < ProcMaxPIDS; pid++)
@@ -519,127 +530,171 @@ ProcReaddir(Vnode* __Node__, void* __Buf__, long __Len__)
             PosixProc* Pr = (PosixProc*)D->Priv;
             char       Num[32];
             UnsignedToStringEx((uint64_t)Pr->Pid, Num, 10, 0);
-            StringCopy(Ent->Name, Num, 256);
-            Ent->Type = VNodeDIR;
-            Ent->Ino  = D->Ino;
-            __AdvanceCursor__(Cur);
-            return sizeof(VfsDirEnt);
+            StringCopy(__Ent__->Name, Num, 256);
+            __Ent__->Type = VNodeDIR;
+            __Ent__->Ino  = D->Ino;
+            return 1;
         }
 
-        long FallbackIdx = ListIdx - Seen;
-        long Count       = PosixProcs.Count;
-        if (FallbackIdx >= 0 && FallbackIdx < Count)
+        long     FallbackIdx = ListIdx - Seen;
+        long     FallbackPid = 0;
+        uint64_t Flags       = AcquireReadSpinLock(&PosixProcs.Lock);
+        if (FallbackIdx >= 0 && FallbackIdx < PosixProcs.Count && PosixProcs.Items[FallbackIdx])
         {
-            PosixProc* Pr = PosixProcs.Items[FallbackIdx];
-            if (Pr)
-            {
-                char Num[32];
-                UnsignedToStringEx((uint64_t)Pr->Pid, Num, 10, 0);
-                StringCopy(Ent->Name, Num, 256);
-                Ent->Type = VNodeDIR;
-                Ent->Ino  = Pn->Ino + 100 + (long)Pr->Pid;
-                __AdvanceCursor__(Cur);
-                return sizeof(VfsDirEnt);
-            }
+            FallbackPid = PosixProcs.Items[FallbackIdx]->Pid;
+        }
+        ReleaseReadSpinLock(&PosixProcs.Lock, Flags);
+        if (FallbackPid > 0)
+        {
+            char Num[32];
+            UnsignedToStringEx((uint64_t)FallbackPid, Num, 10, 0);
+            StringCopy(__Ent__->Name, Num, 256);
+            __Ent__->Type = VNodeDIR;
+            __Ent__->Ino  = __Pn__->Ino + 100 + FallbackPid;
+            return 1;
         }
-        __ResetCursor__(Cur);
         return 0;
     }
     else
     {
-        PosixProc* Pr = (PosixProc*)Pn->Priv;
+        PosixProc* Pr = (PosixProc*)__Pn__->Priv;
         if (!Pr)
         {
-            __ResetCursor__(Cur);
             return 0;
         }
 
-        long LocalIdx = Idx - 2;
+        long LocalIdx = __Idx__ - 2;
 
         if (LocalIdx == 0)
         {
-            StringCopy(Ent->Name, "stat", 256);
-            Ent->Type = VNodeFILE;
-            Ent->Ino  = Pn->Ino + 1;
-            __AdvanceCursor__(Cur);
-            return sizeof(VfsDirEnt);
+            StringCopy(__Ent__->Name, "stat", 256);
+            __Ent__->Type = VNodeFILE;
+            __Ent__->Ino  = __Pn__->Ino + 1;
+            return 1;
         }
         if (LocalIdx == 1)
         {
-            StringCopy(Ent->Name, "status", 256);
-            Ent->Type = VNodeFILE;
-            Ent->Ino  = Pn->Ino + 2;
-            __AdvanceCursor__(Cur);
-            return sizeof(VfsDirEnt);
+            StringCopy(__Ent__->Name, "status", 256);
+            __Ent__->Type = VNodeFILE;
+            __Ent__->Ino  = __Pn__->Ino + 2;
+            return 1;
         }
         if (LocalIdx == 2)
         {
-            StringCopy(Ent->Name, "fds", 256);
-            Ent->Type = VNodeFILE;
-            Ent->Ino  = Pn->Ino + 3;
-            __AdvanceCursor__(Cur);
-            return sizeof(VfsDirEnt);
+            StringCopy(__Ent__->Name, "fds", 256);
+            __Ent__->Type = VNodeFILE;
+            __Ent__->Ino  = __Pn__->Ino + 3;
+            return 1;
         }
         if (LocalIdx == 3)
         {
-            StringCopy(Ent->Name, "state", 256);
-            Ent->Type = VNodeFILE;
-            Ent->Ino  = Pn->Ino + 4;
-            __AdvanceCursor__(Cur);
-            return sizeof(VfsDirEnt);
+            StringCopy(__Ent__->Name, "state", 256);
+            __Ent__->Type = VNodeFILE;
+            __Ent__->Ino  = __Pn__->Ino + 4;
+            return 1;
         }
         if (LocalIdx == 4)
         {
-            StringCopy(Ent->Name, "exec", 256);
-            Ent->Type = VNodeFILE;
-            Ent->Ino  = Pn->Ino + 5;
-            __AdvanceCursor__(Cur);
-            return sizeof(VfsDirEnt);
+            StringCopy(__Ent__->Name, "exec", 256);
+            __Ent__->Type = VNodeFILE;
+            __Ent__->Ino  = __Pn__->Ino + 5;
+            return 1;
         }
         if (LocalIdx == 5)
         {
-            StringCopy(Ent->Name, "signal", 256);
-            Ent->Type = VNodeFILE;
-            Ent->Ino  = Pn->Ino + 6;
-            __AdvanceCursor__(Cur);
-            return sizeof(VfsDirEnt);
+            StringCopy(__Ent__->Name, "signal", 256);
+            __Ent__->Type = VNodeFILE;
+            __Ent__->Ino  = __Pn__->Ino + 6;
+            return 1;
         }
         if (LocalIdx == 6)
         {
-            StringCopy(Ent->Name, "cwd", 256);
-            Ent->Type = VNodeFILE;
-            Ent->Ino  = Pn->Ino + 7;
-            __AdvanceCursor__(Cur);
-            return sizeof(VfsDirEnt);
+            StringCopy(__Ent__->Name, "cwd", 256);
+            __Ent__->Type = VNodeFILE;
+            __Ent__->Ino  = __Pn__->Ino + 7;
+            return 1;
         }
         if (LocalIdx == 7)
         {
-            StringCopy(Ent->Name, "root", 256);
-            Ent->Type = VNodeFILE;
-            Ent->Ino  = Pn->Ino + 8;
-            __AdvanceCursor__(Cur);
-            return sizeof(VfsDirEnt);
+            StringCopy(__Ent__->Name, "root", 256);
+            __Ent__->Type = VNodeFILE;
+            __Ent__->Ino  = __Pn__->Ino + 8;
+            return 1;
         }
         if (LocalIdx == 8)
         {
-            StringCopy(Ent->Name, "cmdline", 256);
-            Ent->Type = VNodeFILE;
-            Ent->Ino  = Pn->Ino + 9;
-            __AdvanceCursor__(Cur);
-            return sizeof(VfsDirEnt);
+            StringCopy(__Ent__->Name, "cmdline", 256);
+            __Ent__->Type = VNodeFILE;
+            __Ent__->Ino  = __Pn__->Ino + 9;
+            return 1;
         }
         if (LocalIdx == 9)
         {
-            StringCopy(Ent->Name, "environ", 256);
-            Ent->Type = VNodeFILE;
-            Ent->Ino  = Pn->Ino + 10;
-            __AdvanceCursor__(Cur);
-            return sizeof(VfsDirEnt);
+            StringCopy(__Ent__->Name, "environ", 256);
+            __Ent__->Type = VNodeFILE;
+            __Ent__->Ino  = __Pn__->Ino + 10;
+            return 1;
         }
 
+        return 0;
+    }
+}
+
+
+long
+ProcReaddir(Vnode* __Node__, void* __Buf__, long __Len__)
+{
+    if (!__Node__ || !__Buf__)
+    {
+        return -1;
+    }
+
+    ProcFsNode* Pn = (ProcFsNode*)__Node__->Priv;
+    if (!Pn || Pn->Kind != ProcFsNodeDir)
+    {
+        return -1;
+    }
+
+    ProcDirCursorEntry* Cur = __GetCursor__(__Node__);
+    if (!Cur)
+    {
+        return -1;
+    }
+
+    if (!__ProcDirEntry__(Pn, Cur->Index, (VfsDirEnt*)__Buf__))
+    {
         __ResetCursor__(Cur);
         return 0;
     }
+    __AdvanceCursor__(Cur);
+    return sizeof(VfsDirEnt);
+}
+
+/* The cursor is the file's own, so concurrent readers of one directory do not share it */
+long
+ProcIterate(File* __Dir__, VfsDirCtx* __Ctx__)
+{
+    if (!__Dir__ || !__Dir__->Node || !__Ctx__)
+    {
+        return -1;
+    }
+
+    ProcFsNode* Pn = (ProcFsNode*)__Dir__->Node->Priv;
+    if (!Pn || Pn->Kind != ProcFsNodeDir)
+    {
+        return -1;
+    }
+
+    VfsDirEnt Ent;
+    while (__ProcDirEntry__(Pn, __Ctx__->Pos, &Ent))
+    {
+        if (!__Ctx__->Emit(__Ctx__, Ent.Name, (long)strlen(Ent.Name), Ent.Ino, Ent.Type))
+        {
+            break;
+        }
+        __Ctx__->Pos++;
+    }
+    return 0;
 }
 
 Vnode*
@@ -711,6 +766,62 @@ ProcLookup(Vnode* __Dir__, const char* __Name__)
             return N;
         }
 
+        if (strcmp(__Name__, "syscalls") == 0)
+        {
+            ProcFsNode* F = (ProcFsNode*)KMalloc(sizeof(ProcFsNode));
+            if (!F)
+            {
+                return NULL;
+            }
+            memset(F, 0, sizeof(*F));
+            F->Kind      = ProcFsNodeFile;
+            F->Name      = "syscalls";
+            F->Ino       = Pn->Ino + 3;
+            F->Perm.Mode = VModeRUSR | VModeWUSR | VModeRGRP | VModeROTH;
+
+            Vnode* N = (Vnode*)KMalloc(sizeof(Vnode));
+            if (!N)
+            {
+                KFree(F);
+                return NULL;
+            }
+            memset(N, 0, sizeof(*N));
+            N->Type   = VNodeFILE;
+            N->Ops    = &__ProcFsOps__;
+            N->Sb     = ProcSuper;
+            N->Priv   = F;
+            N->Refcnt = 1;
+            return N;
+        }
+
+        if (strcmp(__Name__, "softirqs") == 0)
+        {
+            ProcFsNode* F = (ProcFsNode*)KMalloc(sizeof(ProcFsNode));
+            if (!F)
+            {
+                return NULL;
+            }
+            memset(F, 0, sizeof(*F));
+            F->Kind      = ProcFsNodeFile;
+            F->Name      = "softirqs";
+            F->Ino       = Pn->Ino + 4;
+            F->Perm.Mode = VModeRUSR | VModeRGRP | VModeROTH;
+
+            Vnode* N = (Vnode*)KMalloc(sizeof(Vnode));
+            if (!N)
+            {
+                KFree(F);
+                return NULL;
+            }
+            memset(N, 0, sizeof(*N));
+            N->Type   = VNodeFILE;
+            N->Ops    = &__ProcFsOps__;
+            N->Sb     = ProcSuper;
+            N->Priv   = F;
+            N->Refcnt = 1;
+            return N;
+        }
+
         long pid = atol(__Name__);
         if (pid > 0 && pid < ProcMaxPIDS)
         {
@@ -736,13 +847,10 @@ ProcLookup(Vnode* __Dir__, const char* __Name__)
             }
         }
 
-        for (long I = 0; I < PosixProcs.Count; I++)
+        /* Not in the pid cache yet, one table lookup instead of a scan */
+        PosixProc* Pr = PosixFind(pid);
+        if (Pr)
         {
-            PosixProc* Pr = PosixProcs.Items[I];
-            if (!Pr)
-            {
-                continue;
-            }
             char Num[32];
             UnsignedToStringEx((uint64_t)Pr->Pid, Num, 10, 0);
             if (strcmp(__Name__, Num) == 0)
@@ -977,7 +1085,8 @@ const VnodeOps __ProcFsOps__ = {ProcOpen,   ProcClose,  ProcRead,    ProcWrite,
                                 ProcIoctl,  ProcStat,   ProcReaddir, ProcLookup,  ProcCreate,
                                 ProcUnlink, ProcMkdir,  ProcRmdir,   ProcSymlink, ProcReadlink,
                                 ProcLink,   ProcRename, ProcChmod,   ProcChown,   ProcTruncate,
-                                ProcSync,   ProcMap,    ProcUnmap};
+                                ProcSync,   ProcMap,    ProcUnmap,   NULL,        NULL,
+                                NULL,       NULL,       ProcIterate};
 
 const SuperOps __ProcFsSuperOps__ = {
     ProcSuperSync, ProcSuperStatFs, ProcSuperRelease, ProcSuperUmount};
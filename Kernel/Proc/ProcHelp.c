@@ -1,10 +1,15 @@
 #include <AllTypes.h>
+#include <AxeSchd.h>
+#include <ClockSource.h>
 #include <KHeap.h>
 #include <KrnPrintf.h>
 #include <POSIXFd.h>
 #include <POSIXProc.h>
 #include <POSIXSignals.h>
+#include <SMP.h>
 #include <String.h>
+#include <Syscall.h>
+#include <WorkQueue.h>
 
 static inline long
 __AppendStr__(char* __Buf__, long __Cap__, long* __Off__, const char* __Str__)
@@ -336,29 +341,32 @@ ProcFsListFds(PosixProc* __Proc__, char* __Buf__, long __Cap__)
         return 0;
     }
 
-    long N = 0;
-    for (long I = 0; I < __Proc__->Fds->Cap; I++)
+    long N   = 0;
+    long Cap = PosixFdCap(__Proc__->Fds);
+    for (long I = 0; I < Cap; I++)
     {
-        PosixFd* E = &__Proc__->Fds->Entries[I];
-        if (E->Fd < 0)
+        /* Referenced, a concurrent close cannot free it under us */
+        PosixFile* D = PosixFdGet(__Proc__->Fds, (int)I);
+        if (!D)
         {
             continue;
         }
 
         __AppendStr__(__Buf__, __Cap__, &N, "fd:");
-        __AppendU64Dec__(__Buf__, __Cap__, &N, (uint64_t)E->Fd);
+        __AppendU64Dec__(__Buf__, __Cap__, &N, (uint64_t)I);
 
         __AppendStr__(__Buf__, __Cap__, &N, " type:");
         __AppendStr__(__Buf__,
                       __Cap__,
                       &N,
-                      E->IsFile ? "file" : (E->IsChar ? "char" : (E->IsBlock ? "block" : "none")));
+                      D->IsFile ? "file" : (D->IsChar ? "char" : (D->IsBlock ? "block" : "none")));
 
         __AppendStr__(__Buf__, __Cap__, &N, " flags:0x");
-        __AppendU64Hex__(__Buf__, __Cap__, &N, (uint64_t)E->Flags);
+        __AppendU64Hex__(__Buf__, __Cap__, &N, (uint64_t)D->Flags);
 
         __AppendStr__(__Buf__, __Cap__, &N, " refcnt:");
-        __AppendU64Dec__(__Buf__, __Cap__, &N, (uint64_t)(E->Refcnt > 0 ? E->Refcnt : 0));
+        __AppendU64Dec__(__Buf__, __Cap__, &N, (uint64_t)(D->Refcnt > 1 ? D->Refcnt - 1 : 0));
+        PosixFilePut(D);
 
         __AppendChar__(__Buf__, __Cap__, &N, '\n');
         if (N >= __Cap__)
@@ -443,4 +451,168 @@ ProcFsWriteSignal(PosixProc* __Proc__, const char* __Buf__, long __Len__)
         return PosixKill(__Proc__->Pid, SigCont) == 0 ? __Len__ : -1;
     }
     return -1;
-}
\ No newline at end of file
+}
+
+long
+ProcFsMakeSyscalls(char* __Buf__, long __Cap__)
+{
+    if (!__Buf__ || __Cap__ <= 0)
+    {
+        PError("ProcFsMakeSyscalls: bad args\n");
+        return -1;
+    }
+
+    static const char* Buckets[SysHistBuckets] = {
+        "<256", "<512", "<1K", "<2K", "<4K", "<8K", "<16K", "<32K", "<64K", "<128K", "<256K", "more"};
+
+    long N = 0;
+    __AppendStr__(__Buf__, __Cap__, &N, "nr\tname\tcalls\tcycles\tavg");
+    for (uint32_t Bucket = 0; Bucket < SysHistBuckets; Bucket++)
+    {
+        __AppendChar__(__Buf__, __Cap__, &N, '\t');
+        __AppendStr__(__Buf__, __Cap__, &N, Buckets[Bucket]);
+    }
+    __AppendChar__(__Buf__, __Cap__, &N, '\n');
+
+    for (uint32_t Index = 0; Index < SysCount; Index++)
+    {
+        SysCallTotals Totals;
+        if (SyscallStatsRead(Index, &Totals) != 0)
+        {
+            break;
+        }
+
+        __AppendU64Dec__(__Buf__, __Cap__, &N, Totals.Number);
+        __AppendChar__(__Buf__, __Cap__, &N, '\t');
+        __AppendStr__(__Buf__, __Cap__, &N, Totals.Name);
+        __AppendChar__(__Buf__, __Cap__, &N, '\t');
+        __AppendU64Dec__(__Buf__, __Cap__, &N, Totals.Calls);
+        __AppendChar__(__Buf__, __Cap__, &N, '\t');
+        __AppendU64Dec__(__Buf__, __Cap__, &N, Totals.Cycles);
+        __AppendChar__(__Buf__, __Cap__, &N, '\t');
+        __AppendU64Dec__(__Buf__, __Cap__, &N, Totals.Calls ? Totals.Cycles / Totals.Calls : 0);
+        for (uint32_t Bucket = 0; Bucket < SysHistBuckets; Bucket++)
+        {
+            __AppendChar__(__Buf__, __Cap__, &N, '\t');
+            __AppendU64Dec__(__Buf__, __Cap__, &N, Totals.Hist[Bucket]);
+        }
+        __AppendChar__(__Buf__, __Cap__, &N, '\n');
+    }
+
+    return N;
+}
+
+long
+ProcFsWriteSyscalls(const char* __Buf__, long __Len__)
+{
+    if (!__Buf__ || __Len__ <= 0)
+    {
+        return -1;
+    }
+
+    /* "1" turns the counters on, "0" leaves dispatch with no TSC reads at all */
+    if (__Buf__[0] == '1')
+    {
+        SyscallStatsEnable(true);
+        return __Len__;
+    }
+    if (__Buf__[0] == '0')
+    {
+        SyscallStatsEnable(false);
+        return __Len__;
+    }
+    return -1;
+}
+
+static void
+__AppendCentiSec__(char* __Buf__, long __Cap__, long* __Off__, uint64_t __Ns__)
+{
+    uint64_t Centi = __Ns__ / (NsPerSec / 100);
+
+    __AppendU64Dec__(__Buf__, __Cap__, __Off__, Centi / 100);
+    __AppendChar__(__Buf__, __Cap__, __Off__, '.');
+    __AppendChar__(__Buf__, __Cap__, __Off__, (char)('0' + (Centi % 100) / 10));
+    __AppendChar__(__Buf__, __Cap__, __Off__, (char)('0' + Centi % 10));
+}
+
+long
+ProcFsMakeUptime(char* __Buf__, long __Cap__)
+{
+    if (!__Buf__ || __Cap__ <= 0)
+    {
+        PError("ProcFsMakeUptime: bad args\n");
+        return -1;
+    }
+
+    uint64_t Now  = ClockMonotonicNs();
+    uint64_t Idle = 0;
+
+    /* Summed over CPUs like Linux, an open idle period counts up to now */
+    for (uint32_t CpuIndex = 0; CpuIndex < Smp.CpuCount && CpuIndex < MaxCPUs; CpuIndex++)
+    {
+        CpuScheduler* Scheduler = &CpuSchedulers[CpuIndex];
+        uint64_t      Since     = __atomic_load_n(&Scheduler->IdleSince, __ATOMIC_SEQ_CST);
+
+        Idle += __atomic_load_n(&Scheduler->IdleNs, __ATOMIC_SEQ_CST);
+        if (Since && Now > Since)
+        {
+            Idle += Now - Since;
+        }
+    }
+
+    long N = 0;
+    __AppendCentiSec__(__Buf__, __Cap__, &N, Now);
+    __AppendChar__(__Buf__, __Cap__, &N, ' ');
+    __AppendCentiSec__(__Buf__, __Cap__, &N, Idle);
+    __AppendChar__(__Buf__, __Cap__, &N, '\n');
+
+    return N;
+}
+
+/* SoftIrq handler runs, then one line per CPU of work queue counters */
+long
+ProcFsMakeSoftirqs(char* __Buf__, long __Cap__)
+{
+    if (!__Buf__ || __Cap__ <= 0)
+    {
+        PError("ProcFsMakeSoftirqs: bad args\n");
+        return -1;
+    }
+
+    long N = 0;
+    __AppendStr__(__Buf__, __Cap__, &N, "softirq\truns\n");
+    for (uint32_t Vector = 0; Vector < SoftIrqCount; Vector++)
+    {
+        SoftIrqTotals Totals;
+        if (SoftIrqStatsRead(Vector, &Totals) != 0)
+        {
+            break;
+        }
+        __AppendStr__(__Buf__, __Cap__, &N, Totals.Name);
+        __AppendChar__(__Buf__, __Cap__, &N, '\t');
+        __AppendU64Dec__(__Buf__, __Cap__, &N, Totals.Runs);
+        __AppendChar__(__Buf__, __Cap__, &N, '\n');
+    }
+
+    __AppendStr__(__Buf__, __Cap__, &N, "\ncpu\tqueued\texecuted\tbatches\tmax-batch\n");
+    for (uint32_t CpuIndex = 0; CpuIndex < Smp.CpuCount; CpuIndex++)
+    {
+        WorkQueueTotals Totals;
+        if (WorkQueueStatsRead(CpuIndex, &Totals) != 0)
+        {
+            break;
+        }
+        __AppendU64Dec__(__Buf__, __Cap__, &N, CpuIndex);
+        __AppendChar__(__Buf__, __Cap__, &N, '\t');
+        __AppendU64Dec__(__Buf__, __Cap__, &N, Totals.Queued);
+        __AppendChar__(__Buf__, __Cap__, &N, '\t');
+        __AppendU64Dec__(__Buf__, __Cap__, &N, Totals.Executed);
+        __AppendChar__(__Buf__, __Cap__, &N, '\t');
+        __AppendU64Dec__(__Buf__, __Cap__, &N, Totals.Batches);
+        __AppendChar__(__Buf__, __Cap__, &N, '\t');
+        __AppendU64Dec__(__Buf__, __Cap__, &N, Totals.MaxBatch);
+        __AppendChar__(__Buf__, __Cap__, &N, '\n');
+    }
+
+    return N;
+}
@@ -0,0 +1,1023 @@
+#include <AllTypes.h>
+#include <AxeThreads.h>
+#include <KHeap.h>
+#include <KrnPrintf.h>
+#include <PMM.h>
+#include <POSIXFd.h>
+#include <POSIXProc.h>
+#include <POSIXSignals.h>
+#include <String.h>
+#include <Sync.h>
+#include <SysABI.h>
+#include <VFS.h>
+
+/*
+ * Pipes, a ring of page spans. Each slot holds a reference on a page and the
+ * offset and length of the bytes queued in it. write and vmsplice copy into
+ * pages the pipe owns, splice between two pipes moves the references and tee
+ * takes more of them, so pipe to pipe transfers copy nothing. A page shared
+ * that way is never written again, only an unshared tail page takes more.
+ *
+ * Producers (write, splice into the pipe, vmsplice) hold WriteMutex and add
+ * slots at the tail, consumers hold ReadMutex and retire them at the head.
+ * The tail slot is only retired by the producer, so it stays put while the
+ * producer fills its free end. Lock covers the slot bookkeeping and the end
+ * counts, page data is filled and drained with no spinlock held. Nobody
+ * sleeps on a full or empty pipe holding any pipe mutex but the one the wait
+ * drops, and a WriteMutex is always taken before a ReadMutex, so resizing
+ * and pipe to pipe transfers cannot wait on each other in a cycle.
+ */
+
+/* Fills __Dst__ with up to __Len__ bytes, returns how many or -SysErr* */
+typedef long (*PipeFillFn)(void* __Arg__, char* __Dst__, long __Len__);
+
+/* Takes up to __Span__->Len bytes of a span, returns how many or -SysErr* */
+typedef long (*PipeDrainFn)(void* __Arg__, const PosixPipeSlot* __Span__);
+
+static PosixPipePage*
+__PageAlloc__(void)
+{
+    PosixPipePage* Page = (PosixPipePage*)KMalloc(sizeof(PosixPipePage));
+    if (!Page)
+    {
+        return NULL;
+    }
+    uint64_t Phys = AllocPage();
+    if (!Phys)
+    {
+        KFree(Page);
+        return NULL;
+    }
+    Page->Refs = 1;
+    Page->Data = (char*)PhysToVirt(Phys);
+    return Page;
+}
+
+static inline PosixPipePage*
+__PageGet__(PosixPipePage* __Page__)
+{
+    __atomic_fetch_add(&__Page__->Refs, 1, __ATOMIC_ACQ_REL);
+    return __Page__;
+}
+
+static void
+__PagePut__(PosixPipePage* __Page__)
+{
+    if (__Page__ && __atomic_sub_fetch(&__Page__->Refs, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        FreePage(VirtToPhys(__Page__->Data));
+        KFree(__Page__);
+    }
+}
+
+static PosixPipeSlot*
+__RingAlloc__(long __Slots__)
+{
+    return (PosixPipeSlot*)KMalloc(sizeof(PosixPipeSlot) * (size_t)__Slots__);
+}
+
+static inline long
+__Min__(long __A__, long __B__)
+{
+    return __A__ < __B__ ? __A__ : __B__;
+}
+
+/* Ring index __N__ slots past __At__ */
+static inline long
+__PipeIndex__(PosixPipeT* __P__, long __At__, long __N__)
+{
+    __At__ += __N__;
+    return (__At__ >= __P__->Slots) ? __At__ - __P__->Slots : __At__;
+}
+
+/* The slot __N__ places past the head */
+static inline PosixPipeSlot*
+__PipeSlot__(PosixPipeT* __P__, long __N__)
+{
+    return &__P__->Ring[__PipeIndex__(__P__, __P__->Head, __N__)];
+}
+
+/* Lock held, the unshared tail slot more bytes may go into, or NULL */
+static PosixPipeSlot*
+__PipeMergeTail__(PosixPipeT* __P__)
+{
+    if (!__P__->Count)
+    {
+        return NULL;
+    }
+    PosixPipeSlot* Tail = __PipeSlot__(__P__, __P__->Count - 1);
+    return (__atomic_load_n(&Tail->Page->Refs, __ATOMIC_ACQUIRE) == 1) ? Tail : NULL;
+}
+
+/* Lock held, bytes the producer can queue without waiting */
+static long
+__PipeRoom__(PosixPipeT* __P__)
+{
+    /* A lone empty slot is recycled by the next producer */
+    if (__P__->Count == 1 && __P__->Len == 0)
+    {
+        return __P__->Cap;
+    }
+
+    long           Room = (__P__->Slots - __P__->Count) * PageSize;
+    PosixPipeSlot* Tail = __PipeMergeTail__(__P__);
+    if (Tail)
+    {
+        Room += PageSize - (Tail->Off + Tail->Len);
+    }
+    return Room;
+}
+
+/*
+ * WriteMutex and Lock held. The consumer leaves the last slot in place once
+ * drained, the producer starts it over or, when shared, drops it. Returns
+ * a page reference to put once Lock is released.
+ */
+static PosixPipePage*
+__PipeRecycle__(PosixPipeT* __P__)
+{
+    if (__P__->Count != 1 || __P__->Len != 0)
+    {
+        return NULL;
+    }
+    PosixPipeSlot* Tail = __PipeSlot__(__P__, 0);
+    if (__atomic_load_n(&Tail->Page->Refs, __ATOMIC_ACQUIRE) == 1)
+    {
+        Tail->Off = 0;
+        return NULL;
+    }
+    PosixPipePage* Page = Tail->Page;
+    Tail->Page          = NULL;
+    __P__->Count        = 0;
+    return Page;
+}
+
+static void
+__PipeBroken__(void)
+{
+    PosixProc* Proc = PosixCurrent();
+    if (Proc)
+    {
+        PosixKill(Proc->Pid, SigPipe);
+    }
+}
+
+static bool
+__PipeLock__(Mutex* __Side__, int __Nonblock__)
+{
+    if (__Nonblock__)
+    {
+        return TryAcquireMutex(__Side__);
+    }
+    AcquireMutex(__Side__);
+    return true;
+}
+
+/*
+ * WriteMutex held, sleeps until __Need__ bytes are free, returns the room or
+ * -SysErr*. The mutex is dropped across the sleep and held again on return.
+ */
+static long
+__PipeWaitRoom__(PosixPipeT* __P__, long __Need__, int __Nonblock__)
+{
+    for (;;)
+    {
+        /* Queue first, a reader draining the pipe after our check still wakes us */
+        WaitQueuePrepare(&__P__->WriteWait, WaitReasonIo, 0);
+
+        AcquireSpinLock(&__P__->Lock);
+        long Readers = __P__->Readers;
+        long Room    = __PipeRoom__(__P__);
+        ReleaseSpinLock(&__P__->Lock);
+
+        if (Readers <= 0 || Room >= __Need__ || __Nonblock__)
+        {
+            WaitQueueCancel(&__P__->WriteWait);
+            if (Readers <= 0)
+            {
+                return -SysErrPipe;
+            }
+            return (Room >= __Need__) ? Room : -SysErrAgain;
+        }
+        ReleaseMutex(&__P__->WriteMutex);
+        WaitQueueCommit(&__P__->WriteWait);
+        AcquireMutex(&__P__->WriteMutex);
+    }
+}
+
+/* ReadMutex held and dropped across the sleep, returns the bytes queued, 0 at EOF */
+static long
+__PipeWaitData__(PosixPipeT* __P__, int __Nonblock__)
+{
+    for (;;)
+    {
+        /* Queue first, a writer filling the pipe after our check still wakes us */
+        WaitQueuePrepare(&__P__->ReadWait, WaitReasonIo, 0);
+
+        AcquireSpinLock(&__P__->Lock);
+        long Len     = __P__->Len;
+        long Writers = __P__->Writers;
+        ReleaseSpinLock(&__P__->Lock);
+
+        if (Len > 0 || Writers <= 0 || __Nonblock__)
+        {
+            WaitQueueCancel(&__P__->ReadWait);
+            if (Len > 0 || Writers <= 0)
+            {
+                return Len;
+            }
+            return -SysErrAgain;
+        }
+        ReleaseMutex(&__P__->ReadMutex);
+        WaitQueueCommit(&__P__->ReadWait);
+        AcquireMutex(&__P__->ReadMutex);
+    }
+}
+
+/*
+ * WriteMutex held, queues up to __N__ bytes (no more than the room) from
+ * __Fill__, first into the free end of an unshared tail page, then into new
+ * pages. New slots are filled beyond Count where the consumer never looks and
+ * published together. Returns the bytes queued, or the error if none were.
+ */
+static long
+__PipeProduce__(PosixPipeT* __P__, long __N__, PipeFillFn __Fill__, void* __Arg__)
+{
+    AcquireSpinLock(&__P__->Lock);
+    PosixPipePage* Stale = __PipeRecycle__(__P__);
+    PosixPipeSlot* Tail  = __PipeMergeTail__(__P__);
+    long           Free  = __P__->Slots - __P__->Count;
+    long           At    = __PipeIndex__(__P__, __P__->Head, __P__->Count);
+    long           End   = Tail ? Tail->Off + Tail->Len : PageSize;
+    ReleaseSpinLock(&__P__->Lock);
+    __PagePut__(Stale);
+
+    long Done   = 0;
+    long Merged = 0;
+    long Added  = 0;
+    long Err    = 0;
+    if (End < PageSize)
+    {
+        long Want = __Min__(__N__, PageSize - End);
+        long R    = __Fill__(__Arg__, Tail->Page->Data + End, Want);
+        if (R < 0)
+        {
+            Err = R;
+        }
+        Merged = Done = (R > 0) ? R : 0;
+        if (R < Want)
+        {
+            goto Publish;
+        }
+    }
+    while (Done < __N__ && Added < Free)
+    {
+        PosixPipePage* Page = __PageAlloc__();
+        if (!Page)
+        {
+            Err = -SysErrNoMem;
+            break;
+        }
+        long Want = __Min__(__N__ - Done, PageSize);
+        long R    = __Fill__(__Arg__, Page->Data, Want);
+        if (R <= 0)
+        {
+            __PagePut__(Page);
+            Err = R;
+            break;
+        }
+
+        PosixPipeSlot* Slot = &__P__->Ring[__PipeIndex__(__P__, At, Added)];
+        Slot->Page          = Page;
+        Slot->Off           = 0;
+        Slot->Len           = R;
+        Added++;
+        Done += R;
+        if (R < Want)
+        {
+            break;
+        }
+    }
+
+Publish:
+    if (Done > 0)
+    {
+        AcquireSpinLock(&__P__->Lock);
+        if (Merged)
+        {
+            Tail->Len += Merged;
+        }
+        __P__->Count += Added;
+        __P__->Len += Done;
+        ReleaseSpinLock(&__P__->Lock);
+        WaitQueueWakeAll(&__P__->ReadWait);
+    }
+    return Done ? Done : Err;
+}
+
+/*
+ * ReadMutex held, hands up to __N__ queued bytes to __Drain__ a page span at
+ * a time and retires what it took. A short count from __Drain__ ends the
+ * walk. Drained slots are dropped, except the tail which the producer may be
+ * filling. Returns the bytes taken, or the error if none were.
+ */
+static long
+__PipeConsume__(PosixPipeT* __P__, long __N__, PipeDrainFn __Drain__, void* __Arg__)
+{
+    long Done = 0;
+    long Err  = 0;
+    while (Done < __N__)
+    {
+        AcquireSpinLock(&__P__->Lock);
+        if (!__P__->Len)
+        {
+            ReleaseSpinLock(&__P__->Lock);
+            break;
+        }
+        PosixPipeSlot Span = *__PipeSlot__(__P__, 0);
+        ReleaseSpinLock(&__P__->Lock);
+
+        Span.Len = __Min__(Span.Len, __N__ - Done);
+        long R   = Span.Len ? __Drain__(__Arg__, &Span) : 0;
+        if (R < 0)
+        {
+            Err = R;
+            break;
+        }
+
+        PosixPipePage* Retired = NULL;
+        AcquireSpinLock(&__P__->Lock);
+        PosixPipeSlot* Head = __PipeSlot__(__P__, 0);
+        Head->Off += R;
+        Head->Len -= R;
+        __P__->Len -= R;
+        if (Head->Len == 0 && __P__->Count > 1)
+        {
+            Retired     = Head->Page;
+            Head->Page  = NULL;
+            __P__->Head = __PipeIndex__(__P__, __P__->Head, 1);
+            __P__->Count--;
+        }
+        ReleaseSpinLock(&__P__->Lock);
+        __PagePut__(Retired);
+
+        Done += R;
+        if (Span.Len && R < Span.Len)
+        {
+            break;
+        }
+    }
+
+    if (Done > 0)
+    {
+        WaitQueueWakeAll(&__P__->WriteWait);
+    }
+    return Done ? Done : Err;
+}
+
+static long
+__FillCopy__(void* __Arg__, char* __Dst__, long __Len__)
+{
+    const char** Src = (const char**)__Arg__;
+    __builtin_memcpy(__Dst__, *Src, (size_t)__Len__);
+    *Src += __Len__;
+    return __Len__;
+}
+
+static long
+__DrainCopy__(void* __Arg__, const PosixPipeSlot* __Span__)
+{
+    char** Dst = (char**)__Arg__;
+    __builtin_memcpy(*Dst, __Span__->Page->Data + __Span__->Off, (size_t)__Span__->Len);
+    *Dst += __Span__->Len;
+    return __Span__->Len;
+}
+
+PosixPipeT*
+PosixPipeAlloc(void)
+{
+    PosixPipeT* P = (PosixPipeT*)KMalloc(sizeof(PosixPipeT));
+    if (!P)
+    {
+        return NULL;
+    }
+    P->Cap   = PosixPipeDefSize;
+    P->Slots = P->Cap / PageSize;
+    P->Ring  = __RingAlloc__(P->Slots);
+    if (!P->Ring)
+    {
+        KFree(P);
+        return NULL;
+    }
+    P->Head    = 0;
+    P->Count   = 0;
+    P->Len     = 0;
+    P->Readers = 1;
+    P->Writers = 1;
+    P->Refs    = 2;
+    InitializeSpinLock(&P->Lock, "PosixPipeT");
+    InitializeMutex(&P->ReadMutex, "PosixPipeRd");
+    InitializeMutex(&P->WriteMutex, "PosixPipeWr");
+    InitializeWaitQueue(&P->ReadWait, "PosixPipeT");
+    InitializeWaitQueue(&P->WriteWait, "PosixPipeT");
+    return P;
+}
+
+/*
+ * Blocks while the pipe is full. Up to PosixPipeBuf bytes go in with one
+ * copy once there is room for all of them. Larger writes go in piecewise as
+ * readers drain the pipe and may interleave with other writers between pieces.
+ */
+long
+PosixPipeWrite(PosixPipeT* __P__, const void* __Buf__, long __Len__, int __Nonblock__)
+{
+    if (__Len__ <= 0)
+    {
+        return 0;
+    }
+    if (!__PipeLock__(&__P__->WriteMutex, __Nonblock__))
+    {
+        return -SysErrAgain;
+    }
+
+    long        W   = 0;
+    long        Err = 0;
+    const char* Src = (const char*)__Buf__;
+    while (W < __Len__)
+    {
+        long Room = __PipeWaitRoom__(__P__, (__Len__ <= PosixPipeBuf) ? __Len__ : 1, __Nonblock__);
+        if (Room < 0)
+        {
+            Err = Room;
+            break;
+        }
+        long N = __PipeProduce__(__P__, __Min__(__Len__ - W, Room), __FillCopy__, &Src);
+        if (N <= 0)
+        {
+            Err = N;
+            break;
+        }
+        W += N;
+    }
+    ReleaseMutex(&__P__->WriteMutex);
+
+    if (Err == -SysErrPipe)
+    {
+        __PipeBroken__();
+    }
+    return W ? W : Err;
+}
+
+long
+PosixPipeRead(PosixPipeT* __P__, void* __Buf__, long __Len__, int __Nonblock__)
+{
+    if (__Len__ <= 0)
+    {
+        return 0;
+    }
+    if (!__PipeLock__(&__P__->ReadMutex, __Nonblock__))
+    {
+        return -SysErrAgain;
+    }
+
+    long R = __PipeWaitData__(__P__, __Nonblock__);
+    if (R > 0)
+    {
+        char* Dst = (char*)__Buf__;
+        R         = __PipeConsume__(__P__, __Len__, __DrainCopy__, &Dst);
+    }
+    ReleaseMutex(&__P__->ReadMutex);
+    return R;
+}
+
+/* Moves the slots to a ring of __Size__ bytes, rounded up to whole pages */
+long
+PosixPipeResize(PosixPipeT* __P__, long __Size__)
+{
+    if (__Size__ <= 0 || __Size__ > PosixPipeMaxSize)
+    {
+        return -SysErrInval;
+    }
+    long           Cap  = (__Size__ + PageSize - 1) & ~((long)PageSize - 1);
+    PosixPipeSlot* Ring = __RingAlloc__(Cap / PageSize);
+    if (!Ring)
+    {
+        return -SysErrNoMem;
+    }
+
+    /* Both sides out, nobody holds a slot of the old ring and sleepers hold neither */
+    AcquireMutex(&__P__->WriteMutex);
+    AcquireMutex(&__P__->ReadMutex);
+
+    long R = Cap;
+    AcquireSpinLock(&__P__->Lock);
+    if (__P__->Count > Cap / PageSize)
+    {
+        R = -SysErrBusy;
+    }
+    else
+    {
+        for (long I = 0; I < __P__->Count; I++)
+        {
+            Ring[I] = *__PipeSlot__(__P__, I);
+        }
+        PosixPipeSlot* Old = __P__->Ring;
+        __P__->Ring        = Ring;
+        __P__->Slots       = Cap / PageSize;
+        __P__->Cap         = Cap;
+        __P__->Head        = 0;
+        Ring               = Old;
+    }
+    ReleaseSpinLock(&__P__->Lock);
+
+    ReleaseMutex(&__P__->ReadMutex);
+    ReleaseMutex(&__P__->WriteMutex);
+
+    /* The ring not kept, the new one on failure and the old one on success */
+    KFree(Ring);
+    if (R > 0)
+    {
+        WaitQueueWakeAll(&__P__->WriteWait);
+    }
+    return R;
+}
+
+/* Readiness of one end, writable once a PIPE_BUF write would go through whole */
+uint32_t
+PosixPipePoll(PosixPipeT* __P__, long __Flags__, WaitQueue** __Queue__)
+{
+    bool     Writer = (__Flags__ & PosixAccMode) == VFlgWRONLY;
+    uint32_t Mask   = 0;
+
+    AcquireSpinLock(&__P__->Lock);
+    if (Writer)
+    {
+        Mask |= (__PipeRoom__(__P__) >= PosixPipeBuf) ? VfsPollOut : 0;
+        Mask |= (__P__->Readers == 0) ? VfsPollErr : 0;
+    }
+    else
+    {
+        Mask |= (__P__->Len > 0) ? VfsPollIn : 0;
+        Mask |= (__P__->Writers == 0) ? VfsPollHup : 0;
+    }
+    ReleaseSpinLock(&__P__->Lock);
+
+    if (__Queue__)
+    {
+        *__Queue__ = Writer ? &__P__->WriteWait : &__P__->ReadWait;
+    }
+    return Mask;
+}
+
+/* Drops one end, frees the pipe once both sides are gone */
+void
+PosixPipeRelease(PosixPipeT* __P__, long __Flags__)
+{
+    AcquireSpinLock(&__P__->Lock);
+    if ((__Flags__ & PosixAccMode) == VFlgWRONLY)
+    {
+        __P__->Writers--;
+    }
+    else
+    {
+        __P__->Readers--;
+    }
+    ReleaseSpinLock(&__P__->Lock);
+
+    /* Last writer gone, sleeping readers must observe EOF, last reader gone, writers EPIPE */
+    WaitQueueWakeAll(&__P__->ReadWait);
+    WaitQueueWakeAll(&__P__->WriteWait);
+
+    /* Dropped only now, the other end's release cannot free the queues under our wakeups */
+    AcquireSpinLock(&__P__->Lock);
+    long Left = --__P__->Refs;
+    ReleaseSpinLock(&__P__->Lock);
+
+    if (Left <= 0)
+    {
+        for (long I = 0; I < __P__->Count; I++)
+        {
+            __PagePut__(__PipeSlot__(__P__, I)->Page);
+        }
+        KFree(__P__->Ring);
+        KFree(__P__);
+    }
+}
+
+/*
+ * splice, tee and vmsplice. Between two pipes splice hands the page
+ * references over and tee takes new ones, no data moves. A file is read
+ * straight into pipe pages or written straight from them, one copy with no
+ * user bounce buffer. vmsplice copies between user memory and pipe pages:
+ * user pages carry no reference count, so a pipe holding one could outlive
+ * its mapping.
+ */
+
+static inline bool
+__IsPipeEnd__(PosixFile* __Desc__, long __Mode__)
+{
+    if (!__Desc__->IsChar || !__Desc__->Obj)
+    {
+        return false;
+    }
+    bool Writer = (__Desc__->Flags & PosixAccMode) == VFlgWRONLY;
+    return (__Mode__ == VFlgWRONLY) == Writer;
+}
+
+static inline int
+__Nonblock__(PosixFile* __Desc__, unsigned int __Flags__)
+{
+    return (__Flags__ & PosixSpliceNonblock) || (__Desc__->Flags & PosixONonblock);
+}
+
+static long
+__FillFromFile__(void* __Arg__, char* __Dst__, long __Len__)
+{
+    long R = VfsRead((File*)__Arg__, __Dst__, __Len__);
+    return (R < 0) ? -SysErrIo : R;
+}
+
+static long
+__DrainToFile__(void* __Arg__, const PosixPipeSlot* __Span__)
+{
+    long W = VfsWrite((File*)__Arg__, __Span__->Page->Data + __Span__->Off, __Span__->Len);
+    return (W < 0) ? -SysErrIo : W;
+}
+
+/* File into a pipe, read from the file straight into pipe pages */
+static long
+__SpliceFromFile__(PosixFile* __In__, long* __Off__, PosixFile* __Out__, long __Len__, int __Nb__)
+{
+    PosixPipeT* P = (PosixPipeT*)__Out__->Obj;
+    if (!__PipeLock__(&P->WriteMutex, __Nb__))
+    {
+        return -SysErrAgain;
+    }
+
+    long Room = __PipeWaitRoom__(P, 1, __Nb__);
+    if (Room < 0)
+    {
+        ReleaseMutex(&P->WriteMutex);
+        if (Room == -SysErrPipe)
+        {
+            __PipeBroken__();
+        }
+        return Room;
+    }
+
+    File* F     = (File*)__In__->Obj;
+    long  Saved = 0;
+
+    AcquireMutex(&__In__->PosLock);
+    if (__Off__)
+    {
+        Saved = VfsLseek(F, 0, VSeekCUR);
+        VfsLseek(F, *__Off__, VSeekSET);
+    }
+    long Done = __PipeProduce__(P, __Min__(__Len__, Room), __FillFromFile__, F);
+    if (__Off__)
+    {
+        *__Off__ += (Done > 0) ? Done : 0;
+        VfsLseek(F, Saved, VSeekSET);
+    }
+    ReleaseMutex(&__In__->PosLock);
+
+    ReleaseMutex(&P->WriteMutex);
+    return Done;
+}
+
+/* Pipe into a file, the file is written straight from the queued pages */
+static long
+__SpliceToFile__(PosixFile* __In__, PosixFile* __Out__, long* __Off__, long __Len__, int __Nb__)
+{
+    PosixPipeT* P = (PosixPipeT*)__In__->Obj;
+    if (!__PipeLock__(&P->ReadMutex, __Nb__))
+    {
+        return -SysErrAgain;
+    }
+
+    long Avail = __PipeWaitData__(P, __Nb__);
+    if (Avail <= 0)
+    {
+        ReleaseMutex(&P->ReadMutex);
+        return Avail;
+    }
+
+    File* F     = (File*)__Out__->Obj;
+    long  Saved = 0;
+
+    AcquireMutex(&__Out__->PosLock);
+    if (__Off__)
+    {
+        Saved = VfsLseek(F, 0, VSeekCUR);
+        VfsLseek(F, *__Off__, VSeekSET);
+    }
+    long Done = __PipeConsume__(P, __Min__(__Len__, Avail), __DrainToFile__, F);
+    if (__Off__)
+    {
+        *__Off__ += (Done > 0) ? Done : 0;
+        VfsLseek(F, Saved, VSeekSET);
+    }
+    ReleaseMutex(&__Out__->PosLock);
+
+    ReleaseMutex(&P->ReadMutex);
+    return Done;
+}
+
+/*
+ * Source ReadMutex and destination WriteMutex held. Queues up to __N__ bytes
+ * of __In__ on __Out__ as new slots referencing the same pages, one per free
+ * destination slot, and retires them from __In__ for splice. Returns the
+ * bytes linked.
+ */
+static long
+__PipeLink__(PosixPipeT* __In__, PosixPipeT* __Out__, long __N__, bool __Consume__)
+{
+    /* A lone empty slot takes no link, even unshared, so it gives up its place */
+    AcquireSpinLock(&__Out__->Lock);
+    PosixPipePage* Stale = NULL;
+    if (__Out__->Count == 1 && __Out__->Len == 0)
+    {
+        PosixPipeSlot* Lone = __PipeSlot__(__Out__, 0);
+        Stale               = Lone->Page;
+        Lone->Page          = NULL;
+        __Out__->Count      = 0;
+    }
+    long Free = __Out__->Slots - __Out__->Count;
+    long At   = __PipeIndex__(__Out__, __Out__->Head, __Out__->Count);
+    ReleaseSpinLock(&__Out__->Lock);
+    __PagePut__(Stale);
+
+    long Done  = 0;
+    long Added = 0;
+    long Next  = 0; /* tee walks the source slots without retiring them */
+    while (Done < __N__ && Added < Free)
+    {
+        PosixPipePage* Retired = NULL;
+        PosixPipeSlot  Span    = {.Page = NULL, .Off = 0, .Len = 0};
+
+        AcquireSpinLock(&__In__->Lock);
+        if (Next < __In__->Count)
+        {
+            PosixPipeSlot* Src = __PipeSlot__(__In__, Next);
+            Span.Len           = __Min__(Src->Len, __N__ - Done);
+            Span.Off           = Src->Off;
+            Span.Page          = Span.Len ? __PageGet__(Src->Page) : NULL;
+            if (!__Consume__)
+            {
+                Next++;
+            }
+            else
+            {
+                Src->Off += Span.Len;
+                Src->Len -= Span.Len;
+                __In__->Len -= Span.Len;
+                if (Src->Len == 0 && __In__->Count > 1)
+                {
+                    Retired       = Src->Page;
+                    Src->Page     = NULL;
+                    __In__->Head  = __PipeIndex__(__In__, __In__->Head, 1);
+                    __In__->Count--;
+                }
+                else if (Src->Len == 0)
+                {
+                    Next = __In__->Count; /* Drained down to the tail, stop */
+                }
+            }
+        }
+        else
+        {
+            Next = -1;
+        }
+        ReleaseSpinLock(&__In__->Lock);
+        __PagePut__(Retired);
+
+        if (Next < 0)
+        {
+            break;
+        }
+        if (!Span.Len)
+        {
+            continue;
+        }
+
+        __Out__->Ring[__PipeIndex__(__Out__, At, Added)] = Span;
+        Added++;
+        Done += Span.Len;
+    }
+
+    if (Done > 0)
+    {
+        AcquireSpinLock(&__Out__->Lock);
+        __Out__->Count += Added;
+        __Out__->Len += Done;
+        ReleaseSpinLock(&__Out__->Lock);
+        WaitQueueWakeAll(&__Out__->ReadWait);
+        if (__Consume__)
+        {
+            WaitQueueWakeAll(&__In__->WriteWait);
+        }
+    }
+    return Done;
+}
+
+/*
+ * Pipe to pipe, consuming from __In__ for splice and leaving it queued for
+ * tee. The destination's WriteMutex comes first and the wait for room holds
+ * nothing else, the wait for data holds nothing at all, so two opposite
+ * transfers between full or empty pipes each still let the other side move.
+ */
+static long
+__PipeToPipe__(PosixPipeT* __In__, PosixPipeT* __Out__, long __Len__, int __Nb__, bool __Consume__)
+{
+    if (__In__ == __Out__)
+    {
+        return -SysErrInval;
+    }
+
+    for (;;)
+    {
+        if (!__PipeLock__(&__Out__->WriteMutex, __Nb__))
+        {
+            return -SysErrAgain;
+        }
+
+        /* Linking needs a whole free slot, merge room in the tail page is no use */
+        long N = __PipeWaitRoom__(__Out__, PageSize, __Nb__);
+        if (N < 0)
+        {
+            ReleaseMutex(&__Out__->WriteMutex);
+            if (N == -SysErrPipe)
+            {
+                __PipeBroken__();
+            }
+            return N;
+        }
+        if (!__PipeLock__(&__In__->ReadMutex, __Nb__))
+        {
+            ReleaseMutex(&__Out__->WriteMutex);
+            return -SysErrAgain;
+        }
+
+        AcquireSpinLock(&__In__->Lock);
+        long Avail   = __In__->Len;
+        long Writers = __In__->Writers;
+        ReleaseSpinLock(&__In__->Lock);
+
+        N = 0;
+        if (Avail > 0)
+        {
+            N = __PipeLink__(__In__, __Out__, __Min__(__Len__, Avail), __Consume__);
+        }
+        ReleaseMutex(&__In__->ReadMutex);
+        ReleaseMutex(&__Out__->WriteMutex);
+
+        if (Avail > 0 || Writers <= 0)
+        {
+            return N;
+        }
+        if (__Nb__)
+        {
+            return -SysErrAgain;
+        }
+
+        /* Empty, wait for data with the destination let go, then look for room again */
+        AcquireMutex(&__In__->ReadMutex);
+        Avail = __PipeWaitData__(__In__, 0);
+        ReleaseMutex(&__In__->ReadMutex);
+        if (Avail <= 0)
+        {
+            return Avail;
+        }
+    }
+}
+
+long
+PosixSplice(PosixFdTable* __Tab__,
+            int           __FdIn__,
+            long*         __OffIn__,
+            int           __FdOut__,
+            long*         __OffOut__,
+            long          __Len__,
+            unsigned int  __Flags__)
+{
+    if (__Len__ <= 0)
+    {
+        return 0;
+    }
+
+    PosixFile* In  = PosixFdGet(__Tab__, __FdIn__);
+    PosixFile* Out = PosixFdGet(__Tab__, __FdOut__);
+    long       R   = -SysErrBadf;
+    if (!In || !Out)
+    {
+        goto Done;
+    }
+
+    bool InPipe  = __IsPipeEnd__(In, VFlgRDONLY);
+    bool OutPipe = __IsPipeEnd__(Out, VFlgWRONLY);
+    R            = -SysErrInval;
+
+    /* A pipe has no offset to splice from */
+    if ((InPipe && __OffIn__) || (OutPipe && __OffOut__))
+    {
+        R = -SysErrSpipe;
+    }
+    else if (InPipe && OutPipe)
+    {
+        R = __PipeToPipe__((PosixPipeT*)In->Obj,
+                           (PosixPipeT*)Out->Obj,
+                           __Len__,
+                           __Nonblock__(In, __Flags__) || __Nonblock__(Out, __Flags__),
+                           true);
+    }
+    else if (OutPipe && In->IsFile)
+    {
+        R = __SpliceFromFile__(In, __OffIn__, Out, __Len__, __Nonblock__(Out, __Flags__));
+    }
+    else if (InPipe && Out->IsFile)
+    {
+        R = __SpliceToFile__(In, Out, __OffOut__, __Len__, __Nonblock__(In, __Flags__));
+    }
+
+Done:
+    PosixFilePut(In);
+    PosixFilePut(Out);
+    return R;
+}
+
+long
+PosixTee(PosixFdTable* __Tab__, int __FdIn__, int __FdOut__, long __Len__, unsigned int __Flags__)
+{
+    if (__Len__ <= 0)
+    {
+        return 0;
+    }
+
+    PosixFile* In  = PosixFdGet(__Tab__, __FdIn__);
+    PosixFile* Out = PosixFdGet(__Tab__, __FdOut__);
+    long       R   = -SysErrBadf;
+    if (In && Out)
+    {
+        R = -SysErrInval;
+        if (__IsPipeEnd__(In, VFlgRDONLY) && __IsPipeEnd__(Out, VFlgWRONLY))
+        {
+            R = __PipeToPipe__((PosixPipeT*)In->Obj,
+                               (PosixPipeT*)Out->Obj,
+                               __Len__,
+                               __Nonblock__(In, __Flags__) || __Nonblock__(Out, __Flags__),
+                               false);
+        }
+    }
+    PosixFilePut(In);
+    PosixFilePut(Out);
+    return R;
+}
+
+/* User memory into a write end, or out of a read end, one iovec after another */
+long
+PosixVmsplice(PosixFdTable* __Tab__,
+              int           __Fd__,
+              const Iovec*  __Iov__,
+              long          __IovCnt__,
+              unsigned int  __Flags__)
+{
+    PosixFile* Desc = PosixFdGet(__Tab__, __Fd__);
+    if (!Desc)
+    {
+        return -SysErrBadf;
+    }
+    if (!Desc->IsChar || !Desc->Obj || !__Iov__ || __IovCnt__ <= 0)
+    {
+        PosixFilePut(Desc);
+        return -SysErrInval;
+    }
+
+    PosixPipeT* P      = (PosixPipeT*)Desc->Obj;
+    bool        Writer = __IsPipeEnd__(Desc, VFlgWRONLY);
+    int         Nb     = __Nonblock__(Desc, __Flags__);
+    long        Total  = 0;
+    long        R      = 0;
+    for (long I = 0; I < __IovCnt__; I++)
+    {
+        long Len = (long)__Iov__[I].IovLen;
+        if (!__Iov__[I].IovBase || Len <= 0)
+        {
+            continue;
+        }
+
+        R = Writer ? PosixPipeWrite(P, __Iov__[I].IovBase, Len, Nb)
+                   : PosixPipeRead(P, __Iov__[I].IovBase, Len, Nb);
+        if (R <= 0)
+        {
+            break;
+        }
+        Total += R;
+        if (R < Len)
+        {
+            break;
+        }
+    }
+    PosixFilePut(Desc);
+    return Total ? Total : R;
+}
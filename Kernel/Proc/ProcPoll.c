@@ -0,0 +1,858 @@
+#include <AllTypes.h>
+#include <AxeThreads.h>
+#include <KHeap.h>
+#include <KrnPrintf.h>
+#include <POSIXFd.h>
+#include <POSIXPoll.h>
+#include <POSIXUring.h>
+#include <String.h>
+#include <Sync.h>
+#include <SysABI.h>
+#include <Timer.h>
+#include <VFS.h>
+
+/*
+ * poll, select and epoll. A waiter parks on one WaitQueue of its own and
+ * hangs a WaitHook on the queue of every description it watches, a wake on
+ * any of them runs the hook, which wakes the waiter. Nothing rescans on a
+ * timer and epoll only ever looks at the items a hook marked ready.
+ *
+ * Epoll lock order is the link lock, then a watched queue, then Ep->Lock.
+ * Hooks run under the watched queue's lock and only take Ep->Lock.
+ */
+
+/* Interest lists and the per-description watch lists */
+static SpinLock __EpollLinkLock__;
+
+#define __EpollEventBits__(E) ((E) & ~(PosixEpollEt | PosixEpollOneshot))
+#define __PollAlways__        (VfsPollErr | VfsPollHup | VfsPollNval)
+
+uint32_t
+PosixFilePoll(PosixFile* __Desc__, WaitQueue** __Queue__)
+{
+    if (__Queue__)
+    {
+        *__Queue__ = NULL;
+    }
+    if (!__Desc__ || !__Desc__->Obj)
+    {
+        return VfsPollNval;
+    }
+
+    if (__Desc__->IsFile)
+    {
+        return VfsPoll((File*)__Desc__->Obj, __Queue__);
+    }
+    if (__Desc__->IsChar)
+    {
+        return PosixPipePoll((PosixPipeT*)__Desc__->Obj, __Desc__->Flags, __Queue__);
+    }
+    if (__Desc__->IsEpoll)
+    {
+        PosixEpoll* Ep = (PosixEpoll*)__Desc__->Obj;
+        if (__Queue__)
+        {
+            *__Queue__ = &Ep->Wait;
+        }
+        return __atomic_load_n(&Ep->ReadyCount, __ATOMIC_SEQ_CST) > 0 ? VfsPollIn : 0;
+    }
+    if (__Desc__->IsUring)
+    {
+        return PosixUringPoll((PosixUring*)__Desc__->Obj, __Queue__);
+    }
+    return VfsPollNval;
+}
+
+/* Queue first and state second, so a change between the two still wakes us */
+static void
+__PollWatch__(PosixFile* __Desc__, WaitHook* __Hook__)
+{
+    WaitQueue* Queue = NULL;
+    PosixFilePoll(__Desc__, &Queue);
+    if (Queue)
+    {
+        WaitQueueAddHook(Queue, __Hook__);
+    }
+}
+
+typedef struct PosixPollTable
+{
+    WaitQueue    Wait;
+    volatile int Triggered;
+} PosixPollTable;
+
+static void
+__PollWake__(WaitHook* __Hook__)
+{
+    PosixPollTable* Table = (PosixPollTable*)__Hook__->Arg;
+    __atomic_store_n(&Table->Triggered, 1, __ATOMIC_SEQ_CST);
+    WaitQueueWakeAll(&Table->Wait);
+}
+
+/* Milliseconds left before __Deadline__, 0 for none, -1 once it passed */
+static long
+__PollRemaining__(long __TimeoutMs__, uint64_t __Deadline__)
+{
+    if (__TimeoutMs__ < 0)
+    {
+        return 0;
+    }
+    uint64_t Now = GetSystemTicks();
+    return (Now >= __Deadline__) ? -1 : (long)(__Deadline__ - Now);
+}
+
+static long
+__PollScan__(PosixPollFd* __Fds__, PosixFile** __Descs__, long __Nfds__)
+{
+    long Ready = 0;
+    for (long I = 0; I < __Nfds__; I++)
+    {
+        if (__Fds__[I].Fd < 0)
+        {
+            __Fds__[I].Revents = 0;
+            continue;
+        }
+        uint32_t Mask = __Descs__[I] ? PosixFilePoll(__Descs__[I], NULL) : VfsPollNval;
+        uint32_t Want = (uint16_t)__Fds__[I].Events | __PollAlways__;
+
+        __Fds__[I].Revents = (short)(Mask & Want);
+        if (__Fds__[I].Revents)
+        {
+            Ready++;
+        }
+    }
+    return Ready;
+}
+
+/* A single description, for callers that hold it rather than an fd */
+uint32_t
+PosixFilePollWait(PosixFile* __Desc__, uint32_t __Events__, long __TimeoutMs__)
+{
+    uint32_t Want = __Events__ | __PollAlways__;
+
+    PosixPollTable Table;
+    InitializeWaitQueue(&Table.Wait, "PosixPollTable");
+    Table.Triggered = 0;
+
+    WaitHook Hook;
+    WaitHookInit(&Hook, __PollWake__, &Table);
+    if (__TimeoutMs__ != 0)
+    {
+        __PollWatch__(__Desc__, &Hook);
+    }
+
+    uint64_t Deadline = (__TimeoutMs__ > 0) ? GetSystemTicks() + (uint64_t)__TimeoutMs__ : 0;
+    uint32_t Mask     = 0;
+    for (;;)
+    {
+        __atomic_store_n(&Table.Triggered, 0, __ATOMIC_SEQ_CST);
+        Mask = PosixFilePoll(__Desc__, NULL) & Want;
+        if (Mask || __TimeoutMs__ == 0)
+        {
+            break;
+        }
+
+        long Remaining = __PollRemaining__(__TimeoutMs__, Deadline);
+        if (Remaining < 0)
+        {
+            break;
+        }
+
+        WaitQueuePrepare(&Table.Wait, WaitReasonIo, (uint64_t)Remaining);
+        if (__atomic_load_n(&Table.Triggered, __ATOMIC_SEQ_CST))
+        {
+            WaitQueueCancel(&Table.Wait);
+            continue;
+        }
+        WaitQueueCommit(&Table.Wait);
+    }
+
+    WaitQueueRemoveHook(&Hook);
+    return Mask;
+}
+
+long
+PosixPoll(PosixFdTable* __Tab__, PosixPollFd* __Fds__, long __Nfds__, long __TimeoutMs__)
+{
+    if (!__Tab__ || __Nfds__ < 0 || __Nfds__ > PosixFdMax)
+    {
+        return -SysErrInval;
+    }
+    if (__Nfds__ && !__Fds__)
+    {
+        return -SysErrFault;
+    }
+
+    PosixFile** Descs = NULL;
+    WaitHook*   Hooks = NULL;
+    if (__Nfds__)
+    {
+        Descs = (PosixFile**)KMalloc((size_t)__Nfds__ * (sizeof(PosixFile*) + sizeof(WaitHook)));
+        if (!Descs)
+        {
+            return -SysErrNoMem;
+        }
+        Hooks = (WaitHook*)(Descs + __Nfds__);
+    }
+
+    PosixPollTable Table;
+    InitializeWaitQueue(&Table.Wait, "PosixPollTable");
+    Table.Triggered = 0;
+
+    for (long I = 0; I < __Nfds__; I++)
+    {
+        Descs[I] = (__Fds__[I].Fd >= 0) ? PosixFdGet(__Tab__, __Fds__[I].Fd) : NULL;
+        WaitHookInit(&Hooks[I], __PollWake__, &Table);
+        if (Descs[I] && __TimeoutMs__ != 0)
+        {
+            __PollWatch__(Descs[I], &Hooks[I]);
+        }
+    }
+
+    uint64_t Deadline = (__TimeoutMs__ > 0) ? GetSystemTicks() + (uint64_t)__TimeoutMs__ : 0;
+    long     Ready    = 0;
+    for (;;)
+    {
+        __atomic_store_n(&Table.Triggered, 0, __ATOMIC_SEQ_CST);
+        Ready = __PollScan__(__Fds__, Descs, __Nfds__);
+        if (Ready || __TimeoutMs__ == 0)
+        {
+            break;
+        }
+
+        long Remaining = __PollRemaining__(__TimeoutMs__, Deadline);
+        if (Remaining < 0)
+        {
+            break;
+        }
+
+        WaitQueuePrepare(&Table.Wait, WaitReasonIo, (uint64_t)Remaining);
+        if (__atomic_load_n(&Table.Triggered, __ATOMIC_SEQ_CST))
+        {
+            WaitQueueCancel(&Table.Wait);
+            continue;
+        }
+        WaitQueueCommit(&Table.Wait);
+    }
+
+    /* Hooks come off before the table on our stack goes away */
+    for (long I = 0; I < __Nfds__; I++)
+    {
+        WaitQueueRemoveHook(&Hooks[I]);
+        PosixFilePut(Descs[I]);
+    }
+    if (Descs)
+    {
+        KFree(Descs);
+    }
+    return Ready;
+}
+
+static inline bool
+__FdsetTest__(const uint8_t* __Set__, int __Fd__)
+{
+    return __Set__ && (__Set__[__Fd__ / 8] & (1u << (__Fd__ % 8)));
+}
+
+static inline void
+__FdsetSet__(uint8_t* __Set__, int __Fd__)
+{
+    __Set__[__Fd__ / 8] |= (uint8_t)(1u << (__Fd__ % 8));
+}
+
+/* select over the poll path, the sets are rewritten with what is ready */
+long
+PosixSelect(PosixFdTable* __Tab__,
+            int           __Nfds__,
+            uint8_t*      __Rfds__,
+            uint8_t*      __Wfds__,
+            uint8_t*      __Efds__,
+            long          __TimeoutMs__)
+{
+    if (!__Tab__ || __Nfds__ < 0)
+    {
+        return -SysErrInval;
+    }
+    /* Sets sized by FD_SETSIZE may run past the table, nothing is open there */
+    long Cap  = PosixFdCap(__Tab__);
+    int  Scan = (__Nfds__ > Cap) ? (int)Cap : __Nfds__;
+
+    long Count = 0;
+    for (int Fd = 0; Fd < Scan; Fd++)
+    {
+        if (__FdsetTest__(__Rfds__, Fd) || __FdsetTest__(__Wfds__, Fd) ||
+            __FdsetTest__(__Efds__, Fd))
+        {
+            Count++;
+        }
+    }
+
+    PosixPollFd* Fds = NULL;
+    if (Count)
+    {
+        Fds = (PosixPollFd*)KMalloc((size_t)Count * sizeof(PosixPollFd));
+        if (!Fds)
+        {
+            return -SysErrNoMem;
+        }
+    }
+
+    long N = 0;
+    for (int Fd = 0; Fd < Scan && N < Count; Fd++)
+    {
+        short Events = (short)((__FdsetTest__(__Rfds__, Fd) ? VfsPollIn : 0) |
+                               (__FdsetTest__(__Wfds__, Fd) ? VfsPollOut : 0) |
+                               (__FdsetTest__(__Efds__, Fd) ? VfsPollPri : 0));
+        if (Events)
+        {
+            Fds[N].Fd      = Fd;
+            Fds[N].Events  = Events;
+            Fds[N].Revents = 0;
+            N++;
+        }
+    }
+
+    long R = PosixPoll(__Tab__, Fds, N, __TimeoutMs__);
+    for (long I = 0; R > 0 && I < N; I++)
+    {
+        if (Fds[I].Revents & VfsPollNval)
+        {
+            R = -SysErrBadf;
+        }
+    }
+    if (R < 0)
+    {
+        if (Fds)
+        {
+            KFree(Fds);
+        }
+        return R;
+    }
+
+    /* Only the bits that are ready stay set, the return counts bits */
+    long Bytes = (__Nfds__ + 7) / 8;
+    if (__Rfds__)
+    {
+        memset(__Rfds__, 0, (size_t)Bytes);
+    }
+    if (__Wfds__)
+    {
+        memset(__Wfds__, 0, (size_t)Bytes);
+    }
+    if (__Efds__)
+    {
+        memset(__Efds__, 0, (size_t)Bytes);
+    }
+
+    long Bits = 0;
+    for (long I = 0; I < N; I++)
+    {
+        short Got = Fds[I].Revents;
+        if ((Fds[I].Events & VfsPollIn) && (Got & (VfsPollIn | VfsPollHup | VfsPollErr)))
+        {
+            __FdsetSet__(__Rfds__, Fds[I].Fd);
+            Bits++;
+        }
+        if ((Fds[I].Events & VfsPollOut) && (Got & (VfsPollOut | VfsPollErr)))
+        {
+            __FdsetSet__(__Wfds__, Fds[I].Fd);
+            Bits++;
+        }
+        if ((Fds[I].Events & VfsPollPri) && (Got & VfsPollPri))
+        {
+            __FdsetSet__(__Efds__, Fds[I].Fd);
+            Bits++;
+        }
+    }
+
+    if (Fds)
+    {
+        KFree(Fds);
+    }
+    return Bits;
+}
+
+/* A reference only if the description is not already on its way out */
+static bool
+__TryRetain__(PosixFile* __Desc__)
+{
+    long Count = __atomic_load_n(&__Desc__->Refcnt, __ATOMIC_ACQUIRE);
+    while (Count > 0)
+    {
+        if (__atomic_compare_exchange_n(
+                &__Desc__->Refcnt, &Count, Count + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Caller holds Ep->Lock */
+static bool
+__EpollQueue__(PosixEpoll* __Ep__, PosixEpollItem* __It__)
+{
+    if (__It__->Ready || !__It__->Linked || !__EpollEventBits__(__It__->Events))
+    {
+        return false;
+    }
+    __It__->Ready     = true;
+    __It__->ReadyNext = NULL;
+    __It__->ReadyPrev = __Ep__->ReadyTail;
+    if (__Ep__->ReadyTail)
+    {
+        __Ep__->ReadyTail->ReadyNext = __It__;
+    }
+    else
+    {
+        __Ep__->ReadyHead = __It__;
+    }
+    __Ep__->ReadyTail = __It__;
+    __atomic_add_fetch(&__Ep__->ReadyCount, 1, __ATOMIC_SEQ_CST);
+    return true;
+}
+
+/* Caller holds Ep->Lock */
+static void
+__EpollUnready__(PosixEpoll* __Ep__, PosixEpollItem* __It__)
+{
+    if (!__It__->Ready)
+    {
+        return;
+    }
+    if (__It__->ReadyPrev)
+    {
+        __It__->ReadyPrev->ReadyNext = __It__->ReadyNext;
+    }
+    else
+    {
+        __Ep__->ReadyHead = __It__->ReadyNext;
+    }
+    if (__It__->ReadyNext)
+    {
+        __It__->ReadyNext->ReadyPrev = __It__->ReadyPrev;
+    }
+    else
+    {
+        __Ep__->ReadyTail = __It__->ReadyPrev;
+    }
+    __It__->ReadyNext = NULL;
+    __It__->ReadyPrev = NULL;
+    __It__->Ready     = false;
+    __atomic_sub_fetch(&__Ep__->ReadyCount, 1, __ATOMIC_SEQ_CST);
+}
+
+/* Runs under the watched queue's lock, only marks the item and wakes waiters */
+static void
+__EpollHook__(WaitHook* __Hook__)
+{
+    PosixEpollItem* It = (PosixEpollItem*)__Hook__->Arg;
+    PosixEpoll*     Ep = It->Ep;
+
+    AcquireSpinLock(&Ep->Lock);
+    bool Queued = __EpollQueue__(Ep, It);
+    ReleaseSpinLock(&Ep->Lock);
+
+    if (Queued)
+    {
+        WaitQueueWakeAll(&Ep->Wait);
+    }
+}
+
+static void
+__EpollKick__(PosixEpoll* __Ep__, PosixEpollItem* __It__)
+{
+    if (!(PosixFilePoll(__It__->Desc, NULL) & __It__->Events))
+    {
+        return;
+    }
+    AcquireSpinLock(&__Ep__->Lock);
+    bool Queued = __EpollQueue__(__Ep__, __It__);
+    ReleaseSpinLock(&__Ep__->Lock);
+    if (Queued)
+    {
+        WaitQueueWakeAll(&__Ep__->Wait);
+    }
+}
+
+/* Caller holds the link lock */
+static PosixEpollItem*
+__EpollFind__(PosixEpoll* __Ep__, PosixFile* __Desc__, int __Fd__)
+{
+    for (PosixEpollItem* It = __Desc__->EpItems; It; It = It->FileNext)
+    {
+        if (It->Ep == __Ep__ && It->Fd == __Fd__)
+        {
+            return It;
+        }
+    }
+    return NULL;
+}
+
+/* Caller holds the link lock and has taken the item off its description's list */
+static void
+__EpollDrop__(PosixEpollItem* __It__)
+{
+    PosixEpoll* Ep = __It__->Ep;
+
+    /* No hook runs on the item past this point */
+    WaitQueueRemoveHook(&__It__->Hook);
+
+    if (__It__->Prev)
+    {
+        __It__->Prev->Next = __It__->Next;
+    }
+    else
+    {
+        Ep->Items = __It__->Next;
+    }
+    if (__It__->Next)
+    {
+        __It__->Next->Prev = __It__->Prev;
+    }
+
+    AcquireSpinLock(&Ep->Lock);
+    __It__->Linked = false;
+    __EpollUnready__(Ep, __It__);
+    ReleaseSpinLock(&Ep->Lock);
+}
+
+/* Caller holds the link lock */
+static void
+__EpollUnlinkFile__(PosixEpollItem* __It__)
+{
+    PosixEpollItem** Link = &__It__->Desc->EpItems;
+    while (*Link && *Link != __It__)
+    {
+        Link = &(*Link)->FileNext;
+    }
+    if (*Link)
+    {
+        *Link = __It__->FileNext;
+    }
+    __It__->FileNext = NULL;
+}
+
+PosixEpoll*
+PosixEpollAlloc(void)
+{
+    PosixEpoll* Ep = (PosixEpoll*)KMalloc(sizeof(PosixEpoll));
+    if (!Ep)
+    {
+        return NULL;
+    }
+    InitializeSpinLock(&Ep->Lock, "PosixEpoll");
+    InitializeMutex(&Ep->CtlLock, "PosixEpoll");
+    InitializeWaitQueue(&Ep->Wait, "PosixEpoll");
+    Ep->Items      = NULL;
+    Ep->ReadyHead  = NULL;
+    Ep->ReadyTail  = NULL;
+    Ep->ReadyCount = 0;
+    return Ep;
+}
+
+/* Last close of the instance */
+void
+PosixEpollRelease(PosixEpoll* __Ep__)
+{
+    AcquireSpinLock(&__EpollLinkLock__);
+    PosixEpollItem* Dead = NULL;
+    while (__Ep__->Items)
+    {
+        PosixEpollItem* It = __Ep__->Items;
+        __EpollUnlinkFile__(It);
+        __EpollDrop__(It);
+        It->Next = Dead;
+        Dead     = It;
+    }
+    ReleaseSpinLock(&__EpollLinkLock__);
+
+    while (Dead)
+    {
+        PosixEpollItem* Next = Dead->Next;
+        KFree(Dead);
+        Dead = Next;
+    }
+    KFree(__Ep__);
+}
+
+/* Last put of a watched description, every instance watching it lets go */
+void
+PosixEpollForget(PosixFile* __Desc__)
+{
+    AcquireSpinLock(&__EpollLinkLock__);
+    PosixEpollItem* Dead = __Desc__->EpItems;
+    __Desc__->EpItems    = NULL;
+    for (PosixEpollItem* It = Dead; It; It = It->FileNext)
+    {
+        __EpollDrop__(It);
+    }
+    ReleaseSpinLock(&__EpollLinkLock__);
+
+    while (Dead)
+    {
+        PosixEpollItem* Next = Dead->FileNext;
+        KFree(Dead);
+        Dead = Next;
+    }
+}
+
+static int
+__EpollAdd__(PosixEpoll* __Ep__, PosixFile* __Desc__, int __Fd__, const PosixEpollEvent* __Ev__)
+{
+    WaitQueue* Queue = NULL;
+    PosixFilePoll(__Desc__, &Queue);
+    if (!Queue)
+    {
+        /* Regular files never change readiness */
+        return -SysErrPerm;
+    }
+
+    PosixEpollItem* It = (PosixEpollItem*)KMalloc(sizeof(PosixEpollItem));
+    if (!It)
+    {
+        return -SysErrNoMem;
+    }
+    It->Ep        = __Ep__;
+    It->Desc      = __Desc__;
+    It->Fd        = __Fd__;
+    It->Events    = __Ev__->Events | VfsPollErr | VfsPollHup;
+    It->Data      = __Ev__->Data;
+    It->Ready     = false;
+    It->Linked    = false;
+    It->ReadyNext = NULL;
+    It->ReadyPrev = NULL;
+    WaitHookInit(&It->Hook, __EpollHook__, It);
+
+    AcquireSpinLock(&__EpollLinkLock__);
+    if (__EpollFind__(__Ep__, __Desc__, __Fd__))
+    {
+        ReleaseSpinLock(&__EpollLinkLock__);
+        KFree(It);
+        return -SysErrExist;
+    }
+    It->FileNext      = __Desc__->EpItems;
+    __Desc__->EpItems = It;
+    It->Prev          = NULL;
+    It->Next          = __Ep__->Items;
+    if (__Ep__->Items)
+    {
+        __Ep__->Items->Prev = It;
+    }
+    __Ep__->Items = It;
+
+    AcquireSpinLock(&__Ep__->Lock);
+    It->Linked = true;
+    ReleaseSpinLock(&__Ep__->Lock);
+    WaitQueueAddHook(Queue, &It->Hook);
+    ReleaseSpinLock(&__EpollLinkLock__);
+
+    /* Already ready has no wake coming, queue it now */
+    __EpollKick__(__Ep__, It);
+    return 0;
+}
+
+static int
+__EpollMod__(PosixEpoll* __Ep__, PosixFile* __Desc__, int __Fd__, const PosixEpollEvent* __Ev__)
+{
+    AcquireSpinLock(&__EpollLinkLock__);
+    PosixEpollItem* It = __EpollFind__(__Ep__, __Desc__, __Fd__);
+    if (It)
+    {
+        AcquireSpinLock(&__Ep__->Lock);
+        It->Events = __Ev__->Events | VfsPollErr | VfsPollHup;
+        It->Data   = __Ev__->Data;
+        ReleaseSpinLock(&__Ep__->Lock);
+    }
+    ReleaseSpinLock(&__EpollLinkLock__);
+
+    if (!It)
+    {
+        return -SysErrNoEnt;
+    }
+    /* Rearms a fired oneshot, the ctl lock keeps the item alive */
+    __EpollKick__(__Ep__, It);
+    return 0;
+}
+
+static int
+__EpollDel__(PosixEpoll* __Ep__, PosixFile* __Desc__, int __Fd__)
+{
+    AcquireSpinLock(&__EpollLinkLock__);
+    PosixEpollItem* It = __EpollFind__(__Ep__, __Desc__, __Fd__);
+    if (It)
+    {
+        __EpollUnlinkFile__(It);
+        __EpollDrop__(It);
+    }
+    ReleaseSpinLock(&__EpollLinkLock__);
+
+    if (!It)
+    {
+        return -SysErrNoEnt;
+    }
+    KFree(It);
+    return 0;
+}
+
+int
+PosixEpollCtl(PosixFdTable*          __Tab__,
+              int                    __EpFd__,
+              int                    __Op__,
+              int                    __Fd__,
+              const PosixEpollEvent* __Event__)
+{
+    PosixFile* EpDesc = PosixFdGet(__Tab__, __EpFd__);
+    PosixFile* Desc   = PosixFdGet(__Tab__, __Fd__);
+    int        R      = -SysErrBadf;
+
+    if (EpDesc && Desc)
+    {
+        /* Nested instances are refused, a watch cycle would deadlock the hooks */
+        if (!EpDesc->IsEpoll || Desc->IsEpoll)
+        {
+            R = -SysErrInval;
+        }
+        else if (!__Event__ && __Op__ != PosixEpollCtlDel)
+        {
+            R = -SysErrFault;
+        }
+        else
+        {
+            PosixEpoll* Ep = (PosixEpoll*)EpDesc->Obj;
+            AcquireMutex(&Ep->CtlLock);
+            switch (__Op__)
+            {
+                case PosixEpollCtlAdd:
+                    R = __EpollAdd__(Ep, Desc, __Fd__, __Event__);
+                    break;
+                case PosixEpollCtlMod:
+                    R = __EpollMod__(Ep, Desc, __Fd__, __Event__);
+                    break;
+                case PosixEpollCtlDel:
+                    R = __EpollDel__(Ep, Desc, __Fd__);
+                    break;
+                default:
+                    R = -SysErrInval;
+                    break;
+            }
+            ReleaseMutex(&Ep->CtlLock);
+        }
+    }
+
+    PosixFilePut(Desc);
+    PosixFilePut(EpDesc);
+    return R;
+}
+
+/*
+ * Reports from the ready list only. Each pass looks at no more items than
+ * were queued when it started, level-triggered items go back on the tail
+ * while they stay ready, edge-triggered ones wait for the next hook and
+ * oneshot ones are disarmed until EPOLL_CTL_MOD.
+ */
+static int
+__EpollHarvest__(PosixEpoll* __Ep__, PosixEpollEvent* __Out__, int __Max__)
+{
+    int N = 0;
+
+    AcquireMutex(&__Ep__->CtlLock);
+    long Budget = __atomic_load_n(&__Ep__->ReadyCount, __ATOMIC_SEQ_CST);
+    while (Budget-- > 0 && N < __Max__)
+    {
+        AcquireSpinLock(&__Ep__->Lock);
+        PosixEpollItem* It = __Ep__->ReadyHead;
+        if (!It)
+        {
+            ReleaseSpinLock(&__Ep__->Lock);
+            break;
+        }
+        __EpollUnready__(__Ep__, It);
+
+        /* A dying description is about to drop the item, leave it be */
+        PosixFile* Desc = It->Desc;
+        bool       Live = __TryRetain__(Desc);
+        ReleaseSpinLock(&__Ep__->Lock);
+        if (!Live)
+        {
+            continue;
+        }
+
+        uint32_t Mask = PosixFilePoll(Desc, NULL) & __EpollEventBits__(It->Events);
+        if (Mask)
+        {
+            __Out__[N].Events = Mask;
+            __Out__[N].Data   = It->Data;
+            N++;
+        }
+
+        AcquireSpinLock(&__Ep__->Lock);
+        if (Mask && (It->Events & PosixEpollOneshot))
+        {
+            It->Events &= (PosixEpollEt | PosixEpollOneshot);
+        }
+        else if (Mask && !(It->Events & PosixEpollEt))
+        {
+            __EpollQueue__(__Ep__, It);
+        }
+        ReleaseSpinLock(&__Ep__->Lock);
+
+        /* May be the last put, which frees the item, so it is not touched again */
+        PosixFilePut(Desc);
+    }
+    ReleaseMutex(&__Ep__->CtlLock);
+
+    return N;
+}
+
+long
+PosixEpollWait(PosixFdTable*    __Tab__,
+               int              __EpFd__,
+               PosixEpollEvent* __Out__,
+               int              __Max__,
+               long             __TimeoutMs__)
+{
+    if (!__Out__ || __Max__ <= 0)
+    {
+        return -SysErrInval;
+    }
+    PosixFile* Desc = PosixFdGet(__Tab__, __EpFd__);
+    if (!Desc)
+    {
+        return -SysErrBadf;
+    }
+    if (!Desc->IsEpoll)
+    {
+        PosixFilePut(Desc);
+        return -SysErrInval;
+    }
+
+    PosixEpoll* Ep       = (PosixEpoll*)Desc->Obj;
+    uint64_t    Deadline = (__TimeoutMs__ > 0) ? GetSystemTicks() + (uint64_t)__TimeoutMs__ : 0;
+    long        N        = 0;
+    for (;;)
+    {
+        N = __EpollHarvest__(Ep, __Out__, __Max__);
+        if (N || __TimeoutMs__ == 0)
+        {
+            break;
+        }
+
+        long Remaining = __PollRemaining__(__TimeoutMs__, Deadline);
+        if (Remaining < 0)
+        {
+            break;
+        }
+
+        WaitQueuePrepare(&Ep->Wait, WaitReasonIo, (uint64_t)Remaining);
+        if (__atomic_load_n(&Ep->ReadyCount, __ATOMIC_SEQ_CST) > 0)
+        {
+            WaitQueueCancel(&Ep->Wait);
+            continue;
+        }
+        WaitQueueCommit(&Ep->Wait);
+    }
+
+    PosixFilePut(Desc);
+    return N;
+}
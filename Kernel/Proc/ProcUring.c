@@ -0,0 +1,842 @@
+#include <AllTypes.h>
+#include <AxeThreads.h>
+#include <KHeap.h>
+#include <KrnPrintf.h>
+#include <PMM.h>
+#include <POSIXFd.h>
+#include <POSIXPoll.h>
+#include <POSIXUring.h>
+#include <String.h>
+#include <Sync.h>
+#include <SysABI.h>
+#include <Timer.h>
+#include <VFS.h>
+#include <VMM.h>
+
+/*
+ * io_uring. The rings are one run of physical pages, reached by the kernel
+ * through the direct map and by the process through a slot of the ring
+ * window, so neither side copies indices or entries around.
+ *
+ * Submission copies each SQE out before the head moves and tries it once
+ * without blocking. What would block is queued to the ring's workers, plain
+ * kernel threads that run with the ring's page tables loaded so user
+ * buffers resolve as they would for the caller. Workers only ever hold
+ * descriptions, never the fd table, which may be gone by the time they run.
+ *
+ * Ring lifetime is Refs: the description holds one, each worker and the
+ * SQPOLL thread one more, the pages and the address space reference go with
+ * the last.
+ */
+
+/* Slots of the ring window, across every address space */
+static SpinLock __UringMapLock__;
+
+/* A worker parked in a poll rechecks this often whether its ring died */
+#define __UringPollSliceMs__ 250
+
+static uint32_t
+__RoundPow2__(uint32_t __V__)
+{
+    uint32_t P = 1;
+    while (P < __V__)
+    {
+        P <<= 1;
+    }
+    return P;
+}
+
+static inline long
+__AlignUp__(long __V__, long __A__)
+{
+    return (__V__ + (__A__ - 1)) & ~(__A__ - 1);
+}
+
+bool
+PosixUringIsRingAddress(uint64_t __Va__)
+{
+    return __Va__ >= PosixUringBase &&
+           __Va__ < PosixUringBase + (uint64_t)PosixUringSlots * PosixUringSlotSize;
+}
+
+static void
+__UringGet__(PosixUring* __Ring__)
+{
+    __atomic_add_fetch(&__Ring__->Refs, 1, __ATOMIC_ACQ_REL);
+}
+
+static void
+__UringUnmap__(PosixUring* __Ring__)
+{
+    for (long I = 0; I < __Ring__->Pages; I++)
+    {
+        uint64_t Va   = __Ring__->UserBase + (uint64_t)I * PageSize;
+        uint64_t Phys = __Ring__->Phys + (uint64_t)I * PageSize;
+
+        /* The process may have unmapped it and put something else there */
+        if (GetPhysicalAddress(__Ring__->Space, Va) == Phys)
+        {
+            UnmapPage(__Ring__->Space, Va);
+        }
+    }
+    FlushAllTlb();
+}
+
+static void
+__UringPut__(PosixUring* __Ring__)
+{
+    if (__atomic_sub_fetch(&__Ring__->Refs, 1, __ATOMIC_ACQ_REL) > 0)
+    {
+        return;
+    }
+
+    if (__Ring__->UserBase)
+    {
+        __UringUnmap__(__Ring__);
+    }
+    FreePages(__Ring__->Phys, (size_t)__Ring__->Pages);
+    DestroyVirtualSpace(__Ring__->Space);
+    KFree(__Ring__);
+}
+
+static long
+__UringMap__(PosixUring* __Ring__)
+{
+    uint64_t Flags = PTEPRESENT | PTEUSER | PTEWRITABLE | PTENOEXECUTE;
+
+    AcquireSpinLock(&__UringMapLock__);
+    for (long Slot = 0; Slot < PosixUringSlots; Slot++)
+    {
+        uint64_t Va = PosixUringBase + (uint64_t)Slot * PosixUringSlotSize;
+        if (GetPhysicalAddress(__Ring__->Space, Va))
+        {
+            continue;
+        }
+
+        for (long I = 0; I < __Ring__->Pages; I++)
+        {
+            uint64_t Off = (uint64_t)I * PageSize;
+            if (MapPage(__Ring__->Space, Va + Off, __Ring__->Phys + Off, Flags) != 1)
+            {
+                while (--I >= 0)
+                {
+                    UnmapPage(__Ring__->Space, Va + (uint64_t)I * PageSize);
+                }
+                ReleaseSpinLock(&__UringMapLock__);
+                return -SysErrNoMem;
+            }
+        }
+        __Ring__->UserBase = Va;
+        ReleaseSpinLock(&__UringMapLock__);
+        return 0;
+    }
+    ReleaseSpinLock(&__UringMapLock__);
+    return -SysErrMfile;
+}
+
+static void
+__UringComplete__(PosixUring* __Ring__, uint64_t __UserData__, long __Res__)
+{
+    PosixUringRings* R = __Ring__->Rings;
+
+    AcquireSpinLock(&__Ring__->CqLock);
+    uint32_t Tail = R->CqTail;
+    uint32_t Head = __atomic_load_n(&R->CqHead, __ATOMIC_ACQUIRE);
+    if (Tail - Head >= R->CqEntries)
+    {
+        /* Reaper fell behind, counted so it can tell a result went missing */
+        __atomic_add_fetch(&R->CqOverflow, 1, __ATOMIC_RELEASE);
+        ReleaseSpinLock(&__Ring__->CqLock);
+        return;
+    }
+    PosixUringCqe* Cqe = &__Ring__->Cqes[Tail & R->CqMask];
+    Cqe->UserData      = __UserData__;
+    Cqe->Res           = (int32_t)__Res__;
+    Cqe->Flags         = 0;
+    __atomic_store_n(&R->CqTail, Tail + 1, __ATOMIC_RELEASE);
+    ReleaseSpinLock(&__Ring__->CqLock);
+
+    WaitQueueWakeAll(&__Ring__->CqWait);
+}
+
+static long
+__UringVec__(PosixFile* __Desc__, const PosixUringSqe* __Sqe__, long __Off__, int __Nonblock__)
+{
+    const Iovec* Iov = (const Iovec*)__Sqe__->Addr;
+
+    /* One VFS call for the whole list */
+    return (__Sqe__->Opcode == PosixUringOpReadv)
+               ? PosixFileReadv(__Desc__, Iov, (long)__Sqe__->Len, __Off__, __Nonblock__)
+               : PosixFileWritev(__Desc__, Iov, (long)__Sqe__->Len, __Off__, __Nonblock__);
+}
+
+static long
+__UringPollOp__(PosixUring* __Ring__, PosixFile* __Desc__, uint32_t __Events__, int __Nonblock__)
+{
+    if (__Nonblock__)
+    {
+        uint32_t Mask = PosixFilePollWait(__Desc__, __Events__, 0);
+        return Mask ? (long)Mask : -SysErrAgain;
+    }
+
+    /* Sliced so a ring torn down under a parked worker lets it go */
+    while (!__atomic_load_n(&__Ring__->Dying, __ATOMIC_ACQUIRE))
+    {
+        uint32_t Mask = PosixFilePollWait(__Desc__, __Events__, __UringPollSliceMs__);
+        if (Mask)
+        {
+            return (long)Mask;
+        }
+    }
+    return -SysErrIntr;
+}
+
+/* One attempt at a description-backed request, -SysErrAgain when nonblocking would wait */
+static long
+__UringExec__(PosixUring*          __Ring__,
+              PosixFile*           __Desc__,
+              const PosixUringSqe* __Sqe__,
+              int                  __Nonblock__)
+{
+    long Off = ((int64_t)__Sqe__->Off < 0) ? -1 : (long)__Sqe__->Off;
+
+    switch (__Sqe__->Opcode)
+    {
+        case PosixUringOpRead:
+            return PosixFileRead(
+                __Desc__, (void*)__Sqe__->Addr, (long)__Sqe__->Len, Off, __Nonblock__);
+        case PosixUringOpWrite:
+            return PosixFileWrite(
+                __Desc__, (const void*)__Sqe__->Addr, (long)__Sqe__->Len, Off, __Nonblock__);
+        case PosixUringOpReadv:
+        case PosixUringOpWritev:
+            return __UringVec__(__Desc__, __Sqe__, Off, __Nonblock__);
+        case PosixUringOpFsync:
+            if (!__Desc__->IsFile)
+            {
+                return -SysErrInval;
+            }
+            return (VfsFsync((File*)__Desc__->Obj) < 0) ? -SysErrIo : 0;
+        case PosixUringOpPollAdd:
+            return __UringPollOp__(__Ring__, __Desc__, __Sqe__->OpFlags & 0xFFFF, __Nonblock__);
+        default:
+            return -SysErrInval;
+    }
+}
+
+/* A worker's blocking attempt, data waits are sliced like polls so a dead ring lets go */
+static long
+__UringBlocking__(PosixUring* __Ring__, PosixFile* __Desc__, const PosixUringSqe* __Sqe__)
+{
+    uint32_t Events;
+    switch (__Sqe__->Opcode)
+    {
+        case PosixUringOpRead:
+        case PosixUringOpReadv:
+            Events = VfsPollIn;
+            break;
+        case PosixUringOpWrite:
+        case PosixUringOpWritev:
+            Events = VfsPollOut;
+            break;
+        default:
+            return __UringExec__(__Ring__, __Desc__, __Sqe__, 0);
+    }
+
+    /* A write may come back short where a blocking one would have waited for room */
+    while (!__atomic_load_n(&__Ring__->Dying, __ATOMIC_ACQUIRE))
+    {
+        long R = __UringExec__(__Ring__, __Desc__, __Sqe__, 1);
+        if (R != -SysErrAgain)
+        {
+            return R;
+        }
+        PosixFilePollWait(__Desc__, Events, __UringPollSliceMs__);
+    }
+    return -SysErrIntr;
+}
+
+static PosixUringReq*
+__UringPop__(PosixUring* __Ring__)
+{
+    AcquireSpinLock(&__Ring__->WorkLock);
+    PosixUringReq* Req = __Ring__->WorkHead;
+    if (Req)
+    {
+        __Ring__->WorkHead = Req->Next;
+        if (!__Ring__->WorkHead)
+        {
+            __Ring__->WorkTail = NULL;
+        }
+    }
+    ReleaseSpinLock(&__Ring__->WorkLock);
+    return Req;
+}
+
+/* The last put may free the page tables this thread runs on, get off them first */
+static void
+__UringLeave__(PosixUring* __Ring__)
+{
+    Thread* Self = GetCurrentThreadLocal();
+    if (Self)
+    {
+        Self->PageDirectory = Vmm.KernelSpace->PhysicalBase;
+    }
+    SwitchVirtualSpace(Vmm.KernelSpace);
+    __UringPut__(__Ring__);
+    ThreadExit(0);
+}
+
+static void
+__UringWorker__(void* __Arg__)
+{
+    PosixUring* Ring = (PosixUring*)__Arg__;
+
+    for (;;)
+    {
+        PosixUringReq* Req = __UringPop__(Ring);
+        if (Req)
+        {
+            /* Blocking now, unless the description itself asked not to */
+            long R = (Req->Desc->Flags & PosixONonblock)
+                         ? __UringExec__(Ring, Req->Desc, &Req->Sqe, 1)
+                         : __UringBlocking__(Ring, Req->Desc, &Req->Sqe);
+            PosixFilePut(Req->Desc);
+            __UringComplete__(Ring, Req->Sqe.UserData, R);
+            KFree(Req);
+            continue;
+        }
+        if (__atomic_load_n(&Ring->Dying, __ATOMIC_ACQUIRE))
+        {
+            break;
+        }
+
+        __atomic_add_fetch(&Ring->IdleWorkers, 1, __ATOMIC_ACQ_REL);
+        WaitQueuePrepare(&Ring->WorkWait, WaitReasonIo, 0);
+        if (__atomic_load_n(&Ring->WorkHead, __ATOMIC_ACQUIRE) ||
+            __atomic_load_n(&Ring->Dying, __ATOMIC_ACQUIRE))
+        {
+            WaitQueueCancel(&Ring->WorkWait);
+        }
+        else
+        {
+            WaitQueueCommit(&Ring->WorkWait);
+        }
+        __atomic_sub_fetch(&Ring->IdleWorkers, 1, __ATOMIC_ACQ_REL);
+    }
+
+    __atomic_sub_fetch(&Ring->Workers, 1, __ATOMIC_ACQ_REL);
+    __UringLeave__(Ring);
+}
+
+static bool
+__UringSpawn__(PosixUring* __Ring__, void (*__Entry__)(void*), const char* __Name__)
+{
+    Thread* Th = CreateThread(ThreadTypeKernel, __Entry__, __Ring__, ThreadPriorityNormal);
+    if (!Th)
+    {
+        return false;
+    }
+    __UringGet__(__Ring__);
+    StringCopy(Th->Name, __Name__, sizeof(Th->Name));
+    Th->Flags |= ThreadFlagSystem;
+    Th->PageDirectory = __Ring__->Space->PhysicalBase;
+    ThreadExecute(Th);
+    return true;
+}
+
+/* Takes over the reference on __Desc__ */
+static void
+__UringPunt__(PosixUring* __Ring__, PosixFile* __Desc__, const PosixUringSqe* __Sqe__)
+{
+    PosixUringReq* Req = (PosixUringReq*)KMalloc(sizeof(PosixUringReq));
+    if (!Req)
+    {
+        PosixFilePut(__Desc__);
+        __UringComplete__(__Ring__, __Sqe__->UserData, -SysErrNoMem);
+        return;
+    }
+    Req->Next = NULL;
+    Req->Desc = __Desc__;
+    __builtin_memcpy(&Req->Sqe, __Sqe__, sizeof(PosixUringSqe));
+
+    bool Spawn = false;
+    AcquireSpinLock(&__Ring__->WorkLock);
+    if (__Ring__->WorkTail)
+    {
+        __Ring__->WorkTail->Next = Req;
+    }
+    else
+    {
+        __Ring__->WorkHead = Req;
+    }
+    __Ring__->WorkTail = Req;
+    if (!__atomic_load_n(&__Ring__->IdleWorkers, __ATOMIC_ACQUIRE) &&
+        __Ring__->Workers < PosixUringMaxWorkers)
+    {
+        __atomic_add_fetch(&__Ring__->Workers, 1, __ATOMIC_ACQ_REL);
+        Spawn = true;
+    }
+    ReleaseSpinLock(&__Ring__->WorkLock);
+
+    if (Spawn && !__UringSpawn__(__Ring__, __UringWorker__, "iou-wrk"))
+    {
+        PWarn("Uring: worker spawn failed\n");
+        if (__atomic_sub_fetch(&__Ring__->Workers, 1, __ATOMIC_ACQ_REL) == 0)
+        {
+            /* Nobody would ever run what is queued */
+            while ((Req = __UringPop__(__Ring__)) != NULL)
+            {
+                PosixFilePut(Req->Desc);
+                __UringComplete__(__Ring__, Req->Sqe.UserData, -SysErrAgain);
+                KFree(Req);
+            }
+        }
+        return;
+    }
+    WaitQueueWakeOne(&__Ring__->WorkWait);
+}
+
+static long
+__UringOpenat__(PosixFdTable* __Tab__, const PosixUringSqe* __Sqe__)
+{
+    const char* Path = (const char*)__Sqe__->Addr;
+    if (!Path)
+    {
+        return -SysErrFault;
+    }
+    /* No fd-relative lookup yet, only the working directory or absolute paths */
+    if (__Sqe__->Fd != PosixUringAtFdCwd && Path[0] != '/')
+    {
+        return -SysErrBadf;
+    }
+    int Fd = PosixOpen(__Tab__, Path, (long)__Sqe__->OpFlags, (long)__Sqe__->Len);
+    return (Fd >= 0) ? Fd : -SysErrNoEnt;
+}
+
+/* Not on a ring fd, its last put would wait on the SubmitLock held here */
+static long
+__UringClose__(PosixFdTable* __Tab__, int __Fd__)
+{
+    PosixFile* Desc = PosixFdGet(__Tab__, __Fd__);
+    if (!Desc)
+    {
+        return -SysErrBadf;
+    }
+    int IsUring = Desc->IsUring;
+    PosixFilePut(Desc);
+    if (IsUring)
+    {
+        return -SysErrBadf;
+    }
+    return (PosixClose(__Tab__, __Fd__) == 0) ? 0 : -SysErrBadf;
+}
+
+static void
+__UringIssue__(PosixUring* __Ring__, PosixFdTable* __Tab__, const PosixUringSqe* __Sqe__)
+{
+    /* Table operations run here, in the submitter's context, never on a worker */
+    switch (__Sqe__->Opcode)
+    {
+        case PosixUringOpNop:
+            __UringComplete__(__Ring__, __Sqe__->UserData, 0);
+            return;
+        case PosixUringOpOpenat:
+            __UringComplete__(__Ring__, __Sqe__->UserData, __UringOpenat__(__Tab__, __Sqe__));
+            return;
+        case PosixUringOpClose:
+            __UringComplete__(__Ring__, __Sqe__->UserData, __UringClose__(__Tab__, __Sqe__->Fd));
+            return;
+        case PosixUringOpRead:
+        case PosixUringOpWrite:
+        case PosixUringOpReadv:
+        case PosixUringOpWritev:
+        case PosixUringOpFsync:
+        case PosixUringOpPollAdd:
+            break;
+        default:
+            __UringComplete__(__Ring__, __Sqe__->UserData, -SysErrInval);
+            return;
+    }
+
+    PosixFile* Desc = PosixFdGet(__Tab__, __Sqe__->Fd);
+    if (!Desc)
+    {
+        __UringComplete__(__Ring__, __Sqe__->UserData, -SysErrBadf);
+        return;
+    }
+    /* A ring waiting on a ring would pin both */
+    if (Desc->IsUring)
+    {
+        PosixFilePut(Desc);
+        __UringComplete__(__Ring__, __Sqe__->UserData, -SysErrInval);
+        return;
+    }
+
+    if (!(__Sqe__->Flags & PosixUringSqeAsync))
+    {
+        long R = __UringExec__(__Ring__, Desc, __Sqe__, 1);
+        if (R != -SysErrAgain || (Desc->Flags & PosixONonblock))
+        {
+            PosixFilePut(Desc);
+            __UringComplete__(__Ring__, __Sqe__->UserData, R);
+            return;
+        }
+    }
+    __UringPunt__(__Ring__, Desc, __Sqe__);
+}
+
+/* Caller holds SubmitLock */
+static long
+__UringSubmit__(PosixUring* __Ring__, PosixFdTable* __Tab__, uint32_t __Max__)
+{
+    PosixUringRings* R     = __Ring__->Rings;
+    uint32_t         Head  = R->SqHead;
+    uint32_t         Tail  = __atomic_load_n(&R->SqTail, __ATOMIC_ACQUIRE);
+    uint32_t         Avail = Tail - Head;
+    if (Avail > R->SqEntries)
+    {
+        Avail = R->SqEntries; /*Garbage tail, take no more than the ring holds*/
+    }
+
+    long Done = 0;
+    for (uint32_t I = 0; I < Avail && (uint32_t)Done < __Max__; I++)
+    {
+        uint32_t Idx = __atomic_load_n(&__Ring__->SqArray[Head & R->SqMask], __ATOMIC_RELAXED);
+        Head++;
+        if (Idx >= R->SqEntries)
+        {
+            __atomic_add_fetch(&R->SqDropped, 1, __ATOMIC_RELEASE);
+            __atomic_store_n(&R->SqHead, Head, __ATOMIC_RELEASE);
+            continue;
+        }
+
+        /* Copied out before the head moves, the slot is the process's again after */
+        PosixUringSqe Sqe;
+        __builtin_memcpy(&Sqe, &__Ring__->Sqes[Idx], sizeof(PosixUringSqe));
+        __atomic_store_n(&R->SqHead, Head, __ATOMIC_RELEASE);
+
+        __UringIssue__(__Ring__, __Tab__, &Sqe);
+        Done++;
+    }
+    return Done;
+}
+
+static bool
+__UringSqPending__(PosixUring* __Ring__)
+{
+    PosixUringRings* R = __Ring__->Rings;
+    return __atomic_load_n(&R->SqTail, __ATOMIC_ACQUIRE) != R->SqHead;
+}
+
+static void
+__UringSqThread__(void* __Arg__)
+{
+    PosixUring* Ring = (PosixUring*)__Arg__;
+    uint64_t    Last = GetSystemTicks();
+
+    while (!__atomic_load_n(&Ring->Dying, __ATOMIC_ACQUIRE))
+    {
+        long Done = 0;
+        AcquireMutex(&Ring->SubmitLock);
+        if (!__atomic_load_n(&Ring->Dying, __ATOMIC_ACQUIRE))
+        {
+            Done = __UringSubmit__(Ring, Ring->Tab, Ring->Rings->SqEntries);
+        }
+        ReleaseMutex(&Ring->SubmitLock);
+
+        uint64_t Now = GetSystemTicks();
+        if (Done)
+        {
+            Last = Now;
+            continue;
+        }
+        if (Now - Last < Ring->IdleMs)
+        {
+            ThreadYield();
+            continue;
+        }
+
+        /* Flag first and look again, a tail bumped in between is not missed */
+        __atomic_or_fetch(&Ring->Rings->SqFlags, PosixUringSqNeedWakeup, __ATOMIC_SEQ_CST);
+        WaitQueuePrepare(&Ring->SqWait, WaitReasonIo, 0);
+        if (__UringSqPending__(Ring) || __atomic_load_n(&Ring->Dying, __ATOMIC_ACQUIRE))
+        {
+            WaitQueueCancel(&Ring->SqWait);
+        }
+        else
+        {
+            WaitQueueCommit(&Ring->SqWait);
+        }
+        __atomic_and_fetch(&Ring->Rings->SqFlags, ~PosixUringSqNeedWakeup, __ATOMIC_SEQ_CST);
+        Last = GetSystemTicks();
+    }
+
+    __UringLeave__(Ring);
+}
+
+long
+PosixUringAlloc(PosixProc*        __Proc__,
+                uint32_t          __Entries__,
+                PosixUringParams* __Params__,
+                PosixUring**      __Out__)
+{
+    if (!__Params__)
+    {
+        return -SysErrFault;
+    }
+    if (!__Entries__ || __Entries__ > PosixUringMaxEntries ||
+        (__Params__->Flags & ~(PosixUringSetupSqPoll | PosixUringSetupCqSize)))
+    {
+        return -SysErrInval;
+    }
+
+    uint32_t Sq = __RoundPow2__(__Entries__);
+    uint32_t Cq = 2 * Sq;
+    if (__Params__->Flags & PosixUringSetupCqSize)
+    {
+        if (!__Params__->CqEntries || __Params__->CqEntries > 2 * PosixUringMaxEntries)
+        {
+            return -SysErrInval;
+        }
+        Cq = __RoundPow2__(__Params__->CqEntries);
+        Cq = (Cq < Sq) ? Sq : Cq;
+    }
+
+    /* Indices, then the SQ index array, the CQEs, and the SQEs on a page of their own */
+    long ArrayOff = (long)sizeof(PosixUringRings);
+    long CqeOff   = __AlignUp__(ArrayOff + (long)(Sq * sizeof(uint32_t)), 64);
+    long SqeOff   = __AlignUp__(CqeOff + (long)(Cq * sizeof(PosixUringCqe)), PageSize);
+    long Pages    = __AlignUp__(SqeOff + (long)(Sq * sizeof(PosixUringSqe)), PageSize) / PageSize;
+
+    PosixUring* Ring = (PosixUring*)KMalloc(sizeof(PosixUring));
+    if (!Ring)
+    {
+        return -SysErrNoMem;
+    }
+    memset(Ring, 0, sizeof(PosixUring));
+
+    Ring->Phys = AllocPages((size_t)Pages);
+    if (!Ring->Phys)
+    {
+        KFree(Ring);
+        return -SysErrNoMem;
+    }
+    char* Base = (char*)PhysToVirt(Ring->Phys);
+    memset(Base, 0, (size_t)Pages * PageSize);
+
+    Ring->Refs       = 1;
+    Ring->Pages      = Pages;
+    Ring->SqeOff     = SqeOff;
+    Ring->Rings      = (PosixUringRings*)Base;
+    Ring->SqArray    = (uint32_t*)(Base + ArrayOff);
+    Ring->Cqes       = (PosixUringCqe*)(Base + CqeOff);
+    Ring->Sqes       = (PosixUringSqe*)(Base + SqeOff);
+    Ring->Space      = __Proc__->Space;
+    Ring->Tab        = __Proc__->Fds; /*Borrowed, see PosixUringRelease*/
+    Ring->SetupFlags = __Params__->Flags;
+    Ring->IdleMs     = __Params__->SqThreadIdle ? __Params__->SqThreadIdle : PosixUringIdleMs;
+    __atomic_add_fetch(&Ring->Space->RefCount, 1, __ATOMIC_ACQ_REL);
+
+    Ring->Rings->SqMask    = Sq - 1;
+    Ring->Rings->SqEntries = Sq;
+    Ring->Rings->CqMask    = Cq - 1;
+    Ring->Rings->CqEntries = Cq;
+
+    InitializeMutex(&Ring->SubmitLock, "UringSubmit");
+    InitializeSpinLock(&Ring->CqLock, "UringCq");
+    InitializeSpinLock(&Ring->WorkLock, "UringWork");
+    InitializeWaitQueue(&Ring->CqWait, "UringCq");
+    InitializeWaitQueue(&Ring->SqWait, "UringSq");
+    InitializeWaitQueue(&Ring->WorkWait, "UringWork");
+
+    long Err = __UringMap__(Ring);
+    if (Err < 0)
+    {
+        __UringPut__(Ring);
+        return Err;
+    }
+    if ((Ring->SetupFlags & PosixUringSetupSqPoll) &&
+        !__UringSpawn__(Ring, __UringSqThread__, "iou-sqp"))
+    {
+        __UringPut__(Ring);
+        return -SysErrNoMem;
+    }
+
+    __Params__->SqEntries = Sq;
+    __Params__->CqEntries = Cq;
+    __Params__->Features  = PosixUringFeatSingle | PosixUringFeatStable;
+
+    PosixUringSqOffsets* SqOff = &__Params__->SqOff;
+    SqOff->Head                = __builtin_offsetof(PosixUringRings, SqHead);
+    SqOff->Tail                = __builtin_offsetof(PosixUringRings, SqTail);
+    SqOff->RingMask            = __builtin_offsetof(PosixUringRings, SqMask);
+    SqOff->RingEntries         = __builtin_offsetof(PosixUringRings, SqEntries);
+    SqOff->Flags               = __builtin_offsetof(PosixUringRings, SqFlags);
+    SqOff->Dropped             = __builtin_offsetof(PosixUringRings, SqDropped);
+    SqOff->Array               = (uint32_t)ArrayOff;
+    SqOff->Resv1               = 0;
+    SqOff->UserAddr            = Ring->UserBase;
+
+    PosixUringCqOffsets* CqOff = &__Params__->CqOff;
+    CqOff->Head                = __builtin_offsetof(PosixUringRings, CqHead);
+    CqOff->Tail                = __builtin_offsetof(PosixUringRings, CqTail);
+    CqOff->RingMask            = __builtin_offsetof(PosixUringRings, CqMask);
+    CqOff->RingEntries         = __builtin_offsetof(PosixUringRings, CqEntries);
+    CqOff->Overflow            = __builtin_offsetof(PosixUringRings, CqOverflow);
+    CqOff->Cqes                = (uint32_t)CqeOff;
+    CqOff->Flags               = __builtin_offsetof(PosixUringRings, CqFlags);
+    CqOff->Resv1               = 0;
+    CqOff->UserAddr            = Ring->UserBase + (uint64_t)SqeOff; /*SQE array*/
+
+    *__Out__ = Ring;
+    return 0;
+}
+
+void
+PosixUringRelease(PosixUring* __Ring__)
+{
+    __atomic_store_n(&__Ring__->Dying, 1, __ATOMIC_SEQ_CST);
+
+    /*
+     * Ring->Tab holds no reference, this handshake is all that protects it.
+     * Ring fds are skipped at fork, so only the owner's table ever holds the
+     * description, and PosixFdDestroy closes ring fds before it detaches the
+     * set, so this runs while every Tab lookup is still good. The SQPOLL
+     * thread only touches Tab under SubmitLock with Dying clear, so once
+     * this lock has been cycled it never will.
+     */
+    AcquireMutex(&__Ring__->SubmitLock);
+    ReleaseMutex(&__Ring__->SubmitLock);
+
+    /* Nobody reaps any more, queued requests are dropped unrun */
+    AcquireSpinLock(&__Ring__->WorkLock);
+    PosixUringReq* Req = __Ring__->WorkHead;
+    __Ring__->WorkHead = NULL;
+    __Ring__->WorkTail = NULL;
+    ReleaseSpinLock(&__Ring__->WorkLock);
+    while (Req)
+    {
+        PosixUringReq* Next = Req->Next;
+        PosixFilePut(Req->Desc);
+        KFree(Req);
+        Req = Next;
+    }
+
+    WaitQueueWakeAll(&__Ring__->WorkWait);
+    WaitQueueWakeAll(&__Ring__->SqWait);
+    WaitQueueWakeAll(&__Ring__->CqWait);
+    __UringPut__(__Ring__);
+}
+
+uint32_t
+PosixUringPoll(PosixUring* __Ring__, WaitQueue** __Queue__)
+{
+    if (__Queue__)
+    {
+        *__Queue__ = &__Ring__->CqWait;
+    }
+    PosixUringRings* R = __Ring__->Rings;
+    return (__atomic_load_n(&R->CqTail, __ATOMIC_ACQUIRE) !=
+            __atomic_load_n(&R->CqHead, __ATOMIC_ACQUIRE))
+               ? VfsPollIn
+               : 0;
+}
+
+uint64_t
+PosixUringMmapAddr(PosixFile*          __Desc__,
+                   VirtualMemorySpace* __Space__,
+                   uint64_t            __Off__,
+                   uint64_t            __Len__)
+{
+    PosixUring* Ring = (PosixUring*)__Desc__->Obj;
+    if (Ring->Space != __Space__)
+    {
+        return 0;
+    }
+
+    uint64_t At = 0;
+    if (__Off__ == PosixUringOffSqes)
+    {
+        At = (uint64_t)Ring->SqeOff;
+    }
+    else if (__Off__ != PosixUringOffSqRing && __Off__ != PosixUringOffCqRing)
+    {
+        return 0;
+    }
+    if (__Len__ > (uint64_t)Ring->Pages * PageSize - At)
+    {
+        return 0;
+    }
+    return Ring->UserBase + At;
+}
+
+static void
+__UringWaitCq__(PosixUring* __Ring__, uint32_t __Min__)
+{
+    PosixUringRings* R = __Ring__->Rings;
+    __Min__            = (__Min__ > R->CqEntries) ? R->CqEntries : __Min__;
+
+    for (;;)
+    {
+        WaitQueuePrepare(&__Ring__->CqWait, WaitReasonIo, 0);
+        uint32_t Ready = __atomic_load_n(&R->CqTail, __ATOMIC_ACQUIRE) -
+                         __atomic_load_n(&R->CqHead, __ATOMIC_ACQUIRE);
+        if (Ready >= __Min__ || __atomic_load_n(&__Ring__->Dying, __ATOMIC_ACQUIRE))
+        {
+            WaitQueueCancel(&__Ring__->CqWait);
+            return;
+        }
+        WaitQueueCommit(&__Ring__->CqWait);
+    }
+}
+
+long
+PosixUringEnter(PosixProc* __Proc__,
+                int        __Fd__,
+                uint32_t   __ToSubmit__,
+                uint32_t   __MinComplete__,
+                uint32_t   __Flags__)
+{
+    if (__Flags__ & ~(PosixUringEnterGetEvents | PosixUringEnterSqWakeup))
+    {
+        return -SysErrInval;
+    }
+
+    PosixFile* Desc = PosixFdGet(__Proc__->Fds, __Fd__);
+    if (!Desc)
+    {
+        return -SysErrBadf;
+    }
+    PosixUring* Ring = Desc->IsUring ? (PosixUring*)Desc->Obj : NULL;
+    if (!Ring || Ring->Space != __Proc__->Space)
+    {
+        PosixFilePut(Desc);
+        return -SysErrBadf;
+    }
+
+    long Submitted = 0;
+    if (Ring->SetupFlags & PosixUringSetupSqPoll)
+    {
+        /* The polling thread consumes the SQ, the caller only nudges it */
+        if (__Flags__ & PosixUringEnterSqWakeup)
+        {
+            WaitQueueWakeAll(&Ring->SqWait);
+        }
+        Submitted = __ToSubmit__;
+    }
+    else if (__ToSubmit__)
+    {
+        AcquireMutex(&Ring->SubmitLock);
+        Submitted = __UringSubmit__(Ring, __Proc__->Fds, __ToSubmit__);
+        ReleaseMutex(&Ring->SubmitLock);
+    }
+
+    if ((__Flags__ & PosixUringEnterGetEvents) && __MinComplete__)
+    {
+        __UringWaitCq__(Ring, __MinComplete__);
+    }
+
+    PosixFilePut(Desc);
+    return Submitted;
+}
@@ -2,13 +2,16 @@
 #include <KHeap.h>
 #include <KrnPrintf.h>
 #include <PMM.h>
+#include <StackCache.h>
 #include <String.h>
 #include <VFS.h>
 #include <VMM.h>
+#include <Vdso.h>
 #include <VirtBin.h>
 
-#define __STACK_BASE__ 0x0000000001000000ULL
-#define __STACK_SIZE__ 0x0000000000010000ULL
+/* Committed top of the main thread stack, the rest of the reserve faults in */
+#define __STACK_BASE__ (UserStackTop - UserStackCommit)
+#define __STACK_SIZE__ UserStackCommit
 #define __ARG_AREA__   0x0000000000F00000ULL
 
 static inline uint64_t
@@ -59,6 +62,28 @@ VirtMapRangeZeroed(VirtualMemorySpace* __Space__,
     return 0;
 }
 
+int
+VirtStackFault(VirtualMemorySpace* __Space__, uint64_t __Addr__, uint64_t __ErrCode__)
+{
+    /* Only not-present faults inside the reserve, the lowest page stays a guard */
+    uint64_t Floor = UserStackTop - UserStackReserve + PageSize;
+    if (!__Space__ || (__ErrCode__ & 1) || __Addr__ < Floor || __Addr__ >= UserStackTop)
+    {
+        return -1;
+    }
+
+    uint64_t Page = __Addr__ & ~(uint64_t)(PageSize - 1);
+
+    /* Another thread of the process may have grown it first */
+    if (GetPhysicalAddress(__Space__, Page))
+    {
+        return 0;
+    }
+
+    return VirtMapRangeZeroed(
+        __Space__, Page, PageSize, PTEPRESENT | PTEWRITABLE | PTEUSER | PTENOEXECUTE);
+}
+
 static uint64_t
 __PushStrings__(VirtualMemorySpace* __Space__,
                 const char* const*  __List__,
@@ -175,6 +200,9 @@ VirtSetupStack(VirtualMemorySpace* __Space__,
     }
     PDebug("VirtSetupStack: arg area mapped OK\n");
 
+    /* Shared time page and code, advertised through AT_SYSINFO_EHDR below */
+    uint64_t __VdsoAddr__ = VdsoMap(__Space__);
+
     uint64_t __ArgPtrs__[128] = {0};
     uint64_t __EnvPtrs__[128] = {0};
 
@@ -190,11 +218,12 @@ VirtSetupStack(VirtualMemorySpace* __Space__,
 
     enum
     {
-        AT_NULL   = 0,
-        AT_PAGESZ = 6,
-        AT_EXECFN = 31
+        AT_NULL         = 0,
+        AT_PAGESZ       = 6,
+        AT_EXECFN       = 31,
+        AT_SYSINFO_EHDR = AtSysinfoEhdr
     };
-    uint64_t __AuxPairs__ = 2; /* PAGESZ, EXECFN */
+    uint64_t __AuxPairs__ = 3; /* PAGESZ, SYSINFO_EHDR, EXECFN */
 
     /* total qwords to push (excluding optional shim) */
     uint64_t __TotalQwords__ = 1 /*argc*/ + __ArgCount__ + 1 /*argv NULL*/ + __EnvCount__ +
@@ -226,78 +255,66 @@ VirtSetupStack(VirtualMemorySpace* __Space__,
         PDebug("VirtSetupStack: shim pushed; RSP=0x%llx\n", (unsigned long long)__Rsp__);
     }
 
-    /* argc */
-    int RIdx = __Push64__(__Space__, &__Rsp__, __STACK_BASE__, (uint64_t)__ArgCount__);
+    /*
+     * Pushed top down so the finished stack reads, from RSP upwards, argc,
+     * argv[], NULL, envp[], NULL and the auxv pairs, the SysV process layout.
+     */
+
+    /* auxv: AT_NULL terminator pair */
+    int RIdx = __Push64__(__Space__, &__Rsp__, __STACK_BASE__, 0);
     if (RIdx != 0)
     {
-        PError("VirtSetupStack: push argc failed RIdx=%d\n", RIdx);
+        PError("VirtSetupStack: push AT_NULL val failed RIdx=%d\n", RIdx);
         return 0;
     }
-    PDebug("VirtSetupStack: argc=%llu pushed; RSP=0x%llx\n",
-           (unsigned long long)__ArgCount__,
-           (unsigned long long)__Rsp__);
-
-    /* argv[] */
-    for (uint64_t I = 0; I < __ArgCount__; I++)
-    {
-        RIdx = __Push64__(__Space__, &__Rsp__, __STACK_BASE__, __ArgPtrs__[I]);
-        if (RIdx != 0)
-        {
-            PError("VirtSetupStack: push argv[%llu]=0x%llx failed RIdx=%d\n",
-                   (unsigned long long)I,
-                   (unsigned long long)__ArgPtrs__[I],
-                   RIdx);
-            return 0;
-        }
-        PDebug("VirtSetupStack: argv[%llu]=0x%llx pushed; RSP=0x%llx\n",
-               (unsigned long long)I,
-               (unsigned long long)__ArgPtrs__[I],
-               (unsigned long long)__Rsp__);
-    }
-
-    /* argv NULL */
-    RIdx = __PushNull__(__Space__, &__Rsp__, __STACK_BASE__);
+    RIdx = __Push64__(__Space__, &__Rsp__, __STACK_BASE__, (uint64_t)AT_NULL);
     if (RIdx != 0)
     {
-        PError("VirtSetupStack: push argv NULL failed RIdx=%d\n", RIdx);
+        PError("VirtSetupStack: push AT_NULL key failed RIdx=%d\n", RIdx);
         return 0;
     }
-    PDebug("VirtSetupStack: argv NULL pushed; RSP=0x%llx\n", (unsigned long long)__Rsp__);
+    PDebug("VirtSetupStack: auxv AT_NULL pushed; RSP=0x%llx\n", (unsigned long long)__Rsp__);
 
-    /* envp[] (maybe zero) */
-    for (uint64_t J = 0; J < __EnvCount__; J++)
+    /* auxv: AT_EXECFN, argv[0] or 0 */
     {
-        RIdx = __Push64__(__Space__, &__Rsp__, __STACK_BASE__, __EnvPtrs__[J]);
+        uint64_t __Execfn__ = (__ArgCount__ > 0) ? __ArgPtrs__[0] : 0;
+        RIdx                = __Push64__(__Space__, &__Rsp__, __STACK_BASE__, __Execfn__);
         if (RIdx != 0)
         {
-            PError("VirtSetupStack: push envp[%llu]=0x%llx failed RIdx=%d\n",
-                   (unsigned long long)J,
-                   (unsigned long long)__EnvPtrs__[J],
+            PError("VirtSetupStack: push AT_EXECFN val=0x%llx failed RIdx=%d\n",
+                   (unsigned long long)__Execfn__,
                    RIdx);
             return 0;
         }
-        PDebug("VirtSetupStack: envp[%llu]=0x%llx pushed; RSP=0x%llx\n",
-               (unsigned long long)J,
-               (unsigned long long)__EnvPtrs__[J],
+        RIdx = __Push64__(__Space__, &__Rsp__, __STACK_BASE__, (uint64_t)AT_EXECFN);
+        if (RIdx != 0)
+        {
+            PError("VirtSetupStack: push AT_EXECFN key failed RIdx=%d\n", RIdx);
+            return 0;
+        }
+        PDebug("VirtSetupStack: auxv AT_EXECFN=0x%llx pushed; RSP=0x%llx\n",
+               (unsigned long long)__Execfn__,
                (unsigned long long)__Rsp__);
     }
 
-    /* envp NULL */
-    RIdx = __PushNull__(__Space__, &__Rsp__, __STACK_BASE__);
+    /* auxv: AT_SYSINFO_EHDR, vDSO image or 0 when it could not be mapped */
+    RIdx = __Push64__(__Space__, &__Rsp__, __STACK_BASE__, __VdsoAddr__);
     if (RIdx != 0)
     {
-        PError("VirtSetupStack: push envp NULL failed RIdx=%d\n", RIdx);
+        PError("VirtSetupStack: push AT_SYSINFO_EHDR val failed RIdx=%d\n", RIdx);
         return 0;
     }
-    PDebug("VirtSetupStack: envp NULL pushed; RSP=0x%llx\n", (unsigned long long)__Rsp__);
-
-    /* auxv: AT_PAGESZ, PageSize */
-    RIdx = __Push64__(__Space__, &__Rsp__, __STACK_BASE__, (uint64_t)AT_PAGESZ);
+    RIdx = __Push64__(__Space__, &__Rsp__, __STACK_BASE__, (uint64_t)AT_SYSINFO_EHDR);
     if (RIdx != 0)
     {
-        PError("VirtSetupStack: push AT_PAGESZ key failed RIdx=%d\n", RIdx);
+        PError("VirtSetupStack: push AT_SYSINFO_EHDR key failed RIdx=%d\n", RIdx);
         return 0;
     }
+    PDebug("VirtSetupStack: auxv AT_SYSINFO_EHDR=0x%llx pushed; RSP=0x%llx\n",
+           (unsigned long long)__VdsoAddr__,
+           (unsigned long long)__Rsp__);
+
+    /* auxv: AT_PAGESZ, PageSize */
     RIdx = __Push64__(__Space__, &__Rsp__, __STACK_BASE__, (uint64_t)PageSize);
     if (RIdx != 0)
     {
@@ -306,46 +323,80 @@ VirtSetupStack(VirtualMemorySpace* __Space__,
                RIdx);
         return 0;
     }
+    RIdx = __Push64__(__Space__, &__Rsp__, __STACK_BASE__, (uint64_t)AT_PAGESZ);
+    if (RIdx != 0)
+    {
+        PError("VirtSetupStack: push AT_PAGESZ key failed RIdx=%d\n", RIdx);
+        return 0;
+    }
     PDebug("VirtSetupStack: auxv AT_PAGESZ=%llu pushed; RSP=0x%llx\n",
            (unsigned long long)PageSize,
            (unsigned long long)__Rsp__);
 
-    /* auxv: AT_EXECFN, argv[0] or 0 */
-    RIdx = __Push64__(__Space__, &__Rsp__, __STACK_BASE__, (uint64_t)AT_EXECFN);
+    /* envp NULL */
+    RIdx = __PushNull__(__Space__, &__Rsp__, __STACK_BASE__);
     if (RIdx != 0)
     {
-        PError("VirtSetupStack: push AT_EXECFN key failed RIdx=%d\n", RIdx);
+        PError("VirtSetupStack: push envp NULL failed RIdx=%d\n", RIdx);
         return 0;
     }
+    PDebug("VirtSetupStack: envp NULL pushed; RSP=0x%llx\n", (unsigned long long)__Rsp__);
+
+    /* envp[] (maybe zero), last first */
+    for (uint64_t J = __EnvCount__; J-- > 0;)
     {
-        uint64_t __Execfn__ = (__ArgCount__ > 0) ? __ArgPtrs__[0] : 0;
-        RIdx                = __Push64__(__Space__, &__Rsp__, __STACK_BASE__, __Execfn__);
+        RIdx = __Push64__(__Space__, &__Rsp__, __STACK_BASE__, __EnvPtrs__[J]);
         if (RIdx != 0)
         {
-            PError("VirtSetupStack: push AT_EXECFN val=0x%llx failed RIdx=%d\n",
-                   (unsigned long long)__Execfn__,
+            PError("VirtSetupStack: push envp[%llu]=0x%llx failed RIdx=%d\n",
+                   (unsigned long long)J,
+                   (unsigned long long)__EnvPtrs__[J],
                    RIdx);
             return 0;
         }
-        PDebug("VirtSetupStack: auxv AT_EXECFN=0x%llx pushed; RSP=0x%llx\n",
-               (unsigned long long)__Execfn__,
+        PDebug("VirtSetupStack: envp[%llu]=0x%llx pushed; RSP=0x%llx\n",
+               (unsigned long long)J,
+               (unsigned long long)__EnvPtrs__[J],
                (unsigned long long)__Rsp__);
     }
 
-    /* auxv: AT_NULL terminator pair */
-    RIdx = __Push64__(__Space__, &__Rsp__, __STACK_BASE__, (uint64_t)AT_NULL);
+    /* argv NULL */
+    RIdx = __PushNull__(__Space__, &__Rsp__, __STACK_BASE__);
     if (RIdx != 0)
     {
-        PError("VirtSetupStack: push AT_NULL key failed RIdx=%d\n", RIdx);
+        PError("VirtSetupStack: push argv NULL failed RIdx=%d\n", RIdx);
         return 0;
     }
-    RIdx = __Push64__(__Space__, &__Rsp__, __STACK_BASE__, 0);
+    PDebug("VirtSetupStack: argv NULL pushed; RSP=0x%llx\n", (unsigned long long)__Rsp__);
+
+    /* argv[], last first */
+    for (uint64_t I = __ArgCount__; I-- > 0;)
+    {
+        RIdx = __Push64__(__Space__, &__Rsp__, __STACK_BASE__, __ArgPtrs__[I]);
+        if (RIdx != 0)
+        {
+            PError("VirtSetupStack: push argv[%llu]=0x%llx failed RIdx=%d\n",
+                   (unsigned long long)I,
+                   (unsigned long long)__ArgPtrs__[I],
+                   RIdx);
+            return 0;
+        }
+        PDebug("VirtSetupStack: argv[%llu]=0x%llx pushed; RSP=0x%llx\n",
+               (unsigned long long)I,
+               (unsigned long long)__ArgPtrs__[I],
+               (unsigned long long)__Rsp__);
+    }
+
+    /* argc */
+    RIdx = __Push64__(__Space__, &__Rsp__, __STACK_BASE__, (uint64_t)__ArgCount__);
     if (RIdx != 0)
     {
-        PError("VirtSetupStack: push AT_NULL val failed RIdx=%d\n", RIdx);
+        PError("VirtSetupStack: push argc failed RIdx=%d\n", RIdx);
         return 0;
     }
-    PDebug("VirtSetupStack: auxv AT_NULL pushed; RSP=0x%llx\n", (unsigned long long)__Rsp__);
+    PDebug("VirtSetupStack: argc=%llu pushed; RSP=0x%llx\n",
+           (unsigned long long)__ArgCount__,
+           (unsigned long long)__Rsp__);
 
     /* Assert ABI invariant: RSP % 16 == 8 at entry */
     uint64_t ModIdx = (__Rsp__ & 0xFULL);
@@ -399,6 +450,7 @@ VirtLoad(const VirtRequest* __Req__, VirtImage* __OutImg__)
     __OutImg__->Auxv.Buf   = NULL;
     __OutImg__->Auxv.Cap   = 0;
     __OutImg__->Auxv.Len   = 0;
+    __OutImg__->Vdso       = 0;
 
     const DynLoader* Ldr = DynLoaderSelect(__Req__->File);
     if (!Ldr)
@@ -426,6 +478,9 @@ VirtLoad(const VirtRequest* __Req__, VirtImage* __OutImg__)
     __OutImg__->Entry      = Loaded->Entry;
     __OutImg__->LoadBase   = Loaded->LoadBase;
 
+    /* Mapped before the aux vector so the loader advertises where it really is */
+    __OutImg__->Vdso = VdsoMap(Space);
+
     if (Ldr->Ops.BuildAux)
     {
         uint64_t auxBuf[64] = {0};
@@ -1,6 +1,7 @@
 #include <APICTimer.h>  /* APIC Timer specific constants and functions */
 #include <AxeSchd.h>    /* Axe Scheduler definitions */
 #include <AxeThreads.h> /* Thread management interfaces */
+#include <FpuState.h>   /* Lazy FPU/XSAVE setup */
 #include <SymAP.h>      /* Symmetric Multiprocessing Application Processor definitions */
 #include <Syscall.h>
 #include <Timer.h> /* Timer management interfaces */
@@ -19,6 +20,9 @@ ApEntryPoint(struct limine_smp_info* __CpuInfo__)
         }
     }
 
+    /* Before anything takes a lock, spinlocks read the CPU number through GS */
+    PerCpuInstall(CpuNumber);
+
     Smp.Cpus[CpuNumber].Status  = CPU_STATUS_ONLINE;
     Smp.Cpus[CpuNumber].Started = 1; /* Boolean flag indicating startup completion */
 
@@ -44,30 +48,15 @@ ApEntryPoint(struct limine_smp_info* __CpuInfo__)
 
     PerCpuInterruptInit(CpuNumber, NewStackTop);
 
-    unsigned long Cr0, Cr4;
-
-    /* Read CR0 and CR4 */
-    __asm__ volatile("mov %%cr0, %0" : "=r"(Cr0));
-    __asm__ volatile("mov %%cr4, %0" : "=r"(Cr4));
-
-    /* CR0: clear EM (bit 2), set MP (bit 1), clear TS (bit 3) */
-    Cr0 &= ~(1UL << 2); /* EM = 0 */
-    Cr0 |= (1UL << 1);  /* MP = 1 */
-    Cr0 &= ~(1UL << 3); /* TS = 0 */
-    __asm__ volatile("mov %0, %%cr0" ::"r"(Cr0) : "memory");
-
-    /* CR4: set OSFXSR (bit 9) and OSXMMEXCPT (bit 10) for SSE */
-    Cr4 |= (1UL << 9) | (1UL << 10);
-    __asm__ volatile("mov %0, %%cr4" ::"r"(Cr4) : "memory");
-
-    /* Initialize x87/SSE state */
-    __asm__ volatile("fninit");
+    /* Same FPU/XSAVE setup as the boot CPU */
+    InitializeFpu();
 
     SetupApicTimerForThisCpu();
 
     InitializeCpuScheduler(CpuNumber);
 
     SetIdtEntry(0x80, (uint64_t)SysEntASM, KernelCodeSelector, 0xEE);
+    InitSyscallCpu();
 
     __asm__ volatile("sti");
 
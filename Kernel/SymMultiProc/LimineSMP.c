@@ -1,5 +1,6 @@
 #include <LimineSMP.h>      /* Limine SMP protocol definitions */
 #include <LimineServices.h> /* Limine service interfaces */
+#include <PerCPUData.h>     /* GS-anchored per-CPU block */
 #include <SMP.h>            /* SMP manager and CPU structures */
 #include <Timer.h>          /* Timer functions for timeouts */
 #include <VMM.h>            /* Virtual memory management for APIC access */
@@ -8,8 +9,9 @@ SmpManager        Smp;
 SpinLock          SMPLock;
 volatile uint32_t CpuStartupCount = 0;
 
-uint32_t
-GetCurrentCpuId(void)
+/* LAPIC lookup, only used before this CPU has its GS base installed */
+static uint32_t
+__ApicCpuId__(void)
 {
     uint64_t ApicBaseMsr  = ReadMsr(0x1B);            /* IA32_APIC_BASE Model-Specific Register */
     uint64_t ApicPhysBase = ApicBaseMsr & 0xFFFFF000; /* Extract 4KB-aligned base address */
@@ -28,6 +30,17 @@ GetCurrentCpuId(void)
     return ApicId;
 }
 
+uint32_t
+GetCurrentCpuId(void)
+{
+    if (__atomic_load_n(&PerCpuReady, __ATOMIC_ACQUIRE))
+    {
+        return PerCpuCpuNumber();
+    }
+
+    return __ApicCpuId__();
+}
+
 void
 InitializeSmp(void)
 {
@@ -43,6 +56,8 @@ InitializeSmp(void)
         Smp.Cpus[0].CpuNumber = 0;
         Smp.Cpus[0].Status    = CPU_STATUS_ONLINE;
         Smp.Cpus[0].Started   = 1;
+        PerCpuInstall(0);
+        __atomic_store_n(&PerCpuReady, 1, __ATOMIC_RELEASE);
         return;
     }
 
@@ -76,6 +91,8 @@ InitializeSmp(void)
         {
             Smp.Cpus[Index].Status  = CPU_STATUS_ONLINE;
             Smp.Cpus[Index].Started = 1;
+            PerCpuInstall(Index);
+            __atomic_store_n(&PerCpuReady, 1, __ATOMIC_RELEASE);
             PDebug("SMP: BSP CPU %u (LAPIC ID %u)\n", Index, CpuInfo->lapic_id);
         }
         else
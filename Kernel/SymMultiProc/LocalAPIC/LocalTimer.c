@@ -77,10 +77,12 @@ SetupApicTimerForThisCpu(void)
     }
     PDebug("AP: Calculated InitialCount = %u\n", InitialCount);
 
+    /* Same mode the BSP picked, a one-shot is re-armed by every timer interrupt */
+    uint32_t Mode = Timer.OneShot ? TimerApicTimerOneShot : TimerApicTimerPeriodic;
+
     PDebug("AP: Configuring LVT Timer (unmasked)...\n");
-    *LvtTimer =
-        TimerVector | TimerApicTimerPeriodic | (0 << 8); /* Vector | Periodic | Priority 0 */
-    PDebug("AP: Set LVT Timer to 0x%08x (unmasked)\n", TimerVector | TimerApicTimerPeriodic);
+    *LvtTimer = TimerVector | Mode | (0 << 8); /* Vector | Mode | Priority 0 */
+    PDebug("AP: Set LVT Timer to 0x%08x (unmasked)\n", TimerVector | Mode);
 
     PDebug("AP: Starting timer (masked)...\n");
     *TimerInitCount = InitialCount;
@@ -1,11 +1,33 @@
 #include <GDT.h>        /* Global Descriptor Table definitions */
 #include <PerCPUData.h> /* Per-CPU data structure definitions */
 #include <SMP.h>        /* SMP management structures and constants */
+#include <StackCache.h> /* Double fault stack */
 #include <SymAP.h>      /* Symmetric Application Processor definitions */
 #include <Timer.h>      /* Timer interfaces for per-CPU timer data */
 #include <VMM.h>        /* Virtual Memory Management for address translation */
 
-PerCpuData CpuDataArray[MaxCPUs];
+PerCpuData        CpuDataArray[MaxCPUs];
+volatile uint32_t PerCpuReady = 0;
+
+void
+PerCpuInstall(uint32_t __CpuNumber__)
+{
+    PerCpuData* CpuData = &CpuDataArray[__CpuNumber__];
+
+    CpuData->Self      = CpuData;
+    CpuData->CpuNumber = __CpuNumber__;
+
+    /* The boot CPU keeps the TSS from InitializeTss, APs move to their own below */
+    if (!CpuData->ActiveTss)
+    {
+        CpuData->ActiveTss = &Tss;
+    }
+    CpuData->KernelRsp = CpuData->ActiveTss->Rsp0;
+
+    /* Kernel GS points at this block, the user GS base starts out empty */
+    WriteMsr(MsrGsBase, (uint64_t)CpuData);
+    WriteMsr(MsrKernelGsBase, 0);
+}
 
 void
 PerCpuInterruptInit(uint32_t __CpuNumber__, uint64_t __StackTop__)
@@ -30,6 +52,19 @@ PerCpuInterruptInit(uint32_t __CpuNumber__, uint64_t __StackTop__)
 
     CpuData->Tss.Rsp0      = __StackTop__;             /* Kernel stack pointer for ring 0 */
     CpuData->Tss.IoMapBase = sizeof(TaskStateSegment); /* I/O permission bitmap offset */
+    CpuData->ActiveTss     = &CpuData->Tss;
+    CpuData->KernelRsp     = __StackTop__;
+
+    /* Guarded double fault stack, the IDT template already routes #DF to IST1 */
+    StackSlot* IstStack = StackAlloc(KStackIstSize);
+    if (IstStack)
+    {
+        CpuData->Tss.Ist1 = IstStack->Top;
+    }
+    else
+    {
+        PWarn("CPU %u: No double fault stack\n", __CpuNumber__);
+    }
 
     PDebug("CPU %u: TSS initialized with Rsp0=0x%llx\n", __CpuNumber__, CpuData->Tss.Rsp0);
 
@@ -97,6 +132,9 @@ PerCpuInterruptInit(uint32_t __CpuNumber__, uint64_t __StackTop__)
                      :
                      : "ax", "memory");
 
+    /* Reloading GS cleared its base, point it back at this CPU's block */
+    PerCpuInstall(__CpuNumber__);
+
     __asm__ volatile("ltr %0" : : "r"((uint16_t)TssSelector) : "memory");
 
     GdtPointer VerifyGdt;
@@ -0,0 +1,223 @@
+#include <AxeThreads.h>  /* Current thread and its process */
+#include <ClockSource.h> /* Timeout units */
+#include <Futex.h>       /* Futex interfaces */
+#include <POSIXProc.h>   /* Address space of the caller */
+#include <SysABI.h>      /* Error numbers */
+#include <VMM.h>         /* Physical keys */
+
+static WaitQueue         __FutexTable__[FutexBuckets];
+static volatile uint32_t __FutexReady__ = 0;
+
+typedef struct
+{
+    uint64_t  Key;
+    uint32_t  Bitset;
+    uint64_t  NewKey;  /* Requeue only, key the moved waiters take */
+    uint32_t* Uaddr;   /* CMP_REQUEUE only, word compared under the bucket locks */
+    uint32_t  Expect;
+
+} FutexMatch;
+
+void
+InitializeFutex(void)
+{
+    for (uint32_t Index = 0; Index < FutexBuckets; Index++)
+    {
+        InitializeWaitQueue(&__FutexTable__[Index], "Futex");
+    }
+
+    __atomic_store_n(&__FutexReady__, 1, __ATOMIC_RELEASE);
+    PSuccess("Futex: %u hash buckets\n", FutexBuckets);
+}
+
+static long
+__FutexKey__(uint32_t* __Uaddr__, uint64_t* __OutKey__)
+{
+    uint64_t Addr = (uint64_t)__Uaddr__;
+    if ((Addr & 3) != 0)
+    {
+        return -SysErrInval;
+    }
+    if (!Addr || Addr >= FutexUserLimit)
+    {
+        return -SysErrFault;
+    }
+
+    PosixProc* Proc = PosixCurrent();
+    if (!Proc || !Proc->Space)
+    {
+        return -SysErrFault;
+    }
+
+    /* Page plus offset, the same word through any mapping gives the same key */
+    uint64_t Phys = GetPhysicalAddress(Proc->Space, Addr);
+    if (!Phys)
+    {
+        return -SysErrFault;
+    }
+
+    *__OutKey__ = Phys;
+    return 0;
+}
+
+static inline WaitQueue*
+__FutexBucket__(uint64_t __Key__)
+{
+    /* Words are 4-byte aligned, drop the bits that never vary */
+    uint64_t Hash = (__Key__ >> 2) * 0x9E3779B97F4A7C15ULL;
+    return &__FutexTable__[Hash >> (64 - 8)];
+}
+
+_Static_assert(FutexBuckets == 256, "__FutexBucket__ takes the top 8 bits of the hash");
+
+static bool
+__FutexMatchWake__(Thread* __ThreadPtr__, void* __Arg__)
+{
+    FutexMatch* Match = (FutexMatch*)__Arg__;
+    return __ThreadPtr__->FutexKey == Match->Key && (__ThreadPtr__->FutexBitset & Match->Bitset);
+}
+
+static bool
+__FutexMatchRequeue__(Thread* __ThreadPtr__, void* __Arg__)
+{
+    FutexMatch* Match = (FutexMatch*)__Arg__;
+    if (__ThreadPtr__->FutexKey != Match->Key)
+    {
+        return false;
+    }
+
+    /* Only called for threads that will be moved, both bucket locks are held */
+    __ThreadPtr__->FutexKey = Match->NewKey;
+    return true;
+}
+
+static bool
+__FutexCheckValue__(void* __Arg__)
+{
+    FutexMatch* Match = (FutexMatch*)__Arg__;
+    return __atomic_load_n((volatile uint32_t*)Match->Uaddr, __ATOMIC_SEQ_CST) == Match->Expect;
+}
+
+long
+FutexWait(uint32_t* __Uaddr__, uint32_t __Val__, uint64_t __TimeoutNs__, uint32_t __Bitset__)
+{
+    Thread* Self = GetCurrentThreadLocal();
+    if (!Self || !__Bitset__ || !__atomic_load_n(&__FutexReady__, __ATOMIC_ACQUIRE))
+    {
+        return -SysErrInval;
+    }
+
+    uint64_t Key;
+    long     Status = __FutexKey__(__Uaddr__, &Key);
+    if (Status != 0)
+    {
+        return Status;
+    }
+
+    /* Whole milliseconds for the wait queue deadline, rounded up so it never fires early */
+    uint64_t TimeoutMs = 0;
+    if (__TimeoutNs__ != FutexNoTimeout)
+    {
+        TimeoutMs = (__TimeoutNs__ + NsPerMsec - 1) / NsPerMsec;
+        if (!TimeoutMs)
+        {
+            TimeoutMs = 1;
+        }
+    }
+
+    WaitQueue* Bucket = __FutexBucket__(Key);
+
+    Self->FutexKey    = Key;
+    Self->FutexBitset = __Bitset__;
+
+    /* Queued before the value is read, a waker that changed it afterwards finds us */
+    WaitQueuePrepare(Bucket, WaitReasonFutex, TimeoutMs);
+
+    if (__atomic_load_n((volatile uint32_t*)__Uaddr__, __ATOMIC_SEQ_CST) != __Val__)
+    {
+        WaitQueueCancel(Bucket);
+        return -SysErrAgain;
+    }
+
+    if (__TimeoutNs__ == 0)
+    {
+        WaitQueueCancel(Bucket);
+        return -SysErrTimedOut;
+    }
+
+    return WaitQueueCommit(Bucket) == 0 ? 0 : -SysErrTimedOut;
+}
+
+long
+FutexWake(uint32_t* __Uaddr__, uint32_t __Count__, uint32_t __Bitset__)
+{
+    if (!__Bitset__ || !__atomic_load_n(&__FutexReady__, __ATOMIC_ACQUIRE))
+    {
+        return -SysErrInval;
+    }
+
+    uint64_t Key;
+    long     Status = __FutexKey__(__Uaddr__, &Key);
+    if (Status != 0)
+    {
+        return Status;
+    }
+
+    /* Uncontended unlocks land here with nobody parked, an empty bucket costs one load */
+    WaitQueue* Bucket = __FutexBucket__(Key);
+    if (!__Count__ || WaitQueueEmpty(Bucket))
+    {
+        return 0;
+    }
+
+    FutexMatch Match = {.Key = Key, .Bitset = __Bitset__, .NewKey = 0};
+    return (long)WaitQueueWakeMatch(Bucket, __FutexMatchWake__, &Match, __Count__);
+}
+
+long
+FutexRequeue(uint32_t* __Uaddr__,
+             uint32_t  __WakeCount__,
+             uint32_t  __RequeueCount__,
+             uint32_t* __Uaddr2__,
+             bool      __Compare__,
+             uint32_t  __Val3__)
+{
+    if (!__atomic_load_n(&__FutexReady__, __ATOMIC_ACQUIRE))
+    {
+        return -SysErrInval;
+    }
+
+    uint64_t Key;
+    uint64_t Key2;
+    long     Status = __FutexKey__(__Uaddr__, &Key);
+    if (Status == 0)
+    {
+        Status = __FutexKey__(__Uaddr2__, &Key2);
+    }
+    if (Status != 0)
+    {
+        return Status;
+    }
+
+    /*
+     * Compared, woken and moved in one hold of both bucket locks, a waiter
+     * queueing on either key sees the word before or after all of it.
+     */
+    FutexMatch Match = {
+        .Key    = Key,
+        .Bitset = FutexBitsetAll,
+        .NewKey = Key2,
+        .Uaddr  = __Uaddr__,
+        .Expect = __Val3__,
+    };
+
+    long R = WaitQueueWakeRequeue(__FutexBucket__(Key),
+                                  __FutexBucket__(Key2),
+                                  __FutexMatchWake__,
+                                  __FutexMatchRequeue__,
+                                  __Compare__ ? __FutexCheckValue__ : NULL,
+                                  &Match,
+                                  __WakeCount__,
+                                  __RequeueCount__);
+    return R < 0 ? -SysErrAgain : R;
+}
@@ -1,21 +1,198 @@
-#include <SMP.h>  /* Symmetric multiprocessing functions */
-#include <Sync.h> /* Synchronization primitives definitions */
+#include <AxeThreads.h> /* Thread ownership, states and wait reasons */
+#include <SMP.h>        /* Symmetric multiprocessing functions */
+#include <Sync.h>       /* Synchronization primitives definitions */
+
+/* Upper bound for optimistic spinning, the owner may stay on-CPU for a long time */
+#define MutexSpinLimit 4096
+
+/* Mutexes with a lent priority, and the lock over them and every Boost field */
+static SpinLock __MutexBoostLock__;
+static Mutex*   __MutexBoosted__;
+
+static inline Thread*
+__MutexSelf__(void)
+{
+    /* NULL before the scheduler runs anything on this CPU (boot context) */
+    return GetCurrentThreadLocal();
+}
+
+static inline bool
+__MutexTryLock__(Mutex* __Mutex__, Thread* __Self__)
+{
+    uint32_t Expected = 0; /* Expect the lock to be free (0) */
+    if (__atomic_compare_exchange_n(
+            &__Mutex__->Lock, &Expected, 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    {
+        __atomic_store_n(&__Mutex__->Owner, __Self__, __ATOMIC_RELEASE);
+        __Mutex__->RecursionCount = 1;
+        return true;
+    }
+    return false;
+}
+
+/*
+ * The owner, referenced, or NULL. Release clears Owner under Waiters.Lock,
+ * so an owner seen there has not let go yet and cannot have been freed.
+ */
+static Thread*
+__MutexOwnerGet__(Mutex* __Mutex__)
+{
+    AcquireSpinLock(&__Mutex__->Waiters.Lock);
+    Thread* Owner = __atomic_load_n(&__Mutex__->Owner, __ATOMIC_ACQUIRE);
+    if (Owner)
+    {
+        __atomic_fetch_add(&Owner->Refs, 1, __ATOMIC_ACQ_REL);
+    }
+    ReleaseSpinLock(&__Mutex__->Waiters.Lock);
+    return Owner;
+}
+
+/*
+ * Spin only while the owner is actually executing on another CPU, a preempted
+ * or blocked owner cannot release the lock any time soon so we park instead.
+ */
+static bool
+__MutexSpinOnOwner__(Mutex* __Mutex__, Thread* __Self__)
+{
+    uint32_t CpuId = GetCurrentCpuId();
+    Thread*  Owner = NULL; /* Referenced while we look at its state */
+    bool     Taken = false;
+
+    for (uint32_t Spin = 0; Spin < MutexSpinLimit; Spin++)
+    {
+        if (!__atomic_load_n(&__Mutex__->Lock, __ATOMIC_RELAXED))
+        {
+            if (__MutexTryLock__(__Mutex__, __Self__))
+            {
+                Taken = true;
+                break;
+            }
+            continue;
+        }
+
+        Thread* Now = __atomic_load_n(&__Mutex__->Owner, __ATOMIC_ACQUIRE);
+        if (!Now)
+        {
+            /* Lock just taken, owner not published yet */
+            __asm__ volatile("pause");
+            continue;
+        }
+        if (Now != Owner)
+        {
+            /* Only compared until referenced, it may be released and gone already */
+            ThreadPut(Owner);
+            Owner = __MutexOwnerGet__(__Mutex__);
+            if (!Owner)
+            {
+                continue;
+            }
+        }
+
+        if (__atomic_load_n(&Owner->State, __ATOMIC_RELAXED) != ThreadStateRunning ||
+            __atomic_load_n(&Owner->LastCpu, __ATOMIC_RELAXED) == CpuId)
+        {
+            break;
+        }
+
+        __asm__ volatile("pause");
+    }
+
+    ThreadPut(Owner);
+    return Taken;
+}
+
+/*
+ * Priority inheritance, lend our priority to a lower priority owner while we
+ * wait. Done under Waiters.Lock so the owner cannot release in between, and
+ * recorded in the mutex so the owner keeps it until this mutex is released.
+ */
+static void
+__MutexBoostOwner__(Mutex* __Mutex__, Thread* __Self__)
+{
+    if (!__Self__)
+    {
+        return;
+    }
+
+    AcquireSpinLock(&__Mutex__->Waiters.Lock);
+    Thread*        Owner = __atomic_load_n(&__Mutex__->Owner, __ATOMIC_ACQUIRE);
+    ThreadPriority Want  = __Self__->Priority;
+    if (Owner && Owner != __Self__ && Want > Owner->BasePriority)
+    {
+        AcquireSpinLock(&__MutexBoostLock__);
+        if (!__Mutex__->Boost)
+        {
+            __Mutex__->BoostNext = __MutexBoosted__;
+            __MutexBoosted__     = __Mutex__;
+        }
+        if ((uint32_t)Want > __Mutex__->Boost)
+        {
+            __Mutex__->Boost = (uint32_t)Want;
+        }
+
+        ThreadPriority Have = __atomic_load_n(&Owner->Priority, __ATOMIC_RELAXED);
+        while (Have < Want)
+        {
+            if (__atomic_compare_exchange_n(
+                    &Owner->Priority, &Have, Want, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        ReleaseSpinLock(&__MutexBoostLock__);
+    }
+    ReleaseSpinLock(&__Mutex__->Waiters.Lock);
+}
+
+/* Boost lock held, __Mutex__ gives back what it lent, the owner keeps what the others lend */
+static void
+__MutexUnboost__(Mutex* __Mutex__, Thread* __Self__)
+{
+    for (Mutex** Link = &__MutexBoosted__; *Link; Link = &(*Link)->BoostNext)
+    {
+        if (*Link == __Mutex__)
+        {
+            *Link = __Mutex__->BoostNext;
+            break;
+        }
+    }
+    __Mutex__->Boost     = 0;
+    __Mutex__->BoostNext = NULL;
+
+    if (!__Self__)
+    {
+        return;
+    }
+    ThreadPriority Keep = __Self__->BasePriority;
+    for (Mutex* Held = __MutexBoosted__; Held; Held = Held->BoostNext)
+    {
+        if (Held->Owner == __Self__ && Held->Boost > (uint32_t)Keep)
+        {
+            Keep = (ThreadPriority)Held->Boost;
+        }
+    }
+    __atomic_store_n(&__Self__->Priority, Keep, __ATOMIC_SEQ_CST);
+}
 
 void
 InitializeMutex(Mutex* __Mutex__, const char* __Name__)
 {
-    __Mutex__->Lock           = 0;          /* Initially unlocked */
-    __Mutex__->Owner          = 0xFFFFFFFF; /* No owner (kernel value) */
-    __Mutex__->RecursionCount = 0;          /* No recursive locks */
-    __Mutex__->Name           = __Name__;   /* Assign name for debugging */
+    __Mutex__->Lock           = 0;        /* Initially unlocked */
+    __Mutex__->Owner          = NULL;     /* No owning thread */
+    __Mutex__->RecursionCount = 0;        /* No recursive locks */
+    __Mutex__->Name           = __Name__; /* Assign name for debugging */
+    __Mutex__->Boost          = 0;        /* Nothing lent */
+    __Mutex__->BoostNext      = NULL;
+    InitializeWaitQueue(&__Mutex__->Waiters, __Name__);
 }
 
 void
 AcquireMutex(Mutex* __Mutex__)
 {
-    uint32_t CpuId = GetCurrentCpuId();
+    Thread* Self = __MutexSelf__();
 
-    if (__Mutex__->Owner == CpuId)
+    if (__atomic_load_n(&__Mutex__->Lock, __ATOMIC_ACQUIRE) &&
+        __atomic_load_n(&__Mutex__->Owner, __ATOMIC_RELAXED) == Self)
     {
         __Mutex__->RecursionCount++;
         return;
@@ -23,27 +200,40 @@ AcquireMutex(Mutex* __Mutex__)
 
     while (1)
     {
-        uint32_t Expected = 0; /* Expect the lock to be free (0) */
-        if (__atomic_compare_exchange_n(
-                &__Mutex__->Lock, &Expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        if (__MutexTryLock__(__Mutex__, Self))
         {
             /* Successfully acquired the lock */
-            __Mutex__->Owner          = CpuId;
-            __Mutex__->RecursionCount = 1;
             break;
         }
 
-        /* Lock is held by another CPU, spin with pause for efficiency */
-        __asm__ volatile("pause");
+        /* Owner running elsewhere, it will likely release soon */
+        if (__MutexSpinOnOwner__(__Mutex__, Self))
+        {
+            break;
+        }
+
+        /* Queue ourselves first, then retry so a release in between is not missed */
+        WaitQueuePrepare(&__Mutex__->Waiters, WaitReasonMutex, 0);
+
+        if (__MutexTryLock__(__Mutex__, Self))
+        {
+            WaitQueueCancel(&__Mutex__->Waiters);
+            break;
+        }
+
+        /* Lock is held by a descheduled owner, park until it releases */
+        __MutexBoostOwner__(__Mutex__, Self);
+        WaitQueueCommit(&__Mutex__->Waiters);
     }
 }
 
 void
 ReleaseMutex(Mutex* __Mutex__)
 {
-    uint32_t CpuId = GetCurrentCpuId();
+    Thread* Self = __MutexSelf__();
 
-    if (__Mutex__->Owner != CpuId)
+    if (!__atomic_load_n(&__Mutex__->Lock, __ATOMIC_ACQUIRE) ||
+        __atomic_load_n(&__Mutex__->Owner, __ATOMIC_RELAXED) != Self)
     {
         return;
     }
@@ -52,32 +242,40 @@ ReleaseMutex(Mutex* __Mutex__)
 
     if (__Mutex__->RecursionCount == 0)
     {
-        __Mutex__->Owner = 0xFFFFFFFF;                           /* Reset owner to kernel/none */
-        __atomic_store_n(&__Mutex__->Lock, 0, __ATOMIC_RELEASE); /* Unlock atomically */
+        /* Under Waiters.Lock, a contender looking at the owner or lending it priority waits */
+        AcquireSpinLock(&__Mutex__->Waiters.Lock);
+        __atomic_store_n(&__Mutex__->Owner, NULL, __ATOMIC_RELAXED); /* Reset owner to none */
+        __atomic_store_n(&__Mutex__->Lock, 0, __ATOMIC_SEQ_CST);     /* Unlock atomically */
+
+        /* Drop what waiters lent through this mutex only */
+        if (__Mutex__->Boost)
+        {
+            AcquireSpinLock(&__MutexBoostLock__);
+            __MutexUnboost__(__Mutex__, Self);
+            ReleaseSpinLock(&__MutexBoostLock__);
+        }
+        ReleaseSpinLock(&__Mutex__->Waiters.Lock);
+
+        /* Hand the wakeup to the oldest parked contender */
+        if (!WaitQueueEmpty(&__Mutex__->Waiters))
+        {
+            WaitQueueWakeOne(&__Mutex__->Waiters);
+        }
     }
 }
 
 bool
 TryAcquireMutex(Mutex* __Mutex__)
 {
-    uint32_t CpuId = GetCurrentCpuId();
+    Thread* Self = __MutexSelf__();
 
-    if (__Mutex__->Owner == CpuId)
+    if (__atomic_load_n(&__Mutex__->Lock, __ATOMIC_ACQUIRE) &&
+        __atomic_load_n(&__Mutex__->Owner, __ATOMIC_RELAXED) == Self)
     {
         __Mutex__->RecursionCount++;
         return true;
     }
 
-    uint32_t Expected = 0;
-    if (__atomic_compare_exchange_n(
-            &__Mutex__->Lock, &Expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
-    {
-        /* Successfully acquired */
-        __Mutex__->Owner          = CpuId;
-        __Mutex__->RecursionCount = 1;
-        return true;
-    }
-
-    /* Failed to acquire */
-    return false;
+    /* Successfully acquired, or failed when held by someone else */
+    return __MutexTryLock__(__Mutex__, Self);
 }
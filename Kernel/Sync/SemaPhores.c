@@ -1,13 +1,13 @@
-#include <SMP.h>  /* Symmetric multiprocessing functions */
-#include <Sync.h> /* Synchronization primitives definitions */
+#include <AxeThreads.h> /* Wait reasons */
+#include <SMP.h>        /* Symmetric multiprocessing functions */
+#include <Sync.h>       /* Synchronization primitives definitions */
 
 void
 InitializeSemaphore(Semaphore* __Semaphore__, int32_t __InitialCount__, const char* __Name__)
 {
-    __Semaphore__->Count     = __InitialCount__; /* Set initial count */
-    __Semaphore__->WaitQueue = 0;                /* No waiting threads initially */
-    InitializeSpinLock(&__Semaphore__->QueueLock, "SemaphoreQueue"); /* Initialize queue lock */
-    __Semaphore__->Name = __Name__;                                  /* Assign name for debugging */
+    __Semaphore__->Count = __InitialCount__;                 /* Set initial count */
+    InitializeWaitQueue(&__Semaphore__->Waiters, __Name__); /* No waiting threads initially */
+    __Semaphore__->Name = __Name__;                         /* Assign name for debugging */
 }
 
 void
@@ -15,31 +15,34 @@ AcquireSemaphore(Semaphore* __Semaphore__)
 {
     while (1)
     {
-        int32_t CurrentCount = __atomic_load_n(&__Semaphore__->Count, __ATOMIC_ACQUIRE);
+        if (TryAcquireSemaphore(__Semaphore__))
+        {
+            break; /* Successfully acquired */
+        }
+
+        /* Queue ourselves first, then retry so a release in between is not missed */
+        WaitQueuePrepare(&__Semaphore__->Waiters, WaitReasonSemaphore, 0);
 
-        if (CurrentCount > 0)
+        if (TryAcquireSemaphore(__Semaphore__))
         {
-            if (__atomic_compare_exchange_n(&__Semaphore__->Count,
-                                            &CurrentCount,
-                                            CurrentCount - 1,
-                                            false,
-                                            __ATOMIC_ACQUIRE,
-                                            __ATOMIC_RELAXED))
-            {
-                break; /* Successfully acquired */
-            }
-            /* Compare-exchange failed, retry */
+            WaitQueueCancel(&__Semaphore__->Waiters);
+            break;
         }
 
-        /* Count is zero or compare-exchange failed, spin with pause */
-        __asm__ volatile("pause");
+        /* Count is zero, park until a release hands us a wakeup */
+        WaitQueueCommit(&__Semaphore__->Waiters);
     }
 }
 
 void
 ReleaseSemaphore(Semaphore* __Semaphore__)
 {
-    __atomic_fetch_add(&__Semaphore__->Count, 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&__Semaphore__->Count, 1, __ATOMIC_SEQ_CST);
+
+    if (!WaitQueueEmpty(&__Semaphore__->Waiters))
+    {
+        WaitQueueWakeOne(&__Semaphore__->Waiters);
+    }
 }
 
 bool
@@ -47,19 +50,20 @@ TryAcquireSemaphore(Semaphore* __Semaphore__)
 {
     int32_t CurrentCount = __atomic_load_n(&__Semaphore__->Count, __ATOMIC_ACQUIRE);
 
-    if (CurrentCount > 0)
+    /* Only fail when the count is really zero, a lost race just reloads CurrentCount */
+    while (CurrentCount > 0)
     {
         if (__atomic_compare_exchange_n(&__Semaphore__->Count,
                                         &CurrentCount,
                                         CurrentCount - 1,
                                         false,
-                                        __ATOMIC_ACQUIRE,
-                                        __ATOMIC_RELAXED))
+                                        __ATOMIC_SEQ_CST,
+                                        __ATOMIC_ACQUIRE))
         {
             return true; /* Successfully acquired */
         }
     }
 
-    /* Count is zero or compare-exchange failed */
+    /* Count is zero */
     return false;
 }
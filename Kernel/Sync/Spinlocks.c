@@ -1,13 +1,55 @@
 #include <SMP.h>  /* Symmetric multiprocessing functions */
 #include <Sync.h> /* Synchronization primitives definitions */
 
-SpinLock        ConsoleLock;
-static uint64_t SavedFlags[MaxCPUs];
+SpinLock ConsoleLock;
+
+/* Spinlocks held on each CPU and the RFLAGS from before the outermost one */
+static struct
+{
+    uint32_t Depth;
+    uint64_t Flags;
+
+} __IrqNest__[MaxCPUs];
+
+static inline uint64_t
+__SaveIrqDisable__(void)
+{
+    uint64_t Flags;
+    __asm__ volatile("pushfq; popq %0; cli" : "=r"(Flags)::"memory");
+    return Flags;
+}
+
+static inline void
+__RestoreIrq__(uint64_t __Flags__)
+{
+    __asm__ volatile("pushq %0; popfq" ::"r"(__Flags__) : "memory");
+}
+
+static inline void
+__NestEnter__(uint32_t __CpuId__, uint64_t __Flags__)
+{
+    if (__IrqNest__[__CpuId__].Depth++ == 0)
+    {
+        __IrqNest__[__CpuId__].Flags = __Flags__;
+    }
+}
+
+static inline void
+__NestLeave__(void)
+{
+    uint32_t CpuId = GetCurrentCpuId();
+
+    /* Any release order works, only the last lock out restores the caller's state */
+    if (__IrqNest__[CpuId].Depth && --__IrqNest__[CpuId].Depth == 0)
+    {
+        __RestoreIrq__(__IrqNest__[CpuId].Flags);
+    }
+}
 
 void
 InitializeSpinLock(SpinLock* __Lock__, const char* __Name__)
 {
-    __Lock__->Lock  = 0;          /* Initially unlocked */
+    __Lock__->Lock  = 0;          /* Initially unlocked, both tickets at 0 */
     __Lock__->CpuId = 0xFFFFFFFF; /* No owner (kernel value) */
     __Lock__->Name  = __Name__;   /* Assign name for debugging */
 }
@@ -15,52 +57,140 @@ InitializeSpinLock(SpinLock* __Lock__, const char* __Name__)
 void
 AcquireSpinLock(SpinLock* __Lock__)
 {
-    uint32_t CpuId = GetCurrentCpuId();
+    uint64_t Flags = __SaveIrqDisable__();
 
-    uint64_t Flags;
-    __asm__ volatile("pushfq; popq %0; cli" : "=r"(Flags)::"memory");
+    /* Take a ticket, waiters are served strictly in arrival order */
+    uint16_t Ticket = __atomic_fetch_add(&__Lock__->Ticket.Next, 1, __ATOMIC_RELAXED);
 
-    while (1)
+    while (__atomic_load_n(&__Lock__->Ticket.Owner, __ATOMIC_ACQUIRE) != Ticket)
     {
-        uint32_t Expected = 0; /* Expect the lock to be free (0) */
-        if (__atomic_compare_exchange_n(
-                &__Lock__->Lock, &Expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
-        {
-            /* Successfully acquired the lock */
-            __Lock__->CpuId   = CpuId;
-            SavedFlags[CpuId] = Flags; /* Save flags for this CPU */
-            break;
-        }
         /* Lock is held by another CPU, spin with pause for efficiency */
         __asm__ volatile("pause");
     }
+
+    __Lock__->CpuId = GetCurrentCpuId();
+    __NestEnter__(__Lock__->CpuId, Flags);
 }
 
 void
 ReleaseSpinLock(SpinLock* __Lock__)
 {
-    uint32_t CpuId = GetCurrentCpuId();
-
-    uint64_t Flags = SavedFlags[CpuId];
-
-    __Lock__->CpuId = 0xFFFFFFFF;                           /* Reset owner to none */
-    __atomic_store_n(&__Lock__->Lock, 0, __ATOMIC_RELEASE); /* Unlock */
+    __Lock__->CpuId = 0xFFFFFFFF; /* Reset owner to none */
+    __atomic_store_n(&__Lock__->Ticket.Owner,
+                     (uint16_t)(__Lock__->Ticket.Owner + 1),
+                     __ATOMIC_RELEASE); /* Serve next ticket */
 
-    __asm__ volatile("pushq %0; popfq" ::"r"(Flags) : "memory");
+    __NestLeave__();
 }
 
 bool
 TryAcquireSpinLock(SpinLock* __Lock__)
 {
-    uint32_t Expected = 0;
-    if (__atomic_compare_exchange_n(
-            &__Lock__->Lock, &Expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    uint64_t Flags = __SaveIrqDisable__();
+
+    uint32_t Current = __atomic_load_n(&__Lock__->Lock, __ATOMIC_RELAXED);
+    uint16_t Owner   = (uint16_t)(Current & 0xFFFF);
+    uint16_t Next    = (uint16_t)(Current >> 16);
+
+    /* Only free when nobody holds or waits, then take the next ticket in one go */
+    if (Owner == Next)
     {
-        /* Successfully acquired */
-        __Lock__->CpuId = GetCurrentCpuId();
-        return true;
+        uint32_t Want = (uint32_t)Owner | ((uint32_t)(uint16_t)(Next + 1) << 16);
+        if (__atomic_compare_exchange_n(
+                &__Lock__->Lock, &Current, Want, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            /* Successfully acquired */
+            __Lock__->CpuId = GetCurrentCpuId();
+            __NestEnter__(__Lock__->CpuId, Flags);
+            return true;
+        }
     }
 
     /* Failed to acquire */
+    __RestoreIrq__(Flags);
     return false;
 }
+
+void
+InitializeRwSpinLock(RwSpinLock* __Lock__, const char* __Name__)
+{
+    __Lock__->State = 0;        /* No readers, no writer */
+    __Lock__->Name  = __Name__; /* Assign name for debugging */
+}
+
+uint64_t
+AcquireReadSpinLock(RwSpinLock* __Lock__)
+{
+    uint64_t Flags = __SaveIrqDisable__();
+
+    while (1)
+    {
+        uint32_t State = __atomic_load_n(&__Lock__->State, __ATOMIC_RELAXED);
+
+        /* Back off while a writer holds or waits, so writers are not starved */
+        if (!(State & (RwLockWriter | RwLockWriterWaiting)) &&
+            __atomic_compare_exchange_n(
+                &__Lock__->State, &State, State + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            break;
+        }
+        __asm__ volatile("pause");
+    }
+
+    __NestEnter__(GetCurrentCpuId(), Flags);
+    return Flags;
+}
+
+void
+ReleaseReadSpinLock(RwSpinLock* __Lock__, uint64_t __Flags__)
+{
+    (void)__Flags__; /* The depth counter holds what to restore */
+    __atomic_fetch_sub(&__Lock__->State, 1, __ATOMIC_RELEASE);
+    __NestLeave__();
+}
+
+uint64_t
+AcquireWriteSpinLock(RwSpinLock* __Lock__)
+{
+    uint64_t Flags = __SaveIrqDisable__();
+
+    while (1)
+    {
+        uint32_t State = __atomic_load_n(&__Lock__->State, __ATOMIC_RELAXED);
+
+        if (!(State & (RwLockWriter | RwLockReaderMask)))
+        {
+            /* Free, claim it (this also clears the waiting hint) */
+            if (__atomic_compare_exchange_n(&__Lock__->State,
+                                            &State,
+                                            RwLockWriter,
+                                            false,
+                                            __ATOMIC_ACQUIRE,
+                                            __ATOMIC_RELAXED))
+            {
+                break;
+            }
+            continue;
+        }
+
+        /* Hold off new readers until the current ones drain */
+        if (!(State & RwLockWriterWaiting))
+        {
+            __atomic_fetch_or(&__Lock__->State, RwLockWriterWaiting, __ATOMIC_RELAXED);
+        }
+        __asm__ volatile("pause");
+    }
+
+    __NestEnter__(GetCurrentCpuId(), Flags);
+    return Flags;
+}
+
+void
+ReleaseWriteSpinLock(RwSpinLock* __Lock__, uint64_t __Flags__)
+{
+    (void)__Flags__; /* The depth counter holds what to restore */
+
+    /* Other writers may have raised the waiting hint meanwhile, keep it */
+    __atomic_fetch_and(&__Lock__->State, ~RwLockWriter, __ATOMIC_RELEASE);
+    __NestLeave__();
+}
@@ -0,0 +1,452 @@
+#include <AxeSchd.h> /* Scheduler queues and WakeThread */
+#include <SMP.h>     /* Symmetric multiprocessing functions */
+#include <Sync.h>    /* Synchronization primitives definitions */
+#include <Timer.h>   /* System ticks for timeouts */
+
+/*
+ * Usage, the condition is re-checked after queueing so a wakeup between the
+ * check and the block is never lost:
+ *
+ *     for (;;)
+ *     {
+ *         WaitQueuePrepare(&Q, WaitReasonIo, 0);
+ *         if (Condition) { WaitQueueCancel(&Q); break; }
+ *         WaitQueueCommit(&Q);
+ *     }
+ *
+ * Wakers change the condition first and then call WaitQueueWakeOne/All.
+ *
+ * Hooks on the queue run on every wake, before any thread is dequeued and
+ * under the queue lock, poll tables and epoll hang on many queues this way.
+ *
+ * WaitQueueRequeueMatch may move a parked thread to another queue, so a
+ * thread's WaitingOn is the queue it is on now and not necessarily the one
+ * it prepared on. Commit and Cancel follow it there.
+ */
+
+static inline Thread*
+__WaitSelf__(void)
+{
+    return GetCurrentThreadLocal();
+}
+
+/* Caller holds the queue lock */
+static void
+__WaitUnlink__(WaitQueue* __Queue__, Thread* __ThreadPtr__)
+{
+    if (__ThreadPtr__->WaitPrev)
+    {
+        __ThreadPtr__->WaitPrev->WaitNext = __ThreadPtr__->WaitNext;
+    }
+    else
+    {
+        __Queue__->Head = __ThreadPtr__->WaitNext;
+    }
+
+    if (__ThreadPtr__->WaitNext)
+    {
+        __ThreadPtr__->WaitNext->WaitPrev = __ThreadPtr__->WaitPrev;
+    }
+    else
+    {
+        __Queue__->Tail = __ThreadPtr__->WaitPrev;
+    }
+
+    __ThreadPtr__->WaitNext  = NULL;
+    __ThreadPtr__->WaitPrev  = NULL;
+    __ThreadPtr__->WaitingOn = NULL;
+}
+
+/*
+ * Caller holds the queue lock. A dequeued waiter can see WaitingOn cleared,
+ * return and exit before the waker reaches WakeThread, the reference keeps
+ * its Thread alive until the waker's ThreadPut.
+ */
+static inline Thread*
+__WaitHold__(Thread* __ThreadPtr__)
+{
+    __atomic_fetch_add(&__ThreadPtr__->Refs, 1, __ATOMIC_ACQ_REL);
+    return __ThreadPtr__;
+}
+
+/* Caller holds the queue lock */
+static void
+__WaitLink__(WaitQueue* __Queue__, Thread* __ThreadPtr__)
+{
+    __ThreadPtr__->WaitNext = NULL;
+    __ThreadPtr__->WaitPrev = __Queue__->Tail;
+    if (__Queue__->Tail)
+    {
+        __Queue__->Tail->WaitNext = __ThreadPtr__;
+    }
+    else
+    {
+        __Queue__->Head = __ThreadPtr__;
+    }
+    __Queue__->Tail          = __ThreadPtr__;
+    __ThreadPtr__->WaitingOn = (void*)__Queue__;
+}
+
+void
+InitializeWaitQueue(WaitQueue* __Queue__, const char* __Name__)
+{
+    InitializeSpinLock(&__Queue__->Lock, "WaitQueue");
+    __Queue__->Head = NULL;
+    __Queue__->Tail = NULL;
+    __Queue__->Name  = __Name__;
+    __Queue__->Hooks = NULL;
+}
+
+void
+WaitHookInit(WaitHook* __Hook__, WaitHookFn __Fn__, void* __Arg__)
+{
+    __Hook__->Next  = NULL;
+    __Hook__->Prev  = NULL;
+    __Hook__->Fn    = __Fn__;
+    __Hook__->Arg   = __Arg__;
+    __Hook__->Queue = NULL;
+}
+
+void
+WaitQueueAddHook(WaitQueue* __Queue__, WaitHook* __Hook__)
+{
+    AcquireSpinLock(&__Queue__->Lock);
+    __Hook__->Prev = NULL;
+    __Hook__->Next = __Queue__->Hooks;
+    if (__Queue__->Hooks)
+    {
+        __Queue__->Hooks->Prev = __Hook__;
+    }
+    __Queue__->Hooks = __Hook__;
+    __Hook__->Queue  = (void*)__Queue__;
+    ReleaseSpinLock(&__Queue__->Lock);
+}
+
+/* Once this returns the hook is off the queue and its callback is not running */
+void
+WaitQueueRemoveHook(WaitHook* __Hook__)
+{
+    WaitQueue* Queue = (WaitQueue*)__atomic_load_n(&__Hook__->Queue, __ATOMIC_SEQ_CST);
+    if (!Queue)
+    {
+        return;
+    }
+
+    AcquireSpinLock(&Queue->Lock);
+    if (__Hook__->Queue == (void*)Queue)
+    {
+        if (__Hook__->Prev)
+        {
+            __Hook__->Prev->Next = __Hook__->Next;
+        }
+        else
+        {
+            Queue->Hooks = __Hook__->Next;
+        }
+        if (__Hook__->Next)
+        {
+            __Hook__->Next->Prev = __Hook__->Prev;
+        }
+        __Hook__->Next  = NULL;
+        __Hook__->Prev  = NULL;
+        __Hook__->Queue = NULL;
+    }
+    ReleaseSpinLock(&Queue->Lock);
+}
+
+/* Caller holds the queue lock */
+static inline void
+__WaitRunHooks__(WaitQueue* __Queue__)
+{
+    for (WaitHook* Hook = __Queue__->Hooks; Hook; Hook = Hook->Next)
+    {
+        Hook->Fn(Hook);
+    }
+}
+
+void
+WaitQueuePrepare(WaitQueue* __Queue__, uint32_t __Reason__, uint64_t __TimeoutMs__)
+{
+    Thread* Self = __WaitSelf__();
+    if (!Self)
+    {
+        return;
+    }
+
+    AcquireSpinLock(&__Queue__->Lock);
+
+    if (Self->WaitingOn != (void*)__Queue__)
+    {
+        __WaitLink__(__Queue__, Self);
+    }
+
+    Self->WaitReason = __Reason__;
+    __atomic_store_n(
+        &Self->WakeupTime, __TimeoutMs__ ? GetSystemTicks() + __TimeoutMs__ : 0, __ATOMIC_SEQ_CST);
+
+    ReleaseSpinLock(&__Queue__->Lock);
+}
+
+int
+WaitQueueCommit(WaitQueue* __Queue__)
+{
+    Thread* Self = __WaitSelf__();
+    if (!Self)
+    {
+        /* No thread context yet (early boot), let the caller poll */
+        __asm__ volatile("pause");
+        return 0;
+    }
+
+    for (;;)
+    {
+        AcquireSpinLock(&__Queue__->Lock);
+
+        /* Requeued, keep waiting where we were moved with the same deadline */
+        void* On = Self->WaitingOn;
+        if (On && On != (void*)__Queue__)
+        {
+            ReleaseSpinLock(&__Queue__->Lock);
+            __Queue__ = (WaitQueue*)On;
+            continue;
+        }
+
+        /* Dequeued by a waker, we own the wakeup */
+        if (!On)
+        {
+            __atomic_store_n(&Self->WakeupTime, 0, __ATOMIC_SEQ_CST);
+            Self->WaitReason = WaitReasonNone;
+            ReleaseSpinLock(&__Queue__->Lock);
+            return 0;
+        }
+
+        uint64_t Deadline = __atomic_load_n(&Self->WakeupTime, __ATOMIC_SEQ_CST);
+        if (Deadline && Deadline <= GetSystemTicks())
+        {
+            __WaitUnlink__(__Queue__, Self);
+            __atomic_store_n(&Self->WakeupTime, 0, __ATOMIC_SEQ_CST);
+            Self->WaitReason = WaitReasonNone;
+            ReleaseSpinLock(&__Queue__->Lock);
+            return -1;
+        }
+
+        /*
+         * Marked blocked under the queue lock, so a waker that dequeues us after
+         * this point is guaranteed to see the blocked state in WakeThread.
+         */
+        __atomic_store_n(&Self->State, ThreadStateBlocked, __ATOMIC_SEQ_CST);
+        ReleaseSpinLock(&__Queue__->Lock);
+
+        /* Trigger scheduler, we are parked until woken or the deadline expires */
+        __asm__ volatile("int $0x20");
+    }
+}
+
+void
+WaitQueueCancel(WaitQueue* __Queue__)
+{
+    Thread* Self = __WaitSelf__();
+    if (!Self)
+    {
+        return;
+    }
+
+    AcquireSpinLock(&__Queue__->Lock);
+    while (Self->WaitingOn && Self->WaitingOn != (void*)__Queue__)
+    {
+        /* Requeued meanwhile, unlink from wherever it put us */
+        WaitQueue* On = (WaitQueue*)Self->WaitingOn;
+        ReleaseSpinLock(&__Queue__->Lock);
+        __Queue__ = On;
+        AcquireSpinLock(&__Queue__->Lock);
+    }
+    if (Self->WaitingOn == (void*)__Queue__)
+    {
+        __WaitUnlink__(__Queue__, Self);
+    }
+    __atomic_store_n(&Self->WakeupTime, 0, __ATOMIC_SEQ_CST);
+    Self->WaitReason = WaitReasonNone;
+    ReleaseSpinLock(&__Queue__->Lock);
+}
+
+int
+WaitQueueSleep(WaitQueue* __Queue__, uint32_t __Reason__, uint64_t __TimeoutMs__)
+{
+    WaitQueuePrepare(__Queue__, __Reason__, __TimeoutMs__);
+    return WaitQueueCommit(__Queue__);
+}
+
+static uint32_t
+__WaitWakeHead__(WaitQueue* __Queue__, bool __Hooks__)
+{
+    AcquireSpinLock(&__Queue__->Lock);
+    if (__Hooks__)
+    {
+        __WaitRunHooks__(__Queue__);
+    }
+    Thread* Waiter = __Queue__->Head;
+    if (Waiter)
+    {
+        __WaitUnlink__(__Queue__, __WaitHold__(Waiter));
+    }
+    ReleaseSpinLock(&__Queue__->Lock);
+
+    if (!Waiter)
+    {
+        return 0;
+    }
+
+    /* Outside the queue lock, WakeThread takes the target CPU's scheduler lock */
+    WakeThread(Waiter);
+    ThreadPut(Waiter);
+    return 1;
+}
+
+uint32_t
+WaitQueueWakeOne(WaitQueue* __Queue__)
+{
+    return __WaitWakeHead__(__Queue__, true);
+}
+
+uint32_t
+WaitQueueWakeAll(WaitQueue* __Queue__)
+{
+    /* Hooks once per wake, not once per thread */
+    uint32_t Woken = __WaitWakeHead__(__Queue__, true);
+    if (!Woken)
+    {
+        return 0;
+    }
+    while (__WaitWakeHead__(__Queue__, false))
+    {
+        Woken++;
+    }
+    return Woken;
+}
+
+bool
+WaitQueueEmpty(WaitQueue* __Queue__)
+{
+    return __atomic_load_n(&__Queue__->Head, __ATOMIC_SEQ_CST) == NULL;
+}
+
+#define __WaitWakeBatch__ 16
+
+uint32_t
+WaitQueueWakeMatch(WaitQueue* __Queue__, WaitMatchFn __Match__, void* __Arg__, uint32_t __Max__)
+{
+    uint32_t Woken = 0;
+
+    while (Woken < __Max__)
+    {
+        Thread*  Batch[__WaitWakeBatch__];
+        uint32_t Count = 0;
+
+        /* Unlinked in small batches, a dequeued thread may run before it is woken */
+        AcquireSpinLock(&__Queue__->Lock);
+        Thread* Cursor = __Queue__->Head;
+        while (Cursor && Count < __WaitWakeBatch__ && Woken + Count < __Max__)
+        {
+            Thread* Next = Cursor->WaitNext;
+            if (__Match__(Cursor, __Arg__))
+            {
+                __WaitUnlink__(__Queue__, Cursor);
+                Batch[Count++] = __WaitHold__(Cursor);
+            }
+            Cursor = Next;
+        }
+        ReleaseSpinLock(&__Queue__->Lock);
+
+        for (uint32_t Index = 0; Index < Count; Index++)
+        {
+            WakeThread(Batch[Index]);
+            ThreadPut(Batch[Index]);
+        }
+        Woken += Count;
+
+        if (Count < __WaitWakeBatch__)
+        {
+            break;
+        }
+    }
+
+    return Woken;
+}
+
+/*
+ * Both locks are taken in address order, so two opposite requeues cannot
+ * deadlock, and held across the check, the wakes and the moves. WakeThread
+ * nests the target CPU's scheduler lock inside them, nothing takes a queue
+ * lock while holding a scheduler lock.
+ */
+long
+WaitQueueWakeRequeue(WaitQueue*  __From__,
+                     WaitQueue*  __To__,
+                     WaitMatchFn __Wake__,
+                     WaitMatchFn __Move__,
+                     WaitCheckFn __Check__,
+                     void*       __Arg__,
+                     uint32_t    __MaxWake__,
+                     uint32_t    __MaxMove__)
+{
+    WaitQueue* First  = __From__ < __To__ ? __From__ : __To__;
+    WaitQueue* Second = __From__ < __To__ ? __To__ : __From__;
+
+    AcquireSpinLock(&First->Lock);
+    if (Second != First)
+    {
+        AcquireSpinLock(&Second->Lock);
+    }
+
+    long Result = -1;
+    if (!__Check__ || __Check__(__Arg__))
+    {
+        uint32_t Woken  = 0;
+        uint32_t Moved  = 0;
+        Thread*  Cursor = __From__->Head;
+        while (Cursor && (Woken < __MaxWake__ || Moved < __MaxMove__))
+        {
+            Thread* Next = Cursor->WaitNext;
+            if (Woken < __MaxWake__)
+            {
+                /* The first matches are woken, the ones after them moved */
+                if (__Wake__(Cursor, __Arg__))
+                {
+                    __WaitUnlink__(__From__, Cursor);
+                    WakeThread(Cursor);
+                    Woken++;
+                }
+            }
+            else if (__Move__(Cursor, __Arg__))
+            {
+                if (__To__ != __From__)
+                {
+                    __WaitUnlink__(__From__, Cursor);
+                    __WaitLink__(__To__, Cursor);
+                }
+                Moved++;
+            }
+            Cursor = Next;
+        }
+        Result = (long)(Woken + Moved);
+    }
+
+    if (Second != First)
+    {
+        ReleaseSpinLock(&Second->Lock);
+    }
+    ReleaseSpinLock(&First->Lock);
+
+    return Result;
+}
+
+uint32_t
+WaitQueueRequeueMatch(WaitQueue*  __From__,
+                      WaitQueue*  __To__,
+                      WaitMatchFn __Match__,
+                      void*       __Arg__,
+                      uint32_t    __Max__)
+{
+    return (uint32_t)WaitQueueWakeRequeue(
+        __From__, __To__, __Match__, __Match__, NULL, __Arg__, 0, __Max__);
+}
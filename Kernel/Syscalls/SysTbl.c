@@ -5,8 +5,10 @@
 #include <BootConsole.h>
 #include <BootImg.h>
 #include <CharBus.h>
+#include <ClockSource.h>
 #include <DevFS.h>
 #include <EarlyBootFB.h>
+#include <Futex.h>
 #include <GDT.h>
 #include <IDT.h>
 #include <KExports.h>
@@ -17,13 +19,16 @@
 #include <ModMemMgr.h>
 #include <PMM.h>
 #include <POSIXFd.h>
+#include <POSIXPoll.h>
 #include <POSIXProc.h>
 #include <POSIXProcFS.h>
 #include <POSIXSignals.h>
+#include <POSIXUring.h>
 #include <SMP.h>
 #include <Serial.h>
 #include <SymAP.h>
 #include <Sync.h>
+#include <SysABI.h>
 #include <Syscall.h>
 #include <Timer.h>
 #include <VFS.h>
@@ -35,9 +40,7 @@
 static inline PosixProc*
 __GetCurrentProc__(void)
 {
-    uint32_t CpuId = GetCurrentCpuId();
-    Thread*  Thrd  = GetCurrentThread(CpuId);
-    return Thrd ? PosixFind((long)Thrd->ProcessId) : NULL;
+    return PosixCurrent();
 }
 
 int64_t
@@ -86,30 +89,7 @@ __Handle__Writev(uint64_t __Fd__,
         return -1;
     }
 
-    Iovec* Iov   = (Iovec*)__IovPtr__;
-    long   Total = 0;
-
-    for (long I = 0; I < (long)__IovCnt__; I++)
-    {
-        const void* Buf = Iov[I].IovBase;
-        long        Len = (long)Iov[I].IovLen;
-        if (!Buf || Len <= 0)
-        {
-            continue;
-        }
-
-        long W = PosixWrite(Proc->Fds, (int)__Fd__, Buf, Len);
-        if (W < 0)
-        {
-            return (Total > 0) ? Total : -1;
-        }
-        Total += W;
-        if (W < Len)
-        {
-            break; /* short write: stop */
-        }
-    }
-    return Total;
+    return PosixWritev(Proc->Fds, (int)__Fd__, (const Iovec*)__IovPtr__, (long)__IovCnt__);
 }
 
 int64_t
@@ -126,30 +106,7 @@ __Handle__Readv(uint64_t __Fd__,
         return -1;
     }
 
-    Iovec* Iov   = (Iovec*)__IovPtr__;
-    long   Total = 0;
-
-    for (long I = 0; I < (long)__IovCnt__; I++)
-    {
-        void* Buf = Iov[I].IovBase;
-        long  Len = (long)Iov[I].IovLen;
-        if (!Buf || Len <= 0)
-        {
-            continue;
-        }
-
-        long R = PosixRead(Proc->Fds, (int)__Fd__, Buf, Len);
-        if (R < 0)
-        {
-            return (Total > 0) ? Total : -1;
-        }
-        Total += R;
-        if (R < Len)
-        {
-            break; /* short read: stop */
-        }
-    }
-    return Total;
+    return PosixReadv(Proc->Fds, (int)__Fd__, (const Iovec*)__IovPtr__, (long)__IovCnt__);
 }
 
 int64_t
@@ -211,6 +168,28 @@ __Handle__Fstat(uint64_t __Fd__,
     return PosixFstat(Proc->Fds, (int)__Fd__, (VfsStat*)__OutStat__);
 }
 
+int64_t
+__Handle__Getdents64(uint64_t __Fd__,
+                     uint64_t __Dirp__,
+                     uint64_t __Count__,
+                     uint64_t __U4__,
+                     uint64_t __U5__,
+                     uint64_t __U6__)
+{
+    PosixProc* Proc = __GetCurrentProc__();
+    if (!Proc || !Proc->Fds)
+    {
+        return -SysErrBadf;
+    }
+    if (!__Dirp__)
+    {
+        return -SysErrFault;
+    }
+    /* count is an unsigned int in the ABI */
+    long Len = (long)(uint32_t)__Count__;
+    return PosixGetdents(Proc->Fds, (int)__Fd__, (void*)__Dirp__, Len);
+}
+
 int64_t
 __Handle__Lseek(uint64_t __Fd__,
                 uint64_t __Off__,
@@ -316,6 +295,120 @@ __Handle__Dup2(uint64_t __OldFd__,
     return PosixDup2(Proc->Fds, (int)__OldFd__, (int)__NewFd__);
 }
 
+int64_t
+__Handle__Fcntl(uint64_t __Fd__,
+                uint64_t __Cmd__,
+                uint64_t __Arg__,
+                uint64_t __U4__,
+                uint64_t __U5__,
+                uint64_t __U6__)
+{
+    PosixProc* Proc = __GetCurrentProc__();
+    if (!Proc || !Proc->Fds)
+    {
+        return -1;
+    }
+    return PosixFcntl(Proc->Fds, (int)__Fd__, (int)__Cmd__, (long)__Arg__);
+}
+
+int64_t
+__Handle__Splice(uint64_t __FdIn__,
+                 uint64_t __OffIn__,
+                 uint64_t __FdOut__,
+                 uint64_t __OffOut__,
+                 uint64_t __Len__,
+                 uint64_t __Flags__)
+{
+    PosixProc* Proc = __GetCurrentProc__();
+    if (!Proc || !Proc->Fds)
+    {
+        return -1;
+    }
+    return PosixSplice(Proc->Fds,
+                       (int)__FdIn__,
+                       (long*)__OffIn__,
+                       (int)__FdOut__,
+                       (long*)__OffOut__,
+                       (long)__Len__,
+                       (unsigned int)__Flags__);
+}
+
+int64_t
+__Handle__Tee(uint64_t __FdIn__,
+              uint64_t __FdOut__,
+              uint64_t __Len__,
+              uint64_t __Flags__,
+              uint64_t __U5__,
+              uint64_t __U6__)
+{
+    PosixProc* Proc = __GetCurrentProc__();
+    if (!Proc || !Proc->Fds)
+    {
+        return -1;
+    }
+    return PosixTee(
+        Proc->Fds, (int)__FdIn__, (int)__FdOut__, (long)__Len__, (unsigned int)__Flags__);
+}
+
+int64_t
+__Handle__Sendfile(uint64_t __OutFd__,
+                   uint64_t __InFd__,
+                   uint64_t __OffPtr__,
+                   uint64_t __Count__,
+                   uint64_t __U5__,
+                   uint64_t __U6__)
+{
+    PosixProc* Proc = __GetCurrentProc__();
+    if (!Proc || !Proc->Fds)
+    {
+        return -1;
+    }
+    return PosixSendfile(
+        Proc->Fds, (int)__OutFd__, (int)__InFd__, (long*)__OffPtr__, (long)__Count__);
+}
+
+int64_t
+__Handle__CopyFileRange(uint64_t __FdIn__,
+                        uint64_t __OffIn__,
+                        uint64_t __FdOut__,
+                        uint64_t __OffOut__,
+                        uint64_t __Len__,
+                        uint64_t __Flags__)
+{
+    PosixProc* Proc = __GetCurrentProc__();
+    if (!Proc || !Proc->Fds)
+    {
+        return -1;
+    }
+    return PosixCopyFileRange(Proc->Fds,
+                              (int)__FdIn__,
+                              (long*)__OffIn__,
+                              (int)__FdOut__,
+                              (long*)__OffOut__,
+                              (long)__Len__,
+                              (unsigned int)__Flags__);
+}
+
+int64_t
+__Handle__Vmsplice(uint64_t __Fd__,
+                   uint64_t __IovPtr__,
+                   uint64_t __IovCnt__,
+                   uint64_t __Flags__,
+                   uint64_t __U5__,
+                   uint64_t __U6__)
+{
+    PosixProc* Proc = __GetCurrentProc__();
+    if (!Proc || !Proc->Fds)
+    {
+        return -1;
+    }
+    return PosixVmsplice(Proc->Fds,
+                         (int)__Fd__,
+                         (const Iovec*)__IovPtr__,
+                         (long)__IovCnt__,
+                         (unsigned int)__Flags__);
+}
+
 int64_t
 __Handle__Mkdir(uint64_t __Path__,
                 uint64_t __Mode__,
@@ -372,6 +465,36 @@ __Handle__SchedYield(uint64_t __U1__,
     return 0;
 }
 
+/* nanosleep and clock_nanosleep, a relative sleep cut short by a signal reports the rest */
+static int64_t
+__SleepTs__(long __ClockId__, int __Flags__, uint64_t __ReqPtr__, uint64_t __RemPtr__)
+{
+    if (!__ReqPtr__)
+    {
+        return -SysErrFault;
+    }
+    struct Ts
+    {
+        long Sec;
+        long Nsec;
+    }* ts = (void*)__ReqPtr__;
+    if (ts->Sec < 0 || ts->Nsec < 0 || ts->Nsec >= (long)NsPerSec)
+    {
+        return -SysErrInval;
+    }
+
+    uint64_t Ns   = (uint64_t)ts->Sec * NsPerSec + (uint64_t)ts->Nsec;
+    uint64_t Left = 0;
+    long     Err  = PosixClockNanosleep(PosixCurrent(), __ClockId__, __Flags__, Ns, &Left);
+    if (Err == -SysErrIntr && __RemPtr__ && !(__Flags__ & PosixTimerAbstime))
+    {
+        struct Ts* Rem = (void*)__RemPtr__;
+        Rem->Sec       = (long)(Left / NsPerSec);
+        Rem->Nsec      = (long)(Left % NsPerSec);
+    }
+    return Err;
+}
+
 int64_t
 __Handle__Nanosleep(uint64_t __ReqPtr__,
                     uint64_t __RemPtr__,
@@ -380,19 +503,18 @@ __Handle__Nanosleep(uint64_t __ReqPtr__,
                     uint64_t __U5__,
                     uint64_t __U6__)
 {
-    __attribute_unused__ uint64_t __unused_rem__ = __RemPtr__;
-    if (!__ReqPtr__)
-    {
-        return -1;
-    }
-    struct
-    {
-        long Sec;
-        long Nsec;
-    }*       ts = (void*)__ReqPtr__;
-    uint64_t ms = (ts->Sec * 1000ULL) + (ts->Nsec / 1000000ULL);
-    Sleep((uint32_t)ms);
-    return 0;
+    return __SleepTs__(ClockIdMonotonic, 0, __ReqPtr__, __RemPtr__);
+}
+
+int64_t
+__Handle__ClockNanosleep(uint64_t __ClkId__,
+                         uint64_t __Flags__,
+                         uint64_t __ReqPtr__,
+                         uint64_t __RemPtr__,
+                         uint64_t __U5__,
+                         uint64_t __U6__)
+{
+    return __SleepTs__((long)__ClkId__, (int)__Flags__, __ReqPtr__, __RemPtr__);
 }
 
 int64_t
@@ -427,8 +549,7 @@ __Handle__Gettid(uint64_t __U1__,
                  uint64_t __U5__,
                  uint64_t __U6__)
 {
-    uint32_t CpuId = GetCurrentCpuId();
-    Thread*  Thrd  = GetCurrentThread(CpuId);
+    Thread* Thrd = GetCurrentThreadLocal();
     return Thrd ? (int64_t)Thrd->ThreadId : -1;
 }
 
@@ -481,6 +602,12 @@ __Handle__Exit(uint64_t __Status__,
         return -1;
     }
     PosixExit(Proc, (int)__Status__);
+
+    /* Terminated but still on its own stack, the next switch parks it as a zombie */
+    for (;;)
+    {
+        __asm__ volatile("int $0x20");
+    }
     return 0;
 }
 
@@ -605,10 +732,10 @@ __Handle__Gettimeofday(uint64_t __Tv__,
     {
         long Sec;
         long Usec;
-    }*       tv    = (void*)__Tv__;
-    uint64_t ticks = GetSystemTicks();
-    tv->Sec        = (long)(ticks / 1000ULL);
-    tv->Usec       = (long)((ticks % 1000ULL) * 1000ULL);
+    }*       tv = (void*)__Tv__;
+    uint64_t Ns = ClockRealtimeNs();
+    tv->Sec     = (long)(Ns / NsPerSec);
+    tv->Usec    = (long)((Ns % NsPerSec) / NsPerUsec);
     return 0;
 }
 
@@ -659,13 +786,102 @@ __Handle__ClockGettime(uint64_t __ClkId__,
     {
         long Sec;
         long Nsec;
-    }*       tp    = (void*)__Tp__;
-    uint64_t ticks = GetSystemTicks();
-    tp->Sec        = (long)(ticks / 1000ULL);
-    tp->Nsec       = (long)((ticks % 1000ULL) * 1000000ULL);
+    }*       tp = (void*)__Tp__;
+    uint64_t Ns = 0;
+    if (ClockGetNs((long)__ClkId__, &Ns) != 0)
+    {
+        return -1;
+    }
+    tp->Sec  = (long)(Ns / NsPerSec);
+    tp->Nsec = (long)(Ns % NsPerSec);
+    return 0;
+}
+
+/* Deadline of a FUTEX_WAIT_BITSET, absolute on the selected clock, as relative ns */
+static long
+__FutexTimeoutNs__(uint64_t __Ts__, bool __Absolute__, bool __Realtime__, uint64_t* __OutNs__)
+{
+    if (!__Ts__)
+    {
+        *__OutNs__ = FutexNoTimeout;
+        return 0;
+    }
+    struct
+    {
+        long Sec;
+        long Nsec;
+    }* ts = (void*)__Ts__;
+    if (ts->Sec < 0 || ts->Nsec < 0 || ts->Nsec >= (long)NsPerSec)
+    {
+        return -SysErrInval;
+    }
+
+    uint64_t Ns = (uint64_t)ts->Sec * NsPerSec + (uint64_t)ts->Nsec;
+    if (__Absolute__)
+    {
+        uint64_t Now = __Realtime__ ? ClockRealtimeNs() : ClockMonotonicNs();
+        Ns           = Ns > Now ? Ns - Now : 0;
+    }
+    *__OutNs__ = Ns;
     return 0;
 }
 
+int64_t
+__Handle__Futex(uint64_t __Uaddr__,
+                uint64_t __Op__,
+                uint64_t __Val__,
+                uint64_t __Timeout__,
+                uint64_t __Uaddr2__,
+                uint64_t __Val3__)
+{
+    uint32_t* Uaddr    = (uint32_t*)__Uaddr__;
+    uint32_t  Val      = (uint32_t)__Val__;
+    bool      Realtime = (__Op__ & FutexOpRealtime) != 0;
+    uint64_t  Ns       = 0;
+    long      Err;
+
+    switch (__Op__ & FutexOpCommandMask)
+    {
+        case FutexOpWait:
+            Err = __FutexTimeoutNs__(__Timeout__, false, false, &Ns);
+            return Err ? Err : FutexWait(Uaddr, Val, Ns, FutexBitsetAll);
+
+        case FutexOpWaitBitset:
+            if (!(uint32_t)__Val3__)
+            {
+                return -SysErrInval;
+            }
+            Err = __FutexTimeoutNs__(__Timeout__, true, Realtime, &Ns);
+            return Err ? Err : FutexWait(Uaddr, Val, Ns, (uint32_t)__Val3__);
+
+        case FutexOpWake:
+            return FutexWake(Uaddr, Val, FutexBitsetAll);
+
+        case FutexOpWakeBitset:
+            if (!(uint32_t)__Val3__)
+            {
+                return -SysErrInval;
+            }
+            return FutexWake(Uaddr, Val, (uint32_t)__Val3__);
+
+        /* The timeout slot carries the requeue count */
+        case FutexOpRequeue:
+            return FutexRequeue(
+                Uaddr, Val, (uint32_t)__Timeout__, (uint32_t*)__Uaddr2__, false, 0);
+
+        case FutexOpCmpRequeue:
+            return FutexRequeue(Uaddr,
+                                Val,
+                                (uint32_t)__Timeout__,
+                                (uint32_t*)__Uaddr2__,
+                                true,
+                                (uint32_t)__Val3__);
+
+        default:
+            return -SysErrNoSys;
+    }
+}
+
 static inline uint64_t
 __AlignUp__(uint64_t __V__, uint64_t __A__)
 {
@@ -736,8 +952,19 @@ __Handle__Mmap(uint64_t __Addr__,
         PteFlags |= PTENOEXECUTE;
     }
 
-    (void)__Fd__;
-    (void)__Off__;
+    /* A ring fd maps nothing new, its pages are in place since setup */
+    if ((int)__Fd__ >= 0 && !(__Flags__ & 0x20) && Proc->Fds)
+    {
+        PosixFile* Desc = PosixFdGet(Proc->Fds, (int)__Fd__);
+        if (Desc && Desc->IsUring)
+        {
+            uint64_t At = PosixUringMmapAddr(Desc, Proc->Space, __Off__, __Len__);
+            PosixFilePut(Desc);
+            return At ? (int64_t)At : -SysErrInval;
+        }
+        PosixFilePut(Desc);
+    }
+
     int RIdx = VirtMapRangeZeroed(Proc->Space, VaBase, MapLen, PteFlags);
     if (RIdx != 0)
     {
@@ -847,217 +1074,175 @@ __Handle__Brk(uint64_t __NewBrk__,
     }
 }
 
-typedef struct PosixPipeT
+/* struct timeval or struct timespec to poll milliseconds, rounded up, NULL waits forever */
+static long
+__TimeoutMs__(uint64_t __Ptr__, long __SubPerMs__)
 {
-    char*    Buf;
-    long     Cap;
-    long     Head;
-    long     Tail;
-    long     Len;
-    SpinLock Lock;
-
-} PosixPipeT;
-
-static int
-__FdIsReadable__(PosixFdTable* __Tab__, int __Fd__)
-{
-    if (!__Tab__)
-    {
-        return 0;
-    }
-    if (__Fd__ < 0 || (long)__Fd__ >= __Tab__->Cap)
+    if (!__Ptr__)
     {
-        return 0;
-    }
-    PosixFd* E = &__Tab__->Entries[__Fd__];
-    if (E->Fd < 0)
-    {
-        return 0;
+        return -1;
     }
-    if (E->IsFile)
+    struct
     {
-        return 1;
-    }
-    if (E->IsChar && E->Obj)
+        long Sec;
+        long Sub;
+    }* Tv = (void*)__Ptr__;
+    if (Tv->Sec < 0 || Tv->Sub < 0)
     {
-        PosixPipeT* P = (PosixPipeT*)E->Obj;
-        AcquireSpinLock(&P->Lock);
-        int Ok = (P->Len > 0);
-        ReleaseSpinLock(&P->Lock);
-        return Ok;
+        return -2;
     }
-    return 0;
+    return Tv->Sec * 1000 + (Tv->Sub + __SubPerMs__ - 1) / __SubPerMs__;
 }
 
-static int
-__FdIsWritable__(PosixFdTable* __Tab__, int __Fd__)
+int64_t
+__Handle__Select(uint64_t __Nfds__,
+                 uint64_t __Readfds__,
+                 uint64_t __Writefds__,
+                 uint64_t __Exceptfds__,
+                 uint64_t __Timeout__,
+                 uint64_t __U6__)
 {
-    if (!__Tab__)
-    {
-        return 0;
-    }
-    if (__Fd__ < 0 || (long)__Fd__ >= __Tab__->Cap)
-    {
-        return 0;
-    }
-    PosixFd* E = &__Tab__->Entries[__Fd__];
-    if (E->Fd < 0)
-    {
-        return 0;
-    }
-    if (E->IsFile)
+    PosixProc* Proc = __GetCurrentProc__();
+    if (!Proc || !Proc->Fds)
     {
-        return 1;
+        return -1;
     }
-    if (E->IsChar && E->Obj)
+    long Ms = __TimeoutMs__(__Timeout__, 1000);
+    if (Ms < -1)
     {
-        PosixPipeT* P = (PosixPipeT*)E->Obj;
-        AcquireSpinLock(&P->Lock);
-        int Ok = (P->Len < P->Cap);
-        ReleaseSpinLock(&P->Lock);
-        return Ok;
+        return -SysErrInval;
     }
-    return 0;
+    return PosixSelect(Proc->Fds,
+                       (int)__Nfds__,
+                       (uint8_t*)__Readfds__,
+                       (uint8_t*)__Writefds__,
+                       (uint8_t*)__Exceptfds__,
+                       Ms);
 }
 
-static int
-__FdsetTest__(const void* __Set__, int __Fd__)
+int64_t
+__Handle__Poll(uint64_t __Fds__,
+               uint64_t __Nfds__,
+               uint64_t __Timeout__,
+               uint64_t __U4__,
+               uint64_t __U5__,
+               uint64_t __U6__)
 {
-    if (!__Set__ || __Fd__ < 0)
+    PosixProc* Proc = __GetCurrentProc__();
+    if (!Proc || !Proc->Fds)
     {
-        return 0;
+        return -1;
     }
-    const unsigned char* S = (const unsigned char*)__Set__;
-    return (S[__Fd__ / 8] & (1u << (__Fd__ % 8))) ? 1 : 0;
+    return PosixPoll(Proc->Fds, (PosixPollFd*)__Fds__, (long)__Nfds__, (long)(int)__Timeout__);
 }
 
-static void
-__FdsetClear__(void* __Set__, int __Fd__)
+int64_t
+__Handle__EpollCreate(uint64_t __Size__,
+                      uint64_t __U2__,
+                      uint64_t __U3__,
+                      uint64_t __U4__,
+                      uint64_t __U5__,
+                      uint64_t __U6__)
 {
-    if (!__Set__ || __Fd__ < 0)
+    PosixProc* Proc = __GetCurrentProc__();
+    if (!Proc || !Proc->Fds)
     {
-        return;
+        return -1;
     }
-    unsigned char* S = (unsigned char*)__Set__;
-    S[__Fd__ / 8] &= ~(1u << (__Fd__ % 8));
-}
-
-static void
-__FdsetSet__(void* __Set__, int __Fd__)
-{
-    if (!__Set__ || __Fd__ < 0)
+    /* The size hint is obsolete but must be positive */
+    if ((int)__Size__ <= 0)
     {
-        return;
+        return -SysErrInval;
     }
-    unsigned char* S = (unsigned char*)__Set__;
-    S[__Fd__ / 8] |= (1u << (__Fd__ % 8));
+    return PosixEpollCreate(Proc->Fds, 0);
 }
 
 int64_t
-__Handle__Select(uint64_t __Nfds__,
-                 uint64_t __Readfds__,
-                 uint64_t __Writefds__,
-                 uint64_t __Exceptfds__,
-                 uint64_t __Timeout__,
-                 uint64_t __U6__)
+__Handle__EpollCreate1(uint64_t __Flags__,
+                       uint64_t __U2__,
+                       uint64_t __U3__,
+                       uint64_t __U4__,
+                       uint64_t __U5__,
+                       uint64_t __U6__)
 {
-    (void)__U6__;
-
     PosixProc* Proc = __GetCurrentProc__();
     if (!Proc || !Proc->Fds)
     {
         return -1;
     }
+    return PosixEpollCreate(Proc->Fds, (long)__Flags__);
+}
 
-    unsigned char* Rfds = (unsigned char*)__Readfds__;
-    unsigned char* Wfds = (unsigned char*)__Writefds__;
-    unsigned char* Efds = (unsigned char*)__Exceptfds__;
-
-    if (Efds)
+int64_t
+__Handle__EpollCtl(uint64_t __EpFd__,
+                   uint64_t __Op__,
+                   uint64_t __Fd__,
+                   uint64_t __Event__,
+                   uint64_t __U5__,
+                   uint64_t __U6__)
+{
+    PosixProc* Proc = __GetCurrentProc__();
+    if (!Proc || !Proc->Fds)
     {
-        long Bytes = (long)((__Nfds__ + 7) / 8);
-        for (long I = 0; I < Bytes; I++)
-        {
-            Efds[I] = 0;
-        }
+        return -1;
     }
+    return PosixEpollCtl(
+        Proc->Fds, (int)__EpFd__, (int)__Op__, (int)__Fd__, (const PosixEpollEvent*)__Event__);
+}
 
-    long Ready = 0;
-
-    for (int fd = 0; fd < (int)__Nfds__; fd++)
+int64_t
+__Handle__EpollWait(uint64_t __EpFd__,
+                    uint64_t __Events__,
+                    uint64_t __Max__,
+                    uint64_t __Timeout__,
+                    uint64_t __U5__,
+                    uint64_t __U6__)
+{
+    PosixProc* Proc = __GetCurrentProc__();
+    if (!Proc || !Proc->Fds)
     {
-        int WantR = Rfds && __FdsetTest__(Rfds, fd);
-        int WantW = Wfds && __FdsetTest__(Wfds, fd);
-        int OkR   = WantR ? __FdIsReadable__(Proc->Fds, fd) : 0;
-        int OkW   = WantW ? __FdIsWritable__(Proc->Fds, fd) : 0;
-
-        if (Rfds && WantR && !OkR)
-        {
-            __FdsetClear__(Rfds, fd);
-        }
-        else if (Rfds && WantR && OkR)
-        {
-            __FdsetSet__(Rfds, fd);
-            Ready++;
-        }
-
-        if (Wfds && WantW && !OkW)
-        {
-            __FdsetClear__(Wfds, fd);
-        }
-        else if (Wfds && WantW && OkW)
-        {
-            __FdsetSet__(Wfds, fd);
-            Ready++;
-        }
+        return -1;
     }
+    return PosixEpollWait(Proc->Fds,
+                          (int)__EpFd__,
+                          (PosixEpollEvent*)__Events__,
+                          (int)__Max__,
+                          (long)(int)__Timeout__);
+}
 
-    if (Ready > 0)
+int64_t
+__Handle__IoUringSetup(uint64_t __Entries__,
+                       uint64_t __Params__,
+                       uint64_t __U3__,
+                       uint64_t __U4__,
+                       uint64_t __U5__,
+                       uint64_t __U6__)
+{
+    PosixProc* Proc = __GetCurrentProc__();
+    if (!Proc || !Proc->Fds || !Proc->Space)
     {
-        return Ready;
+        return -1;
     }
+    return PosixUringCreate(Proc, (uint32_t)__Entries__, (PosixUringParams*)__Params__);
+}
 
-    if (__Timeout__)
+int64_t
+__Handle__IoUringEnter(uint64_t __Fd__,
+                       uint64_t __ToSubmit__,
+                       uint64_t __MinComplete__,
+                       uint64_t __Flags__,
+                       uint64_t __Sig__,
+                       uint64_t __SigSz__)
+{
+    PosixProc* Proc = __GetCurrentProc__();
+    if (!Proc || !Proc->Fds)
     {
-        struct
-        {
-            long Sec;
-            long Usec;
-        }*       tv = (void*)__Timeout__;
-        uint64_t ms = (tv->Sec * 1000ULL) + (tv->Usec / 1000ULL);
-        Sleep((uint32_t)ms);
-
-        Ready = 0;
-        for (int fd = 0; fd < (int)__Nfds__; fd++)
-        {
-            int WantR = Rfds && __FdsetTest__(Rfds, fd);
-            int WantW = Wfds && __FdsetTest__(Wfds, fd);
-            int OkR   = WantR ? __FdIsReadable__(Proc->Fds, fd) : 0;
-            int OkW   = WantW ? __FdIsWritable__(Proc->Fds, fd) : 0;
-
-            if (Rfds && WantR && !OkR)
-            {
-                __FdsetClear__(Rfds, fd);
-            }
-            else if (Rfds && WantR && OkR)
-            {
-                __FdsetSet__(Rfds, fd);
-                Ready++;
-            }
-
-            if (Wfds && WantW && !OkW)
-            {
-                __FdsetClear__(Wfds, fd);
-            }
-            else if (Wfds && WantW && OkW)
-            {
-                __FdsetSet__(Wfds, fd);
-                Ready++;
-            }
-        }
-        return Ready;
+        return -1;
     }
-
-    ThreadYield();
-    return 0;
+    /* No signal mask swap while waiting, the mask argument is ignored */
+    return PosixUringEnter(Proc,
+                           (int)__Fd__,
+                           (uint32_t)__ToSubmit__,
+                           (uint32_t)__MinComplete__,
+                           (uint32_t)__Flags__);
 }
@@ -1,198 +1,344 @@
+#include <GDT.h>        /* Selectors for STAR */
+#include <KHeap.h>      /* Statistics blocks */
+#include <PerCPUData.h> /* Entry stack slots */
+#include <SMP.h>        /* Current CPU for the statistics */
+#include <String.h>
 #include <SysABI.h>
 #include <SysTbl.h>
 #include <Syscall.h>
+#include <Timer.h> /* MSR access and TSC */
+
+#define __SysStr__(__X__)  #__X__
+#define __SysXStr__(__X__) __SysStr__(__X__)
+
+/* Dense and read-only, __SysSlot__ maps an ABI number to its index here */
+const SysEnt SysTbl[] __attribute__((aligned(64))) = {
+    {__Handle__Read,           SysRead,           "read"},
+    {__Handle__Write,          SysWrite,          "write"},
+    {__Handle__Open,           SysOpen,           "open"},
+    {__Handle__Close,          SysClose,          "close"},
+    {__Handle__Stat,           SysStat,           "stat"},
+    {__Handle__Fstat,          SysFstat,          "fstat"},
+    {__Handle__Getdents64,     SysGetdents64,     "getdents64"},
+    {__Handle__Lseek,          SysLseek,          "lseek"},
+    {__Handle__Ioctl,          SysIoctl,          "ioctl"},
+    {__Handle__Access,         SysAccess,         "access"},
+    {__Handle__Pipe,           SysPipe,           "pipe"},
+    {__Handle__SchedYield,     SysSchedYield,     "sched_yield"},
+    {__Handle__Mkdir,          SysMkdir,          "mkdir"},
+    {__Handle__Rmdir,          SysRmdir,          "rmdir"},
+    {__Handle__Unlink,         SysUnlink,         "unlink"},
+    {__Handle__Rename,         SysRename,         "rename"},
+    {__Handle__Getpid,         SysGetpid,         "getpid"},
+    {__Handle__Getppid,        SysGetppid,        "getppid"},
+    {__Handle__Gettid,         SysGettid,         "gettid"},
+    {__Handle__Fork,           SysFork,           "fork"},
+    {__Handle__Execve,         SysExecve,         "execve"},
+    {__Handle__Exit,           SysExit,           "exit"},
+    {__Handle__Wait4,          SysWait4,          "wait4"},
+    {__Handle__Kill,           SysKill,           "kill"},
+    {__Handle__Dup,            SysDup,            "dup"},
+    {__Handle__Dup2,           SysDup2,           "dup2"},
+    {__Handle__Fcntl,          SysFcntl,          "fcntl"},
+    {__Handle__Nanosleep,      SysNanosleep,      "nanosleep"},
+    {__Handle__Getcwd,         SysGetcwd,         "getcwd"},
+    {__Handle__Chdir,          SysChdir,          "chdir"},
+    {__Handle__Uname,          SysUname,          "uname"},
+    {__Handle__Gettimeofday,   SysGettimeofday,   "gettimeofday"},
+    {__Handle__Times,          SysTimes,          "times"},
+    {__Handle__ClockGettime,   SysClockGettime,   "clock_gettime"},
+    {__Handle__ClockNanosleep, SysClockNanosleep, "clock_nanosleep"},
+    {__Handle__Mmap,           SysMmap,           "mmap"},
+    {__Handle__Munmap,         SysMunmap,         "munmap"},
+    {__Handle__Brk,            SysBrk,            "brk"},
+    {__Handle__Select,         SysSelect,         "select"},
+    {__Handle__Poll,           SysPoll,           "poll"},
+    {__Handle__EpollCreate,    SysEpollCreate,    "epoll_create"},
+    {__Handle__EpollCreate1,   SysEpollCreate1,   "epoll_create1"},
+    {__Handle__EpollCtl,       SysEpollCtl,       "epoll_ctl"},
+    {__Handle__EpollWait,      SysEpollWait,      "epoll_wait"},
+    {__Handle__Writev,         SysWritev,         "writev"},
+    {__Handle__Readv,          SysReadv,          "readv"},
+    {__Handle__Futex,          SysFutex,          "futex"},
+    {__Handle__Splice,         SysSplice,         "splice"},
+    {__Handle__Tee,            SysTee,            "tee"},
+    {__Handle__Vmsplice,       SysVmsplice,       "vmsplice"},
+    {__Handle__Sendfile,       SysSendfile,       "sendfile"},
+    {__Handle__CopyFileRange,  SysCopyFileRange,  "copy_file_range"},
+    {__Handle__IoUringSetup,   SysIoUringSetup,   "io_uring_setup"},
+    {__Handle__IoUringEnter,   SysIoUringEnter,   "io_uring_enter"},
+};
+
+const uint32_t SysCount = sizeof(SysTbl) / sizeof(SysTbl[0]);
+
+/* Zero means no handler, otherwise the SysTbl index plus one */
+static uint8_t __SysSlot__[MaxSysNo];
+
+/* Per-CPU blocks, allocated on a CPU's first counted call. Off until /proc/syscalls gets "1" */
+static SysCallStat*      __SysStats__[MaxCPUs];
+static volatile uint32_t __SysStatsOn__ = 0;
+
+static void
+__SysAccount__(uint32_t __Index__, uint64_t __Cycles__)
+{
+    uint32_t     CpuId = GetCurrentCpuId();
+    SysCallStat* Stats = __SysStats__[CpuId];
+    if (!Stats)
+    {
+        Stats = (SysCallStat*)KMalloc(SysCount * sizeof(SysCallStat));
+        if (!Stats)
+        {
+            return;
+        }
+        memset(Stats, 0, SysCount * sizeof(SysCallStat));
+
+        /* A thread preempted here may race another on this CPU, the loser frees its copy */
+        SysCallStat* Expected = NULL;
+        if (!__atomic_compare_exchange_n(
+                &__SysStats__[CpuId], &Expected, Stats, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            KFree(Stats);
+            Stats = Expected;
+        }
+    }
+
+    uint32_t Bucket = 0;
+    if (__Cycles__ >> SysHistShift)
+    {
+        Bucket = 64 - (uint32_t)__builtin_clzll(__Cycles__ >> SysHistShift);
+        if (Bucket >= SysHistBuckets)
+        {
+            Bucket = SysHistBuckets - 1;
+        }
+    }
+
+    /* Handlers may block and migrate, so the block is mostly but not only this CPU's */
+    SysCallStat* Stat = &Stats[__Index__];
+    __atomic_fetch_add(&Stat->Calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&Stat->Cycles, __Cycles__, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&Stat->Hist[Bucket], 1, __ATOMIC_RELAXED);
+}
 
 void
-SyscallHandler(uint64_t __SyscallNo__,
-               uint64_t __A1__,
-               uint64_t __A2__,
-               uint64_t __A3__,
-               uint64_t __A4__,
-               uint64_t __A5__,
-               uint64_t __A6__)
+SyscallDispatch(InterruptFrame* __Frame__)
 {
-    if (__SyscallNo__ >= MaxSysNo || SysTbl[__SyscallNo__].Handler == NULL)
+    uint64_t SyscallNo = __Frame__->Rax;
+    uint32_t Slot      = SyscallNo < MaxSysNo ? __SysSlot__[SyscallNo] : 0;
+    if (!Slot)
     {
-        __asm__ volatile("movq $-1, %%rax" : : : "rax");
+        __Frame__->Rax = (uint64_t)-1;
         return;
     }
-    int64_t RaxrRes = SysTbl[__SyscallNo__].Handler(__A1__, __A2__, __A3__, __A4__, __A5__, __A6__);
-    __asm__ volatile("movq %0, %%rax" : : "r"(RaxrRes) : "rax");
+
+    const SysEnt* Ent = &SysTbl[Slot - 1];
+    if (!__atomic_load_n(&__SysStatsOn__, __ATOMIC_RELAXED))
+    {
+        __Frame__->Rax = (uint64_t)Ent->Handler(__Frame__->Rdi,
+                                                __Frame__->Rsi,
+                                                __Frame__->Rdx,
+                                                __Frame__->R10,
+                                                __Frame__->R8,
+                                                __Frame__->R9);
+        return;
+    }
+
+    uint64_t Start = ReadTsc();
+    __Frame__->Rax = (uint64_t)Ent->Handler(
+        __Frame__->Rdi, __Frame__->Rsi, __Frame__->Rdx, __Frame__->R10, __Frame__->R8, __Frame__->R9);
+    __SysAccount__(Slot - 1, ReadTsc() - Start);
+}
+
+void
+SyscallStatsEnable(bool __Enable__)
+{
+    __atomic_store_n(&__SysStatsOn__, __Enable__ ? 1U : 0U, __ATOMIC_RELAXED);
+}
+
+int
+SyscallStatsRead(uint32_t __Index__, SysCallTotals* __Out__)
+{
+    if (__Index__ >= SysCount || !__Out__)
+    {
+        return -1;
+    }
+
+    memset(__Out__, 0, sizeof(*__Out__));
+    __Out__->Number = SysTbl[__Index__].Number;
+    __Out__->Name   = SysTbl[__Index__].SysName;
+
+    /* Unlocked sum, a reader may see a call counted but its cycles not yet */
+    for (uint32_t CpuIndex = 0; CpuIndex < MaxCPUs; CpuIndex++)
+    {
+        SysCallStat* Stats = __atomic_load_n(&__SysStats__[CpuIndex], __ATOMIC_ACQUIRE);
+        if (!Stats)
+        {
+            continue;
+        }
+
+        __Out__->Calls += __atomic_load_n(&Stats[__Index__].Calls, __ATOMIC_RELAXED);
+        __Out__->Cycles += __atomic_load_n(&Stats[__Index__].Cycles, __ATOMIC_RELAXED);
+        for (uint32_t Bucket = 0; Bucket < SysHistBuckets; Bucket++)
+        {
+            __Out__->Hist[Bucket] +=
+                __atomic_load_n(&Stats[__Index__].Hist[Bucket], __ATOMIC_RELAXED);
+        }
+    }
+
+    return 0;
 }
 
+/* int 0x80 compatibility gate, the CPU already pushed the iretq part of the frame */
 __asm__(".global SysEntASM\n"
         "SysEntASM:\n"
-        " pushq %rbx\n"
-        " pushq %rcx\n"
-        " pushq %rdx\n"
-        " pushq %rsi\n"
-        " pushq %rdi\n"
-        " pushq %rbp\n"
-        " pushq %r8\n"
-        " pushq %r9\n"
-        " pushq %r10\n"
-        " pushq %r11\n"
-        " pushq %r12\n"
-        " pushq %r13\n"
-        " pushq %r14\n"
+        " testb $3, 8(%rsp) # Entered from user mode, switch to the kernel GS base\n"
+        " jz 1f\n"
+        " swapgs\n"
+        "1:\n"
+        " pushq $0 # ErrCode\n"
+        " pushq $0x80 # IntNo\n"
         " pushq %r15\n"
+        " pushq %r14\n"
+        " pushq %r13\n"
+        " pushq %r12\n"
+        " pushq %r11\n"
+        " pushq %r10\n"
+        " pushq %r9\n"
+        " pushq %r8\n"
+        " pushq %rbp\n"
+        " pushq %rdi\n"
+        " pushq %rsi\n"
+        " pushq %rdx\n"
+        " pushq %rcx\n"
+        " pushq %rbx\n"
+        " pushq %rax\n"
         " \n"
-        " # RAX = syscall number\n"
-        " # RDI = __A1__, RSI = __A2__, RDX = __A3__\n"
-        " # R10 = __A4__, R8 = __A5__, R9 = __A6__\n"
+        " movq %rsp, %rdi\n"
+        " call SyscallDispatch\n"
         " \n"
-        " movq %rdi, %rbx # Save __A1__\n"
-        " movq %rsi, %r11 # Save __A2__\n"
-        " movq %rdx, %r12 # Save __A3__\n"
-        " movq %r10, %r13 # Save __A4__\n"
-        " movq %r8, %r14 # Save __A5__\n"
-        " movq %r9, %r15 # Save __A6__\n"
+        " popq %rax\n"
+        " popq %rbx\n"
+        " popq %rcx\n"
+        " popq %rdx\n"
+        " popq %rsi\n"
+        " popq %rdi\n"
+        " popq %rbp\n"
+        " popq %r8\n"
+        " popq %r9\n"
+        " popq %r10\n"
+        " popq %r11\n"
+        " popq %r12\n"
+        " popq %r13\n"
+        " popq %r14\n"
+        " popq %r15\n"
+        " addq $16, %rsp # IntNo, ErrCode\n"
         " \n"
-        " # SyscallHandler(__SyscallNo__, __A1__, __A2__, __A3__, __A4__, __A5__, "
-        "__A6__)\n"
-        " movq %rax, %rdi # __SyscallNo__ -> RDI\n"
-        " movq %rbx, %rsi # __A1__ -> RSI\n"
-        " movq %r11, %rdx # __A2__ -> RDX\n"
-        " movq %r12, %rcx # __A3__ -> RCX\n"
-        " movq %r13, %r8 # __A4__ -> R8\n"
-        " movq %r14, %r9 # __A5__ -> R9\n"
-        " pushq %r15 # __A6__ -> stack\n"
+        " testb $3, 8(%rsp)\n"
+        " jz 2f\n"
+        " swapgs\n"
+        "2:\n"
+        " iretq\n");
+
+/*
+ * SYSCALL entry, RCX holds the user RIP and R11 the user RFLAGS, SFMASK has
+ * already cleared IF. Nothing switches stacks for us, so the user RSP is
+ * parked in the per-CPU block and the thread's kernel stack loaded from it.
+ * The frame built here has the InterruptFrame layout of the int 0x80 path.
+ */
+__asm__(".global SysCallEntry\n"
+        "SysCallEntry:\n"
+        " swapgs\n"
+        " movq %rsp, %gs:" __SysXStr__(PerCpuUserRspOffset) "\n"
+        " movq %gs:" __SysXStr__(PerCpuKernelRspOffset) ", %rsp\n"
+        " pushq $" __SysXStr__(UserDataSelector) " # Ss\n"
+        " pushq %gs:" __SysXStr__(PerCpuUserRspOffset) " # Rsp\n"
+        " pushq %r11 # Rflags\n"
+        " pushq $" __SysXStr__(UserCodeSelector) " # Cs\n"
+        " pushq %rcx # Rip\n"
+        " pushq $0 # ErrCode\n"
+        " pushq $0x80 # IntNo, same as the compatibility gate\n"
+        " pushq %r15\n"
+        " pushq %r14\n"
+        " pushq %r13\n"
+        " pushq %r12\n"
+        " pushq %r11\n"
+        " pushq %r10\n"
+        " pushq %r9\n"
+        " pushq %r8\n"
+        " pushq %rbp\n"
+        " pushq %rdi\n"
+        " pushq %rsi\n"
+        " pushq %rdx\n"
+        " pushq %rcx\n"
+        " pushq %rbx\n"
+        " pushq %rax\n"
         " \n"
-        " call SyscallHandler\n"
-        " addq $8, %rsp # Clean up pushed __A6__\n"
+        " movq %rsp, %rdi\n"
+        " call SyscallDispatch\n"
         " \n"
-        " popq %r15\n"
-        " popq %r14\n"
-        " popq %r13\n"
-        " popq %r12\n"
-        " popq %r11\n"
-        " popq %r10\n"
-        " popq %r9\n"
-        " popq %r8\n"
-        " popq %rbp\n"
-        " popq %rdi\n"
-        " popq %rsi\n"
-        " popq %rdx\n"
-        " popq %rcx\n"
+        " popq %rax\n"
         " popq %rbx\n"
+        " popq %rcx\n"
+        " popq %rdx\n"
+        " popq %rsi\n"
+        " popq %rdi\n"
+        " popq %rbp\n"
+        " popq %r8\n"
+        " popq %r9\n"
+        " popq %r10\n"
+        " popq %r11\n"
+        " popq %r12\n"
+        " popq %r13\n"
+        " popq %r14\n"
+        " popq %r15\n"
+        " addq $16, %rsp # IntNo, ErrCode\n"
         " \n"
+        " # SYSRET only returns to the user code selector and faults in ring 0\n"
+        " # on a non-canonical RIP, anything else leaves through iretq\n"
+        " cmpq $" __SysXStr__(UserCodeSelector) ", 8(%rsp)\n"
+        " jne 1f\n"
+        " movq (%rsp), %rcx\n"
+        " movq %rcx, %r11\n"
+        " shrq $47, %r11\n"
+        " jnz 1f\n"
+        " movq 16(%rsp), %r11\n"
+        " movq 24(%rsp), %rsp\n"
+        " swapgs\n"
+        " sysretq\n"
+        "1:\n"
+        " testb $3, 8(%rsp)\n"
+        " jz 2f\n"
+        " swapgs\n"
+        "2:\n"
         " iretq\n");
 
 void
-InitSyscall(void)
+InitSyscallCpu(void)
 {
-    /*handles*/
-    SysTbl[SysRead].Handler = __Handle__Read;
-    SysTbl[SysRead].SysName = "read";
-
-    SysTbl[SysWrite].Handler = __Handle__Write;
-    SysTbl[SysWrite].SysName = "write";
-
-    SysTbl[SysOpen].Handler = __Handle__Open;
-    SysTbl[SysOpen].SysName = "open";
-
-    SysTbl[SysClose].Handler = __Handle__Close;
-    SysTbl[SysClose].SysName = "close";
-
-    SysTbl[SysStat].Handler = __Handle__Stat;
-    SysTbl[SysStat].SysName = "stat";
-
-    SysTbl[SysFstat].Handler = __Handle__Fstat;
-    SysTbl[SysFstat].SysName = "fstat";
-
-    SysTbl[SysLseek].Handler = __Handle__Lseek;
-    SysTbl[SysLseek].SysName = "lseek";
-
-    SysTbl[SysIoctl].Handler = __Handle__Ioctl;
-    SysTbl[SysIoctl].SysName = "ioctl";
-
-    SysTbl[SysAccess].Handler = __Handle__Access;
-    SysTbl[SysAccess].SysName = "access";
-
-    SysTbl[SysPipe].Handler = __Handle__Pipe;
-    SysTbl[SysPipe].SysName = "pipe";
-
-    SysTbl[SysSchedYield].Handler = __Handle__SchedYield;
-    SysTbl[SysSchedYield].SysName = "sched_yield";
-
-    SysTbl[SysMkdir].Handler = __Handle__Mkdir;
-    SysTbl[SysMkdir].SysName = "mkdir";
-
-    SysTbl[SysRmdir].Handler = __Handle__Rmdir;
-    SysTbl[SysRmdir].SysName = "rmdir";
-
-    SysTbl[SysUnlink].Handler = __Handle__Unlink;
-    SysTbl[SysUnlink].SysName = "unlink";
-
-    SysTbl[SysRename].Handler = __Handle__Rename;
-    SysTbl[SysRename].SysName = "rename";
-
-    SysTbl[SysGetpid].Handler = __Handle__Getpid;
-    SysTbl[SysGetpid].SysName = "getpid";
-
-    SysTbl[SysGetppid].Handler = __Handle__Getppid;
-    SysTbl[SysGetppid].SysName = "getppid";
-
-    SysTbl[SysGettid].Handler = __Handle__Gettid;
-    SysTbl[SysGettid].SysName = "gettid";
-
-    SysTbl[SysFork].Handler = __Handle__Fork;
-    SysTbl[SysFork].SysName = "fork";
-
-    SysTbl[SysExecve].Handler = __Handle__Execve;
-    SysTbl[SysExecve].SysName = "execve";
-
-    SysTbl[SysExit].Handler = __Handle__Exit;
-    SysTbl[SysExit].SysName = "exit";
-
-    SysTbl[SysWait4].Handler = __Handle__Wait4;
-    SysTbl[SysWait4].SysName = "wait4";
-
-    SysTbl[SysKill].Handler = __Handle__Kill;
-    SysTbl[SysKill].SysName = "kill";
-
-    SysTbl[SysDup].Handler = __Handle__Dup;
-    SysTbl[SysDup].SysName = "dup";
-
-    SysTbl[SysDup2].Handler = __Handle__Dup2;
-    SysTbl[SysDup2].SysName = "dup2";
-
-    SysTbl[SysNanosleep].Handler = __Handle__Nanosleep;
-    SysTbl[SysNanosleep].SysName = "nanosleep";
-
-    SysTbl[SysGetcwd].Handler = __Handle__Getcwd;
-    SysTbl[SysGetcwd].SysName = "getcwd";
-
-    SysTbl[SysChdir].Handler = __Handle__Chdir;
-    SysTbl[SysChdir].SysName = "chdir";
-
-    SysTbl[SysUname].Handler = __Handle__Uname;
-    SysTbl[SysUname].SysName = "uname";
-
-    SysTbl[SysGettimeofday].Handler = __Handle__Gettimeofday;
-    SysTbl[SysGettimeofday].SysName = "gettimeofday";
-
-    SysTbl[SysTimes].Handler = __Handle__Times;
-    SysTbl[SysTimes].SysName = "times";
-
-    SysTbl[SysClockGettime].Handler = __Handle__ClockGettime;
-    SysTbl[SysClockGettime].SysName = "clock_gettime";
-
-    SysTbl[SysMmap].Handler = __Handle__Mmap;
-    SysTbl[SysMmap].SysName = "mmap";
-
-    SysTbl[SysMunmap].Handler = __Handle__Munmap;
-    SysTbl[SysMunmap].SysName = "munmap";
-
-    SysTbl[SysBrk].Handler = __Handle__Brk;
-    SysTbl[SysBrk].SysName = "brk";
+    /* Read-modify-write, the loader already turned on NXE and LME */
+    WriteMsr(MsrEfer, ReadMsr(MsrEfer) | EferSyscallEnable);
+
+    /*
+     * SYSCALL loads CS from STAR[47:32] and SS from it plus 8. SYSRET takes
+     * STAR[63:48], SS is that plus 8 and CS plus 16, which is why the user
+     * data descriptor sits right below user code in the GDT.
+     */
+    uint64_t Star = ((uint64_t)KernelCodeSelector << 32) |
+                    ((uint64_t)(UserDataSelector - 8 - 3) << 48);
+    WriteMsr(MsrStar, Star);
+    WriteMsr(MsrLstar, (uint64_t)SysCallEntry);
+    WriteMsr(MsrSfmask, SyscallFlagMask);
+}
 
-    SysTbl[SysSelect].Handler = __Handle__Select;
-    SysTbl[SysSelect].SysName = "select";
+void
+InitSyscall(void)
+{
+    _Static_assert(sizeof(SysTbl) / sizeof(SysTbl[0]) < 256, "__SysSlot__ holds a byte");
 
-    SysTbl[SysWritev].Handler = __Handle__Writev;
-    SysTbl[SysWritev].SysName = "writev";
+    for (uint32_t Index = 0; Index < SysCount; Index++)
+    {
+        __SysSlot__[SysTbl[Index].Number] = (uint8_t)(Index + 1);
+    }
 
-    SysTbl[SysReadv].Handler = __Handle__Readv;
-    SysTbl[SysReadv].SysName = "readv";
+    /* Boot CPU, the APs program their own MSRs from ApEntry */
+    InitSyscallCpu();
 }
@@ -20,3 +20,127 @@ __TEST__Proc(void)
         PSuccess("Execve succeeded for pid=%ld\n", Proc->Pid);
     }
 }
+
+/*Splice test*/
+typedef struct
+{
+    PosixFdTable* Tab;
+    int           In;
+    int           Out;
+    volatile long Result;
+    volatile int  Finished;
+
+} __TEST__SpliceArg;
+
+static void
+__TEST__SpliceWorker(void* __Arg__)
+{
+    __TEST__SpliceArg* Arg = (__TEST__SpliceArg*)__Arg__;
+
+    /* Blocks on a full destination until the other side makes room */
+    Arg->Result = PosixSplice(Arg->Tab, Arg->In, NULL, Arg->Out, NULL, PageSize, 0);
+    __atomic_store_n(&Arg->Finished, 1, __ATOMIC_RELEASE);
+    ThreadExit(0);
+}
+
+static void
+__TEST__FillPipe(PosixFdTable* __Tab__, int __Fd__, const char* __Page__)
+{
+    PosixFile* Desc = PosixFdGet(__Tab__, __Fd__);
+    if (!Desc)
+    {
+        return;
+    }
+    while (PosixPipeWrite((PosixPipeT*)Desc->Obj, __Page__, PageSize, 1) > 0)
+    {
+    }
+    PosixFilePut(Desc);
+}
+
+static long
+__TEST__TryRead(PosixFdTable* __Tab__, int __Fd__, char* __Page__)
+{
+    PosixFile* Desc = PosixFdGet(__Tab__, __Fd__);
+    if (!Desc)
+    {
+        return -1;
+    }
+    long R = PosixPipeRead((PosixPipeT*)Desc->Obj, __Page__, PageSize, 1);
+    PosixFilePut(Desc);
+    return R;
+}
+
+/* Two splices in opposite directions between full pipes, a reader must still get through */
+void
+__TEST__PipeSplice(void)
+{
+    PosixFdTable* Tab  = (PosixFdTable*)KMalloc(sizeof(PosixFdTable));
+    char*         Page = (char*)KMalloc(PageSize);
+    if (!Tab || !Page || PosixFdInit(Tab, PosixFdMin) != 0)
+    {
+        PError("Splice test: setup failed\n");
+        return;
+    }
+
+    int P1[2];
+    int P2[2];
+    if (PosixPipe(Tab, P1) != 0 || PosixPipe(Tab, P2) != 0)
+    {
+        PError("Splice test: pipe failed\n");
+        return;
+    }
+    memset(Page, 'a', PageSize);
+    __TEST__FillPipe(Tab, P1[1], Page);
+    __TEST__FillPipe(Tab, P2[1], Page);
+
+    static __TEST__SpliceArg Args[2];
+    Args[0] = (__TEST__SpliceArg){.Tab = Tab, .In = P1[0], .Out = P2[1]};
+    Args[1] = (__TEST__SpliceArg){.Tab = Tab, .In = P2[0], .Out = P1[1]};
+    for (int I = 0; I < 2; I++)
+    {
+        Thread* Th =
+            CreateThread(ThreadTypeKernel, __TEST__SpliceWorker, &Args[I], ThreadPriorityNormal);
+        if (!Th)
+        {
+            PError("Splice test: thread failed\n");
+            return;
+        }
+        ThreadExecute(Th);
+    }
+
+    /* Let both park on a full destination, then free one page of the first pipe */
+    ThreadSleep(50);
+    bool Drained = false;
+    for (int Try = 0; Try < 200; Try++)
+    {
+        if (!Drained && __TEST__TryRead(Tab, P1[0], Page) == PageSize)
+        {
+            Drained = true;
+        }
+        if (Drained && __atomic_load_n(&Args[0].Finished, __ATOMIC_ACQUIRE) &&
+            __atomic_load_n(&Args[1].Finished, __ATOMIC_ACQUIRE))
+        {
+            break;
+        }
+        ThreadSleep(10);
+    }
+
+    if (!Drained || !Args[0].Finished || !Args[1].Finished)
+    {
+        /* The workers may still hold the table, leave it */
+        PError("Splice test: opposite splices stuck (read=%d)\n", Drained);
+        return;
+    }
+    if (Args[0].Result != PageSize || Args[1].Result != PageSize)
+    {
+        PError("Splice test: moved %ld and %ld bytes\n", Args[0].Result, Args[1].Result);
+    }
+    else
+    {
+        PSuccess("Splice test: opposite splices between full pipes completed\n");
+    }
+
+    PosixFdDestroy(Tab);
+    KFree(Tab);
+    KFree(Page);
+}
@@ -1,9 +1,10 @@
-#include <APICTimer.h>  /* APIC timer constants and register definitions */
-#include <LimineSMP.h>  /* Limine SMP request structures */
-#include <PerCPUData.h> /* Per-CPU data structures */
-#include <SymAP.h>      /* Symmetric Application Processor definitions */
-#include <Timer.h>      /* Global timer management structures */
-#include <VMM.h>        /* Virtual memory mapping functions */
+#include <APICTimer.h>   /* APIC timer constants and register definitions */
+#include <ClockSource.h> /* Calibration delay */
+#include <LimineSMP.h>   /* Limine SMP request structures */
+#include <PerCPUData.h>  /* Per-CPU data structures */
+#include <SymAP.h>       /* Symmetric Application Processor definitions */
+#include <Timer.h>       /* Global timer management structures */
+#include <VMM.h>         /* Virtual memory mapping functions */
 
 static int
 CheckApicSupport(void)
@@ -111,10 +112,7 @@ InitializeApicTimer(void)
     *TimerInitCount     = 0xFFFFFFFF;
     uint32_t StartCount = *TimerCurrCount;
 
-    for (uint32_t I = 0; I < 10000; I++)
-    {
-        __asm__ volatile("outb %%al, $0x80" : : "a"((uint8_t)0)); /* Short delay */
-    }
+    ClockBusyWaitNs(10 * NsPerMsec); /* TSC or PIT timed window */
 
     uint32_t EndCount    = *TimerCurrCount;
     uint32_t TicksIn10ms = StartCount - EndCount;
@@ -137,7 +135,11 @@ InitializeApicTimer(void)
         __asm__ volatile("nop");
     }
 
-    *LvtTimer = TimerVector | TimerApicTimerPeriodic | TimerApicTimerMasked;
+    /* A clock that does not lean on the tick lets each interrupt pick the next one */
+    Timer.OneShot = ClockSource.Kind != ClockSourceTick;
+    uint32_t Mode = Timer.OneShot ? TimerApicTimerOneShot : TimerApicTimerPeriodic;
+
+    *LvtTimer = TimerVector | Mode | TimerApicTimerMasked;
 
     *TimerInitCount = InitialCount;
 
@@ -152,8 +154,10 @@ InitializeApicTimer(void)
         PDebug("APIC: Set CPU %u APIC base to 0x%llx\n", CpuIndex, CpuData->ApicBase);
     }
 
-    PSuccess("APIC Timer initialized at %u Hz\n", Timer.TimerFrequency);
+    PSuccess("APIC Timer initialized at %u Hz (%s)\n",
+             Timer.TimerFrequency,
+             Timer.OneShot ? "one-shot" : "periodic");
 
-    *LvtTimer = TimerVector | TimerApicTimerPeriodic;
+    *LvtTimer = TimerVector | Mode;
     return 1;
 }
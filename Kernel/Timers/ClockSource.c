@@ -0,0 +1,499 @@
+#include <AxeThreads.h>  /* CPU time clocks */
+#include <ClockSource.h> /* Clocksource state and interfaces */
+#include <HPETTimer.h>   /* Calibration reference and fallback counter */
+#include <SMP.h>         /* Current CPU */
+#include <Sync.h>        /* Writer lock */
+#include <Timer.h>       /* Tick counter and TSC */
+
+ClockSourceState ClockSource;
+
+static SpinLock          __ClockLock__;
+static volatile uint32_t __ClockReady__ = 0;
+
+static inline uint8_t
+__Inb__(uint16_t __Port__)
+{
+    uint8_t Value;
+    __asm__ volatile("inb %1, %0" : "=a"(Value) : "Nd"(__Port__));
+    return Value;
+}
+
+static inline void
+__Outb__(uint16_t __Port__, uint8_t __Value__)
+{
+    __asm__ volatile("outb %0, %1" : : "a"(__Value__), "Nd"(__Port__));
+}
+
+static inline void
+__Cpuid__(uint32_t __Leaf__, uint32_t* __A__, uint32_t* __B__, uint32_t* __C__, uint32_t* __D__)
+{
+    __asm__ volatile("cpuid"
+                     : "=a"(*__A__), "=b"(*__B__), "=c"(*__C__), "=d"(*__D__)
+                     : "a"(__Leaf__), "c"(0));
+}
+
+static int
+__DetectInvariantTsc__(void)
+{
+    uint32_t A, B, C, D;
+
+    __Cpuid__(0x80000000, &A, &B, &C, &D);
+    if (A < 0x80000007)
+    {
+        return 0;
+    }
+
+    /* CPUID.80000007H:EDX[8], constant rate in every P-, C- and T-state */
+    __Cpuid__(0x80000007, &A, &B, &C, &D);
+    return (D >> 8) & 1;
+}
+
+static uint64_t
+__TscHzFromCpuid__(void)
+{
+    uint32_t A, B, C, D;
+
+    __Cpuid__(0, &A, &B, &C, &D);
+    if (A < 0x15)
+    {
+        return 0;
+    }
+
+    /* Leaf 15H, TSC = crystal * EBX / EAX, only usable when the crystal is reported */
+    __Cpuid__(0x15, &A, &B, &C, &D);
+    if (!A || !B || !C)
+    {
+        return 0;
+    }
+
+    return (uint64_t)C * B / A;
+}
+
+/*
+ * Busy-wait on PIT channel 2 in one-shot mode with the speaker gated off.
+ * Port 0x61 bit 5 follows the channel output and rises at terminal count.
+ */
+static int
+__PitWaitUs__(uint32_t __Us__)
+{
+    uint64_t Latch = ((uint64_t)ClockPitHz * __Us__) / 1000000ULL;
+    if (Latch == 0 || Latch > 0xFFFF)
+    {
+        return -1;
+    }
+
+    __Outb__(0x61, (uint8_t)((__Inb__(0x61) & ~0x02) | 0x01));
+    __Outb__(0x43, 0xB0); /* Channel 2, lobyte/hibyte, mode 0 */
+    __Outb__(0x42, (uint8_t)(Latch & 0xFF));
+    __Outb__(0x42, (uint8_t)(Latch >> 8));
+
+    for (uint32_t Poll = 0; Poll < ClockPitPollLimit; Poll++)
+    {
+        if (__Inb__(0x61) & 0x20)
+        {
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+static uint64_t
+__CalibrateTscPit__(void)
+{
+    uint64_t Best = 0;
+
+    for (uint32_t Run = 0; Run < ClockCalibrateRuns; Run++)
+    {
+        uint64_t Flags;
+        __asm__ volatile("pushfq; popq %0; cli" : "=r"(Flags)::"memory");
+
+        uint64_t Start = ReadTsc();
+        int      Done  = __PitWaitUs__(ClockCalibrateUs);
+        uint64_t End   = ReadTsc();
+
+        __asm__ volatile("pushq %0; popfq" ::"r"(Flags) : "memory");
+
+        if (Done != 0)
+        {
+            return 0;
+        }
+
+        /* SMIs and emulation exits only ever lengthen a window */
+        if (!Best || End - Start < Best)
+        {
+            Best = End - Start;
+        }
+    }
+
+    return Best * (1000000ULL / ClockCalibrateUs);
+}
+
+static uint64_t
+__CalibrateTscHpet__(void)
+{
+    uint64_t Window = Hpet.Hz / (1000000ULL / ClockCalibrateUs);
+    uint64_t Mask   = Hpet.Counter64 ? ~0ULL : 0xFFFFFFFFULL;
+    uint64_t Best   = 0;
+    uint64_t BestHz = 0;
+
+    for (uint32_t Run = 0; Run < ClockCalibrateRuns; Run++)
+    {
+        uint64_t Flags;
+        __asm__ volatile("pushfq; popq %0; cli" : "=r"(Flags)::"memory");
+
+        /* Both ends are read back to back, the counter delta is exact */
+        uint64_t Start = ReadTsc();
+        uint64_t From  = HpetReadCounter();
+        uint64_t To    = From;
+        while (((To - From) & Mask) < Window)
+        {
+            To = HpetReadCounter();
+        }
+        uint64_t End = ReadTsc();
+
+        __asm__ volatile("pushq %0; popfq" ::"r"(Flags) : "memory");
+
+        uint64_t Cycles  = End - Start;
+        uint64_t Elapsed = (To - From) & Mask;
+        if (!Best || Cycles < Best)
+        {
+            Best   = Cycles;
+            BestHz = Cycles * Hpet.Hz / Elapsed;
+        }
+    }
+
+    return BestHz;
+}
+
+static inline uint64_t
+__HpetWiden__(uint64_t __Last__)
+{
+    uint64_t Mask = Hpet.Counter64 ? ~0ULL : 0xFFFFFFFFULL;
+    return __Last__ + ((HpetReadCounter() - __Last__) & Mask);
+}
+
+static uint64_t
+__HpetClockNs__(void)
+{
+    uint32_t Seq;
+    uint64_t Now;
+
+    do
+    {
+        Seq = __atomic_load_n(&ClockSource.Data.Seq, __ATOMIC_ACQUIRE);
+        Now = __HpetWiden__(ClockSource.HpetLast);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((Seq & 1) || __atomic_load_n(&ClockSource.Data.Seq, __ATOMIC_RELAXED) != Seq);
+
+    return HpetCounterToNs(Now - ClockSource.HpetBoot);
+}
+
+static uint8_t
+__CmosRead__(uint8_t __Reg__)
+{
+    __Outb__(0x70, (uint8_t)(0x80 | __Reg__)); /* Keep NMIs masked while selecting */
+    return __Inb__(0x71);
+}
+
+static uint64_t
+__DaysFromCivil__(int64_t __Year__, uint32_t __Month__, uint32_t __Day__)
+{
+    /* Days since 1970-01-01 in the proleptic Gregorian calendar */
+    __Year__ -= __Month__ <= 2;
+    int64_t  Era = (__Year__ >= 0 ? __Year__ : __Year__ - 399) / 400;
+    uint32_t Yoe = (uint32_t)(__Year__ - Era * 400);
+    uint32_t Doy = (153 * (__Month__ + (__Month__ > 2 ? -3 : 9)) + 2) / 5 + __Day__ - 1;
+    uint32_t Doe = Yoe * 365 + Yoe / 4 - Yoe / 100 + Doy;
+    return (uint64_t)(Era * 146097 + (int64_t)Doe - 719468);
+}
+
+static uint64_t
+__ReadRtcSeconds__(void)
+{
+    uint8_t Sec, Min, Hour, Day, Mon, Year, Again;
+
+    /* Read twice around the update-in-progress flag until two passes agree */
+    do
+    {
+        for (uint32_t Spin = 0; Spin < 100000 && (__CmosRead__(0x0A) & 0x80); Spin++)
+        {
+            __asm__ volatile("pause");
+        }
+
+        Sec   = __CmosRead__(0x00);
+        Min   = __CmosRead__(0x02);
+        Hour  = __CmosRead__(0x04);
+        Day   = __CmosRead__(0x07);
+        Mon   = __CmosRead__(0x08);
+        Year  = __CmosRead__(0x09);
+        Again = __CmosRead__(0x00);
+    } while (Again != Sec);
+
+    uint8_t StatusB = __CmosRead__(0x0B);
+    bool    Pm      = (Hour & 0x80) != 0;
+    Hour &= 0x7F;
+
+    if (!(StatusB & 0x04))
+    {
+#define __Bcd__(V) (uint8_t)(((V) & 0x0F) + ((V) >> 4) * 10)
+        Sec  = __Bcd__(Sec);
+        Min  = __Bcd__(Min);
+        Hour = __Bcd__(Hour);
+        Day  = __Bcd__(Day);
+        Mon  = __Bcd__(Mon);
+        Year = __Bcd__(Year);
+#undef __Bcd__
+    }
+
+    if (!(StatusB & 0x02))
+    {
+        Hour = (uint8_t)((Hour % 12) + (Pm ? 12 : 0));
+    }
+
+    if (Mon < 1 || Mon > 12 || Day < 1 || Day > 31 || Hour > 23 || Min > 59 || Sec > 60)
+    {
+        PWarn("Clock: RTC returned garbage, wall clock starts at the epoch\n");
+        return 0;
+    }
+
+    /* No century register without FADT parsing, two digit years are 2000-2099 */
+    uint64_t Days = __DaysFromCivil__(2000 + Year, Mon, Day);
+    return Days * 86400ULL + Hour * 3600ULL + Min * 60ULL + Sec;
+}
+
+static void
+__ClockWriteBegin__(void)
+{
+    __atomic_store_n(&ClockSource.Data.Seq, ClockSource.Data.Seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void
+__ClockWriteEnd__(void)
+{
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&ClockSource.Data.Seq, ClockSource.Data.Seq + 1, __ATOMIC_RELAXED);
+}
+
+void
+InitializeClockSource(void)
+{
+    InitializeSpinLock(&__ClockLock__, "ClockSource");
+
+    ClockSource.InvariantTsc = (uint32_t)__DetectInvariantTsc__();
+    ClockSource.TscHz        = __TscHzFromCpuid__();
+    ClockSource.CalibratedBy = "cpuid";
+
+    if (!ClockSource.TscHz && Hpet.Ready)
+    {
+        ClockSource.TscHz        = __CalibrateTscHpet__();
+        ClockSource.CalibratedBy = "hpet";
+    }
+
+    if (!ClockSource.TscHz)
+    {
+        ClockSource.TscHz        = __CalibrateTscPit__();
+        ClockSource.CalibratedBy = ClockSource.TscHz ? "pit" : "none";
+    }
+
+    uint64_t Mult = 0;
+    if (ClockSource.TscHz >= 1000000)
+    {
+        Mult = (NsPerSec << VdsoMultShift) / ClockSource.TscHz;
+    }
+
+    if (ClockSource.InvariantTsc && Mult)
+    {
+        ClockSource.Kind = ClockSourceTsc;
+    }
+    else if (Hpet.Ready)
+    {
+        ClockSource.Kind = ClockSourceHpet;
+    }
+    else
+    {
+        ClockSource.Kind = ClockSourceTick;
+    }
+    ClockSource.TscBoot = ReadTsc();
+
+    uint64_t Flags;
+    __asm__ volatile("pushfq; popq %0; cli" : "=r"(Flags)::"memory");
+
+    __ClockWriteBegin__();
+    ClockSource.Data.TscBase = ClockSource.TscBoot;
+    ClockSource.Data.Mult    = Mult;
+    if (ClockSource.Kind == ClockSourceTsc)
+    {
+        /* The TSC alone is the clock, BaseNs stays zero and nothing caps it */
+        ClockSource.Data.BaseNs      = 0;
+        ClockSource.Data.MaxInterpNs = ~0ULL;
+    }
+    else if (ClockSource.Kind == ClockSourceHpet)
+    {
+        /* MMIO is not mapped for user mode, the vDSO sends callers to the syscall */
+        ClockSource.HpetBoot   = HpetReadCounter();
+        ClockSource.HpetLast   = ClockSource.HpetBoot;
+        ClockSource.Data.Flags = VdsoFlagSyscall;
+    }
+    else
+    {
+        ClockSource.Data.BaseNs      = Timer.SystemTicks * (NsPerSec / TimerTargetFrequency);
+        ClockSource.Data.MaxInterpNs = NsPerSec / TimerTargetFrequency;
+    }
+    ClockSource.Data.RealtimeOffsetNs = __ReadRtcSeconds__() * NsPerSec;
+    __ClockWriteEnd__();
+
+    __atomic_store_n(&__ClockReady__, 1, __ATOMIC_RELEASE);
+
+    __asm__ volatile("pushq %0; popfq" ::"r"(Flags) : "memory");
+
+    PSuccess("Clock: %s clocksource, TSC %llu Hz (%s)%s\n",
+             ClockSource.Kind == ClockSourceTsc    ? "tsc"
+             : ClockSource.Kind == ClockSourceHpet ? "hpet"
+                                                   : "tick",
+             ClockSource.TscHz,
+             ClockSource.CalibratedBy,
+             ClockSource.InvariantTsc ? ", invariant" : "");
+}
+
+void
+ClockTick(void)
+{
+    /* The TSC clock is free running, the others move with the boot CPU's tick */
+    if (ClockSource.Kind == ClockSourceTsc || !__ClockReady__)
+    {
+        return;
+    }
+
+    AcquireSpinLock(&__ClockLock__);
+    __ClockWriteBegin__();
+    if (ClockSource.Kind == ClockSourceHpet)
+    {
+        /* Often enough that a 32-bit counter cannot wrap twice between readers */
+        ClockSource.HpetLast = __HpetWiden__(ClockSource.HpetLast);
+    }
+    else
+    {
+        ClockSource.Data.BaseNs  = Timer.SystemTicks * (NsPerSec / TimerTargetFrequency);
+        ClockSource.Data.TscBase = ReadTsc();
+    }
+    __ClockWriteEnd__();
+    ReleaseSpinLock(&__ClockLock__);
+}
+
+uint64_t
+ClockMonotonicNs(void)
+{
+    if (!__atomic_load_n(&__ClockReady__, __ATOMIC_ACQUIRE))
+    {
+        return Timer.SystemTicks * (NsPerSec / TimerTargetFrequency);
+    }
+
+    if (ClockSource.Kind == ClockSourceHpet)
+    {
+        return __HpetClockNs__();
+    }
+    return VdsoReadNs(&ClockSource.Data);
+}
+
+uint64_t
+ClockRealtimeNs(void)
+{
+    /* Offset arithmetic is modular, a wall clock set before boot time still adds up */
+    uint64_t Offset = __atomic_load_n(&ClockSource.Data.RealtimeOffsetNs, __ATOMIC_RELAXED);
+    return ClockMonotonicNs() + Offset;
+}
+
+void
+ClockSetRealtimeNs(uint64_t __Ns__)
+{
+    uint64_t Now = ClockMonotonicNs();
+
+    AcquireSpinLock(&__ClockLock__);
+    __ClockWriteBegin__();
+    ClockSource.Data.RealtimeOffsetNs = __Ns__ - Now;
+    __ClockWriteEnd__();
+    ReleaseSpinLock(&__ClockLock__);
+}
+
+int
+ClockGetNs(long __ClockId__, uint64_t* __OutNs__)
+{
+    if (!__OutNs__)
+    {
+        return -1;
+    }
+
+    switch (__ClockId__)
+    {
+        case ClockIdRealtime:
+        case ClockIdRealtimeCoarse:
+            *__OutNs__ = ClockRealtimeNs();
+            return 0;
+
+        case ClockIdMonotonic:
+        case ClockIdMonotonicRaw:
+        case ClockIdMonotonicCoarse:
+        case ClockIdBoottime:
+            *__OutNs__ = ClockMonotonicNs();
+            return 0;
+
+        case ClockIdProcessCputime:
+        case ClockIdThreadCputime:
+        {
+            /* Threads are the unit of accounting, a process is its calling thread */
+            Thread* Current = GetCurrentThread(GetCurrentCpuId());
+            if (!Current)
+            {
+                return -1;
+            }
+            uint64_t Now   = ClockMonotonicNs();
+            uint64_t Since = __atomic_load_n(&Current->StartTime, __ATOMIC_SEQ_CST);
+            *__OutNs__     = __atomic_load_n(&Current->CpuTime, __ATOMIC_SEQ_CST) +
+                         (Now > Since ? Now - Since : 0);
+            return 0;
+        }
+
+        default:
+            return -1;
+    }
+}
+
+void
+ClockBusyWaitNs(uint64_t __Ns__)
+{
+    if (ClockSource.TscHz)
+    {
+        /* Busy waits are short, cycles per microsecond keeps this in 64 bits */
+        uint64_t Cycles = __Ns__ * (ClockSource.TscHz / 1000000ULL) / NsPerUsec;
+        uint64_t Start  = ReadTsc();
+        while (ReadTsc() - Start < Cycles)
+        {
+            __asm__ volatile("pause");
+        }
+        return;
+    }
+
+    if (Hpet.Ready)
+    {
+        HpetBusyWaitNs(__Ns__);
+        return;
+    }
+
+    /* No TSC rate, fall back to PIT windows of at most 50 ms */
+    uint64_t Us = (__Ns__ + NsPerUsec - 1) / NsPerUsec;
+    while (Us)
+    {
+        uint32_t Chunk = Us > 50000 ? 50000 : (uint32_t)Us;
+        if (__PitWaitUs__(Chunk) != 0)
+        {
+            /* Not even a PIT, port 0x80 writes take roughly a microsecond each */
+            for (uint32_t I = 0; I < Chunk; I++)
+            {
+                __Outb__(0x80, 0);
+            }
+        }
+        Us -= Chunk;
+    }
+}
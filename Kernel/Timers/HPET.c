@@ -1,15 +1,405 @@
-#include <HPETTimer.h> /* HPET-specific constants and definitions */
-#include <Timer.h>     /* Timer management structures */
+#include <APICTimer.h>  /* EOI register */
+#include <HPETTimer.h>  /* HPET-specific constants and definitions */
+#include <LimineRSDP.h> /* ACPI root pointer */
+#include <LimineSMP.h>  /* BSP APIC id for message delivery */
+#include <PMM.h>        /* Physical to virtual */
+#include <PerCPUData.h> /* Per-CPU APIC base */
+#include <SMP.h>        /* Current CPU */
+#include <String.h>     /* Signature compare */
+#include <SymAP.h>      /* Per-CPU data lookup */
+#include <Timer.h>      /* Timer management structures */
+
+HpetState Hpet = {.TickTimer = -1, .OneShot = -1};
+
+typedef struct __attribute__((packed))
+{
+    char     Signature[4];
+    uint32_t Length;
+    uint8_t  Revision;
+    uint8_t  Checksum;
+    char     OemId[6];
+    char     OemTableId[8];
+    uint32_t OemRevision;
+    uint32_t CreatorId;
+    uint32_t CreatorRevision;
+
+} AcpiSdtHeader;
+
+typedef struct __attribute__((packed))
+{
+    char     Signature[8];
+    uint8_t  Checksum;
+    char     OemId[6];
+    uint8_t  Revision;
+    uint32_t RsdtAddress;
+    uint32_t Length;
+    uint64_t XsdtAddress;
+    uint8_t  ExtendedChecksum;
+    uint8_t  Reserved[3];
+
+} AcpiRsdp;
+
+typedef struct __attribute__((packed))
+{
+    AcpiSdtHeader Header;
+    uint32_t      EventTimerBlockId;
+    uint8_t       AddressSpace; /* Generic address structure, 0 is system memory */
+    uint8_t       RegisterBitWidth;
+    uint8_t       RegisterBitOffset;
+    uint8_t       AccessSize;
+    uint64_t      Address;
+    uint8_t       HpetNumber;
+    uint16_t      MinimumTick;
+    uint8_t       PageProtection;
+
+} AcpiHpetTable;
+
+static inline uint64_t
+__HpetRead__(uint32_t __Reg__)
+{
+    return *(volatile uint64_t*)(Hpet.Regs + __Reg__);
+}
+
+static inline void
+__HpetWrite__(uint32_t __Reg__, uint64_t __Value__)
+{
+    *(volatile uint64_t*)(Hpet.Regs + __Reg__) = __Value__;
+}
+
+static inline uint32_t
+__HpetTimerReg__(int32_t __Timer__, uint32_t __Reg0__)
+{
+    return __Reg0__ + (uint32_t)__Timer__ * TimerHpetTimerStride;
+}
+
+static void*
+__AcpiPtr__(uint64_t __Addr__)
+{
+    /* Older boot protocol revisions hand out HHDM addresses, newer ones physical */
+    if (__Addr__ >= HhdmRequest.response->offset)
+    {
+        return (void*)__Addr__;
+    }
+    return PhysToVirt(__Addr__);
+}
+
+static bool
+__AcpiChecksumOk__(const void* __Table__, uint32_t __Length__)
+{
+    const uint8_t* Bytes = (const uint8_t*)__Table__;
+    uint8_t        Sum   = 0;
+
+    for (uint32_t Index = 0; Index < __Length__; Index++)
+    {
+        Sum = (uint8_t)(Sum + Bytes[Index]);
+    }
+    return Sum == 0;
+}
+
+static const AcpiSdtHeader*
+__AcpiFindTable__(const char* __Signature__)
+{
+    struct limine_rsdp_response* Response = EarlyLimineRsdp.response;
+    if (!Response || !Response->address || !HhdmRequest.response)
+    {
+        return NULL;
+    }
+
+    const AcpiRsdp* Rsdp = (const AcpiRsdp*)__AcpiPtr__((uint64_t)Response->address);
+    if (strncmp(Rsdp->Signature, "RSD PTR ", 8) != 0 || !__AcpiChecksumOk__(Rsdp, 20))
+    {
+        PWarn("ACPI: Bad RSDP\n");
+        return NULL;
+    }
+
+    /* XSDT entries are 64 bits wide, RSDT entries 32 */
+    bool                 Extended = Rsdp->Revision >= 2 && Rsdp->XsdtAddress;
+    const AcpiSdtHeader* Root     = (const AcpiSdtHeader*)__AcpiPtr__(
+        Extended ? Rsdp->XsdtAddress : (uint64_t)Rsdp->RsdtAddress);
+    if (!__AcpiChecksumOk__(Root, Root->Length))
+    {
+        PWarn("ACPI: Bad %s checksum\n", Extended ? "XSDT" : "RSDT");
+        return NULL;
+    }
+
+    uint32_t       EntrySize = Extended ? 8 : 4;
+    uint32_t       Entries   = (Root->Length - sizeof(AcpiSdtHeader)) / EntrySize;
+    const uint8_t* Table     = (const uint8_t*)Root + sizeof(AcpiSdtHeader);
+
+    for (uint32_t Index = 0; Index < Entries; Index++)
+    {
+        uint64_t Addr = 0;
+        __builtin_memcpy(&Addr, Table + Index * EntrySize, EntrySize);
+
+        const AcpiSdtHeader* Header = (const AcpiSdtHeader*)__AcpiPtr__(Addr);
+        if (strncmp(Header->Signature, __Signature__, 4) == 0 &&
+            __AcpiChecksumOk__(Header, Header->Length))
+        {
+            return Header;
+        }
+    }
+
+    return NULL;
+}
+
+static uint32_t
+__HpetMsiDestination__(void)
+{
+    struct limine_smp_response* SmpResponse = EarlyLimineSmp.response;
+    return SmpResponse ? SmpResponse->bsp_lapic_id : 0;
+}
 
 int
 DetectHpetTimer(void)
 {
-    return 0;
+    PDebug("HPET: detecting...\n");
+
+    const AcpiHpetTable* Table = (const AcpiHpetTable*)__AcpiFindTable__("HPET");
+    if (!Table)
+    {
+        PDebug("HPET: No ACPI HPET table\n");
+        return 0;
+    }
+
+    if (Table->AddressSpace != 0 || !Table->Address)
+    {
+        PWarn("HPET: Registers not in system memory (space %u)\n", Table->AddressSpace);
+        return 0;
+    }
+
+    Hpet.PhysBase  = Table->Address;
+    Hpet.Regs      = (volatile uint8_t*)PhysToVirt(Hpet.PhysBase);
+    Timer.HpetBase = (uint64_t)Hpet.Regs;
+
+    uint64_t Caps   = __HpetRead__(TimerHpetCapabilitiesReg);
+    uint32_t Period = (uint32_t)(Caps >> TimerHpetCapPeriodShift);
+    if (Period == 0 || Period > TimerHpetMaxPeriodFs)
+    {
+        PError("HPET: Invalid counter period %u fs\n", Period);
+        return 0;
+    }
+
+    Hpet.PeriodFs  = Period;
+    Hpet.Hz        = 1000000000000000ULL / Period;
+    Hpet.NsMult    = ((uint64_t)Period << 32) / 1000000ULL;
+    Hpet.TickMult  = (1000000ULL << 32) / Period;
+    Hpet.Counter64 = (Caps & TimerHpetCapCounter64) ? 1 : 0;
+    Hpet.Timers    = (uint32_t)((Caps >> TimerHpetCapTimersShift) & TimerHpetCapTimersMask) + 1;
+
+    /* Comparators stay quiet until someone arms them */
+    for (int32_t Index = 0; Index < (int32_t)Hpet.Timers; Index++)
+    {
+        uint32_t Reg = __HpetTimerReg__(Index, TimerHpetTimer0ConfigReg);
+        __HpetWrite__(Reg, __HpetRead__(Reg) & ~(TimerHpetTnIntEnable | TimerHpetTnFsbEnable));
+    }
+
+    /* Plain routing, the counter keeps its value if firmware already started it */
+    uint64_t Config = __HpetRead__(TimerHpetConfigReg);
+    Config &= ~TimerHpetCfgLegacyRoute;
+    Config |= TimerHpetCfgEnable;
+    __HpetWrite__(TimerHpetConfigReg, Config);
+
+    /* The highest message-capable comparator takes one-shots, timer 0 is left for the tick */
+    for (int32_t Index = (int32_t)Hpet.Timers - 1; Index > 0; Index--)
+    {
+        if (__HpetRead__(__HpetTimerReg__(Index, TimerHpetTimer0ConfigReg)) & TimerHpetTnFsbOk)
+        {
+            Hpet.OneShot = Index;
+            break;
+        }
+    }
+
+    Hpet.Ready = 1;
+
+    PSuccess("HPET: %llu Hz, %u timers, %s counter, one-shot on %d\n",
+             Hpet.Hz,
+             Hpet.Timers,
+             Hpet.Counter64 ? "64-bit" : "32-bit",
+             Hpet.OneShot);
+    return 1;
 }
 
 int
 InitializeHpetTimer(void)
 {
     PInfo("Initializing HPET Timer...\n");
+
+    if (!Hpet.Ready || !Timer.ApicBase)
+    {
+        return 0;
+    }
+
+    uint32_t Reg  = __HpetTimerReg__(0, TimerHpetTimer0ConfigReg);
+    uint64_t Caps = __HpetRead__(Reg);
+
+    /* Without an I/O APIC the only path to a CPU is a message to its local APIC */
+    if (!(Caps & TimerHpetTnPeriodicOk) || !(Caps & TimerHpetTnFsbOk))
+    {
+        PWarn("HPET: Timer 0 cannot tick periodically by message\n");
+        return 0;
+    }
+
+    uint64_t Delta = Hpet.Hz / TimerTargetFrequency;
+
+    __HpetWrite__(__HpetTimerReg__(0, TimerHpetTimer0FsbRouteReg),
+                  (TimerHpetMsiAddress(__HpetMsiDestination__()) << 32) | TimerVector);
+
+    /* Stopping only pauses the counter, the clock loses a few cycles at most */
+    uint64_t Config = __HpetRead__(TimerHpetConfigReg);
+    __HpetWrite__(TimerHpetConfigReg, Config & ~TimerHpetCfgEnable);
+
+    uint64_t Tn = (Caps & ~(TimerHpetTnLevel | TimerHpetTn32Mode)) | TimerHpetTnIntEnable |
+                  TimerHpetTnPeriodic | TimerHpetTnValSet | TimerHpetTnFsbEnable;
+    __HpetWrite__(Reg, Tn);
+    __HpetWrite__(__HpetTimerReg__(0, TimerHpetTimer0ComparatorReg), HpetReadCounter() + Delta);
+    __HpetWrite__(__HpetTimerReg__(0, TimerHpetTimer0ComparatorReg), Delta);
+
+    __HpetWrite__(TimerHpetConfigReg, Config | TimerHpetCfgEnable);
+
+    Hpet.TickTimer = 0;
+    if (Hpet.OneShot == 0)
+    {
+        Hpet.OneShot = -1;
+    }
+
+    struct limine_smp_response* SmpResponse = EarlyLimineSmp.response;
+    for (uint32_t CpuIndex = 0; SmpResponse && CpuIndex < SmpResponse->cpu_count; CpuIndex++)
+    {
+        GetPerCpuData(CpuIndex)->ApicBase = Timer.ApicBase;
+    }
+
+    Timer.TimerFrequency = TimerTargetFrequency;
+    Timer.ActiveTimer    = TIMER_TYPE_HPET;
+
+    PSuccess("HPET Timer initialized at %u Hz\n", Timer.TimerFrequency);
+    return 1;
+}
+
+uint64_t
+HpetReadCounter(void)
+{
+    if (!Hpet.Ready)
+    {
+        return 0;
+    }
+
+    if (Hpet.Counter64)
+    {
+        return __HpetRead__(TimerHpetCounterReg);
+    }
+    return *(volatile uint32_t*)(Hpet.Regs + TimerHpetCounterReg);
+}
+
+uint64_t
+HpetCounterToNs(uint64_t __Ticks__)
+{
+    return (uint64_t)(((unsigned __int128)__Ticks__ * Hpet.NsMult) >> 32);
+}
+
+void
+HpetBusyWaitNs(uint64_t __Ns__)
+{
+    if (!Hpet.Ready)
+    {
+        return;
+    }
+
+    uint64_t Ticks = (uint64_t)(((unsigned __int128)__Ns__ * Hpet.TickMult) >> 32);
+    uint64_t Mask  = Hpet.Counter64 ? ~0ULL : 0xFFFFFFFFULL;
+    uint64_t Start = HpetReadCounter();
+
+    while (((HpetReadCounter() - Start) & Mask) < Ticks)
+    {
+        __asm__ volatile("pause");
+    }
+}
+
+int
+HpetOneShotSetHandler(HpetHandler __Handler__)
+{
+    if (!Hpet.Ready || Hpet.OneShot < 0)
+    {
+        return -1;
+    }
+
+    __atomic_store_n(&Hpet.OneShotHandler, __Handler__, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int
+HpetArmOneShot(uint64_t __DeltaNs__)
+{
+    if (!Hpet.Ready || Hpet.OneShot < 0)
+    {
+        return -1;
+    }
+
+    uint32_t Reg  = __HpetTimerReg__(Hpet.OneShot, TimerHpetTimer0ConfigReg);
+    uint64_t Caps = __HpetRead__(Reg);
+    bool     Wide = Hpet.Counter64 && (Caps & TimerHpetTn64Ok);
+    uint64_t Mask = Wide ? ~0ULL : 0xFFFFFFFFULL;
+
+    uint64_t Ticks = (uint64_t)(((unsigned __int128)__DeltaNs__ * Hpet.TickMult) >> 32);
+    if (Ticks == 0)
+    {
+        return 1;
+    }
+    if (Ticks > (Mask >> 1))
+    {
+        Ticks = Mask >> 1; /* Far deadlines fire early and get re-armed */
+    }
+
+    __HpetWrite__(__HpetTimerReg__(Hpet.OneShot, TimerHpetTimer0FsbRouteReg),
+                  (TimerHpetMsiAddress(__HpetMsiDestination__()) << 32) | HpetOneShotVector);
+
+    uint64_t Tn = (Caps & ~(TimerHpetTnLevel | TimerHpetTnPeriodic | TimerHpetTn32Mode)) |
+                  TimerHpetTnIntEnable | TimerHpetTnFsbEnable;
+    if (!Wide)
+    {
+        Tn |= TimerHpetTn32Mode;
+    }
+    __HpetWrite__(Reg, Tn);
+
+    uint64_t Target = (HpetReadCounter() + Ticks) & Mask;
+    __HpetWrite__(__HpetTimerReg__(Hpet.OneShot, TimerHpetTimer0ComparatorReg), Target);
+
+    /* The comparator matches on equality, a target already behind the counter never fires */
+    uint64_t Now = HpetReadCounter() & Mask;
+    if (((Now - Target) & Mask) < (Mask >> 1))
+    {
+        HpetCancelOneShot();
+        return 1;
+    }
+
     return 0;
 }
+
+void
+HpetCancelOneShot(void)
+{
+    if (!Hpet.Ready || Hpet.OneShot < 0)
+    {
+        return;
+    }
+
+    uint32_t Reg = __HpetTimerReg__(Hpet.OneShot, TimerHpetTimer0ConfigReg);
+    __HpetWrite__(Reg, __HpetRead__(Reg) & ~TimerHpetTnIntEnable);
+}
+
+void
+HpetInterrupt(void)
+{
+    HpetHandler Handler = __atomic_load_n(&Hpet.OneShotHandler, __ATOMIC_ACQUIRE);
+
+    /* Message interrupts are acknowledged at the local APIC only */
+    PerCpuData* CpuData = GetPerCpuData(GetCurrentCpuId());
+    if (CpuData->ApicBase)
+    {
+        *(volatile uint32_t*)(CpuData->ApicBase + TimerApicRegEoi) = 0;
+    }
+
+    if (Handler)
+    {
+        Handler();
+    }
+}
@@ -1,17 +1,31 @@
-#include <APICTimer.h>  /* APIC timer constants and functions */
-#include <AxeSchd.h>    /* Scheduler functions */
-#include <AxeThreads.h> /* Thread management functions */
-#include <HPETTimer.h>  /* HPET timer constants and functions */
-#include <PerCPUData.h> /* Per-CPU data structures */
-#include <SMP.h>        /* Symmetric multiprocessing functions */
-#include <SymAP.h>      /* Symmetric Application Processor definitions */
-#include <Timer.h>      /* Timer management structures and definitions */
-#include <VMM.h>        /* Virtual memory management (for timer mapping) */
+#include <APICTimer.h>   /* APIC timer constants and functions */
+#include <AxeSchd.h>     /* Scheduler functions */
+#include <AxeThreads.h>  /* Thread management functions */
+#include <ClockSource.h> /* Nanosecond timekeeping */
+#include <HPETTimer.h>   /* HPET timer constants and functions */
+#include <PerCPUData.h>  /* Per-CPU data structures */
+#include <SMP.h>         /* Symmetric multiprocessing functions */
+#include <SymAP.h>       /* Symmetric Application Processor definitions */
+#include <Timer.h>       /* Timer management structures and definitions */
+#include <VMM.h>         /* Virtual memory management (for timer mapping) */
+#include <Vdso.h>        /* User visible time page */
+#include <WorkQueue.h>   /* Timer softirq */
 
 TimerManager Timer;
 
 volatile uint32_t TimerInterruptCount = 0;
 
+static void
+__TimerSoftIrq__(uint32_t __CpuId__)
+{
+    WakeupSleepingThreads(__CpuId__);
+
+    if (__CpuId__ == 0)
+    {
+        VdsoUpdate();
+    }
+}
+
 void
 InitializeTimer(void)
 {
@@ -19,12 +33,18 @@ InitializeTimer(void)
     Timer.SystemTicks      = 0;
     Timer.TimerInitialized = 0;
 
+    SoftIrqRegister(SoftIrqTimer, __TimerSoftIrq__);
+
+    /* HPET first as the calibration reference, then the TSC rate the APIC timer uses */
+    int HpetPresent = DetectHpetTimer();
+    InitializeClockSource();
+
     if (DetectApicTimer() && InitializeApicTimer())
     {
         /* APIC timer successfully initialized */
     }
 
-    else if (DetectHpetTimer() && InitializeHpetTimer())
+    else if (HpetPresent && InitializeHpetTimer())
     {
         /* HPET timer successfully initialized */
     }
@@ -50,6 +70,31 @@ InitializeTimer(void)
     __asm__ volatile("sti");
 }
 
+/* One-shot mode, fire at the next tick or at this CPU's earliest sleeper if that is sooner */
+static void
+__TimerArm__(uint32_t __CpuId__, PerCpuData* __CpuData__)
+{
+    uint64_t Due     = __CpuData__->NextTickNs;
+    uint64_t Sleeper = NextSleeperDeadline(__CpuId__);
+    if (Sleeper && Sleeper < Due)
+    {
+        Due = Sleeper;
+    }
+
+    /* At most one tick away, so the product stays well inside 64 bits */
+    uint64_t Now   = ClockMonotonicNs();
+    uint64_t Delta = Due > Now ? Due - Now : 0;
+    uint64_t Count = Delta * Timer.TimerFrequency / NsPerSec;
+    if (Count == 0)
+    {
+        Count = 1;
+    }
+
+    volatile uint32_t* InitCount =
+        (volatile uint32_t*)(__CpuData__->ApicBase + TimerApicRegTimerInitCount);
+    *InitCount = (uint32_t)Count;
+}
+
 void
 TimerHandler(InterruptFrame* __Frame__)
 {
@@ -57,14 +102,46 @@ TimerHandler(InterruptFrame* __Frame__)
     PerCpuData* CpuData = GetPerCpuData(CpuId);
 
     __atomic_fetch_add(&CpuData->LocalInterrupts, 1, __ATOMIC_SEQ_CST);
-    __atomic_fetch_add(&CpuData->LocalTicks, 1, __ATOMIC_SEQ_CST);
-
     __atomic_fetch_add(&TimerInterruptCount, 1, __ATOMIC_SEQ_CST);
-    __atomic_fetch_add(&Timer.SystemTicks, 1, __ATOMIC_SEQ_CST);
 
-    WakeupSleepingThreads(CpuId);
+    /* Periodic interrupts are all ticks, one-shot ones only when the tick fell due */
+    int Tick = 1;
+    if (Timer.OneShot)
+    {
+        uint64_t Now = ClockMonotonicNs();
+        Tick         = Now >= CpuData->NextTickNs;
+        if (Tick)
+        {
+            CpuData->NextTickNs += TimerTickNs;
+            if (CpuData->NextTickNs <= Now)
+            {
+                CpuData->NextTickNs = Now + TimerTickNs;
+            }
+        }
+    }
+
+    if (Tick)
+    {
+        __atomic_fetch_add(&CpuData->LocalTicks, 1, __ATOMIC_SEQ_CST);
+
+        /* Every CPU ticks, only the boot CPU's ticks count as time */
+        if (CpuId == 0)
+        {
+            __atomic_fetch_add(&Timer.SystemTicks, 1, __ATOMIC_SEQ_CST);
+            ClockTick();
+        }
+    }
+
+    /* Wakeups and anything drivers raised run before picking the next thread */
+    SoftIrqRaiseOn(CpuId, SoftIrqTimer);
+    SoftIrqRun(CpuId);
     Schedule(CpuId, __Frame__);
 
+    if (Timer.OneShot)
+    {
+        __TimerArm__(CpuId, CpuData);
+    }
+
     volatile uint32_t* EoiReg = (volatile uint32_t*)(CpuData->ApicBase + TimerApicRegEoi);
     *EoiReg                   = 0;
 }
@@ -72,7 +149,8 @@ TimerHandler(InterruptFrame* __Frame__)
 uint64_t
 GetSystemTicks(void)
 {
-    return Timer.SystemTicks;
+    /* Milliseconds since boot, the same on every CPU whichever clocksource runs */
+    return ClockMonotonicNs() / NsPerMsec;
 }
 
 void
@@ -83,10 +161,16 @@ Sleep(uint32_t __Milliseconds__)
         return;
     }
 
-    uint64_t StartTicks = Timer.SystemTicks;
-    uint64_t EndTicks   = StartTicks + __Milliseconds__;
+    /* A thread gives the CPU up, only early boot without one halts in place */
+    if (GetCurrentThreadLocal())
+    {
+        ThreadSleep(__Milliseconds__);
+        return;
+    }
+
+    uint64_t Deadline = ClockMonotonicNs() + (uint64_t)__Milliseconds__ * NsPerMsec;
 
-    while (Timer.SystemTicks < EndTicks)
+    while (ClockMonotonicNs() < Deadline)
     {
         __asm__ volatile("hlt"); /* Halt CPU to save power while waiting */
     }
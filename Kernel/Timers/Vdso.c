@@ -0,0 +1,191 @@
+#include <ClockSource.h> /* Timekeeping state copied to the data page */
+#include <PMM.h>         /* Image and data pages */
+#include <String.h>      /* Image copy */
+#include <Vdso.h>        /* vDSO layout */
+
+/*
+ * Everything in VdsoText runs in ring 3 from a copy of the section, so it
+ * may not call out, touch kernel data or use anything that needs a
+ * relocation. The data page is reached through its fixed user address.
+ */
+#define __VdsoText__ __attribute__((section("VdsoText"), used, noinline))
+
+extern const uint8_t __start_VdsoText[];
+extern const uint8_t __stop_VdsoText[];
+
+typedef struct
+{
+    long Sec;
+    long Nsec;
+
+} VdsoTimespec;
+
+typedef struct
+{
+    long Sec;
+    long Usec;
+
+} VdsoTimeval;
+
+static uint64_t  __VdsoImagePhys__;
+static uint64_t  __VdsoDataPhys__;
+static VdsoData* __VdsoKernelData__;
+static uint32_t  __VdsoPublished__; /* ClockSource.Data.Seq last copied out */
+
+int __VdsoText__
+VdsoClockGettime(long __ClockId__, VdsoTimespec* __Tp__)
+{
+    const volatile VdsoData* Data = (const volatile VdsoData*)VdsoDataBase;
+
+    /* Wall and monotonic clocks with their coarse/raw/boot variants, CPU clocks trap */
+    if (__ClockId__ < ClockIdRealtime || __ClockId__ > ClockIdBoottime ||
+        __ClockId__ == ClockIdProcessCputime || __ClockId__ == ClockIdThreadCputime ||
+        (Data->Flags & VdsoFlagSyscall))
+    {
+        return -1;
+    }
+
+    uint64_t Ns = VdsoReadNs(Data);
+    if (__ClockId__ == ClockIdRealtime || __ClockId__ == ClockIdRealtimeCoarse)
+    {
+        Ns += Data->RealtimeOffsetNs;
+    }
+
+    __Tp__->Sec  = (long)(Ns / NsPerSec);
+    __Tp__->Nsec = (long)(Ns % NsPerSec);
+    return 0;
+}
+
+int __VdsoText__
+VdsoGettimeofday(VdsoTimeval* __Tv__, void* __Tz__)
+{
+    const volatile VdsoData* Data = (const volatile VdsoData*)VdsoDataBase;
+    if (Data->Flags & VdsoFlagSyscall)
+    {
+        return -1;
+    }
+
+    uint64_t Ns = VdsoReadNs(Data) + Data->RealtimeOffsetNs;
+    if (__Tv__)
+    {
+        __Tv__->Sec  = (long)(Ns / NsPerSec);
+        __Tv__->Usec = (long)((Ns % NsPerSec) / NsPerUsec);
+    }
+    return 0;
+}
+
+void
+InitializeVdso(void)
+{
+    uint64_t TextSize = (uint64_t)(__stop_VdsoText - __start_VdsoText);
+    if (sizeof(VdsoHeader) + TextSize > PageSize)
+    {
+        PError("Vdso: %llu bytes of text do not fit one page\n", TextSize);
+        return;
+    }
+
+    __VdsoImagePhys__ = AllocPage();
+    __VdsoDataPhys__  = AllocPage();
+    if (!__VdsoImagePhys__ || !__VdsoDataPhys__)
+    {
+        PError("Vdso: Out of memory\n");
+        return;
+    }
+
+    uint8_t* Image = (uint8_t*)PhysToVirt(__VdsoImagePhys__);
+    memset(Image, 0xCC, PageSize);
+    __builtin_memcpy(Image + sizeof(VdsoHeader), __start_VdsoText, (size_t)TextSize);
+
+    VdsoHeader* Header   = (VdsoHeader*)Image;
+    Header->Magic        = VdsoMagic;
+    Header->Version      = VdsoVersion;
+    Header->ClockGettime = (uint32_t)(sizeof(VdsoHeader) +
+                                      ((const uint8_t*)VdsoClockGettime - __start_VdsoText));
+    Header->Gettimeofday = (uint32_t)(sizeof(VdsoHeader) +
+                                      ((const uint8_t*)VdsoGettimeofday - __start_VdsoText));
+    Header->DataOffset   = (uint32_t)(VdsoDataBase - VdsoBase);
+
+    __VdsoKernelData__ = (VdsoData*)PhysToVirt(__VdsoDataPhys__);
+    memset(__VdsoKernelData__, 0, PageSize);
+    VdsoUpdate();
+
+    PSuccess("vDSO ready: %llu bytes of text at 0x%016llx\n", TextSize, VdsoBase);
+}
+
+void
+VdsoUpdate(void)
+{
+    VdsoData* Page = __VdsoKernelData__;
+    if (!Page)
+    {
+        return;
+    }
+
+    /* Snapshot the clock, an unchanged sequence means nothing to publish */
+    VdsoData Snap;
+    uint32_t Seq;
+    do
+    {
+        Seq = __atomic_load_n(&ClockSource.Data.Seq, __ATOMIC_ACQUIRE);
+        if (Seq & 1)
+        {
+            continue;
+        }
+        Snap = ClockSource.Data;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((Seq & 1) || __atomic_load_n(&ClockSource.Data.Seq, __ATOMIC_RELAXED) != Seq);
+
+    if (Seq == __VdsoPublished__ && Page->Seq)
+    {
+        return;
+    }
+
+    /* Single writer, the timer softirq on the boot CPU */
+    __atomic_store_n(&Page->Seq, Page->Seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    Page->Flags            = Snap.Flags;
+    Page->BaseNs           = Snap.BaseNs;
+    Page->TscBase          = Snap.TscBase;
+    Page->Mult             = Snap.Mult;
+    Page->MaxInterpNs      = Snap.MaxInterpNs;
+    Page->RealtimeOffsetNs = Snap.RealtimeOffsetNs;
+
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&Page->Seq, Page->Seq + 1, __ATOMIC_RELAXED);
+
+    __VdsoPublished__ = Seq;
+}
+
+uint64_t
+VdsoMap(VirtualMemorySpace* __Space__)
+{
+    if (!__Space__ || !__VdsoImagePhys__)
+    {
+        return 0;
+    }
+
+    /* Execve may set up the same space twice */
+    if (GetPhysicalAddress(__Space__, VdsoBase) == __VdsoImagePhys__)
+    {
+        return VdsoBase;
+    }
+
+    if (MapPage(__Space__, VdsoBase, __VdsoImagePhys__, PTEPRESENT | PTEUSER) != 1 ||
+        MapPage(__Space__,
+                VdsoDataBase,
+                __VdsoDataPhys__,
+                PTEPRESENT | PTEUSER | PTENOEXECUTE) != 1)
+    {
+        PError("Vdso: map failed\n");
+        return 0;
+    }
+
+    return VdsoBase;
+}
+
+bool
+VdsoIsVdsoAddress(uint64_t __Addr__)
+{
+    return __Addr__ >= VdsoBase && __Addr__ < VdsoBase + VdsoSize;
+}
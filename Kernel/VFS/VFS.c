@@ -1,6 +1,7 @@
 #include <AllTypes.h>
 #include <KHeap.h>
 #include <KrnPrintf.h>
+#include <PMM.h>
 #include <String.h>
 #include <VFS.h>
 
@@ -19,6 +20,7 @@ typedef struct __MountEntry__
 
 static __MountEntry__ __Mounts__[64];
 static long           __MountCount__ = 0;
+static RwSpinLock     __MountLock__; /*Path lookups share, table edits are exclusive*/
 
 static Vnode*  __RootNode__ = 0;
 static Dentry* __RootDe__   = 0;
@@ -138,8 +140,9 @@ __walk__(Vnode* __StartNode__, Dentry* __StartDe__, const char* __Path__)
 static __MountEntry__*
 __find_mount__(const char* __Path__)
 {
-    long Best    = -1;
-    long BestLen = -1;
+    long     Best    = -1;
+    long     BestLen = -1;
+    uint64_t Flags   = AcquireReadSpinLock(&__MountLock__);
     for (long I = 0; I < __MountCount__; I++)
     {
         const char* Mp = __Mounts__[I].Path;
@@ -157,6 +160,7 @@ __find_mount__(const char* __Path__)
             }
         }
     }
+    ReleaseReadSpinLock(&__MountLock__, Flags);
     return Best >= 0 ? &__Mounts__[Best] : 0;
 }
 
@@ -165,6 +169,7 @@ VfsInit(void)
 {
     AcquireMutex(&VfsLock);
     InitializeMutex(&VfsLock, "vfs-central");
+    InitializeRwSpinLock(&__MountLock__, "vfs-mounts");
     __FsCount__        = 0;
     __MountCount__     = 0;
     __RootNode__       = 0;
@@ -196,10 +201,15 @@ VfsShutdown(void)
         {
             Sb->Ops->Release(Sb);
         }
+    }
+    uint64_t Flags = AcquireWriteSpinLock(&__MountLock__);
+    for (long I = 0; I < __MountCount__; I++)
+    {
         __Mounts__[I].Sb      = 0;
         __Mounts__[I].Path[0] = 0;
     }
     __MountCount__ = 0;
+    ReleaseWriteSpinLock(&__MountLock__, Flags);
     __FsCount__    = 0;
     __RootNode__   = 0;
     __RootDe__     = 0;
@@ -347,9 +357,11 @@ VfsMount(const char* __Dev__,
         return 0;
     }
 
-    __MountEntry__* M = &__Mounts__[__MountCount__++];
-    M->Sb             = Sb;
+    uint64_t        Flags = AcquireWriteSpinLock(&__MountLock__);
+    __MountEntry__* M     = &__Mounts__[__MountCount__++];
+    M->Sb                 = Sb;
     __builtin_memcpy(M->Path, __Path__, (size_t)(Plen + 1));
+    ReleaseWriteSpinLock(&__MountLock__, Flags);
 
     if (!__RootNode__ && strcmp(__Path__, "/") == 0)
     {
@@ -374,34 +386,46 @@ VfsUnmount(const char* __Path__)
         return -1;
     }
 
+    /*Unlink under the table lock, filesystem callbacks run after it is dropped*/
+    Superblock* Sb    = 0;
+    int         Found = 0;
+    uint64_t    Flags = AcquireWriteSpinLock(&__MountLock__);
     for (long I = 0; I < __MountCount__; I++)
     {
         if (strcmp(__Mounts__[I].Path, __Path__) == 0)
         {
-            Superblock* Sb = __Mounts__[I].Sb;
-            if (Sb && Sb->Ops && Sb->Ops->Umount)
-            {
-                Sb->Ops->Umount(Sb);
-            }
-            if (Sb && Sb->Ops && Sb->Ops->Release)
-            {
-                Sb->Ops->Release(Sb);
-            }
+            Sb = __Mounts__[I].Sb;
             for (long J = I; J < __MountCount__ - 1; J++)
             {
                 __Mounts__[J] = __Mounts__[J + 1];
             }
             __Mounts__[--__MountCount__].Sb    = 0;
             __Mounts__[__MountCount__].Path[0] = 0;
+            Found                              = 1;
+            break;
+        }
+    }
+    ReleaseWriteSpinLock(&__MountLock__, Flags);
 
-            if (strcmp(__Path__, "/") == 0)
-            {
-                __RootNode__ = 0;
-                __RootDe__   = 0;
-            }
-            PDebug("VFS: Unmounted %s\n", __Path__);
-            return 0;
+    if (Found)
+    {
+        if (Sb && Sb->Ops && Sb->Ops->Umount)
+        {
+            Sb->Ops->Umount(Sb);
         }
+        if (Sb && Sb->Ops && Sb->Ops->Release)
+        {
+            Sb->Ops->Release(Sb);
+        }
+
+        if (strcmp(__Path__, "/") == 0)
+        {
+            __RootNode__ = 0;
+            __RootDe__   = 0;
+        }
+        PDebug("VFS: Unmounted %s\n", __Path__);
+        ReleaseMutex(&VfsLock);
+        return 0;
     }
 
     PError("VFS: Unmount path not found %s\n", __Path__);
@@ -459,9 +483,11 @@ VfsBindMount(const char* __Src__, const char* __Dst__)
         return -1;
     }
 
-    __MountEntry__* New = &__Mounts__[__MountCount__++];
-    New->Sb             = M->Sb;
+    uint64_t        Flags = AcquireWriteSpinLock(&__MountLock__);
+    __MountEntry__* New   = &__Mounts__[__MountCount__++];
+    New->Sb               = M->Sb;
     __builtin_memcpy(New->Path, __Dst__, (size_t)(N + 1));
+    ReleaseWriteSpinLock(&__MountLock__, Flags);
 
     PDebug("VFS: Bind mount %s -> %s\n", __Src__, __Dst__);
     ReleaseMutex(&VfsLock);
@@ -489,7 +515,9 @@ VfsMoveMount(const char* __Src__, const char* __Dst__)
         return -1;
     }
 
+    uint64_t Flags = AcquireWriteSpinLock(&__MountLock__);
     __builtin_memcpy(M->Path, __Dst__, (size_t)(N + 1));
+    ReleaseWriteSpinLock(&__MountLock__, Flags);
     PDebug("VFS: Move mount %s -> %s\n", __Src__, __Dst__);
     ReleaseMutex(&VfsLock);
     return 0;
@@ -785,7 +813,6 @@ VfsClose(File* __File__)
 long
 VfsRead(File* __File__, void* __Buf__, long __Len__)
 {
-    AcquireMutex(&VfsLock);
     if (!__File__ || !__Buf__ || __Len__ <= 0)
     {
         return -1;
@@ -796,6 +823,8 @@ VfsRead(File* __File__, void* __Buf__, long __Len__)
         return -1;
     }
 
+    AcquireMutex(&VfsLock);
+
     long Got = __File__->Node->Ops->Read(__File__, __Buf__, __Len__);
     if (Got > 0)
     {
@@ -808,7 +837,6 @@ VfsRead(File* __File__, void* __Buf__, long __Len__)
 long
 VfsWrite(File* __File__, const void* __Buf__, long __Len__)
 {
-    AcquireMutex(&VfsLock);
     if (!__File__ || !__Buf__ || __Len__ <= 0)
     {
         return -1;
@@ -819,6 +847,7 @@ VfsWrite(File* __File__, const void* __Buf__, long __Len__)
         return -1;
     }
 
+    AcquireMutex(&VfsLock);
     long Put = __File__->Node->Ops->Write(__File__, __Buf__, __Len__);
     if (Put > 0)
     {
@@ -828,10 +857,159 @@ VfsWrite(File* __File__, const void* __Buf__, long __Len__)
     return Put;
 }
 
+/*Sum of the segment lengths, -1 on a bad list*/
+static long
+__IovTotal__(const VfsIovec* __Iov__, long __Cnt__)
+{
+    if (!__Iov__ || __Cnt__ <= 0)
+    {
+        return -1;
+    }
+
+    long Total = 0;
+    for (long I = 0; I < __Cnt__; I++)
+    {
+        if ((long)__Iov__[I].IovLen < 0 || (__Iov__[I].IovLen && !__Iov__[I].IovBase))
+        {
+            return -1;
+        }
+        if ((long)__Iov__[I].IovLen > 0x7FFFFFFFFFFFFFFFL - Total)
+        {
+            return -1;
+        }
+        Total += (long)__Iov__[I].IovLen;
+    }
+    return Total;
+}
+
 long
-VfsLseek(File* __File__, long __Off__, int __Whence__)
+VfsReadv(File* __File__, const VfsIovec* __Iov__, long __Cnt__)
 {
+    if (!__File__ || !__File__->Node || !__File__->Node->Ops)
+    {
+        return -1;
+    }
+
+    const VnodeOps* Ops = __File__->Node->Ops;
+    if (!Ops->ReadIter && !Ops->Read)
+    {
+        return -1;
+    }
+
+    long Total = __IovTotal__(__Iov__, __Cnt__);
+    if (Total <= 0)
+    {
+        return Total;
+    }
+
     AcquireMutex(&VfsLock);
+
+    long Got = 0;
+    if (Ops->ReadIter)
+    {
+        Got = Ops->ReadIter(__File__, __Iov__, __Cnt__);
+    }
+    else
+    {
+        /*One lock hold for the whole list, a short segment ends it*/
+        for (long I = 0; I < __Cnt__; I++)
+        {
+            if (!__Iov__[I].IovLen)
+            {
+                continue;
+            }
+
+            long R = Ops->Read(__File__, __Iov__[I].IovBase, (long)__Iov__[I].IovLen);
+            if (R < 0)
+            {
+                if (!Got)
+                {
+                    Got = R;
+                }
+                break;
+            }
+
+            Got += R;
+            if (R < (long)__Iov__[I].IovLen)
+            {
+                break;
+            }
+        }
+    }
+
+    if (Got > 0)
+    {
+        __File__->Offset += Got;
+    }
+    ReleaseMutex(&VfsLock);
+    return Got;
+}
+
+long
+VfsWritev(File* __File__, const VfsIovec* __Iov__, long __Cnt__)
+{
+    if (!__File__ || !__File__->Node || !__File__->Node->Ops)
+    {
+        return -1;
+    }
+
+    const VnodeOps* Ops = __File__->Node->Ops;
+    if (!Ops->WriteIter && !Ops->Write)
+    {
+        return -1;
+    }
+
+    long Total = __IovTotal__(__Iov__, __Cnt__);
+    if (Total <= 0)
+    {
+        return Total;
+    }
+
+    AcquireMutex(&VfsLock);
+
+    long Put = 0;
+    if (Ops->WriteIter)
+    {
+        Put = Ops->WriteIter(__File__, __Iov__, __Cnt__);
+    }
+    else
+    {
+        for (long I = 0; I < __Cnt__; I++)
+        {
+            if (!__Iov__[I].IovLen)
+            {
+                continue;
+            }
+
+            long W = Ops->Write(__File__, __Iov__[I].IovBase, (long)__Iov__[I].IovLen);
+            if (W < 0)
+            {
+                if (!Put)
+                {
+                    Put = W;
+                }
+                break;
+            }
+
+            Put += W;
+            if (W < (long)__Iov__[I].IovLen)
+            {
+                break;
+            }
+        }
+    }
+
+    if (Put > 0)
+    {
+        __File__->Offset += Put;
+    }
+    ReleaseMutex(&VfsLock);
+    return Put;
+}
+
+long
+VfsLseek(File* __File__, long __Off__, int __Whence__)
+{
     if (!__File__)
     {
         return -1;
@@ -842,6 +1020,8 @@ VfsLseek(File* __File__, long __Off__, int __Whence__)
         return -1;
     }
 
+    AcquireMutex(&VfsLock);
+
     long New = __File__->Node->Ops->Lseek(__File__, __Off__, __Whence__);
     if (New >= 0)
     {
@@ -869,6 +1049,26 @@ VfsIoctl(File* __File__, unsigned long __Cmd__, void* __Arg__)
     return __File__->Node->Ops->Ioctl(__File__, __Cmd__, __Arg__);
 }
 
+/* No VfsLock, pollers call this on every scan and the op only reads state */
+uint32_t
+VfsPoll(File* __File__, WaitQueue** __Queue__)
+{
+    if (__Queue__)
+    {
+        *__Queue__ = NULL;
+    }
+    if (!__File__ || !__File__->Node)
+    {
+        return VfsPollNval;
+    }
+    if (!__File__->Node->Ops || !__File__->Node->Ops->Poll)
+    {
+        /* Regular files never block */
+        return VfsPollIn | VfsPollOut;
+    }
+    return __File__->Node->Ops->Poll(__File__, __Queue__);
+}
+
 int
 VfsFsync(File* __File__)
 {
@@ -971,6 +1171,102 @@ VfsReaddirF(File* __Dir__, void* __Buf__, long __BufLen__)
     return __Dir__->Node->Ops->Readdir(__Dir__->Node, __Buf__, __BufLen__);
 }
 
+/* getdents64 sink, records packed into the caller's buffer until the next one would not fit */
+typedef struct VfsDentsSink
+{
+    VfsDirCtx Ctx;
+    char*     Buf;
+    long      Len;
+    long      Used;
+    int       Full;
+} VfsDentsSink;
+
+static uint8_t
+__DirentType__(long __Type__)
+{
+    switch (__Type__)
+    {
+        case VNodeFILE:
+            return 8; /*DT_REG*/
+        case VNodeDIR:
+            return 4; /*DT_DIR*/
+        case VNodeDEV:
+            return 2; /*DT_CHR*/
+        case VNodeSYM:
+            return 10; /*DT_LNK*/
+        case VNodeFIFO:
+            return 1; /*DT_FIFO*/
+        case VNodeSOCK:
+            return 12; /*DT_SOCK*/
+        default:
+            return 0; /*DT_UNKNOWN*/
+    }
+}
+
+static int
+__DentsEmit__(
+    VfsDirCtx* __Ctx__, const char* __Name__, long __NameLen__, long __Ino__, long __Type__)
+{
+    VfsDentsSink* S      = (VfsDentsSink*)__Ctx__;
+    long          Head   = (long)__builtin_offsetof(VfsDirent64, Name);
+    long          Reclen = (Head + __NameLen__ + 1 + 7) & ~7L;
+    if (Reclen > S->Len - S->Used)
+    {
+        S->Full = 1;
+        return 0;
+    }
+
+    VfsDirent64* D = (VfsDirent64*)(S->Buf + S->Used);
+    D->Ino         = (uint64_t)__Ino__;
+    D->Off         = __Ctx__->Pos + 1;
+    D->Reclen      = (uint16_t)Reclen;
+    D->Type        = __DirentType__(__Type__);
+    __builtin_memcpy(D->Name, __Name__, (size_t)__NameLen__);
+    /* NUL and the padding, nothing stale leaks out to the caller */
+    __builtin_memset(D->Name + __NameLen__, 0, (size_t)(Reclen - Head - __NameLen__));
+    S->Used += Reclen;
+    return 1;
+}
+
+/*
+ * As many entries as fit from the directory's cursor, one filesystem call
+ * for the whole batch. Bytes filled, 0 at the end, -1 when the directory
+ * cannot be iterated or the first entry alone does not fit.
+ */
+long
+VfsGetdents(File* __Dir__, void* __Buf__, long __Len__)
+{
+    if (!__Dir__ || !__Buf__ || __Len__ <= 0)
+    {
+        return -1;
+    }
+    if (!__Dir__->Node || __Dir__->Node->Type != VNodeDIR || !__Dir__->Node->Ops ||
+        !__Dir__->Node->Ops->Iterate)
+    {
+        return -1;
+    }
+
+    VfsDentsSink Sink;
+    Sink.Ctx.Emit = __DentsEmit__;
+    Sink.Ctx.Pos  = __Dir__->Offset;
+    Sink.Buf      = (char*)__Buf__;
+    Sink.Len      = __Len__;
+    Sink.Used     = 0;
+    Sink.Full     = 0;
+
+    if (__Dir__->Node->Ops->Iterate(__Dir__, &Sink.Ctx) != 0)
+    {
+        return -1;
+    }
+    __Dir__->Offset = Sink.Ctx.Pos;
+
+    if (Sink.Used == 0 && Sink.Full)
+    {
+        return -1;
+    }
+    return Sink.Used;
+}
+
 int
 VfsCreate(const char* __Path__, long __Flags__, VfsPerm __Perm__)
 {
@@ -1839,50 +2135,179 @@ VfsIsSymlink(const char* __Path__)
     return (De && De->Node && De->Node->Type == VNodeSYM) ? 1 : 0;
 }
 
-int
-VfsCopy(const char* __Src__, const char* __Dst__, long __Flags__)
+/* Moves to the given offset and back, the generic loop works at the file position */
+static long
+__VfsSeekTo__(File* __File__, long* __Pos__, long* __Saved__)
 {
-    AcquireMutex(&VfsLock);
-    (void)__Flags__;
-    File* S = VfsOpen(__Src__, VFlgRDONLY);
-    if (!S)
+    if (!__Pos__)
+    {
+        return 0;
+    }
+    *__Saved__ = VfsLseek(__File__, 0, VSeekCUR);
+    if (*__Saved__ < 0 || VfsLseek(__File__, *__Pos__, VSeekSET) != *__Pos__)
     {
         return -1;
     }
-    File* D = VfsOpen(__Dst__, VFlgCREATE | VFlgWRONLY | VFlgTRUNC);
-    if (!D)
+    return 0;
+}
+
+static long
+__VfsCopyLoop__(File* __In__, File* __Out__, long __Len__)
+{
+    uint64_t Phys = AllocPages(VfsCopyChunk / PageSize);
+    if (!Phys)
     {
-        VfsClose(S);
         return -1;
     }
+    char* Buf = (char*)PhysToVirt(Phys);
 
-    char Buf[4096];
-    for (;;)
+    long Done = 0;
+    long Err  = 0;
+    while (Done < __Len__)
     {
-        long r = VfsRead(S, Buf, sizeof(Buf));
-        if (r < 0)
+        long Want = (__Len__ - Done < VfsCopyChunk) ? __Len__ - Done : VfsCopyChunk;
+        long R    = VfsRead(__In__, Buf, Want);
+        if (R <= 0)
         {
-            VfsClose(S);
-            VfsClose(D);
-            return -1;
+            Err = R;
+            break;
         }
-        if (r == 0)
+        long W = VfsWrite(__Out__, Buf, R);
+        if (W < 0)
         {
+            Err = W;
+            W   = 0;
+        }
+        Done += W;
+        if (W < R)
+        {
+            /* Give back what was read but not written, the input resumes there */
+            VfsLseek(__In__, W - R, VSeekCUR);
             break;
         }
-        long w = VfsWrite(D, Buf, r);
-        if (w != r)
+        if (R < Want)
         {
-            VfsClose(S);
-            VfsClose(D);
-            return -1;
+            break;
         }
     }
 
+    FreePages(Phys, VfsCopyChunk / PageSize);
+    return Done ? Done : Err;
+}
+
+/*
+ * Copies up to __Len__ bytes from __In__ to __Out__ inside the kernel. A
+ * NULL offset uses and advances the file position, otherwise the offset is
+ * used and advanced and the position left alone. Both files on one
+ * filesystem with a CopyRange op get the native copy, anything else or a
+ * native refusal goes through a chunked read/write loop.
+ */
+long
+VfsCopyRange(File* __In__,
+             long* __OffIn__,
+             File* __Out__,
+             long* __OffOut__,
+             long  __Len__,
+             long  __Flags__)
+{
+    (void)__Flags__;
+    if (!__In__ || !__Out__ || !__In__->Node || !__Out__->Node || __Len__ < 0)
+    {
+        return -1;
+    }
+    if (__Len__ == 0)
+    {
+        return 0;
+    }
+
+    const VnodeOps* Ops = __In__->Node->Ops;
+    if (Ops && Ops == __Out__->Node->Ops && Ops->CopyRange)
+    {
+        long InPos  = __OffIn__ ? *__OffIn__ : VfsLseek(__In__, 0, VSeekCUR);
+        long OutPos = __OffOut__ ? *__OffOut__ : VfsLseek(__Out__, 0, VSeekCUR);
+        if (InPos >= 0 && OutPos >= 0)
+        {
+            AcquireMutex(&VfsLock);
+            long N = Ops->CopyRange(__In__, InPos, __Out__, OutPos, __Len__);
+            ReleaseMutex(&VfsLock);
+            if (N >= 0)
+            {
+                if (__OffIn__)
+                {
+                    *__OffIn__ += N;
+                }
+                else
+                {
+                    VfsLseek(__In__, InPos + N, VSeekSET);
+                }
+                if (__OffOut__)
+                {
+                    *__OffOut__ += N;
+                }
+                else
+                {
+                    VfsLseek(__Out__, OutPos + N, VSeekSET);
+                }
+                return N;
+            }
+        }
+    }
+
+    long SavedIn  = 0;
+    long SavedOut = 0;
+    if (__VfsSeekTo__(__In__, __OffIn__, &SavedIn) != 0)
+    {
+        return -1;
+    }
+    if (__VfsSeekTo__(__Out__, __OffOut__, &SavedOut) != 0)
+    {
+        if (__OffIn__)
+        {
+            VfsLseek(__In__, SavedIn, VSeekSET);
+        }
+        return -1;
+    }
+
+    long N = __VfsCopyLoop__(__In__, __Out__, __Len__);
+
+    if (__OffIn__)
+    {
+        *__OffIn__ += (N > 0) ? N : 0;
+        VfsLseek(__In__, SavedIn, VSeekSET);
+    }
+    if (__OffOut__)
+    {
+        *__OffOut__ += (N > 0) ? N : 0;
+        VfsLseek(__Out__, SavedOut, VSeekSET);
+    }
+    return N;
+}
+
+int
+VfsCopy(const char* __Src__, const char* __Dst__, long __Flags__)
+{
+    (void)__Flags__;
+    File* S = VfsOpen(__Src__, VFlgRDONLY);
+    if (!S)
+    {
+        return -1;
+    }
+    File* D = VfsOpen(__Dst__, VFlgCREATE | VFlgWRONLY | VFlgTRUNC);
+    if (!D)
+    {
+        VfsClose(S);
+        return -1;
+    }
+
+    long N;
+    do
+    {
+        N = VfsCopyRange(S, NULL, D, NULL, 0x40000000L, 0);
+    } while (N > 0);
+
     VfsClose(S);
     VfsClose(D);
-    ReleaseMutex(&VfsLock);
-    return 0;
+    return (N < 0) ? -1 : 0;
 }
 
 int
@@ -1964,12 +2389,12 @@ VfsWriteAll(const char* __Path__, const void* __Buf__, long __Len__)
 int
 VfsMountTableEnumerate(char* __Buf__, long __Len__)
 {
-    AcquireMutex(&VfsLock);
     if (!__Buf__ || __Len__ <= 0)
     {
         return -1;
     }
-    long off = 0;
+    long     off   = 0;
+    uint64_t Flags = AcquireReadSpinLock(&__MountLock__);
     for (long I = 0; I < __MountCount__; I++)
     {
         const char* __Path = __Mounts__[I].Path;
@@ -1982,37 +2407,38 @@ VfsMountTableEnumerate(char* __Buf__, long __Len__)
         off += N;
         __Buf__[off++] = '\n';
     }
+    ReleaseReadSpinLock(&__MountLock__, Flags);
     if (off < __Len__)
     {
         __Buf__[off] = 0;
     }
-    ReleaseMutex(&VfsLock);
     return (int)off;
 }
 
 int
 VfsMountTableFind(const char* __Path__, char* __Buf__, long __Len__)
 {
-    AcquireMutex(&VfsLock);
     if (!__Path__ || !__Buf__ || __Len__ <= 0)
     {
         return -1;
     }
+    int      Ret   = -1;
+    uint64_t Flags = AcquireReadSpinLock(&__MountLock__);
     for (long I = 0; I < __MountCount__; I++)
     {
         if (strcmp(__Mounts__[I].Path, __Path__) == 0)
         {
             long N = (long)strlen(__Mounts__[I].Path);
-            if (N >= __Len__)
+            if (N < __Len__)
             {
-                return -1;
+                __builtin_memcpy(__Buf__, __Mounts__[I].Path, (size_t)(N + 1));
+                Ret = 0;
             }
-            __builtin_memcpy(__Buf__, __Mounts__[I].Path, (size_t)(N + 1));
-            return 0;
+            break;
         }
     }
-    ReleaseMutex(&VfsLock);
-    return -1;
+    ReleaseReadSpinLock(&__MountLock__, Flags);
+    return Ret;
 }
 
 int
@@ -2229,10 +2655,12 @@ VfsRegisterPseudoFs(const char* __Path__, Superblock* __Sb__)
     {
         return -1;
     }
-    long            N = (long)strlen(__Path__);
-    __MountEntry__* M = &__Mounts__[__MountCount__++];
-    M->Sb             = __Sb__;
+    long            N     = (long)strlen(__Path__);
+    uint64_t        Flags = AcquireWriteSpinLock(&__MountLock__);
+    __MountEntry__* M     = &__Mounts__[__MountCount__++];
+    M->Sb                 = __Sb__;
     __builtin_memcpy(M->Path, __Path__, (size_t)(N + 1));
+    ReleaseWriteSpinLock(&__MountLock__, Flags);
     ReleaseMutex(&VfsLock);
     return 0;
 }
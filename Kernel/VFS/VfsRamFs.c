@@ -5,29 +5,32 @@
 #include <String.h>
 
 const VnodeOps __RamVfsOps__ = {
-    .Open     = RamVfsOpen,     /**< Open file/directory handle */
-    .Close    = RamVfsClose,    /**< Close file handle and free resources */
-    .Read     = RamVfsRead,     /**< Read data from file */
-    .Write    = RamVfsWrite,    /**< Write to file (not implemented - read-only) */
-    .Lseek    = RamVfsLseek,    /**< Seek to position within file */
-    .Ioctl    = RamVfsIoctl,    /**< I/O control operations (not implemented) */
-    .Stat     = RamVfsStat,     /**< Get file/directory metadata */
-    .Readdir  = RamVfsReaddir,  /**< Read directory entries */
-    .Lookup   = RamVfsLookup,   /**< Lookup child by name in directory */
-    .Create   = RamVfsCreate,   /**< Create new file in directory */
-    .Unlink   = RamVfsUnlink,   /**< Remove file (not implemented) */
-    .Mkdir    = RamVfsMkdir,    /**< Create new directory */
-    .Rmdir    = RamVfsRmdir,    /**< Remove directory (not implemented) */
-    .Symlink  = RamVfsSymlink,  /**< Create symlink (not implemented) */
-    .Readlink = RamVfsReadlink, /**< Read symlink target (not implemented) */
-    .Link     = RamVfsLink,     /**< Create hard link (not implemented) */
-    .Rename   = RamVfsRename,   /**< Rename/move file (not implemented) */
-    .Chmod    = RamVfsChmod,    /**< Change permissions (no-op) */
-    .Chown    = RamVfsChown,    /**< Change ownership (no-op) */
-    .Truncate = RamVfsTruncate, /**< Truncate file (not implemented) */
-    .Sync     = RamVfsSync,     /**< Synchronize file (no-op) */
-    .Map      = RamVfsMap,      /**< Memory map file (not implemented) */
-    .Unmap    = RamVfsUnmap     /**< Unmap memory (not implemented) */
+    .Open      = RamVfsOpen,      /**< Open file/directory handle */
+    .Close     = RamVfsClose,     /**< Close file handle and free resources */
+    .Read      = RamVfsRead,      /**< Read data from file */
+    .Write     = RamVfsWrite,     /**< Write to file (not implemented - read-only) */
+    .Lseek     = RamVfsLseek,     /**< Seek to position within file */
+    .Ioctl     = RamVfsIoctl,     /**< I/O control operations (not implemented) */
+    .Stat      = RamVfsStat,      /**< Get file/directory metadata */
+    .Readdir   = RamVfsReaddir,   /**< Read directory entries */
+    .Iterate   = RamVfsIterate,   /**< Batched entries from the directory cursor */
+    .Lookup    = RamVfsLookup,    /**< Lookup child by name in directory */
+    .Create    = RamVfsCreate,    /**< Create new file in directory */
+    .Unlink    = RamVfsUnlink,    /**< Remove file (not implemented) */
+    .Mkdir     = RamVfsMkdir,     /**< Create new directory */
+    .Rmdir     = RamVfsRmdir,     /**< Remove directory (not implemented) */
+    .Symlink   = RamVfsSymlink,   /**< Create symlink (not implemented) */
+    .Readlink  = RamVfsReadlink,  /**< Read symlink target (not implemented) */
+    .Link      = RamVfsLink,      /**< Create hard link (not implemented) */
+    .Rename    = RamVfsRename,    /**< Rename/move file (not implemented) */
+    .Chmod     = RamVfsChmod,     /**< Change permissions (no-op) */
+    .Chown     = RamVfsChown,     /**< Change ownership (no-op) */
+    .Truncate  = RamVfsTruncate,  /**< Truncate file (not implemented) */
+    .Sync      = RamVfsSync,      /**< Synchronize file (no-op) */
+    .Map       = RamVfsMap,       /**< Memory map file (not implemented) */
+    .Unmap     = RamVfsUnmap,     /**< Unmap memory (not implemented) */
+    .CopyRange = RamVfsCopyRange, /**< Copy the source data into an empty file */
+    .ReadIter  = RamVfsReadIter   /**< Fill a whole iovec list in one pass */
 };
 
 const SuperOps __RamVfsSuperOps__ = {
@@ -188,14 +191,49 @@ RamVfsRead(File* __File__, void* __Buf__, long __Len__)
     size_t Got = RamFSRead(PF->Node, (size_t)PF->Offset, __Buf__, (size_t)__Len__);
     if (Got > 0)
     {
+        /* File->Offset is advanced by VfsRead */
         PF->Offset += (long)Got;
-        __File__->Offset += (long)Got;
         return (long)Got;
     }
 
     return 0;
 }
 
+long
+RamVfsReadIter(File* __File__, const VfsIovec* __Iov__, long __Cnt__)
+{
+    if (!__File__ || !__Iov__ || __Cnt__ <= 0)
+    {
+        return -1;
+    }
+
+    RamVfsPrivFile* PF = (RamVfsPrivFile*)__File__->Priv;
+    if (!PF || !PF->Node)
+    {
+        return -1;
+    }
+
+    /* Straight out of the node's data, stopping at end of file */
+    long Got = 0;
+    for (long I = 0; I < __Cnt__; I++)
+    {
+        if (!__Iov__[I].IovLen)
+        {
+            continue;
+        }
+
+        size_t R = RamFSRead(PF->Node, (size_t)PF->Offset, __Iov__[I].IovBase, __Iov__[I].IovLen);
+        PF->Offset += (long)R;
+        Got += (long)R;
+        if (R < __Iov__[I].IovLen)
+        {
+            break;
+        }
+    }
+
+    return Got;
+}
+
 long
 RamVfsWrite(File* __File__, const void* __Buf__, long __Len__)
 {
@@ -346,6 +384,56 @@ RamVfsReaddir(Vnode* __Dir__, void* __Buf__, long __BufLen__)
     return Wrote; /* return count of entries */
 }
 
+/* Positions 0 and 1 are "." and "..", child I sits at I + 2 */
+long
+RamVfsIterate(File* __Dir__, VfsDirCtx* __Ctx__)
+{
+    if (!__Dir__ || !__Dir__->Node || !__Ctx__)
+    {
+        return -1;
+    }
+
+    RamVfsPrivNode* PN = (RamVfsPrivNode*)__Dir__->Node->Priv;
+    if (!PN || !PN->Node || PN->Node->Type != RamFSNode_Directory)
+    {
+        return -1;
+    }
+
+    RamFSNode* D   = PN->Node;
+    long       Ino = (long)(uintptr_t)D; /* No parent link, ".." names the directory too */
+    if (__Ctx__->Pos == 0)
+    {
+        if (!__Ctx__->Emit(__Ctx__, ".", 1, Ino, VNodeDIR))
+        {
+            return 0;
+        }
+        __Ctx__->Pos++;
+    }
+    if (__Ctx__->Pos == 1)
+    {
+        if (!__Ctx__->Emit(__Ctx__, "..", 2, Ino, VNodeDIR))
+        {
+            return 0;
+        }
+        __Ctx__->Pos++;
+    }
+
+    while (__Ctx__->Pos >= 2 && __Ctx__->Pos - 2 < (long)D->ChildCount)
+    {
+        RamFSNode* C = D->Children[__Ctx__->Pos - 2];
+        if (!__Ctx__->Emit(__Ctx__,
+                           C->Name,
+                           (long)strlen(C->Name),
+                           (long)(uintptr_t)C,
+                           (C->Type == RamFSNode_Directory) ? VNodeDIR : VNodeFILE))
+        {
+            break;
+        }
+        __Ctx__->Pos++;
+    }
+    return 0;
+}
+
 /** Fixed this shi because it wasn't looking inside childrens*/
 Vnode*
 RamVfsLookup(Vnode* __Dir__, const char* __Name__)
@@ -572,6 +660,46 @@ RamVfsUnmap(Vnode* __Node__, void* __Addr__, long __Len__)
     return -1;
 }
 
+/*
+ * An empty file gets its own copy of a slice of another's data in a single
+ * pass. Anything else is refused, RamFS has no write path for the generic
+ * loop to fall back on.
+ */
+long
+RamVfsCopyRange(File* __In__, long __OffIn__, File* __Out__, long __OffOut__, long __Len__)
+{
+    RamVfsPrivFile* Src = __In__ ? (RamVfsPrivFile*)__In__->Priv : NULL;
+    RamVfsPrivFile* Dst = __Out__ ? (RamVfsPrivFile*)__Out__->Priv : NULL;
+    if (!Src || !Dst || !Src->Node || !Dst->Node || Src->Node == Dst->Node)
+    {
+        return -1;
+    }
+    if (Dst->Node->Size != 0 || __OffOut__ != 0 || __OffIn__ < 0)
+    {
+        return -1;
+    }
+    if (__OffIn__ >= (long)Src->Node->Size)
+    {
+        return 0;
+    }
+
+    long N = (long)Src->Node->Size - __OffIn__;
+    if (N > __Len__)
+    {
+        N = __Len__;
+    }
+    uint8_t* Copy = (uint8_t*)KMalloc((size_t)N);
+    if (!Copy)
+    {
+        return -1;
+    }
+    __builtin_memcpy(Copy, Src->Node->Data + __OffIn__, (size_t)N);
+
+    Dst->Node->Data = Copy;
+    Dst->Node->Size = (uint32_t)N;
+    return N;
+}
+
 int
 RamVfsSuperSync(Superblock* __Sb__)
 {
@@ -98,10 +98,11 @@ DestroyVirtualSpace(VirtualMemorySpace* __Space__)
         return;
     }
 
-    __Space__->RefCount--;
-    if (__Space__->RefCount > 0)
+    /* Rings and their workers hold references too, dropped from other CPUs */
+    uint32_t Left = __atomic_sub_fetch(&__Space__->RefCount, 1, __ATOMIC_ACQ_REL);
+    if (Left > 0)
     {
-        PDebug("Virtual space still has %u references\n", __Space__->RefCount);
+        PDebug("Virtual space still has %u references\n", Left);
         return;
     }
 